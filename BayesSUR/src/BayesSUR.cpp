@@ -15,6 +15,7 @@
 //' NOTE THAT THIS IS BASICALLY JUST A WRAPPER
 
 #include "drive.h"
+#include "output_writer.h"
 #include <RcppArmadillo.h>
 
 using Rcpp::Rcerr;
@@ -28,7 +29,8 @@ int BayesSUR_internal(const std::string& dataFile, const std::string& mrfGFile,
                     const std::string& gammaInit = "MLE",
                     const std::string& betaPrior="independent", const int maxThreads=2,
                     bool output_gamma = true, bool output_beta = true, bool output_Gy = true, bool output_sigmaRho = true, 
-                    bool output_pi = true, bool output_tail = true, bool output_model_size = true, bool output_CPO = true, bool output_model_visit = false )
+                    bool output_pi = true, bool output_tail = true, bool output_model_size = true, bool output_CPO = true, bool output_model_visit = false,
+                    unsigned int checkpointInterval = 0, bool resume = false, unsigned int nProcesses = 1, double xtxMemoryBudget = 200 )
 {
   int status {1};
   
@@ -36,7 +38,8 @@ int BayesSUR_internal(const std::string& dataFile, const std::string& mrfGFile,
   {
     status =  drive(dataFile,mrfGFile,blockFile,structureGraphFile,hyperParFile,outFilePath,nIter,burnin,nChains,
                     covariancePrior,gammaPrior,gammaSampler,gammaInit,betaPrior,maxThreads,output_gamma, output_beta,
-                    output_Gy, output_sigmaRho, output_pi, output_tail, output_model_size, output_CPO, output_model_visit);
+                    output_Gy, output_sigmaRho, output_pi, output_tail, output_model_size, output_CPO, output_model_visit,
+                    checkpointInterval, resume, nProcesses, xtxMemoryBudget);
   }
   catch(const std::exception& e)
   {
@@ -46,3 +49,18 @@ int BayesSUR_internal(const std::string& dataFile, const std::string& mrfGFile,
   return status;
   
 }
+
+//' @title exportTraceToText
+//' @description
+//' Rebuild the text file of an MCMC trace (e.g. \code{*_logP_out.txt}) from its binary file, written next to it with the extra extension \code{.bin}.
+//' The binary traces are left behind if the process was killed (and kept when \code{checkpointInterval > 0}); the rows recorded after the last periodic export are only in them.
+//' @name exportTraceToText
+//' @param binFile path to the binary trace
+//' @param txtFile path to the text file to (over)write
+//' @return \code{TRUE} if the trace was exported, \code{FALSE} if the binary file could not be read or is corrupted
+//' @export
+// [[Rcpp::export]]
+bool exportTraceToText(const std::string& binFile, const std::string& txtFile)
+{
+  return OutputWriter::exportTraceToText( binFile , txtFile );
+}
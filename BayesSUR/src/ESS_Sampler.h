@@ -15,6 +15,8 @@ using Rcpp::Rcerr;
 #include <vector>
 #include <string>
 #include <memory>
+#include <sstream>
+#include <algorithm>
 
 #include "utils.h"
 #include "distr.h"
@@ -22,6 +24,8 @@ using Rcpp::Rcerr;
 #include "ESS_Atom.h"
 #include "HRR_Chain.h"
 #include "SUR_Chain.h"
+#include "checkpoint.h"
+#include "replica_pool.h"
 
 template<typename T>  //  the template here should be a class derived from ESS_Atom
 class ESS_Sampler{
@@ -29,8 +33,11 @@ class ESS_Sampler{
 public:
     
     // Constructor - nChains and type of MCMC
+    // with nProcesses > 1 the chains are spread over that many processes of this machine (see replica_pool.h) before
+    // they are built, each process building only its own; the constructor returns in all of them, see serve()
     ESS_Sampler( Utils::SUR_Data& surData , unsigned int nChains_ , double temperatureRatio ,
-                Gamma_Sampler_Type gamma_sampler_type, Gamma_Type gamma_type, Beta_Type beta_type, Covariance_Type covariance_type, bool output_CPO , int maxThreads , unsigned int burnin_ );
+                Gamma_Sampler_Type gamma_sampler_type, Gamma_Type gamma_type, Beta_Type beta_type, Covariance_Type covariance_type, bool output_CPO , int maxThreads , unsigned int burnin_ ,
+                unsigned int nProcesses = 1 );
     
     ESS_Sampler( Utils::SUR_Data& surData , unsigned int nChains_ , double temperatureRatio ) :
     ESS_Sampler( surData , nChains_ , temperatureRatio ,
@@ -38,8 +45,20 @@ public:
     
     ESS_Sampler( Utils::SUR_Data& surData , unsigned int nChains_ ) : ESS_Sampler( surData , nChains_ , 1.2 ){}
     
-    // this gets one of the chains from the vector
-    std::shared_ptr<T> operator[]( unsigned int i ) { return chain[i]; }
+    // this gets the chain at the i-th temperature of the ladder, 0 being the cold chain
+    // (in a multi-process run the others may be null, and the cold one on rank 0 may be a copy of its outputs, see poolStep)
+    std::shared_ptr<T> operator[]( unsigned int i ) { return ( i == 0 && !chain[ladder[0]] ) ? coldOutput : chain[ladder[i]]; }
+    
+    // the i-th temperature of the ladder, wherever its chain runs
+    double getTemperature( unsigned int i ) const { return getChainTemperature( ladder[i] ); }
+    
+    // runs f on each chain held by this process (all of them in a single process run)
+    template<typename F> void forLocalChains( F f )
+    {
+        for( auto& c : chain )
+            if( c )
+                f( c );
+    }
     
     // this gets the size of the chain which should be equal to nChains
     unsigned int size() const { return chain.size(); }
@@ -50,6 +69,11 @@ public:
     
     void step();
     
+    // only the first process returns (with the cold chain), the others run their share of every step() it makes
+    // until the sampler is destroyed or fails, and then exit; call it once every process has set up its chains.
+    // Checkpointing is not available in a multi-process run
+    void serve();
+    
     // Local Operator
     void localStep();
     
@@ -58,20 +82,29 @@ public:
     //  this one selectes two chains and ask them to check for global operators to be applied
     std::pair<unsigned int , unsigned int>  randomChainSelect();
     std::pair<unsigned int , unsigned int>  nearChainSelect();
+    bool processChainSelect( bool near , std::pair<unsigned int , unsigned int>& chainIdx );
     
     void globalStep();
     
     int allExchangeAll_step();
-    void swapAll( std::shared_ptr<T>& thisChain , std::shared_ptr<T>& thatChain );
+    int replicaExchange_step();
+    int chainGlobal_step( unsigned int thisPosition , unsigned int thatPosition );
+    void swapAll( unsigned int thisPosition , unsigned int thatPosition );
+    void syncLadder();
     
     
     // Temperature ladder update and getter for the acceptance rate of global updates
     double getGlobalAccRate() const;
+    arma::vec getPairSwapAccRates() const; // one for each pair of adjacent temperatures
     
     void updateTemperatures(); // we will need extra tracking of the global acceptance rate of the moves
     
     void setHyperParameters( const Utils::Chain_Data& chainData );
     
+    // whole sampler state (counters, random streams and every chain, in position order), see checkpoint.h
+    void saveState( CheckpointWriter& checkpoint );
+    void loadState( CheckpointReader& checkpoint );
+    
 private:
     
     unsigned int nChains;
@@ -82,10 +115,46 @@ private:
     // we use pointers so that the client can ask for the original object and manipulate them as he wish
     std::vector<std::shared_ptr<T>> chain;
     
+    // exchanges between chains swap their temperatures only, the states stay where they are (and so do their caches,
+    // random streams, threads and processes); ladder[i] is the index in chain of the one currently at the i-th temperature
+    std::vector<unsigned int> ladder;
+    
     unsigned int updateCounter; // how often do we update the temperatures?
     unsigned int global_proposal_count, global_acc_count, global_count;
     double tmpRand;
     
+    // replica exchange, pair i is the pair of temperatures (i,i+1) in the ladder
+    unsigned int swapRound; // even rounds try the pairs (0,1),(2,3),... odd rounds (1,2),(3,4),...
+    std::vector<unsigned int> pairSwapProposalCount, pairSwapAccCount; // since the start
+    std::vector<unsigned int> windowSwapProposalCount, windowSwapAccCount; // since the last ladder update
+    unsigned int nLadderUpdates;
+    double swapTargetAccRate;
+    
+    // one random number stream per chain (which stays with it across exchanges), so that the local moves can run in parallel
+    // and give the same results whatever the number of threads, plus one for the global moves;
+    // once the sampler is built R's RNG is not used anymore, so that the streams are the whole random state of a run
+    std::vector<RNGStream> rngStreams;
+    RNGStream globalRNGStream;
+    
+    // multi-process runs: each process holds the chains it owns (the others are null) and a copy of every temperature,
+    // which all the processes update with the same decisions; rank 0 keeps the outputs of the cold chain in coldOutput
+    // while it runs in another process
+    ReplicaPool pool;
+    std::vector<double> temperatures;
+    std::shared_ptr<T> coldOutput;
+    
+    void poolStep();
+    
+    // pool.collective(), except that a worker exits when it fails, it has no caller to report to
+    template<typename F> void runCollective( F task );
+    
+    void setChainHyperParameters( std::shared_ptr<T>& c , const Utils::Chain_Data& chainData );
+    
+    // temperature and untempered log-likelihood of chain c, wherever it runs
+    double getChainTemperature( unsigned int c ) const;
+    void setChainTemperature( unsigned int c , double temperature );
+    double getChainLogLikelihood( unsigned int c ) const;
+    
 };
 
 // ***********************************
@@ -95,14 +164,24 @@ private:
 
 template<typename T>
 ESS_Sampler<T>::ESS_Sampler( Utils::SUR_Data& surData , unsigned int nChains_ , double temperatureRatio ,
-                            Gamma_Sampler_Type gamma_sampler_type, Gamma_Type gamma_type, Beta_Type beta_type, Covariance_Type covariance_type, bool output_CPO , int maxThreads, unsigned int burnin_ ):
+                            Gamma_Sampler_Type gamma_sampler_type, Gamma_Type gamma_type, Beta_Type beta_type, Covariance_Type covariance_type, bool output_CPO , int maxThreads, unsigned int burnin_ ,
+                            unsigned int nProcesses ):
 nChains(nChains_),
 burnin(burnin_),
 chain(std::vector<std::shared_ptr<T>>(nChains)),
+ladder(nChains),
 updateCounter(100), // how often do we update the temperatures?
 global_proposal_count(0),
 global_acc_count(0),
-global_count(0)
+global_count(0),
+swapRound(0),
+pairSwapProposalCount( nChains_ > 1 ? nChains_-1 : 0 , 0 ),
+pairSwapAccCount( nChains_ > 1 ? nChains_-1 : 0 , 0 ),
+windowSwapProposalCount( nChains_ > 1 ? nChains_-1 : 0 , 0 ),
+windowSwapAccCount( nChains_ > 1 ? nChains_-1 : 0 , 0 ),
+nLadderUpdates(0),
+swapTargetAccRate(0.234),
+temperatures(nChains_)
 {
     
     
@@ -110,9 +189,45 @@ global_count(0)
     static_assert(std::is_base_of<ESS_Base, T>::value, "type parameter of this class must derive from ESS_Atom");
     
     for( unsigned int i=0; i<nChains; ++i )
-        chain[i] = std::make_shared<T>( surData ,
-                                       gamma_sampler_type, gamma_type, beta_type, covariance_type, output_CPO, maxThreads ,
-                                       std::pow( temperatureRatio , (double)i ) );  // default init for now
+        ladder[i] = i;
+    
+    // seed the streams from R's RNG, so that set.seed() still controls the whole run
+    rngStreams = std::vector<RNGStream>(nChains+1);
+    seedRNGStreams( rngStreams , ( (uint64_t)( randU01() * 4294967296. ) << 32 ) | (uint64_t)( randU01() * 4294967296. ) );
+    globalRNGStream = rngStreams.back();
+    rngStreams.pop_back();
+    
+    for( unsigned int i=0; i<nChains; ++i )
+        temperatures[i] = std::pow( temperatureRatio , (double)i );  // default init for now
+    
+    // fork before building anything, so that each chain only ever lives in the process that runs it
+    nProcesses = std::min( nProcesses , nChains );
+    if( nProcesses > 1 )
+    {
+        if( ReplicaPool::isAvailable() )
+        {
+            pool.start( nProcesses , nChains );
+            
+#ifdef _OPENMP
+            if( pool.getRank() != 0 )
+                omp_set_num_threads(1); // the threads of the parent's OpenMP pool do not exist in this process
+#endif
+        }
+        else
+            Rcout << "Multi-process runs are only available on Linux, all the chains run in this process" << '\n';
+    }
+    
+    // each chain draws its initial state from its own stream, so it is the same whichever process builds it
+    runCollective( [&](){
+        for( unsigned int i=0; i<nChains; ++i )
+            if( pool.owns(i) )
+            {
+                RNGStreamScope rngScope( rngStreams[i] );
+                chain[i] = std::make_shared<T>( surData ,
+                                               gamma_sampler_type, gamma_type, beta_type, covariance_type, output_CPO, maxThreads ,
+                                               temperatures[i] );
+            }
+    } );
 }
 
 // Example of specialised constructor, might be needed to initialise with more precise arguments depending on the chain type
@@ -129,10 +244,88 @@ global_count(0)
 template<typename T>
 void ESS_Sampler<T>::step()
 {
+    if( pool.isActive() )
+    {
+        pool.barrier(); // lets the workers in serve() go
+        this->poolStep();
+        return;
+    }
+    
     this->localStep();
+    
+    RNGStreamScope rngScope( globalRNGStream );
     this->globalStep();
 }
 
+// the same step, in every process of the pool
+template<typename T>
+void ESS_Sampler<T>::poolStep()
+{
+    pool.collective( [this](){
+        this->localStep();
+        
+        for( unsigned int i=0; i<nChains; ++i )
+            if( chain[i] )
+                pool.setLogLikelihood( i , chain[i]->getLogLikelihood() * chain[i]->getTemperature() );
+    } );
+    
+    {
+        RNGStreamScope rngScope( globalRNGStream );
+        this->globalStep();
+    }
+    
+    // the output is written by rank 0, so the outputs of the cold chain are sent over when it runs elsewhere
+    unsigned int cold = ladder[0];
+    if( pool.owner( cold ) == 0 )
+        return;
+    
+    std::ostringstream outputOut;
+    if( pool.owns( cold ) )
+    {
+        CheckpointWriter writer( outputOut );
+        chain[cold]->saveOutputState( writer );
+    }
+    
+    std::string output = outputOut.str();
+    pool.sendToRoot( pool.owner( cold ) , output );
+    
+    if( pool.getRank() == 0 )
+    {
+        if( !coldOutput )
+            coldOutput = std::make_shared<T>( *chain[0] ); // rank 0 always owns chain 0
+        
+        std::istringstream outputIn( output );
+        CheckpointReader reader( outputIn , "cold chain output" );
+        coldOutput->loadOutputState( reader );
+    }
+}
+
+template<typename T>
+void ESS_Sampler<T>::serve()
+{
+    if( pool.getRank() == 0 )
+        return;
+    
+    pool.serve( [this](){ this->poolStep(); } );
+}
+
+template<typename T>
+template<typename F>
+void ESS_Sampler<T>::runCollective( F task )
+{
+    try
+    {
+        pool.collective( task );
+    }
+    catch( ... )
+    {
+        if( pool.getRank() == 0 )
+            throw;
+        
+        pool.exitWorker(); // the failure is recorded in the pool already, rank 0 reports it
+    }
+}
+
 // Local Operator
 template<typename T>
 void ESS_Sampler<T>::localStep()
@@ -142,7 +335,13 @@ void ESS_Sampler<T>::localStep()
 #endif
     
     for( unsigned int i=0; i<nChains; ++i )
+    {
+        if( !chain[i] ) // runs in another process
+            continue;
+        
+        RNGStreamScope rngScope( rngStreams[i] );
         chain[i] -> step();
+    }
     
     // this sintactic sugar is disabled for omp
     // for( auto i : chain )
@@ -196,6 +395,35 @@ std::pair<unsigned int , unsigned int>  ESS_Sampler<T>::nearChainSelect()
 }
 
 
+// with the pool, the chains' own global moves need both states at hand, so the pair is drawn among the positions
+// whose chains run in the same process: uniformly over all of them, or over the neighbours in the sub-ladder of a process;
+// false if every chain runs in a process of its own
+template<typename T>
+bool ESS_Sampler<T>::processChainSelect( bool near , std::pair<unsigned int , unsigned int>& chainIdx )
+{
+    std::vector<std::pair<unsigned int , unsigned int>> pairs;
+    
+    for(unsigned int c=1; c<nChains; ++c)
+    {
+        for(unsigned int r=c; r-- > 0; )
+        {
+            if( pool.owner( ladder[r] ) == pool.owner( ladder[c] ) )
+            {
+                pairs.push_back( std::pair<unsigned int , unsigned int>( r , c ) );
+                if( near )
+                    break;
+            }
+        }
+    }
+    
+    if( pairs.empty() )
+        return false;
+    
+    chainIdx = pairs[ randIntUniform(0, (int)pairs.size()-1 ) ];
+    return true;
+}
+
+
 template<typename T>
 void ESS_Sampler<T>::globalStep()
 {
@@ -205,20 +433,27 @@ void ESS_Sampler<T>::globalStep()
     
     if( nChains > 1 )
     {
+        // swap the states of adjacent temperatures, every pair of the round at once
+        replicaExchange_step();
+        
+        // then one of the chains' own global moves (crossovers and exchanges) between two chains
         tmpRand = randU01();
-        if( tmpRand < 0.9 )
+        if( pool.isActive() )
+        {
+            if( processChainSelect( tmpRand >= 0.5 , chainIdx ) )
+                global_acc_count += chainGlobal_step( chainIdx.first , chainIdx.second );
+        }
+        else
         {
             if( tmpRand < 0.5 )
                 chainIdx = randomChainSelect();
             else
                 chainIdx = nearChainSelect();
             
-            global_acc_count += chain[chainIdx.first] -> globalStep( chain[chainIdx.second] );
-            
-        }else
-            global_acc_count += allExchangeAll_step();
+            global_acc_count += chainGlobal_step( chainIdx.first , chainIdx.second );
+        }
         
-        if ( ((global_proposal_count % updateCounter) == 0) && (global_count <= burnin) )
+        if ( ((global_count % updateCounter) == 0) && (global_count <= burnin) )
             updateTemperatures();
     }
 }
@@ -226,46 +461,85 @@ void ESS_Sampler<T>::globalStep()
 template<typename T>
 double ESS_Sampler<T>::getGlobalAccRate() const { return ((double)global_acc_count)/((double)global_proposal_count); }
 
+template<typename T>
+arma::vec ESS_Sampler<T>::getPairSwapAccRates() const
+{
+    arma::vec rates( pairSwapProposalCount.size() , arma::fill::zeros );
+    for( unsigned int i=0; i<rates.n_elem; ++i )
+        if( pairSwapProposalCount[i] > 0 )
+            rates(i) = ((double)pairSwapAccCount[i])/((double)pairSwapProposalCount[i]);
+    return rates;
+}
+
 
-// This below assumes that acceptance ratio is a monotonic function of the temperatre ratio
+// Each gap between adjacent temperatures is adapted on its own, on the log scale, with a Robbins-Monro step
+// that pushes the swap acceptance rate of that pair towards the target (Miasojedow, Moulines and Vihola, 2013);
+// the ladder is then free to bunch up where the posterior changes quickly with the temperature
 template<typename T>
 void ESS_Sampler<T>::updateTemperatures()
 {
+    ++nLadderUpdates;
+    double stepSize = std::pow( (double)nLadderUpdates , -0.6 );
     
-    double tempRatio = chain[1]->getTemperature(); // / temperatures(0) = 1
+    std::vector<double> logGap( nChains-1 );
+    for( unsigned int i=0; i < nChains-1 ; ++i )
+    {
+        logGap[i] = log( std::max( 1e-8 , getChainTemperature( ladder[i+1] ) - getChainTemperature( ladder[i] ) ) );
+        
+        if( windowSwapProposalCount[i] > 0 )
+            logGap[i] += stepSize * ( ((double)windowSwapAccCount[i])/((double)windowSwapProposalCount[i]) - swapTargetAccRate );
+    }
     
-    // check acceptance rate
-    // if too high/low , update temperatures
+    for( unsigned int i=1; i < nChains ; ++i )
+        setChainTemperature( ladder[i] , getChainTemperature( ladder[i-1] ) + exp( logGap[i-1] ) );
     
-    if( getGlobalAccRate() > 0.3 )
+    if( pool.getRank() == 0 )
     {
-        tempRatio *= 1.1 ;
-        
-        for( unsigned int i=1; i < nChains ; ++i )
-        {
-            chain[i]->setTemperature( tempRatio * chain[i-1]->getTemperature() );
-        }
+        Rcout << "Temperature ladder updated, new temperatures :";
+        for( unsigned int i=0; i < nChains ; ++i )
+            Rcout << " " << getChainTemperature( ladder[i] );
+        Rcout << std::endl;
+    }
+    
+    // the acceptance rates that drive the update are only the ones in the near-past,
+    // so reset the window counts (and the global ones, for the same reason) each time I update the temperature
+    std::fill( windowSwapProposalCount.begin() , windowSwapProposalCount.end() , 0 );
+    std::fill( windowSwapAccCount.begin() , windowSwapAccCount.end() , 0 );
+    global_proposal_count = 0;
+    global_acc_count = 0;
+    
+}
+
+// Deterministic even/odd replica exchange: the pairs in a round don't overlap, so they are all tried in the same step,
+// and alternating between the two sets makes the states travel along the ladder rather than diffuse on it
+template<typename T>
+int ESS_Sampler<T>::replicaExchange_step()
+{
+    int nAccepted = 0;
+    
+    for( unsigned int i = swapRound % 2; i+1 < nChains; i += 2 )
+    {
+        unsigned int cold = ladder[i], hot = ladder[i+1];
         
-        Rcout << "Temperature ladder updated, new temperature ratio : " << tempRatio << std::endl;
+        double logPExchange = ( getChainLogLikelihood( cold ) - getChainLogLikelihood( hot ) ) *
+        ( 1. / getChainTemperature( hot ) - 1. / getChainTemperature( cold ) );
+        //  no priors because that is not tempered so it cancels out
         
-    }else if( getGlobalAccRate() < 0.05 )
-    {
-        tempRatio = std::max( 1. + 1e-8 , tempRatio * 0.9 );
+        ++pairSwapProposalCount[i];
+        ++windowSwapProposalCount[i];
         
-        for( unsigned int i=1; i < nChains ; ++i )
+        if( randLogU01() < logPExchange )
         {
-            chain[i]->setTemperature( tempRatio * chain[i-1]->getTemperature() );
+            swapAll( i , i+1 );
+            
+            ++pairSwapAccCount[i];
+            ++windowSwapAccCount[i];
+            ++nAccepted;
         }
-        
-        Rcout << "Temperature ladder updated, new temperature ratio : " << tempRatio << std::endl;
     }
     
-    // I want to maintain a sort-of-moving avaerage acceptance count for the global moves, so that
-    // when we check if we should update the temperatures we only check in the near-past
-    // in order to do this, I simply reset the varaibles each time I update the temperature
-    global_proposal_count = 0;
-    global_acc_count = 0;
-    
+    ++swapRound;
+    return nAccepted;
 }
 
 template<typename T>
@@ -304,9 +578,10 @@ int ESS_Sampler<T>::allExchangeAll_step()
         unsigned int secondChain = indexTable(tabIndex,1);
         
         // Swap probability
-        pExchange(tabIndex) = ( chain[firstChain]->getLogLikelihood() * chain[firstChain]->getTemperature() -
-                               chain[secondChain]->getLogLikelihood() * chain[secondChain]->getTemperature() ) *
-        ( 1. / chain[secondChain]->getTemperature() - 1. / chain[firstChain]->getTemperature() );
+        unsigned int first = ladder[firstChain], second = ladder[secondChain];
+        
+        pExchange(tabIndex) = ( getChainLogLikelihood( first ) - getChainLogLikelihood( second ) ) *
+        ( 1. / getChainTemperature( second ) - 1. / getChainTemperature( first ) );
         //  no priors because that is not tempered so it cancels out
     }
     
@@ -328,7 +603,7 @@ int ESS_Sampler<T>::allExchangeAll_step()
         unsigned int firstChain = indexTable(swapIdx,0);
         unsigned int secondChain  = indexTable(swapIdx,1);
         
-        swapAll( chain[firstChain] , chain[secondChain] );
+        swapAll( firstChain , secondChain );
         
         return 1;
     }else
@@ -336,21 +611,99 @@ int ESS_Sampler<T>::allExchangeAll_step()
     
 }
 
+// The chains' own global move between the chains at two positions of the ladder. It draws from a copy of the global
+// stream, which then jumps past it, so that only the process that runs the move has to draw its random numbers.
+// With the pool both chains run in the same process (see processChainSelect), which publishes the outcome
 template<typename T>
-void ESS_Sampler<T>::swapAll( std::shared_ptr<T>& thisChain , std::shared_ptr<T>& thatChain )
+int ESS_Sampler<T>::chainGlobal_step( unsigned int thisPosition , unsigned int thatPosition )
 {
+    unsigned int thisChain = ladder[thisPosition], thatChain = ladder[thatPosition];
+    
+    RNGStream moveRNGStream = globalRNGStream;
+    globalRNGStream.jump();
+    
+    if( !pool.isActive() )
+    {
+        RNGStreamScope rngScope( moveRNGStream );
+        int accepted = chain[thisChain] -> globalStep( chain[thatChain] );
+        syncLadder(); // the chains' full exchange swaps their temperatures
+        return accepted;
+    }
     
-    // POINTER SWAP
-    std::swap ( thisChain , thatChain );
+    runCollective( [&](){
+        if( !pool.owns( thisChain ) )
+            return;
+        
+        RNGStreamScope rngScope( moveRNGStream );
+        int accepted = chain[thisChain] -> globalStep( chain[thatChain] );
+        pool.setMoveResult( accepted , chain[thisChain]->getTemperature() , chain[thatChain]->getTemperature() );
+    } );
     
-    double swapTemp = thisChain -> getTemperature();
-    thisChain -> setTemperature( thatChain -> getTemperature() );
-    thatChain -> setTemperature( swapTemp );
+    int accepted = pool.getMoveResult( temperatures[thisChain] , temperatures[thatChain] );
+    syncLadder();
     
+    return accepted;
+}
+
+// swap the temperatures at two positions of the ladder, O(1) whatever the size of the state
+// (and nothing to send, every process applies it to the chains it holds)
+template<typename T>
+void ESS_Sampler<T>::swapAll( unsigned int thisPosition , unsigned int thatPosition )
+{
+    unsigned int thisChain = ladder[thisPosition], thatChain = ladder[thatPosition];
+    
+    double swapTemp = getChainTemperature( thisChain );
+    setChainTemperature( thisChain , getChainTemperature( thatChain ) );
+    setChainTemperature( thatChain , swapTemp );
+    
+    std::swap( ladder[thisPosition] , ladder[thatPosition] );
+}
+
+// re-read the ladder off the chains' temperatures, after a move that swapped them from within the chains
+template<typename T>
+void ESS_Sampler<T>::syncLadder()
+{
+    std::stable_sort( ladder.begin() , ladder.end() ,
+                     [this]( unsigned int a , unsigned int b ){ return getChainTemperature(a) < getChainTemperature(b); } );
+}
+
+template<typename T>
+double ESS_Sampler<T>::getChainTemperature( unsigned int c ) const
+{
+    return pool.isActive() ? temperatures[c] : chain[c]->getTemperature();
+}
+
+template<typename T>
+void ESS_Sampler<T>::setChainTemperature( unsigned int c , double temperature )
+{
+    if( pool.isActive() )
+        temperatures[c] = temperature;
+    
+    if( chain[c] )
+        chain[c]->setTemperature( temperature );
+}
+
+template<typename T>
+double ESS_Sampler<T>::getChainLogLikelihood( unsigned int c ) const
+{
+    return pool.isActive() ? pool.getLogLikelihood(c) : chain[c]->getLogLikelihood() * chain[c]->getTemperature();
 }
 
 template<typename T>
 void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
+{
+    runCollective( [&](){
+        for( unsigned int i=0; i<nChains; ++i )
+            if( chain[i] )
+            {
+                RNGStreamScope rngScope( rngStreams[i] );
+                setChainHyperParameters( chain[i] , chainData );
+            }
+    } );
+}
+
+template<typename T>
+void ESS_Sampler<T>::setChainHyperParameters( std::shared_ptr<T>& c , const Utils::Chain_Data& chainData )
 {
     // MRF Prior
     if ( chainData.gamma_type == Gamma_Type::mrf )
@@ -359,19 +712,16 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
         {
             if ( ! std::isnan( chainData.mrfE ) )
             {
-                for( auto c : chain )
-                    c->setGammaDE( chainData.mrfD, chainData.mrfE );
+                c->setGammaDE( chainData.mrfD, chainData.mrfE );
             }
             else
             {
-                for( auto c : chain )
-                    c->setGammaD( chainData.mrfD );
+                c->setGammaD( chainData.mrfD );
             }
         }
         else if ( ! std::isnan( chainData.mrfE ) )
         {
-            for( auto c : chain )
-                c->setGammaE( chainData.mrfE );
+            c->setGammaE( chainData.mrfE );
         }
     }
     
@@ -383,19 +733,16 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
         {
             if ( ! std::isnan( chainData.piB ) )
             {
-                for( auto c : chain )
-                    c->setPiAB( chainData.piA, chainData.piB );
+                c->setPiAB( chainData.piA, chainData.piB );
             }
             else
             {
-                for( auto c : chain )
-                    c->setPiA( chainData.piA );
+                c->setPiA( chainData.piA );
             }
         }
         else if ( ! std::isnan( chainData.piB ) )
         {
-            for( auto c : chain )
-                c->setPiB( chainData.piB );
+            c->setPiB( chainData.piB );
         }
         
         // HOTSPOT only
@@ -406,19 +753,16 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
             {
                 if ( ! std::isnan( chainData.oB ) )
                 {
-                    for( auto c : chain )
-                        c->setOAB( chainData.oA, chainData.oB );
+                    c->setOAB( chainData.oA, chainData.oB );
                 }
                 else
                 {
-                    for( auto c : chain )
-                        c->setOA( chainData.oA );
+                    c->setOA( chainData.oA );
                 }
             }
             else if ( ! std::isnan( chainData.oB ) )
             {
-                for( auto c : chain )
-                    c->setOB( chainData.oB );
+                c->setOB( chainData.oB );
             }
         }
     }
@@ -432,19 +776,16 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
         {
             if ( ! std::isnan( chainData.sigmaB ) )
             {
-                for( auto c : chain )
-                    c->setSigmaAB( chainData.sigmaA, chainData.sigmaB );
+                c->setSigmaAB( chainData.sigmaA, chainData.sigmaB );
             }
             else
             {
-                for( auto c : chain )
-                    c->setSigmaA( chainData.sigmaA );
+                c->setSigmaA( chainData.sigmaA );
             }
         }
         else if ( ! std::isnan( chainData.sigmaB ) )
         {
-            for( auto c : chain )
-                c->setSigmaB( chainData.sigmaB );
+            c->setSigmaB( chainData.sigmaB );
         }
     }
     else // SUR
@@ -454,25 +795,21 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
         {
             if ( ! std::isnan( chainData.tauB ) )
             {
-                for( auto c : chain )
-                    c->setTauAB( chainData.tauA, chainData.tauB );
+                c->setTauAB( chainData.tauA, chainData.tauB );
             }
             else
             {
-                for( auto c : chain )
-                    c->setTauA( chainData.tauA );
+                c->setTauA( chainData.tauA );
             }
         }
         else if ( ! std::isnan( chainData.tauB ) )
         {
-            for( auto c : chain )
-                c->setTauB( chainData.tauB );
+            c->setTauB( chainData.tauB );
         }
         
         // NU
         if ( ! std::isnan( chainData.nu ) )
-            for( auto c : chain )
-                c->setNu( chainData.nu );
+            c->setNu( chainData.nu );
     }
     
     if ( chainData.covariance_type == Covariance_Type::HIW )  // Sparse SUR
@@ -482,19 +819,16 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
         {
             if ( ! std::isnan( chainData.etaB ) )
             {
-                for( auto c : chain )
-                    c->setEtaAB( chainData.etaA, chainData.etaB );
+                c->setEtaAB( chainData.etaA, chainData.etaB );
             }
             else
             {
-                for( auto c : chain )
-                    c->setEtaA( chainData.etaA );
+                c->setEtaA( chainData.etaA );
             }
         }
         else if ( ! std::isnan( chainData.etaB ) )
         {
-            for( auto c : chain )
-                c->setEtaB( chainData.etaB );
+            c->setEtaB( chainData.etaB );
         }
     }
     
@@ -503,19 +837,16 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
     {
         if ( ! std::isnan( chainData.wB ) )
         {
-            for( auto c : chain )
-                c->setWAB( chainData.wA, chainData.wB );
+            c->setWAB( chainData.wA, chainData.wB );
         }
         else
         {
-            for( auto c : chain )
-                c->setWA( chainData.wA );
+            c->setWA( chainData.wA );
         }
     }
     else if ( ! std::isnan( chainData.wB ) )
     {
-        for( auto c : chain )
-            c->setWB( chainData.wB );
+        c->setWB( chainData.wB );
     }
     
     // a_w0 and b_w0
@@ -523,21 +854,68 @@ void ESS_Sampler<T>::setHyperParameters( const Utils::Chain_Data& chainData )
     {
         if ( ! std::isnan( chainData.w0B ) )
         {
-            for( auto c : chain )
-                c->setW0AB( chainData.w0A, chainData.w0B );
+            c->setW0AB( chainData.w0A, chainData.w0B );
         }
         else
         {
-            for( auto c : chain )
-                c->setW0A( chainData.w0A );
+            c->setW0A( chainData.w0A );
         }
     }
     else if ( ! std::isnan( chainData.w0B ) )
     {
-        for( auto c : chain )
-            c->setW0B( chainData.w0B );
+        c->setW0B( chainData.w0B );
     }
     
 }
 
+
+// ********************************
+// CHECKPOINTING
+// ********************************
+
+template<typename T>
+void ESS_Sampler<T>::saveState( CheckpointWriter& checkpoint )
+{
+    checkpoint.match( nChains );
+    checkpoint.io( updateCounter );
+    checkpoint.io( global_proposal_count );
+    checkpoint.io( global_acc_count );
+    checkpoint.io( global_count );
+    checkpoint.io( ladder );
+    checkpoint.io( swapRound );
+    checkpoint.io( pairSwapProposalCount );
+    checkpoint.io( pairSwapAccCount );
+    checkpoint.io( windowSwapProposalCount );
+    checkpoint.io( windowSwapAccCount );
+    checkpoint.io( nLadderUpdates );
+    checkpoint.io( rngStreams );
+    checkpoint.io( globalRNGStream );
+    
+    // temperatures live in the chains, which are saved in their own order (the ladder is above)
+    for( unsigned int i=0; i<nChains; ++i )
+        chain[i]->saveState( checkpoint );
+}
+
+template<typename T>
+void ESS_Sampler<T>::loadState( CheckpointReader& checkpoint )
+{
+    checkpoint.match( nChains );
+    checkpoint.io( updateCounter );
+    checkpoint.io( global_proposal_count );
+    checkpoint.io( global_acc_count );
+    checkpoint.io( global_count );
+    checkpoint.io( ladder );
+    checkpoint.io( swapRound );
+    checkpoint.io( pairSwapProposalCount );
+    checkpoint.io( pairSwapAccCount );
+    checkpoint.io( windowSwapProposalCount );
+    checkpoint.io( windowSwapAccCount );
+    checkpoint.io( nLadderUpdates );
+    checkpoint.io( rngStreams );
+    checkpoint.io( globalRNGStream );
+    
+    for( unsigned int i=0; i<nChains; ++i )
+        chain[i]->loadState( checkpoint );
+}
+
 #endif
@@ -18,8 +18,8 @@ HRR_Chain::HRR_Chain( std::shared_ptr<arma::mat> data_, std::shared_ptr<arma::ma
                      std::shared_ptr<arma::uvec> fixedPredictorsIdx_, std::shared_ptr<arma::umat> missingDataArrayIdx_, std::shared_ptr<arma::uvec> completeCases_,
                      Gamma_Sampler_Type gamma_sampler_type_ , Gamma_Type gamma_type_ ,
                      Beta_Type beta_type_ , Covariance_Type covariance_type_ , bool output_CPO , int maxThreads ,
-                     double externalTemperature ):
-data(data_), mrfG(mrfG_), outcomesIdx(outcomesIdx_), VSPredictorsIdx(VSPredictorsIdx_), fixedPredictorsIdx(fixedPredictorsIdx_),
+                     double externalTemperature , std::shared_ptr<GramCache> gramCache_ , std::shared_ptr<PredictorMatrix> predictors_ ):
+data(data_), predictors(predictors_), mrfG(mrfG_), outcomesIdx(outcomesIdx_), VSPredictorsIdx(VSPredictorsIdx_), fixedPredictorsIdx(fixedPredictorsIdx_),
 missingDataArrayIdx(missingDataArrayIdx_), completeCases(completeCases_),
 nObservations(nObservations_), nOutcomes(nOutcomes_), nVSPredictors(nVSPredictors_), nFixedPredictors(nFixedPredictors_),
 temperature(externalTemperature),internalIterationCounter(0),
@@ -30,7 +30,12 @@ covariance_type(covariance_type_),gamma_type(gamma_type_),beta_type(beta_type_),
         throw Bad_Covariance_Type ( covariance_type );
     
     predictorsIdx = std::make_shared<arma::uvec>(arma::join_vert( *fixedPredictorsIdx, *VSPredictorsIdx ));
+    if( !predictors )
+        predictors = std::make_shared<PredictorMatrix>( data );
+    gramCache = gramCache_ ? gramCache_ : std::make_shared<GramCache>( predictors , predictorsIdx );
     setXtX();
+    logLikKCache = std::vector<std::array<LogLikKEntry,2>>(nOutcomes);
+    logLikKLastSlot = std::vector<unsigned int>(nOutcomes,0);
     
     switch ( gamma_sampler_type )
     {
@@ -87,13 +92,13 @@ HRR_Chain::HRR_Chain( Utils::SUR_Data& surData,
                      double externalTemperature ):
 HRR_Chain(surData.data,surData.mrfG,surData.nObservations,surData.nOutcomes,surData.nVSPredictors,surData.nFixedPredictors,
 surData.outcomesIdx,surData.VSPredictorsIdx,surData.fixedPredictorsIdx,surData.missingDataArrayIdx,surData.completeCases,
-          gamma_sampler_type_,gamma_type_,beta_type_,covariance_type_,output_CPO,maxThreads,externalTemperature){ }
+          gamma_sampler_type_,gamma_type_,beta_type_,covariance_type_,output_CPO,maxThreads,externalTemperature,surData.gramCache,surData.predictors){ }
 
 HRR_Chain::HRR_Chain( Utils::SUR_Data& surData, double externalTemperature ):
 HRR_Chain(surData.data,surData.mrfG,surData.nObservations,surData.nOutcomes,surData.nVSPredictors,surData.nFixedPredictors,
 surData.outcomesIdx,surData.VSPredictorsIdx,surData.fixedPredictorsIdx,surData.missingDataArrayIdx,surData.completeCases,
           Gamma_Sampler_Type::bandit , Gamma_Type::hotspot , Beta_Type::independent , Covariance_Type::IG , false ,
-          externalTemperature){ }
+          1 , externalTemperature , surData.gramCache , surData.predictors){ }
 
 // *******************************
 // Getters and Setters
@@ -103,12 +108,12 @@ surData.outcomesIdx,surData.VSPredictorsIdx,surData.fixedPredictorsIdx,surData.m
 void HRR_Chain::setXtX()
 {
     
-    // Compute XtX
-    if( (nFixedPredictors+nVSPredictors) < 5000 )  // kinda arbitrary value, how can we assess a more sensible one?
+    // Compute XtX fully if it fits in the memory budget, otherwise its tiles are computed (and cached) on demand by gramCache
+    if( gramCache->fitsInBudget() )
     {
         preComputedXtX = true;
-        XtX = data->cols( *predictorsIdx ).t() * data->cols( *predictorsIdx );
-        corrMatX = arma::cor( data->submat(arma::regspace<arma::uvec>(0,nObservations-1), *VSPredictorsIdx ) );  // this is only for values to be selected
+        XtX = predictors->gram( *predictorsIdx , *predictorsIdx );
+        corrMatX = predictors->cor( *VSPredictorsIdx , *VSPredictorsIdx );  // this is only for values to be selected
     }else{
         
         preComputedXtX = false;
@@ -188,7 +193,7 @@ unsigned int HRR_Chain::getNUpdatesBandit() const{ return n_updates_bandit ; }
 void HRR_Chain::setNUpdatesBandit( unsigned int n_updates_bandit_ ){ n_updates_bandit = n_updates_bandit_ ; }
 
 arma::mat& HRR_Chain::getBanditZeta(){ return banditZeta; }
-void HRR_Chain::setBanditZeta( arma::mat banditZeta_ ){ banditZeta = banditZeta_ ; }
+void HRR_Chain::setBanditZeta( arma::mat banditZeta_ ){ banditZeta = banditZeta_ ; banditResetMismatch(); }
 
 arma::mat& HRR_Chain::getBanditAlpha(){ return banditAlpha ; }
 void HRR_Chain::setBanditAlpha( arma::mat banditAlpha_ ){ banditAlpha = banditAlpha_ ; }
@@ -196,15 +201,6 @@ void HRR_Chain::setBanditAlpha( arma::mat banditAlpha_ ){ banditAlpha = banditAl
 arma::mat& HRR_Chain::getBanditBeta(){ return banditBeta ; }
 void HRR_Chain::setBanditBeta( arma::mat banditBeta_ ){ banditBeta = banditBeta_ ; }
 
-arma::vec& HRR_Chain::getBanditMismatch(){ return mismatch; }
-void HRR_Chain::setBanditMismatch( arma::vec mismatch_ ){ mismatch = mismatch_ ; }
-
-arma::vec& HRR_Chain::getBanditNormalisedMismatch(){ return normalised_mismatch ; }
-void HRR_Chain::setBanditNormalisedMismatch( arma::vec normalised_mismatch_ ){ normalised_mismatch = normalised_mismatch_ ; }
-
-arma::vec& HRR_Chain::getBanditNormalisedMismatchBackwards(){ return normalised_mismatch_backwards ; }
-void HRR_Chain::setBanditNormalisedMismatchBackwards( arma::vec normalised_mismatch_backwards_ ){ normalised_mismatch_backwards = normalised_mismatch_backwards_ ; }
-
 // Parameter states etc
 
 void HRR_Chain::sigmaABInit()
@@ -337,6 +333,7 @@ arma::umat& HRR_Chain::getGamma(){ return gamma ; }
 void HRR_Chain::setGamma( arma::umat& externalGamma )
 {
     gamma = externalGamma ;
+    banditResetMismatch();
     logPGamma();
     log_likelihood = logLikelihood( gammaMask , gamma ); // update internal state
 }
@@ -344,6 +341,7 @@ void HRR_Chain::setGamma( arma::umat& externalGamma )
 void HRR_Chain::setGamma( arma::umat& externalGamma , double logP_gamma_ )
 {
     gamma = externalGamma ;
+    banditResetMismatch();
     logP_gamma = logP_gamma_ ;
     log_likelihood = logLikelihood( gammaMask , gamma ); // update internal state
 }
@@ -526,20 +524,20 @@ arma::mat& HRR_Chain::getBeta() //const
                 {
                     case Beta_Type::gprior :
                     {
-                        W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN) ).t() * data->cols( (*predictorsIdx)(VS_IN) ) ) );
+                        W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( ( gramCache->submat( VS_IN , VS_IN ) ) );
                         break;
                     }
                         
                     case Beta_Type::independent :
                     {
-                        W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN) ).t() * data->cols( (*predictorsIdx)(VS_IN) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN.n_elem,VS_IN.n_elem) );
+                        W_k = arma::inv_sympd( ( gramCache->submat( VS_IN , VS_IN ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN.n_elem,VS_IN.n_elem) );
                         break;
                     }
                         
                     case Beta_Type::reGroup :
                     {
                       // W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN) ).t() * data->cols( (*predictorsIdx)(VS_IN) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN.n_elem,VS_IN.n_elem) );
-                      W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN) ).t() * data->cols( (*predictorsIdx)(VS_IN) ) )/temperature + arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN.n_elem-nFixedPredictors)) ) );
+                      W_k = arma::inv_sympd( ( gramCache->submat( VS_IN , VS_IN ) )/temperature + arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN.n_elem-nFixedPredictors)) ) );
                       break;
                     }
                         
@@ -548,7 +546,7 @@ arma::mat& HRR_Chain::getBeta() //const
                 }
             }
             
-            arma::vec mu_k = W_k * ( data->cols( VS_IN ).t() * data->col( (*outcomesIdx)(k) ) ); // we divide by temp later
+            arma::vec mu_k = W_k * ( predictors->crossprod( (*predictorsIdx)(VS_IN) , data->col( (*outcomesIdx)(k) ) ) ); // we divide by temp later
             
             beta.submat(VS_IN,singleIdx_k) = Distributions::randMvNormal( mu_k , W_k );
         }
@@ -690,6 +688,7 @@ void HRR_Chain::mrfGInit()
         throw Bad_Gamma_Type ( gamma_type );
     
     mrf_G = arma::zeros<arma::mat>(2,2);
+    mrfGraph.build( *mrfG , nVSPredictors * nOutcomes );
     mrf_d = -3. ;
     mrf_e = 0.2 ;
 }
@@ -707,6 +706,7 @@ void HRR_Chain::mrfGInit( arma::mat& mrf_G_ )
 void HRR_Chain::gammaInit( arma::umat& gamma_init )
 {
     gamma = gamma_init;
+    banditResetMismatch();
     gamma_acc_count = 0.;
     logPGamma();
     updateGammaMask();
@@ -895,36 +895,84 @@ double HRR_Chain::logPGamma( const arma::umat& externalGamma , const arma::vec&
     return logP;
 }
 
-// this is the MRF prior
-double HRR_Chain::logPGamma( const arma::umat& externalGamma , double d , double e )
+// single o_k / pi_j moves: only the terms of the priors that involve them, O(p) and O(s) instead of O(ps)
+double HRR_Chain::logPODelta( unsigned int k , double proposedOk )
 {
-    if( gamma_type != Gamma_Type::mrf )
+    if ( gamma_type != Gamma_Type::hotspot )
         throw Bad_Gamma_Type ( gamma_type );
     
-    arma::mat externalMRFG = mrfG->cols( arma::linspace<arma::uvec>(0,2,3) );
+    return Distributions::logPDFBeta( proposedOk , a_o, b_o ) - Distributions::logPDFBeta( o(k) , a_o, b_o );
+}
+
+double HRR_Chain::logPPiDelta( unsigned int j , double proposedPij )
+{
+    switch ( gamma_type )
+    {
+        case Gamma_Type::hotspot :
+            return Distributions::logPDFGamma( proposedPij , a_pi, b_pi ) - Distributions::logPDFGamma( pi(j) , a_pi, b_pi );
+            
+        case Gamma_Type::hierarchical :
+            return Distributions::logPDFBeta( proposedPij , a_pi, b_pi ) - Distributions::logPDFBeta( pi(j) , a_pi, b_pi );
+            
+        default:
+            throw Bad_Gamma_Type ( gamma_type );
+    }
+}
+
+// column k of gamma, hotspot prior
+double HRR_Chain::logPGammaODelta( unsigned int k , double proposedOk )
+{
+    if( gamma_type != Gamma_Type::hotspot )
+        throw Bad_Gamma_Type ( gamma_type );
     
     double logP = 0.;
-    // calculate the linear and quadratic parts in MRF by using all edges of G
-    arma::vec gammaVec = arma::conv_to< arma::vec >::from(arma::vectorise(externalGamma));
-    double quad_mrf = 0.;
-    double linear_mrf = 0.;
-    int count_linear_mrf = 0;
-    for( unsigned i=0; i < (externalMRFG).n_rows; ++i )
+    for(unsigned int j=0; j<nVSPredictors; ++j)
     {
-        if( (externalMRFG)(i,0) != (externalMRFG)(i,1) ){
-            quad_mrf += e * 2.0 * gammaVec( (externalMRFG)(i,0) ) * gammaVec( (externalMRFG)(i,1) ) * (externalMRFG)(i,2);
-        }else{
-                if( gammaVec( (externalMRFG)(i,0) ) == 1 ){
-                    linear_mrf += d * gammaVec( (externalMRFG)(i,0) ) * (externalMRFG)(i,2);
-                    count_linear_mrf ++;
-                }
-        }
+        if( ( proposedOk * pi(j) ) > 1 )
+            return -std::numeric_limits<double>::infinity();
+        
+        logP += Distributions::logPDFBernoulli( gamma(j,k), proposedOk * pi(j) ) - Distributions::logPDFBernoulli( gamma(j,k), o(k) * pi(j) );
     }
-    logP = arma::as_scalar( linear_mrf + d * (arma::accu( externalGamma ) - count_linear_mrf) + e * 2.0 * quad_mrf );
+    return logP;
+}
+
+// row j of gamma, hotspot or hierarchical prior
+double HRR_Chain::logPGammaPiDelta( unsigned int j , double proposedPij )
+{
+    double logP = 0.;
     
+    switch ( gamma_type )
+    {
+        case Gamma_Type::hotspot :
+            for(unsigned int k=0; k<nOutcomes; ++k)
+            {
+                if( ( o(k) * proposedPij ) > 1 )
+                    return -std::numeric_limits<double>::infinity();
+                
+                logP += Distributions::logPDFBernoulli( gamma(j,k), o(k) * proposedPij ) - Distributions::logPDFBernoulli( gamma(j,k), o(k) * pi(j) );
+            }
+            break;
+            
+        case Gamma_Type::hierarchical :
+            logP = Distributions::logPDFBernoulli( gamma.row(j).t() , proposedPij ) - Distributions::logPDFBernoulli( gamma.row(j).t() , pi(j) );
+            break;
+            
+        default:
+            throw Bad_Gamma_Type ( gamma_type );
+    }
     return logP;
 }
 
+// this is the MRF prior
+double HRR_Chain::logPGamma( const arma::umat& externalGamma , double d , double e )
+{
+    if( gamma_type != Gamma_Type::mrf )
+        throw Bad_Gamma_Type ( gamma_type );
+    
+    // only the active nodes and their incident edges are visited, see Utils::MRFGraph
+    return mrfGraph.logP( externalGamma , d , e );
+}
+
 // these below are general interfaces
 double HRR_Chain::logPGamma( )
 {
@@ -1016,236 +1064,157 @@ arma::mat HRR_Chain::predLikelihood( )
 }
 
 // LOG LIKELIHOODS
-double HRR_Chain::logLikelihood( )
+// each outcome contributes independently to the marginal likelihood, so its term is cached per outcome
+// (two slots, i.e. the current state and the last proposal) and recomputed only if its gamma column,
+// w, w0, a_sigma, b_sigma or the temperature changed
+bool HRR_Chain::isCurrentLogLikKEntry( const unsigned int k , const LogLikKEntry& entry ) const
 {
+    if( !entry.valid || entry.w != w || entry.w0 != w0 || entry.a_sigma != a_sigma || entry.b_sigma != b_sigma || entry.temperature != temperature )
+        return false;
     
-    double logP {0};
-    predLik.set_size(nObservations, nOutcomes);
+    arma::uvec VS_IN_k = {};
+    if(gammaMask.n_rows>0)
+        VS_IN_k = gammaMask( arma::find(  gammaMask.col(1) == k) , arma::zeros<arma::uvec>(1) );
     
-    // yMean is needed if y is not standardized
-    arma::mat yMean = data->cols( *outcomesIdx );
-    for( unsigned k=0; k<nOutcomes; k++)
-    {
-        yMean.col(k) = arma::mean(yMean.col(k)) * arma::ones(nObservations);
-    }
+    return entry.VS_IN_k.n_elem == VS_IN_k.n_elem && std::equal( VS_IN_k.begin() , VS_IN_k.end() , entry.VS_IN_k.begin() );
+}
 
-    #ifdef _OPENMP
-    #pragma omp parallel for default(shared) reduction(+:logP)
-    #endif
-    
-    for( unsigned int k=0; k<nOutcomes; ++k)
+double HRR_Chain::logLikelihoodK( const unsigned int k , const arma::uvec& VS_IN_k , const double externalW , const double externalW0 ,
+                                 const double externalA_sigma , const double externalB_sigma , bool computeCPO )
+{
+    if( !computeCPO )
     {
-        arma::uvec VS_IN_k = {}; // be sure it's empty by default
-        if(gammaMask.n_rows>0)
-            VS_IN_k = gammaMask( arma::find(  gammaMask.col(1) == k) , arma::zeros<arma::uvec>(1) );
-        
-        arma::mat W_k;
-        if( preComputedXtX )
+        for( unsigned int slot=0; slot<2; ++slot )
         {
-            switch ( beta_type )
+            const LogLikKEntry& entry = logLikKCache[k][slot];
+            if( entry.valid && entry.w == externalW && entry.w0 == externalW0 &&
+               entry.a_sigma == externalA_sigma && entry.b_sigma == externalB_sigma && entry.temperature == temperature &&
+               entry.VS_IN_k.n_elem == VS_IN_k.n_elem && std::equal( VS_IN_k.begin() , VS_IN_k.end() , entry.VS_IN_k.begin() ) )
             {
-                case Beta_Type::gprior :
-                {
-                    W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                  //W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                  W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                  break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
+                logLikKLastSlot[k] = slot;
+                return entry.logP;
             }
         }
-        else
+    }
+    
+    // y needs to be centered if not standardized
+    arma::vec y_k = data->col( (*outcomesIdx)(k) );
+    y_k -= arma::mean( y_k );
+    
+    double logP {0};
+    double quadForm {0}; // mu_k.t() * X_k.t() * y_k
+    
+    arma::mat R_k; // upper Cholesky factor of W_k^-1
+    arma::vec tmpVec;
+    
+    if( VS_IN_k.n_elem > 0 )
+    {
+        arma::mat XtX_k = preComputedXtX ? arma::mat( XtX(VS_IN_k,VS_IN_k) ) :
+                    arma::mat( gramCache->submat( VS_IN_k , VS_IN_k ) );
+        
+        switch ( beta_type )
         {
-            switch ( beta_type )
+            case Beta_Type::gprior :
             {
-                case Beta_Type::gprior :
-                {
-                    W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                    //W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                    break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
+                R_k = arma::chol( XtX_k * ( (externalW+temperature)/(externalW*temperature) ) );
+                break;
             }
-        }
-        
-        arma::vec mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * (data->col( (*outcomesIdx)(k) ) - yMean.col(k)) ); // we divide by temp later
-               
-        double a_sigma_k = a_sigma + 0.5*(double)nObservations/temperature;
-        double b_sigma_k = b_sigma + 0.5* arma::as_scalar( (( data->col((*outcomesIdx)(k)) - yMean.col(k) ).t() * (data->col((*outcomesIdx)(k)) - yMean.col(k) )) - ( mu_k.t() * data->cols( (*predictorsIdx)(VS_IN_k) ).t() * ( data->col((*outcomesIdx)(k)) - yMean.col(k) ) ) )/temperature;
-        
-        double sign, tmp;
-        arma::log_det(tmp, sign, W_k );
-        logP += 0.5*tmp;
-        
-        // arma::log_det(tmp, sign, w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-        logP -= 0.5 * (double)VS_IN_k.n_elem * log(w);
-        
-        logP += a_sigma*log(b_sigma) - a_sigma_k*log(b_sigma_k);
-        
-        logP += std::lgamma(a_sigma_k) - std::lgamma(a_sigma);
-        
-        // posterior predictive - t distribution after shifting and scaling by some quantities; from the multivariate t distribution p(y_tilde |y)
-        if( output_CPO && (temperature = 1.) ){
-            for( unsigned int j=0; j<nObservations; ++j )
-            {
-                double mu_scale, W_scale, t1, t2;
                 
-                mu_scale = (data->col(k))(j) - arma::as_scalar(arma::conv_to<arma::vec>::from(data->row(j))((*predictorsIdx)(VS_IN_k)).t() *mu_k);
-                W_scale = b_sigma_k/a_sigma_k * ( 1. + arma::as_scalar(arma::conv_to<arma::vec>::from(data->row(j))((*predictorsIdx)(VS_IN_k)).t() * W_k * arma::conv_to<arma::vec>::from(data->row(j))((*predictorsIdx)(VS_IN_k))) );
-                
-                t1 = std::lgamma(a_sigma_k+0.5) - 0.5*std::log(2.*a_sigma_k*M_PI) - 0.5*std::log( W_scale ) - std::lgamma(a_sigma_k);
-                t2 = -(a_sigma_k+0.5) * std::log( 1. + mu_scale*mu_scale/W_scale/2./a_sigma_k );
+            case Beta_Type::independent :
+            {
+                R_k = arma::chol( XtX_k/temperature + 1./externalW * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
+                break;
+            }
                 
-                predLik(j,k) = std::exp( t1+t2 );
+            case Beta_Type::reGroup :
+            {
+                R_k = arma::chol( XtX_k/temperature + arma::diagmat( arma::join_cols(1./externalW0*arma::ones(nFixedPredictors),1./externalW*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
+                break;
             }
+                
+            default:
+                throw Bad_Beta_Type ( beta_type );
         }
         
+        tmpVec = arma::solve( arma::trimatl( R_k.t() ) , predictors->crossprod( (*predictorsIdx)(VS_IN_k) , y_k ) ); // we divide by temp later
+        quadForm = arma::dot( tmpVec , tmpVec );
+        
+        logP -= arma::sum( arma::log( R_k.diag() ) ); // 0.5 * log_det( W_k )
     }
     
-    logP += -log(M_PI)*((double)nObservations*(double)nOutcomes*0.5); // normalising constant remaining from the likelhood
-    log_likelihood = logP; // update internal state
+    double a_sigma_k = externalA_sigma + 0.5*(double)nObservations/temperature;
+    double b_sigma_k = externalB_sigma + 0.5* ( arma::dot( y_k , y_k ) - quadForm )/temperature;
     
-    return logP;
-}
-
-double HRR_Chain::logLikelihood( const arma::umat&  externalGammaMask )
-{
-    double logP {0};
+    // arma::log_det(tmp, sign, w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
+    logP -= 0.5 * (double)VS_IN_k.n_elem * log(externalW);
     
-    // yMean is needed if y is not standardized
-    arma::mat yMean = data->cols( *outcomesIdx );
-    for( unsigned k=0; k<nOutcomes; k++)
-    {
-        yMean.col(k) = arma::mean(yMean.col(k)) * arma::ones(nObservations);
-    }
+    logP += externalA_sigma*log(externalB_sigma) - a_sigma_k*log(b_sigma_k);
     
-    #ifdef _OPENMP
-    #pragma omp parallel for default(shared) reduction(+:logP)
-    #endif
+    logP += std::lgamma(a_sigma_k) - std::lgamma(externalA_sigma);
     
-    for( unsigned int k=0; k<nOutcomes; ++k)
+    // posterior predictive - t distribution after shifting and scaling by some quantities; from the multivariate t distribution p(y_tilde |y)
+    if( computeCPO )
     {
-        arma::uvec VS_IN_k = {};
-        if(externalGammaMask.n_rows>0)
-            VS_IN_k = externalGammaMask( arma::find(  externalGammaMask.col(1) == k) , arma::zeros<arma::uvec>(1) );
-        
-        arma::mat W_k;
-        if( preComputedXtX )
+        arma::vec mu_k, x_j;
+        arma::mat X_k; // the selected predictors only, not the whole data rows
+        if( VS_IN_k.n_elem > 0 )
         {
-            switch ( beta_type )
-            {
-                case Beta_Type::gprior :
-                {
-                    W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-            {
-                //W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                break;
-            }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
-            }
+            mu_k = arma::solve( arma::trimatu( R_k ) , tmpVec );
+            X_k = predictors->cols( (*predictorsIdx)(VS_IN_k) );
         }
-        else
+        
+        for( unsigned int j=0; j<nObservations; ++j )
         {
-            switch ( beta_type )
+            double mu_scale, W_scale, t1, t2;
+            
+            mu_scale = (*data)( j , (*outcomesIdx)(k) );
+            W_scale = 1.;
+            
+            if( VS_IN_k.n_elem > 0 )
             {
-                case Beta_Type::gprior :
-                {
-                    W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                    //W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                    break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
+                x_j = X_k.row(j).t();
+                mu_scale -= arma::dot( x_j , mu_k );
+                
+                tmpVec = arma::solve( arma::trimatl( R_k.t() ) , x_j );
+                W_scale += arma::dot( tmpVec , tmpVec );
             }
+            W_scale *= b_sigma_k/a_sigma_k;
+            
+            t1 = std::lgamma(a_sigma_k+0.5) - 0.5*std::log(2.*a_sigma_k*M_PI) - 0.5*std::log( W_scale ) - std::lgamma(a_sigma_k);
+            t2 = -(a_sigma_k+0.5) * std::log( 1. + mu_scale*mu_scale/W_scale/2./a_sigma_k );
+            
+            predLik(j,k) = std::exp( t1+t2 );
         }
-               
-        arma::vec mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * (data->col( (*outcomesIdx)(k) ) - yMean.col(k)) ); // we divide by temp later
-               
-        double a_sigma_k = a_sigma + 0.5*(double)nObservations/temperature;
-        double b_sigma_k = b_sigma + 0.5* arma::as_scalar( (( data->col((*outcomesIdx)(k)) - yMean.col(k) ).t() * (data->col((*outcomesIdx)(k)) - yMean.col(k) )) - ( mu_k.t() * data->cols( (*predictorsIdx)(VS_IN_k) ).t() * ( data->col((*outcomesIdx)(k)) - yMean.col(k) ) ) )/temperature;
-        
-        double sign, tmp; //sign is needed for the implementation, but we 'assume' that all the matrices are (semi-)positive-definite (-> det>=0)
-        arma::log_det(tmp, sign, W_k );
-        logP += 0.5*tmp;
-        
-        // arma::log_det(tmp, sign, w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-        logP -= 0.5 * (double)VS_IN_k.n_elem * log(w);
-        
-        logP += a_sigma*log(b_sigma) - a_sigma_k*log(b_sigma_k);
-        
-        logP += std::lgamma(a_sigma_k) - std::lgamma(a_sigma);
     }
     
-    logP += -log(M_PI)*((double)nObservations*(double)nOutcomes*0.5); // normalising constant remaining from the likelhood
-    return logP;
+    // store in the least recently used slot, unless that one holds the term of the current state and the other doesn't:
+    // that one is pinned, so that a run of rejected proposals for this outcome doesn't evict it
+    unsigned int slot = 1 - logLikKLastSlot[k];
+    if( isCurrentLogLikKEntry( k , logLikKCache[k][slot] ) && !isCurrentLogLikKEntry( k , logLikKCache[k][1-slot] ) )
+        slot = 1 - slot;
+    
+    logLikKLastSlot[k] = slot;
+    LogLikKEntry& entry = logLikKCache[k][slot];
+    
+    entry.VS_IN_k = VS_IN_k;
+    entry.w = externalW;
+    entry.w0 = externalW0;
+    entry.a_sigma = externalA_sigma;
+    entry.b_sigma = externalB_sigma;
+    entry.temperature = temperature;
+    entry.logP = logP;
+    entry.valid = true;
     
+    return logP;
 }
 
-double HRR_Chain::logLikelihood( arma::umat& externalGammaMask , const arma::umat& externalGamma ) // gammaMask , gamma
+double HRR_Chain::logLikelihood( )
 {
     
-    double logP{0};
-    externalGammaMask = createGammaMask(externalGamma);
+    double logP {0};
+    predLik.set_size(nObservations, nOutcomes);
     
-    // yMean is needed if y is not standardized
-    arma::mat yMean = data->cols( *outcomesIdx );
-    for( unsigned k=0; k<nOutcomes; k++)
-    {
-        yMean.col(k) = arma::mean(yMean.col(k)) * arma::ones(nObservations);
-    }
+    bool computeCPO = ( output_CPO && (temperature == 1.) );
     
     #ifdef _OPENMP
     #pragma omp parallel for default(shared) reduction(+:logP)
@@ -1253,86 +1222,28 @@ double HRR_Chain::logLikelihood( arma::umat& externalGammaMask , const arma::uma
     
     for( unsigned int k=0; k<nOutcomes; ++k)
     {
-        arma::uvec VS_IN_k = {};
-        if(externalGammaMask.n_rows>0)
-            VS_IN_k = externalGammaMask( arma::find(  externalGammaMask.col(1) == k) , arma::zeros<arma::uvec>(1) );
-        
-        arma::mat W_k;
-        if( preComputedXtX )
-        {
-            switch ( beta_type )
-            {
-                case Beta_Type::gprior :
-                {
-                    W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                  //W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                  W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature +  arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                  break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
-            }
-        }
-        else
-        {
-            switch ( beta_type )
-            {
-                case Beta_Type::gprior :
-                {
-                    W_k = (w*temperature)/(w+temperature) * arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                  //W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                  W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature +  arma::diagmat( arma::join_cols(1./w0*arma::ones(nFixedPredictors),1./w*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                  break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
-            }
-        }
-               
-        arma::vec mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * (data->col( (*outcomesIdx)(k) ) - yMean.col(k)) ); // we divide by temp later
-               
-        double a_sigma_k = a_sigma + 0.5*(double)nObservations/temperature;
-        double b_sigma_k = b_sigma + 0.5* arma::as_scalar( (( data->col((*outcomesIdx)(k)) - yMean.col(k) ).t() * (data->col((*outcomesIdx)(k)) - yMean.col(k) )) - ( mu_k.t() * data->cols( (*predictorsIdx)(VS_IN_k) ).t() * ( data->col((*outcomesIdx)(k)) - yMean.col(k) ) ) )/temperature;
-        
-        double sign, tmp; //sign is needed for the implementation, but we 'assume' that all the matrices are (semi-)positive-definite (-> det>=0)
-        arma::log_det(tmp, sign, W_k );
-        logP += 0.5*tmp;
-        
-        // arma::log_det(tmp, sign, w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-        logP -= 0.5 * (double)VS_IN_k.n_elem * log(w);
-        
-        logP += a_sigma*log(b_sigma) - a_sigma_k*log(b_sigma_k);
+        arma::uvec VS_IN_k = {}; // be sure it's empty by default
+        if(gammaMask.n_rows>0)
+            VS_IN_k = gammaMask( arma::find(  gammaMask.col(1) == k) , arma::zeros<arma::uvec>(1) );
         
-        logP += std::lgamma(a_sigma_k) - std::lgamma(a_sigma);
+        logP += logLikelihoodK( k , VS_IN_k , w , w0 , a_sigma , b_sigma , computeCPO );
     }
     
     logP += -log(M_PI)*((double)nObservations*(double)nOutcomes*0.5); // normalising constant remaining from the likelhood
-    return logP;
+    log_likelihood = logP; // update internal state
     
+    return logP;
+}
+
+double HRR_Chain::logLikelihood( const arma::umat&  externalGammaMask )
+{
+    return logLikelihood( externalGammaMask , w , w0 , a_sigma , b_sigma );
+}
+
+double HRR_Chain::logLikelihood( arma::umat& externalGammaMask , const arma::umat& externalGamma ) // gammaMask , gamma
+{
+    externalGammaMask = createGammaMask(externalGamma);
+    return logLikelihood( externalGammaMask , w , w0 , a_sigma , b_sigma );
 }
 
 double HRR_Chain::logLikelihood( const arma::umat& externalGammaMask , const double externalW, const double externalW0 , const double externalA_sigma, const double externalB_sigma)
@@ -1340,13 +1251,6 @@ double HRR_Chain::logLikelihood( const arma::umat& externalGammaMask , const dou
     
     double logP{0};
     
-    // yMean is needed if y is not standardized
-    arma::mat yMean = data->cols( *outcomesIdx );
-    for( unsigned k=0; k<nOutcomes; k++)
-    {
-        yMean.col(k) = arma::mean(yMean.col(k)) * arma::ones(nObservations);
-    }
-   
     #ifdef _OPENMP
     #pragma omp parallel for default(shared) reduction(+:logP)
     #endif
@@ -1357,77 +1261,7 @@ double HRR_Chain::logLikelihood( const arma::umat& externalGammaMask , const dou
         if(externalGammaMask.n_rows>0)
             VS_IN_k = externalGammaMask( arma::find(  externalGammaMask.col(1) == k) , arma::zeros<arma::uvec>(1) );
         
-        arma::mat W_k;
-        if( preComputedXtX )
-        {
-            switch ( beta_type )
-            {
-                case Beta_Type::gprior :
-                {
-                    W_k = (externalW*temperature)/(externalW+temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./externalW * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                    // W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + 1./externalW * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    W_k = arma::inv_sympd( XtX(VS_IN_k,VS_IN_k)/temperature + arma::diagmat( arma::join_cols(1./externalW0*arma::ones(nFixedPredictors),1./externalW*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                    break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
-            }
-        }
-        else
-        {
-            switch ( beta_type )
-            {
-                case Beta_Type::gprior :
-                {
-                    W_k = (externalW*temperature)/(externalW+temperature) * arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) );
-                    break;
-                }
-                    
-                case Beta_Type::independent :
-                {
-                    W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./externalW * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                    break;
-                }
-                    
-                case Beta_Type::reGroup :
-                {
-                  //W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + 1./externalW * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                  W_k = arma::inv_sympd( ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) )/temperature + arma::diagmat( arma::join_cols(1./externalW0*arma::ones(nFixedPredictors),1./externalW*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                  break;
-                }
-                    
-                default:
-                    throw Bad_Beta_Type ( beta_type );
-            }
-        }
-               
-        arma::vec mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * (data->col( (*outcomesIdx)(k) ) - yMean.col(k)) ); // we divide by temp later
-               
-        double a_sigma_k = externalA_sigma + 0.5*(double)nObservations/temperature;
-        double b_sigma_k = externalB_sigma + 0.5* arma::as_scalar( (( data->col((*outcomesIdx)(k)) - yMean.col(k) ).t() * (data->col((*outcomesIdx)(k)) - yMean.col(k) )) - ( mu_k.t() * data->cols( (*predictorsIdx)(VS_IN_k) ).t() * ( data->col((*outcomesIdx)(k)) - yMean.col(k) ) ) )/temperature;
-        
-        double sign, tmp; //sign is needed for the implementation, but we 'assume' that all the matrices are (semi-)positive-definite (-> det>=0)
-        arma::log_det(tmp, sign, W_k );
-        logP += 0.5*tmp;
-        
-        // arma::log_det(tmp, sign, w * arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-        logP -= 0.5 * (double)VS_IN_k.n_elem * log(externalW);
-        
-        logP += externalA_sigma*log(externalB_sigma) - a_sigma_k*log(b_sigma_k);
-        
-        logP += std::lgamma(a_sigma_k) - std::lgamma(externalA_sigma);
+        logP += logLikelihoodK( k , VS_IN_k , externalW , externalW0 , externalA_sigma , externalB_sigma );
     }
     
     logP += -log(M_PI)*((double)nObservations*(double)nOutcomes*0.5); // initialise with the normalising constant remaining from the likelhood
@@ -1446,76 +1280,58 @@ double HRR_Chain::gammaBanditProposal( arma::umat& mutantGamma , arma::uvec& upd
     // decide on one outcome
     outcomeUpdateIdx = randIntUniform(0,nOutcomes-1);
     
-    // Sample Zs (only for relevant outocome)
-    for(unsigned int i=0; i<nVSPredictors; ++i)
-    {
-        banditZeta(i) = randBeta(banditAlpha(i,outcomeUpdateIdx),banditAlpha(i,outcomeUpdateIdx));
-    }
-    
-    // Create mismatch (only for relevant outcome)
-    for(unsigned int i=0; i<nVSPredictors; ++i)
-    {
-        mismatch(i) = (mutantGamma(i,outcomeUpdateIdx)==0)?(banditZeta(i)):(1.-banditZeta(i));   //mismatch
-    }
-    
-    // Normalise
-    // mismatch = arma::log(mismatch); //logscale ??? TODO
-    // normalised_mismatch = mismatch - Utils::logspace_add(mismatch);
-    
-    normalised_mismatch = mismatch / arma::as_scalar(arma::sum(mismatch));
+    // mismatch weights for the relevant outcome, after refreshing a few of its zetas
+    Utils::SumTree& mismatch = banditMismatchTree( outcomeUpdateIdx );
+    banditRefreshZeta( outcomeUpdateIdx );
     
     if( randU01() < 0.5 )   // one deterministic update
     {
-        
         // Decide which to update
         updateIdx = arma::zeros<arma::uvec>(1);
-        updateIdx(0) = Distributions::randWeightedIndexSampleWithoutReplacement(nVSPredictors,normalised_mismatch); // sample the one
+        updateIdx(0) = mismatch.sample(); // sample the one
         
         // Update
         mutantGamma(updateIdx(0),outcomeUpdateIdx) = 1 - gamma(updateIdx(0),outcomeUpdateIdx); // deterministic, just switch
         
-        // Compute logProposalRatio probabilities
-        normalised_mismatch_backwards = mismatch;
-        normalised_mismatch_backwards(updateIdx(0)) = 1. - normalised_mismatch_backwards(updateIdx(0)) ;
-        
-        // normalised_mismatch_backwards = normalised_mismatch_backwards - Utils::logspace_add(normalised_mismatch_backwards);
-        normalised_mismatch_backwards = normalised_mismatch_backwards / arma::as_scalar(arma::sum(normalised_mismatch_backwards));
+        // Compute logProposalRatio probabilities, backwards only the switched weight changes ( to 1-w )
+        double w_j = mismatch.weight(updateIdx(0));
         
-        logProposalRatio = ( std::log( normalised_mismatch_backwards(updateIdx(0)) ) ) -
-        ( std::log( normalised_mismatch(updateIdx(0)) ) );
+        logProposalRatio = ( std::log( 1. - w_j ) - std::log( mismatch.sum() - w_j + (1. - w_j) ) ) -
+        ( std::log( w_j ) - std::log( mismatch.sum() ) );
         
     }else{
         
         /*
          n_updates_bandit random (bern) updates
-         Note that we make use of column indexing here for armadillo matrices
+         The indexes are drawn sequentially without replacement, but the proposal probabilities are those of the
+         (unordered) set of indexes, computed in O(n_updates_bandit) -- the backward one being the same set under the mismatch of mutantGamma
          */
         
-        logProposalRatio = 0.;
-        // Decide which to update
-        updateIdx = arma::zeros<arma::uvec>(n_updates_bandit);
-        updateIdx = Distributions::randWeightedIndexSampleWithoutReplacement(nVSPredictors,normalised_mismatch,n_updates_bandit); // sample n_updates_bandit indexes
+        unsigned int nUpdates = std::min( n_updates_bandit , nVSPredictors );
+        mismatch.sampleWithoutReplacement( nUpdates , updateIdx ); // sample n_updates_bandit indexes
         
-        normalised_mismatch_backwards = mismatch; // copy for backward proposal
+        arma::vec forwardWeights(nUpdates), backwardWeights(nUpdates);
+        
+        logProposalRatio = 0.;
         
         // Update
-        for(unsigned int i=0; i<n_updates_bandit; ++i)
+        for(unsigned int i=0; i<nUpdates; ++i)
         {
-            mutantGamma(updateIdx(i),outcomeUpdateIdx) = randBernoulli(banditZeta(updateIdx(i))); // random update
+            double zeta_i = banditZeta(updateIdx(i),outcomeUpdateIdx);
+            mutantGamma(updateIdx(i),outcomeUpdateIdx) = randBernoulli(zeta_i); // random update
             
-            normalised_mismatch_backwards(updateIdx(i)) = 1.- normalised_mismatch_backwards(updateIdx(i));
+            forwardWeights(i) = mismatch.weight(updateIdx(i));
+            backwardWeights(i) = ( mutantGamma(updateIdx(i),outcomeUpdateIdx) == 0 ) ? zeta_i : 1. - zeta_i ;
             
-            logProposalRatio += Distributions::logPDFBernoulli(gamma(updateIdx(i),outcomeUpdateIdx),banditZeta(updateIdx(i))) -
-            Distributions::logPDFBernoulli(mutantGamma(updateIdx(i),outcomeUpdateIdx),banditZeta(updateIdx(i)));
+            logProposalRatio += Distributions::logPDFBernoulli(gamma(updateIdx(i),outcomeUpdateIdx),zeta_i) -
+            Distributions::logPDFBernoulli(mutantGamma(updateIdx(i),outcomeUpdateIdx),zeta_i);
         }
-        // note that above I might be resampling a value equal to the current one, thus not updating da facto ... TODO
         
-        // Compute logProposalRatio probabilities
-        // normalised_mismatch_backwards = normalised_mismatch_backwards - Utils::logspace_add(normalised_mismatch_backwards);
-        normalised_mismatch_backwards = normalised_mismatch_backwards / arma::as_scalar(arma::sum(normalised_mismatch_backwards));
+        // the weights of the non-selected indexes are the same in both directions
+        double otherWeights = std::max( mismatch.sum() - arma::sum(forwardWeights) , 0. );
         
-        logProposalRatio += Distributions::logPDFWeightedIndexSampleWithoutReplacement(normalised_mismatch_backwards,updateIdx) -
-        Distributions::logPDFWeightedIndexSampleWithoutReplacement(normalised_mismatch,updateIdx);
+        logProposalRatio += Distributions::logPDFWeightedSetSampleWithoutReplacement( backwardWeights , otherWeights ) -
+        Distributions::logPDFWeightedSetSampleWithoutReplacement( forwardWeights , otherWeights );
     }
     
     return logProposalRatio; // pass this to the outside
@@ -1548,25 +1364,23 @@ void HRR_Chain::stepOneO()
 {
     
     unsigned int k = randIntUniform(0,nOutcomes-1);
-    arma::vec proposedO = o;
-    
-    double proposedOPrior, proposedGammaPrior, logAccProb;
+    double proposedOk, proposedOPrior, proposedGammaPrior, logAccProb;
     
-    proposedO(k) = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
+    proposedOk = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
     
-    if( arma::all( ( pi * proposedO(k) ) <= 1 ) )
+    if( pi.max() * proposedOk <= 1 )
     {
-        proposedOPrior = logPO( proposedO );
-        proposedGammaPrior = logPGamma( gamma, proposedO, pi);
+        proposedOPrior = logP_o + logPODelta( k , proposedOk );
+        proposedGammaPrior = logP_gamma + logPGammaODelta( k , proposedOk );
         
         // A/R
-        logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedO(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedO(k) ) ) -
-        Distributions::logPDFTruncNorm( std::log( proposedO(k) ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
+        logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedOk ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedOk ) ) -
+        Distributions::logPDFTruncNorm( std::log( proposedOk ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
         logAccProb += (proposedOPrior + proposedGammaPrior) - (logP_o + logP_gamma);
         
         if( randLogU01() < logAccProb )
         {
-            o(k) = proposedO(k);
+            o(k) = proposedOk;
             logP_o = proposedOPrior;
             logP_gamma = proposedGammaPrior;
             
@@ -1579,35 +1393,31 @@ void HRR_Chain::stepOneO()
 void HRR_Chain::stepO()
 {
     
-    arma::vec proposedO = o;
-    
-    double proposedOPrior, proposedGammaPrior, logAccProb;
+    double proposedOk, proposedOPrior, proposedGammaPrior, logAccProb;
     
     for( unsigned int k=0; k<nOutcomes ; ++k )
     {
-        proposedO(k) = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
+        proposedOk = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
         
-        if( arma::all( ( pi * proposedO(k) ) <= 1 ) )
+        if( pi.max() * proposedOk <= 1 )
         {
-            proposedOPrior = logPO( proposedO );
-            proposedGammaPrior = logPGamma( gamma, proposedO, pi);
+            proposedOPrior = logP_o + logPODelta( k , proposedOk );
+            proposedGammaPrior = logP_gamma + logPGammaODelta( k , proposedOk );
             
             // A/R
-            logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedO(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedO(k) ) ) -
-            Distributions::logPDFTruncNorm( std::log( proposedO(k) ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
+            logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedOk ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedOk ) ) -
+            Distributions::logPDFTruncNorm( std::log( proposedOk ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
             logAccProb += (proposedOPrior + proposedGammaPrior) - (logP_o + logP_gamma);
             
             if( randLogU01() < logAccProb )
             {
-                o(k) = proposedO(k);
+                o(k) = proposedOk;
                 logP_o = proposedOPrior;
                 logP_gamma = proposedGammaPrior;
                 
                 o_acc_count += o_acc_count / (double)nOutcomes;
-            }else
-                proposedO(k) = o(k);
-        }else
-            proposedO(k) = o(k);
+            }
+        }
     }
     
 }
@@ -1621,22 +1431,22 @@ void HRR_Chain::stepOnePi()
     {
         case Gamma_Type::hotspot :
         {
-            arma::vec proposedPi = pi;
+            double proposedPij;
             double proposedPiPrior, proposedGammaPrior, logAccProb;
             
-            proposedPi(j) = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
+            proposedPij = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
             
-            if( arma::all( ( o * proposedPi(j) ) <= 1 ) )
+            if( o.max() * proposedPij <= 1 )
             {
-                proposedPiPrior = logPPi( proposedPi );
-                proposedGammaPrior = logPGamma( gamma, o, proposedPi);
+                proposedPiPrior = logP_pi + logPPiDelta( j , proposedPij );
+                proposedGammaPrior = logP_gamma + logPGammaPiDelta( j , proposedPij );
                 
                 // A/R
                 logAccProb = (proposedPiPrior + proposedGammaPrior) - (logP_pi + logP_gamma);
                 
                 if( randLogU01() < logAccProb )
                 {
-                    pi(j) = proposedPi(j);
+                    pi(j) = proposedPij;
                     logP_pi = proposedPiPrior;
                     logP_gamma = proposedGammaPrior;
                     
@@ -1665,31 +1475,29 @@ void HRR_Chain::stepPi()
     {
         case Gamma_Type::hotspot :
         {
-            arma::vec proposedPi = pi;
+            double proposedPij;
             double proposedPiPrior, proposedGammaPrior, logAccProb;
             for( unsigned int j=0; j < nVSPredictors ; ++j )
             {
-                proposedPi(j) = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
+                proposedPij = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
                 
-                if( arma::all( ( o * proposedPi(j) ) <= 1 ) )
+                if( o.max() * proposedPij <= 1 )
                 {
-                    proposedPiPrior = logPPi( proposedPi );
-                    proposedGammaPrior = logPGamma( gamma, o, proposedPi);
+                    proposedPiPrior = logP_pi + logPPiDelta( j , proposedPij );
+                    proposedGammaPrior = logP_gamma + logPGammaPiDelta( j , proposedPij );
                     
                     // A/R
                     logAccProb = (proposedPiPrior + proposedGammaPrior) - (logP_pi + logP_gamma);
                     
                     if( randLogU01() < logAccProb )
                     {
-                        pi(j) = proposedPi(j);
+                        pi(j) = proposedPij;
                         logP_pi = proposedPiPrior;
                         logP_gamma = proposedGammaPrior;
                         
                         pi_acc_count += pi_acc_count / (double)nVSPredictors;
-                    }else
-                        proposedPi(j) = pi(j);
-                }else
-                    proposedPi(j) = pi(j);
+                    }
+                }
             }
             break;
         }
@@ -1781,7 +1589,12 @@ void HRR_Chain::stepGamma()
     
     // note only one outcome is updated
     // update log probabilities
-    double proposedGammaPrior = logPGamma( proposedGamma );
+    // the MRF prior changes only through the edges incident to the flipped entries, no need to go through the whole graph
+    double proposedGammaPrior;
+    if( gamma_type == Gamma_Type::mrf )
+        proposedGammaPrior = logP_gamma + mrfGraph.logPDelta( gamma , proposedGamma , updateIdx + outcomeUpdateIdx * nVSPredictors , mrf_d , mrf_e );
+    else
+        proposedGammaPrior = logPGamma( proposedGamma );
     double proposedLikelihood = logLikelihood( proposedGammaMask );
     
     double logAccProb = logProposalRatio +
@@ -1805,6 +1618,8 @@ void HRR_Chain::stepGamma()
     // after A/R, update bandit Related variables
     if( gamma_sampler_type == Gamma_Sampler_Type::bandit )
     {
+        banditUpdateMismatch( outcomeUpdateIdx , updateIdx );
+        
         for(arma::uvec::iterator iter = updateIdx.begin(); iter != updateIdx.end(); ++iter)
         {
             // FINITE UPDATE
@@ -2390,26 +2205,159 @@ void HRR_Chain::updateGammaMask()
 // Bandit-sampling related methods
 void HRR_Chain::banditInit()// initialise all the private memebers
 {
-    banditZeta = arma::vec(nVSPredictors);
-    
     banditAlpha = arma::mat(nVSPredictors,nOutcomes);
     banditAlpha.fill( 0.5 );
     
     banditBeta = arma::mat(nVSPredictors,nOutcomes);
     banditBeta.fill( 0.5 );
     
-    mismatch = arma::vec(nVSPredictors);
-    normalised_mismatch = arma::vec(nVSPredictors);
-    normalised_mismatch_backwards = arma::vec(nVSPredictors);
+    banditZeta = arma::mat(nVSPredictors,nOutcomes);
+    for( unsigned int k=0; k<nOutcomes; ++k )
+        banditZeta.col(k) = randVecBeta( banditAlpha.col(k) , banditBeta.col(k) );
+    
+    banditResetMismatch();
     
-    n_updates_bandit = 4; // this needs to be low as its O(n_updates!)
+    n_updates_bandit = 4; // proposal cost is O(n_updates log p), this can be raised (to 20-50) for large p
+    n_refresh_bandit = std::min( 32u , nVSPredictors ); // arbitrary, trades freshness of the zetas against cost per step
     
     banditLimit = (double)nObservations;
     banditIncrement = 1.;
 }
 
+Utils::SumTree& HRR_Chain::banditMismatchTree( unsigned int k )
+{
+    if( banditMismatch[k].size() == 0 )
+    {
+        arma::vec weights = banditZeta.col(k);
+        for( unsigned int i=0; i<nVSPredictors; ++i )
+            if( gamma(i,k) != 0 )
+                weights(i) = 1. - weights(i);
+        
+        banditMismatch[k].build( weights );
+    }
+    
+    return banditMismatch[k];
+}
+
+void HRR_Chain::banditResetMismatch()
+{
+    banditMismatch = std::vector<Utils::SumTree>(nOutcomes); // empty trees, rebuilt on demand
+}
+
+// gamma(idx,k) might have changed, zetas haven't
+void HRR_Chain::banditUpdateMismatch( unsigned int k , const arma::uvec& idx )
+{
+    if( banditMismatch[k].size() == 0 )
+        return;
+    
+    for( auto i : idx )
+        banditMismatch[k].update( i , ( gamma(i,k) == 0 ) ? banditZeta(i,k) : 1. - banditZeta(i,k) );
+}
+
+// Gibbs refresh of n_refresh_bandit zetas from their Beta. The zetas are independent of everything else, so this is valid
+// as long as which ones are refreshed does not depend on their values
+void HRR_Chain::banditRefreshZeta( unsigned int k )
+{
+    Utils::SumTree& mismatch = banditMismatchTree( k );
+    
+    for( unsigned int r=0; r<n_refresh_bandit; ++r )
+    {
+        unsigned int i = randIntUniform(0,nVSPredictors-1);
+        banditZeta(i,k) = randBeta( banditAlpha(i,k) , banditBeta(i,k) );
+        mismatch.update( i , ( gamma(i,k) == 0 ) ? banditZeta(i,k) : 1. - banditZeta(i,k) );
+    }
+}
+
 // MC3 init
 void HRR_Chain::MC3Init()
 {
     n_updates_MC3 = std::ceil( nVSPredictors/40 ); //arbitrary number, should I use something different?
 }
+
+// *******************************
+// Checkpointing
+// *******************************
+
+// everything that evolves during the run (or is set after construction), in a fixed order;
+// data and what is derived from it (XtX, corrMatX, the Gram cache) are rebuilt with the chain instead
+template<typename Archive>
+void HRR_Chain::checkpointState( Archive& ar )
+{
+    ar.match( nObservations ); ar.match( nOutcomes ); ar.match( nVSPredictors ); ar.match( nFixedPredictors );
+    ar.match( covariance_type ); ar.match( gamma_type ); ar.match( beta_type ); ar.match( gamma_sampler_type );
+    
+    ar.io( gammaMask );
+    
+    // cached per-outcome log-likelihoods, so that hits and misses after a resume are the same as in the original run
+    uint64_t nCached = logLikKCache.size();
+    ar.io( nCached );
+    logLikKCache.resize( nCached );
+    for( auto& slots : logLikKCache )
+        for( auto& entry : slots )
+        {
+            ar.io( entry.VS_IN_k );
+            ar.io( entry.w ); ar.io( entry.w0 ); ar.io( entry.a_sigma ); ar.io( entry.b_sigma ); ar.io( entry.temperature );
+            ar.io( entry.logP ); ar.io( entry.valid );
+        }
+    ar.io( logLikKLastSlot );
+    
+    ar.io( temperature ); ar.io( internalIterationCounter );
+    
+    // adaptation
+    ar.io( wEmpiricalMean ); ar.io( oEmpiricalMean ); ar.io( piEmpiricalMean );
+    ar.io( wEmpiricalM2 ); ar.io( oEmpiricalM2 ); ar.io( piEmpiricalM2 );
+    ar.io( var_w_proposal_init ); ar.io( var_o_proposal_init ); ar.io( var_pi_proposal_init );
+    ar.io( w0EmpiricalMean ); ar.io( w0EmpiricalM2 ); ar.io( var_w0_proposal_init );
+    
+    // bandit, the mismatch trees are rebuilt from zeta and gamma (bit-identical, see Utils::SumTree)
+    ar.io( n_updates_bandit ); ar.io( n_refresh_bandit );
+    ar.io( banditZeta ); ar.io( banditAlpha ); ar.io( banditBeta );
+    ar.io( banditLimit ); ar.io( banditIncrement );
+    
+    // parameters
+    ar.io( o ); ar.io( a_o ); ar.io( b_o ); ar.io( var_o_proposal ); ar.io( o_acc_count ); ar.io( logP_o );
+    ar.io( pi ); ar.io( a_pi ); ar.io( b_pi ); ar.io( var_pi_proposal ); ar.io( pi_acc_count ); ar.io( logP_pi );
+    ar.io( mrf_d ); ar.io( mrf_e );
+    ar.io( gamma ); ar.io( n_updates_MC3 ); ar.io( gamma_acc_count ); ar.io( logP_gamma );
+    ar.io( a_sigma ); ar.io( b_sigma );
+    ar.io( w ); ar.io( var_w_proposal ); ar.io( w_acc_count ); ar.io( a_w ); ar.io( b_w ); ar.io( logP_w );
+    ar.io( w0 ); ar.io( var_w0_proposal ); ar.io( w0_acc_count ); ar.io( a_w0 ); ar.io( b_w0 ); ar.io( logP_w0 );
+    
+    ar.io( log_likelihood ); ar.io( predLik );
+}
+
+void HRR_Chain::saveState( CheckpointWriter& ar )
+{
+    checkpointState( ar );
+}
+
+void HRR_Chain::loadState( CheckpointReader& ar )
+{
+    checkpointState( ar );
+    banditResetMismatch();
+}
+
+// what the output and the progress messages read off the cold chain, a small part of the state above
+// (getBeta draws from gamma, w and w0)
+template<typename Archive>
+void HRR_Chain::outputState( Archive& ar )
+{
+    ar.io( temperature ); ar.io( internalIterationCounter );
+    ar.io( o ); ar.io( logP_o );
+    ar.io( pi ); ar.io( logP_pi );
+    ar.io( gamma ); ar.io( gamma_acc_count ); ar.io( logP_gamma );
+    ar.io( w ); ar.io( var_w_proposal ); ar.io( logP_w );
+    ar.io( w0 ); ar.io( logP_w0 );
+    
+    ar.io( log_likelihood ); ar.io( predLik );
+}
+
+void HRR_Chain::saveOutputState( CheckpointWriter& ar )
+{
+    outputState( ar );
+}
+
+void HRR_Chain::loadOutputState( CheckpointReader& ar )
+{
+    outputState( ar );
+}
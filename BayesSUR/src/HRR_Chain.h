@@ -4,10 +4,13 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <array>
+#include <algorithm>
 
 #include "utils.h"
 #include "distr.h"
 #include "junction_tree.h"
+#include "checkpoint.h"
 
 #include "ESS_Atom.h"
 #include "Parameter_types.h"
@@ -35,7 +38,7 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
             std::shared_ptr<arma::uvec> fixedPredictorIdx_, std::shared_ptr<arma::umat> missingDataArrayIdx_, std::shared_ptr<arma::uvec> completeCases_, 
             Gamma_Sampler_Type gamma_sampler_type_ , Gamma_Type gamma_type_ ,
             Beta_Type beta_type_ , Covariance_Type covariance_type_ , bool output_CPO = false, int maxThreads = 1,
-            double externalTemperature = 1. );
+            double externalTemperature = 1. , std::shared_ptr<GramCache> gramCache_ = nullptr , std::shared_ptr<PredictorMatrix> predictors_ = nullptr );
 
         HRR_Chain( Utils::SUR_Data& surData,
             Gamma_Sampler_Type gamma_sampler_type_ , Gamma_Type gamma_type_ ,
@@ -99,15 +102,6 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
         arma::mat& getBanditBeta();
         void setBanditBeta( arma::mat );
         
-        arma::vec& getBanditMismatch();
-        void setBanditMismatch( arma::vec );
-
-        arma::vec& getBanditNormalisedMismatch();
-        void setBanditNormalisedMismatch( arma::vec );
-        
-        arma::vec& getBanditNormalisedMismatchBackwards();
-        void setBanditNormalisedMismatchBackwards( arma::vec );
-        
         // Parameter states etc
 
         double getSigmaA() const; 
@@ -317,6 +311,12 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
         double logPGamma( const arma::umat& , const arma::vec& );
         double logPGamma( const arma::umat& , double , double );
 
+        // change in the o / pi / gamma log-priors when only o_k or pi_j moves
+        double logPODelta( unsigned int , double );
+        double logPPiDelta( unsigned int , double );
+        double logPGammaODelta( unsigned int , double );
+        double logPGammaPiDelta( unsigned int , double );
+
         // W
         double logPW( );
         double logPW( double );
@@ -343,6 +343,9 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
         // with full arguments for computing using different values
         double logLikelihood( const arma::umat& , const double , const double , const double , const double); //gammaMask , w, w0, a_sigma, b_sigma
 
+        // marginal likelihood term of a single outcome (cached), optionally filling its column of predLik
+        double logLikelihoodK( const unsigned int , const arma::uvec& , const double , const double , const double , const double , bool computeCPO = false ); // k, VS_IN_k, w, w0, a_sigma, b_sigma
+
 
         // *********************
         // STEP FUNCTION - PERFORM ONE ITERATION FOR THE CHAIN
@@ -367,6 +370,13 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
 
         // update all the internal proposal RW variances based on their acceptance rate
         void updateProposalVariances();
+
+        // save/restore the whole state of the chain (but not the data) for checkpoint and resume
+        void saveState( CheckpointWriter& );
+        void loadState( CheckpointReader& );
+        // save/restore only what the output reads, to follow the cold chain from another process
+        void saveOutputState( CheckpointWriter& );
+        void loadOutputState( CheckpointReader& );
         // more complex functions could be defined outide
         // through public methods but this as a baseline is good to have.
 
@@ -409,7 +419,9 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
 
         // Data (and related quatities)
         std::shared_ptr<arma::mat> data;
+        std::shared_ptr<PredictorMatrix> predictors; // X'y, X'X and X*beta go through this, see predictor_matrix.h
         std::shared_ptr<arma::mat> mrfG;
+        Utils::MRFGraph mrfGraph; // CSR adjacency of mrfG, built in mrfGInit
         std::shared_ptr<arma::uvec> outcomesIdx;
 
         std::shared_ptr<arma::uvec> predictorsIdx;
@@ -419,12 +431,28 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
         std::shared_ptr<arma::umat> missingDataArrayIdx;
         std::shared_ptr<arma::uvec> completeCases;
 
+        template<typename Archive> void checkpointState( Archive& ); // describes the checkpoint, see saveState/loadState
+        template<typename Archive> void outputState( Archive& ); // see saveOutputState/loadOutputState
+
         // these are pointers cause they will live on outside the MCMC
         
         bool preComputedXtX;
+        std::shared_ptr<GramCache> gramCache; // used for X'X when this is too big to be precomputed
         arma::mat XtX;
         void setXtX();
 
+        // per-outcome cache for logLikelihoodK
+        struct LogLikKEntry
+        {
+            arma::uvec VS_IN_k;
+            double w, w0, a_sigma, b_sigma, temperature;
+            double logP;
+            bool valid = false;
+        };
+        std::vector<std::array<LogLikKEntry,2>> logLikKCache;
+        std::vector<unsigned int> logLikKLastSlot; // slot used last, for each outcome
+        bool isCurrentLogLikKEntry( const unsigned int , const LogLikKEntry& ) const; // does it hold the term of the chain's current state?
+
         unsigned int nObservations; // number of samples
         unsigned int nOutcomes; // number of outcomes
         unsigned int nVSPredictors; // number of predictors to be selected
@@ -456,9 +484,16 @@ class HRR_Chain : public ESS_Atom<HRR_Chain>
         arma::mat banditZeta;
         arma::mat banditAlpha;
         arma::mat banditBeta;
-        arma::vec mismatch;
-        arma::vec normalised_mismatch;
-        arma::vec normalised_mismatch_backwards;
+
+        // mismatch weights ( zeta if gamma is 0, 1-zeta otherwise ), one sum tree per outcome over the persistent zetas
+        // so that each bandit proposal is O(log p); a tree is (re)built lazily when gamma is changed outside stepGamma
+        std::vector<Utils::SumTree> banditMismatch;
+        unsigned int n_refresh_bandit; // zetas redrawn at each proposal, chosen uniformly at random
+
+        Utils::SumTree& banditMismatchTree( unsigned int k );
+        void banditResetMismatch();
+        void banditUpdateMismatch( unsigned int k , const arma::uvec& idx );
+        void banditRefreshZeta( unsigned int k );
 
         double banditLimit;
         double banditIncrement;
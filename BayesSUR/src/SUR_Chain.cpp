@@ -11,8 +11,8 @@ SUR_Chain::SUR_Chain( std::shared_ptr<arma::mat> data_, std::shared_ptr<arma::ma
                      std::shared_ptr<arma::uvec> fixedPredictorsIdx_, std::shared_ptr<arma::umat> missingDataArrayIdx_, std::shared_ptr<arma::uvec> completeCases_,
                      Gamma_Sampler_Type gamma_sampler_type_ , Gamma_Type gamma_type_ ,
                      Beta_Type beta_type_ , Covariance_Type covariance_type_ , bool output_CPO , int maxThreads ,
-                     double externalTemperature ):
-data(data_), mrfG(mrfG_), outcomesIdx(outcomesIdx_), VSPredictorsIdx(VSPredictorsIdx_), fixedPredictorsIdx(fixedPredictorsIdx_),
+                     double externalTemperature , std::shared_ptr<GramCache> gramCache_ , std::shared_ptr<PredictorMatrix> predictors_ ):
+data(data_), predictors(predictors_), mrfG(mrfG_), outcomesIdx(outcomesIdx_), VSPredictorsIdx(VSPredictorsIdx_), fixedPredictorsIdx(fixedPredictorsIdx_),
 missingDataArrayIdx(missingDataArrayIdx_), completeCases(completeCases_),
 nObservations(nObservations_), nOutcomes(nOutcomes_), nVSPredictors(nVSPredictors_), nFixedPredictors(nFixedPredictors_),
 temperature(externalTemperature),internalIterationCounter(0),jtStartIteration(0),
@@ -20,7 +20,11 @@ covariance_type(covariance_type_), gamma_type(gamma_type_),beta_type(beta_type_)
 {
     
     predictorsIdx = std::make_shared<arma::uvec>(arma::join_vert( *fixedPredictorsIdx, *VSPredictorsIdx ));
+    if( !predictors )
+        predictors = std::make_shared<PredictorMatrix>( data );
+    gramCache = gramCache_ ? gramCache_ : std::make_shared<GramCache>( predictors , predictorsIdx );
     setXtX();
+    betaKFactor = std::vector<BetaKFactor>(nOutcomes);
     
     switch ( gamma_sampler_type )
     {
@@ -87,13 +91,13 @@ SUR_Chain::SUR_Chain( Utils::SUR_Data& surData,
                      double externalTemperature ):
 SUR_Chain(surData.data,surData.mrfG,surData.nObservations,surData.nOutcomes,surData.nVSPredictors,surData.nFixedPredictors,
 surData.outcomesIdx,surData.VSPredictorsIdx,surData.fixedPredictorsIdx,surData.missingDataArrayIdx,surData.completeCases,
-          gamma_sampler_type_,gamma_type_,beta_type_,covariance_type_,output_CPO,maxThreads,externalTemperature){ }
+          gamma_sampler_type_,gamma_type_,beta_type_,covariance_type_,output_CPO,maxThreads,externalTemperature,surData.gramCache,surData.predictors){ }
 
 SUR_Chain::SUR_Chain( Utils::SUR_Data& surData, double externalTemperature ):
 SUR_Chain(surData.data,surData.mrfG,surData.nObservations,surData.nOutcomes,surData.nVSPredictors,surData.nFixedPredictors,
 surData.outcomesIdx,surData.VSPredictorsIdx,surData.fixedPredictorsIdx,surData.missingDataArrayIdx,surData.completeCases,
           Gamma_Sampler_Type::bandit , Gamma_Type::hotspot , Beta_Type::independent , Covariance_Type::HIW , false,
-          externalTemperature){ }
+          1 , externalTemperature , surData.gramCache , surData.predictors){ }
 
 
 // *******************************
@@ -103,12 +107,12 @@ surData.outcomesIdx,surData.VSPredictorsIdx,surData.fixedPredictorsIdx,surData.m
 void SUR_Chain::setXtX()
 {
     
-    // Compute XtX
-    if( (nFixedPredictors+nVSPredictors) < 5000 )  // kinda arbitrary value, how can we assess a more sensible one?
+    // Compute XtX fully if it fits in the memory budget, otherwise its tiles are computed (and cached) on demand by gramCache
+    if( gramCache->fitsInBudget() )
     {
         preComputedXtX = true;
-        XtX = data->cols( *predictorsIdx ).t() * data->cols( *predictorsIdx );
-        corrMatX = arma::cor( data->submat(arma::regspace<arma::uvec>(0,nObservations-1), *VSPredictorsIdx ) );  // this is only for values to be selected
+        XtX = predictors->gram( *predictorsIdx , *predictorsIdx );
+        corrMatX = predictors->cor( *VSPredictorsIdx , *VSPredictorsIdx );  // this is only for values to be selected
     }else{
         
         preComputedXtX = false;
@@ -117,6 +121,14 @@ void SUR_Chain::setXtX()
     }
 }
 
+arma::mat SUR_Chain::XtXSubmat( const arma::uvec& rowsIdx , const arma::uvec& colsIdx )
+{
+    if( preComputedXtX )
+        return XtX( rowsIdx , colsIdx );
+    else
+        return gramCache->submat( rowsIdx , colsIdx );
+}
+
 // gPrior
 void SUR_Chain::gPriorInit() // g Prior can only be init at the start, so no proper set method
 {
@@ -200,7 +212,7 @@ unsigned int SUR_Chain::getNUpdatesBandit() const{ return n_updates_bandit ; }
 void SUR_Chain::setNUpdatesBandit( unsigned int n_updates_bandit_ ){ n_updates_bandit = n_updates_bandit_ ; }
 
 arma::mat& SUR_Chain::getBanditZeta(){ return banditZeta; }
-void SUR_Chain::setBanditZeta( arma::mat banditZeta_ ){ banditZeta = banditZeta_ ; }
+void SUR_Chain::setBanditZeta( arma::mat banditZeta_ ){ banditZeta = banditZeta_ ; banditResetMismatch(); }
 
 arma::mat& SUR_Chain::getBanditAlpha(){ return banditAlpha ; }
 void SUR_Chain::setBanditAlpha( arma::mat banditAlpha_ ){ banditAlpha = banditAlpha_ ; }
@@ -208,15 +220,6 @@ void SUR_Chain::setBanditAlpha( arma::mat banditAlpha_ ){ banditAlpha = banditAl
 arma::mat& SUR_Chain::getBanditBeta(){ return banditBeta ; }
 void SUR_Chain::setBanditBeta( arma::mat banditBeta_ ){ banditBeta = banditBeta_ ; }
 
-arma::vec& SUR_Chain::getBanditMismatch(){ return mismatch; }
-void SUR_Chain::setBanditMismatch( arma::vec mismatch_ ){ mismatch = mismatch_ ; }
-
-arma::vec& SUR_Chain::getBanditNormalisedMismatch(){ return normalised_mismatch ; }
-void SUR_Chain::setBanditNormalisedMismatch( arma::vec normalised_mismatch_ ){ normalised_mismatch = normalised_mismatch_ ; }
-
-arma::vec& SUR_Chain::getBanditNormalisedMismatchBackwards(){ return normalised_mismatch_backwards ; }
-void SUR_Chain::setBanditNormalisedMismatchBackwards( arma::vec normalised_mismatch_backwards_ ){ normalised_mismatch_backwards = normalised_mismatch_backwards_ ; }
-
 // Parameter states etc
 
 // TAU
@@ -309,7 +312,7 @@ double SUR_Chain::getLogPEta() const{ return logP_eta ; }
 
 // JT
 JunctionTree& SUR_Chain::getJT(){ return jt; }  // need to check this works correctly TODO (i.e. correct behaviour is returning a copy of jt)
-arma::sp_umat SUR_Chain::getGAdjMat() const{ return jt.getAdjMat(); }  // need to check this works correctly TODO (i.e. correct behaviour is returning a copy of jt)
+const arma::sp_umat& SUR_Chain::getGAdjMat() const{ return jt.getAdjMat(); } // a view on the current graph, valid until the next JT move
 void SUR_Chain::setJT( JunctionTree& externalJT )
 {
     jt = externalJT ; // old jt gets destroyed as there's no reference to him anymore, new jt "points" to the foreign object
@@ -457,12 +460,14 @@ arma::umat& SUR_Chain::getGamma(){ return gamma ; }
 void SUR_Chain::setGamma( arma::umat& externalGamma )
 {
     gamma = externalGamma ;
+    banditResetMismatch();
     logPGamma();
 }
 
 void SUR_Chain::setGamma( arma::umat& externalGamma , double logP_gamma_ )
 {
     gamma = externalGamma ;
+    banditResetMismatch();
     logP_gamma = logP_gamma_ ;
 }
 
@@ -838,6 +843,7 @@ void SUR_Chain::mrfGInit()
         throw Bad_Gamma_Type ( gamma_type );
     
     //    mrf_G = arma::zeros<arma::mat>(0,2);
+    mrfGraph.build( *mrfG , nVSPredictors * nOutcomes );
     mrf_d = -3. ;
     mrf_e = 0.3 ;
 }
@@ -855,6 +861,7 @@ void SUR_Chain::mrfGInit()
 void SUR_Chain::gammaInit( arma::umat& gamma_init )
 {
     gamma = gamma_init;
+    banditResetMismatch();
     gamma_acc_count = 0.;
     logPGamma();
     updateGammaMask();
@@ -1032,10 +1039,10 @@ double SUR_Chain::logPSigmaRho( const arma::mat&  externalSigmaRho , double nu_
     std::vector<unsigned int> Prime_q,Res_q, Sep_q;
     unsigned int l;
     
-    for( unsigned q=0; q < externalJT.perfectCliqueSequence.size(); ++q )
+    for( unsigned q=0; q < externalJT.getNCliques(); ++q )
     {
-        Sep_q = externalJT.perfectCliqueSequence[q]->getSeparator();
-        Prime_q = externalJT.perfectCliqueSequence[q]->getNodes();
+        Sep_q.assign( externalJT.getClique(q).getSeparator().begin() , externalJT.getClique(q).getSeparator().end() );
+        Prime_q.assign( externalJT.getClique(q).getNodes().begin() , externalJT.getClique(q).getNodes().end() );
         Res_q.clear();
         std::set_difference(Prime_q.begin(), Prime_q.end(),
                             Sep_q.begin(), Sep_q.end(),
@@ -1208,38 +1215,85 @@ double SUR_Chain::logPGamma( const arma::umat& externalGamma , const arma::vec&
     return logP;
 }
 
-// this is the MRF prior
-//double SUR_Chain::logPGamma( const arma::umat& externalGamma , double d, double e, const arma::mat& externalMRFG )
-double SUR_Chain::logPGamma( const arma::umat& externalGamma , double d, double e )
+// single o_k / pi_j moves: only the terms of the priors that involve them, O(p) and O(s) instead of O(ps)
+double SUR_Chain::logPODelta( unsigned int k , double proposedOk )
 {
-    if( gamma_type != Gamma_Type::mrf )
+    if ( gamma_type != Gamma_Type::hotspot )
         throw Bad_Gamma_Type ( gamma_type );
     
-    arma::mat externalMRFG = mrfG->cols( arma::linspace<arma::uvec>(0,2,3) );
+    return Distributions::logPDFBeta( proposedOk , a_o, b_o ) - Distributions::logPDFBeta( o(k) , a_o, b_o );
+}
+
+double SUR_Chain::logPPiDelta( unsigned int j , double proposedPij )
+{
+    switch ( gamma_type )
+    {
+        case Gamma_Type::hotspot :
+            return Distributions::logPDFGamma( proposedPij , a_pi, b_pi ) - Distributions::logPDFGamma( pi(j) , a_pi, b_pi );
+            
+        case Gamma_Type::hierarchical :
+            return Distributions::logPDFBeta( proposedPij , a_pi, b_pi ) - Distributions::logPDFBeta( pi(j) , a_pi, b_pi );
+            
+        default:
+            throw Bad_Gamma_Type ( gamma_type );
+    }
+}
+
+// column k of gamma, hotspot prior
+double SUR_Chain::logPGammaODelta( unsigned int k , double proposedOk )
+{
+    if( gamma_type != Gamma_Type::hotspot )
+        throw Bad_Gamma_Type ( gamma_type );
     
     double logP = 0.;
-    // calculate the linear and quadratic parts in MRF by using all edges of G
-    arma::vec gammaVec = arma::conv_to< arma::vec >::from(arma::vectorise(externalGamma));
-    double quad_mrf = 0.;
-    double linear_mrf = 0.;
-    int count_linear_mrf = 0;
-    for( unsigned i=0; i < (externalMRFG).n_rows; ++i )
-    {
-        if( (externalMRFG)(i,0) != (externalMRFG)(i,1) ){
-            quad_mrf += e * 2.0 * gammaVec( (externalMRFG)(i,0) ) * gammaVec( (externalMRFG)(i,1) ) * (externalMRFG)(i,2);
-        }else{
-            if( gammaVec( (externalMRFG)(i,0) ) == 1 ){
-                linear_mrf += d * gammaVec( (externalMRFG)(i,0) ) * (externalMRFG)(i,2);
-                count_linear_mrf ++;
-            }
-        }
+    for(unsigned int j=0; j<nVSPredictors; ++j)
+    {
+        if( ( proposedOk * pi(j) ) > 1 )
+            return -std::numeric_limits<double>::infinity();
         
+        logP += Distributions::logPDFBernoulli( gamma(j,k), proposedOk * pi(j) ) - Distributions::logPDFBernoulli( gamma(j,k), o(k) * pi(j) );
     }
-    logP = arma::as_scalar( linear_mrf + d * (arma::accu( externalGamma ) - count_linear_mrf) + e * 2.0 * quad_mrf );
+    return logP;
+}
+
+// row j of gamma, hotspot or hierarchical prior
+double SUR_Chain::logPGammaPiDelta( unsigned int j , double proposedPij )
+{
+    double logP = 0.;
     
+    switch ( gamma_type )
+    {
+        case Gamma_Type::hotspot :
+            for(unsigned int k=0; k<nOutcomes; ++k)
+            {
+                if( ( o(k) * proposedPij ) > 1 )
+                    return -std::numeric_limits<double>::infinity();
+                
+                logP += Distributions::logPDFBernoulli( gamma(j,k), o(k) * proposedPij ) - Distributions::logPDFBernoulli( gamma(j,k), o(k) * pi(j) );
+            }
+            break;
+            
+        case Gamma_Type::hierarchical :
+            logP = Distributions::logPDFBernoulli( gamma.row(j).t() , proposedPij ) - Distributions::logPDFBernoulli( gamma.row(j).t() , pi(j) );
+            break;
+            
+        default:
+            throw Bad_Gamma_Type ( gamma_type );
+    }
     return logP;
 }
 
+// this is the MRF prior
+//double SUR_Chain::logPGamma( const arma::umat& externalGamma , double d, double e, const arma::mat& externalMRFG )
+double SUR_Chain::logPGamma( const arma::umat& externalGamma , double d, double e )
+{
+    if( gamma_type != Gamma_Type::mrf )
+        throw Bad_Gamma_Type ( gamma_type );
+    
+    // only the active nodes and their incident edges are visited, see Utils::MRFGraph
+    return mrfGraph.logP( externalGamma , d , e );
+}
+
 // these below are general interfaces
 double SUR_Chain::logPGamma( )
 {
@@ -1373,7 +1427,7 @@ double SUR_Chain::logPBetaMask( const arma::mat&  externalBeta , const arma::uma
                                                     arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) ) , ( 1./ sigmaRho(k,k) + xtxMultiplier(k) ) );
                     else
                         logP += logPBetaMaskgPriorK( externalBeta(VS_IN_k,singleIdx_k) , w_ ,
-                                                    arma::inv_sympd( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) ,
+                                                    arma::inv_sympd( gramCache->submat( VS_IN_k , VS_IN_k ) ) ,
                                                     ( 1./ sigmaRho(k,k) + xtxMultiplier(k) ) );
                 }
                 break;
@@ -1516,155 +1570,144 @@ double SUR_Chain::logLikelihood( arma::umat&  externalGammaMask , arma::mat& ext
 
 
 // This function sample sigmas and rhos from their full conditionals and updates the relevant matrix rhoU to reflect thats
-double SUR_Chain::sampleSigmaRhoGivenBeta( const arma::mat&  externalBeta , arma::mat& mutantSigmaRho , const JunctionTree& externalJT ,
-                                          const arma::umat&  externalGammaMask , const arma::mat& externalXB , const arma::mat& externalU , arma::mat& mutantRhoU )
+template<typename F>
+void SUR_Chain::forEachSigmaRhoConditional( const arma::mat& Sigma , const JunctionTree& externalJT , F visit ) const
 {
-    double logP = 0.;
-    
-    mutantSigmaRho.zeros(nOutcomes,nOutcomes); // RESET THE WHOLE MATRIX !!!
-    
-    // hyperparameter of the posterior sampler
-    arma::mat Sigma = ( externalU.t() * externalU ) / temperature; Sigma.diag() += tau;
-    
-    double thisSigmaTT;
-    arma::uvec connectedNodes;
+    arma::mat L;
+    arma::vec v;
     arma::uvec conditioninIndexes;
-    unsigned int nConditioninIndexes;
     
-    double a,b;
-    arma::mat rhoVar; // inverse matrix of the residual elements of Sigma in the component
-    arma::rowvec rhoMean; // this is the partial Schur complement, needed for the sampler
+    // the outcomes in res are conditioned on sep and on the ones before them in res,
+    // so the factor of Sigma(conditioninIndexes,conditioninIndexes) gains one row per node: O(n^2) each rather than an O(n^3) inverse
+    auto visitClique = [&]( const std::vector<unsigned int>& sep , const std::vector<unsigned int>& res , const arma::mat& sepFactor )
+    {
+        L = sepFactor;
+        conditioninIndexes = arma::conv_to<arma::uvec>::from( sep );
+        
+        for( unsigned int t=0; t<res.size(); ++t )
+        {
+            unsigned int l = res[t];
+            unsigned int n = conditioninIndexes.n_elem;
+            double schurComplement = Sigma(l,l);
+            
+            if( n > 0 )
+            {
+                v = arma::solve( arma::trimatl( L ) , arma::vec( Sigma.col(l) ).elem( conditioninIndexes ) );
+                schurComplement -= arma::dot( v , v );
+            }
+            else
+                v.reset();
+            
+            if( !( schurComplement > 0. ) )
+                throw Distributions::negativeDefiniteParameters();
+            
+            visit( l , conditioninIndexes , schurComplement , L , v );
+            
+            if( t+1 < res.size() )
+            {
+                L.resize( n+1 , n+1 ); // keeps the elements, the new ones are zeros
+                if( n > 0 )
+                    L( n , arma::span(0,n-1) ) = v.t();
+                L(n,n) = std::sqrt( schurComplement );
+                
+                conditioninIndexes.resize( n+1 );
+                conditioninIndexes(n) = l;
+            }
+        }
+    };
     
     switch ( covariance_type )
     {
         case Covariance_Type::HIW :
         {
-            arma::uvec singleIdx_l(1); // needed for convention with arma::submat
+            std::map< std::vector<unsigned int> , arma::mat > separatorFactors;
             std::vector<unsigned int> Prime_q,Res_q, Sep_q;
-            unsigned int l;
-            for( unsigned q=0; q < externalJT.perfectCliqueSequence.size(); ++q )
+            
+            for( unsigned q=0; q < externalJT.getNCliques(); ++q )
             {
-                Sep_q = externalJT.perfectCliqueSequence[q]->getSeparator();
-                Prime_q = externalJT.perfectCliqueSequence[q]->getNodes();
+                Sep_q.assign( externalJT.getClique(q).getSeparator().begin() , externalJT.getClique(q).getSeparator().end() );
+                Prime_q.assign( externalJT.getClique(q).getNodes().begin() , externalJT.getClique(q).getNodes().end() );
                 Res_q.clear();
                 std::set_difference(Prime_q.begin(), Prime_q.end(),
                                     Sep_q.begin(), Sep_q.end(),
                                     std::inserter(Res_q, Res_q.begin()));;
                 
-                for( unsigned int t=0; t<Res_q.size(); ++t )
+                auto sepFactor = separatorFactors.find( Sep_q );
+                if( sepFactor == separatorFactors.end() )
                 {
-                    l = Res_q[t];
-                    singleIdx_l(0) = l;
-                    
-                    // start computing interesting things
-                    thisSigmaTT = Sigma(l,l);
-                    
-                    nConditioninIndexes = Sep_q.size() + t;
-                    conditioninIndexes.zeros( nConditioninIndexes );
-                    
-                    if( nConditioninIndexes > 0 )
-                    {
-                        
-                        if( Sep_q.size() > 0 )
-                            conditioninIndexes(arma::span(0,Sep_q.size()-1)) = arma::conv_to<arma::uvec>::from( Sep_q );
-                        
-                        for( unsigned int inner_l=0; inner_l<t; ++inner_l )
-                        {
-                            conditioninIndexes( Sep_q.size() + inner_l ) = Res_q[inner_l];
-                        }
-                        /*test = */arma::inv_sympd( rhoVar , Sigma(conditioninIndexes,conditioninIndexes) ) ;
-                        rhoMean = Sigma( singleIdx_l , conditioninIndexes ) * rhoVar ;
-                        thisSigmaTT -= arma::as_scalar( rhoMean * Sigma( conditioninIndexes , singleIdx_l ) );
-                    }
-                    
-                    // *** Diagonal Element
-                    
-                    // Compute parameters
-                    a = 0.5 * ( nObservations/temperature + nu - nOutcomes + nConditioninIndexes + 1. ) ;
-                    b = 0.5 * thisSigmaTT ;
-                    
-                    mutantSigmaRho(l,l) = randIGamma( a , b );
-                    
-                    logP += Distributions::logPDFIGamma( mutantSigmaRho(l,l), a , b );
-                    
-                    
-                    // *** Off-Diagonal Element(s)
-                    if( nConditioninIndexes > 0 )
+                    arma::mat sepL;
+                    if( !Sep_q.empty() )
                     {
-                        
-                        mutantSigmaRho( conditioninIndexes , singleIdx_l ) =
-                        Distributions::randMvNormal( rhoMean.t() , mutantSigmaRho(l,l) * rhoVar );
-                        
-                        mutantSigmaRho( singleIdx_l , conditioninIndexes ) =
-                        mutantSigmaRho( conditioninIndexes , singleIdx_l ).t();
-                        
-                        logP += Distributions::logPDFNormal( mutantSigmaRho( conditioninIndexes , singleIdx_l ) ,
-                                                            rhoMean.t() , mutantSigmaRho(l,l) * rhoVar );
+                        arma::uvec sepIdx = arma::conv_to<arma::uvec>::from( Sep_q );
+                        if( !arma::chol( sepL , Sigma( sepIdx , sepIdx ) , "lower" ) )
+                            throw Distributions::negativeDefiniteParameters();
                     }
-                    
-                    // add zeros were set at the beginning with the SigmaRho reset, so no need to act now
-                    
-                } // end loop over elements inside components
-            } // end loop over components
+                    sepFactor = separatorFactors.emplace( Sep_q , sepL ).first;
+                }
+                
+                visitClique( Sep_q , Res_q , sepFactor->second );
+            }
             break;
         }
             
         case Covariance_Type::IW :
         {
-            arma::uvec singleIdx_k(1); // needed for convention with arma::submat
-            for( unsigned int k=0; k<nOutcomes; ++k )
-            {
-                singleIdx_k(0) = k;
-                
-                // start computing interesting things
-                thisSigmaTT = Sigma(k,k);
-                
-                nConditioninIndexes = k;
-                conditioninIndexes.zeros( nConditioninIndexes );
-                
-                if( nConditioninIndexes > 0 )
-                {
-                    conditioninIndexes = arma::regspace<arma::uvec>(0, k-1);
-                    
-                    /*test = */arma::inv_sympd( rhoVar , Sigma(conditioninIndexes,conditioninIndexes) ) ;
-                    rhoMean = Sigma( singleIdx_k , conditioninIndexes ) * rhoVar ;
-                    thisSigmaTT -= arma::as_scalar( rhoMean * Sigma( conditioninIndexes , singleIdx_k ) );
-                }
-                
-                // *** Diagonal Element
-                
-                // Compute parameters
-                a = 0.5 * ( nObservations/temperature + nu - nOutcomes + nConditioninIndexes + 1. ) ;
-                b = 0.5 * thisSigmaTT ;
-                
-                mutantSigmaRho(k,k) = randIGamma( a , b );
-                
-                logP += Distributions::logPDFIGamma( mutantSigmaRho(k,k), a , b );
-                
-                
-                // *** Off-Diagonal Element(s)
-                if( nConditioninIndexes > 0 )
-                {
-                    
-                    mutantSigmaRho( conditioninIndexes , singleIdx_k ) =
-                    Distributions::randMvNormal( rhoMean.t() , mutantSigmaRho(k,k) * rhoVar );
-                    
-                    mutantSigmaRho( singleIdx_k , conditioninIndexes ) =
-                    mutantSigmaRho( conditioninIndexes , singleIdx_k ).t();
-                    
-                    logP += Distributions::logPDFNormal( mutantSigmaRho( conditioninIndexes , singleIdx_k ) ,
-                                                        rhoMean.t() , mutantSigmaRho(k,k) * rhoVar );
-                }
-                
-                // add zeros were set at the beginning with the SigmaRho reset, so no need to act now
-                
-            } // end loop over all elements
+            // a single clique with all the outcomes
+            std::vector<unsigned int> allOutcomes( nOutcomes );
+            std::iota( allOutcomes.begin() , allOutcomes.end() , 0 );
+            
+            visitClique( std::vector<unsigned int>() , allOutcomes , arma::mat() );
             break;
         }
             
         default:
             throw Bad_Covariance_Type ( covariance_type );
     }
+}
+
+double SUR_Chain::sampleSigmaRhoGivenBeta( const arma::mat&  externalBeta , arma::mat& mutantSigmaRho , const JunctionTree& externalJT ,
+                                          const arma::umat&  externalGammaMask , const arma::mat& externalXB , const arma::mat& externalU , arma::mat& mutantRhoU )
+{
+    double logP = 0.;
+    
+    mutantSigmaRho.zeros(nOutcomes,nOutcomes); // RESET THE WHOLE MATRIX !!!
+    
+    // hyperparameter of the posterior sampler
+    arma::mat Sigma = ( externalU.t() * externalU ) / temperature; Sigma.diag() += tau;
+    
+    arma::uvec singleIdx_l(1); // needed for convention with arma::submat
+    
+    forEachSigmaRhoConditional( Sigma , externalJT ,
+        [&]( unsigned int l , const arma::uvec& conditioninIndexes , double thisSigmaTT , const arma::mat& L , const arma::vec& v )
+    {
+        unsigned int nConditioninIndexes = conditioninIndexes.n_elem;
+        singleIdx_l(0) = l;
+        
+        // *** Diagonal Element
+        
+        // Compute parameters
+        double a = 0.5 * ( nObservations/temperature + nu - nOutcomes + nConditioninIndexes + 1. ) ;
+        double b = 0.5 * thisSigmaTT ;
+        
+        mutantSigmaRho(l,l) = randIGamma( a , b );
+        
+        logP += Distributions::logPDFIGamma( mutantSigmaRho(l,l), a , b );
+        
+        
+        // *** Off-Diagonal Element(s)
+        if( nConditioninIndexes > 0 )
+        {
+            // N( Sigma_CC^-1 * Sigma_Cl , sigma_ll * Sigma_CC^-1 ), i.e. with precision L*L'/sigma_ll
+            arma::vec rho;
+            logP += Distributions::randMvNormalPrecisionCholAndLogPDF( rho , arma::solve( arma::trimatu( L.t() ) , v ) ,
+                                                                      L.t() / std::sqrt( mutantSigmaRho(l,l) ) );
+            
+            mutantSigmaRho( conditioninIndexes , singleIdx_l ) = rho;
+            mutantSigmaRho( singleIdx_l , conditioninIndexes ) = rho.t();
+        }
+        
+        // add zeros were set at the beginning with the SigmaRho reset, so no need to act now
+    } );
     
     // modify useful quantities, only rhoU impacted
     //recompute rhoU as the rhos have changed
@@ -1689,8 +1732,7 @@ double SUR_Chain::sampleBetaGivenSigmaRho( arma::mat& mutantBeta , const arma::m
     {
         
         arma::vec mu_k; // beta samplers
-        arma::mat W_k , iXtX; // indep prior uses W_k, gPrior uses iXtX
-        double varianceFactor;
+        double xtxScale, fixedPrecision, vsPrecision;
         
         arma::uvec singleIdx_k(1); // needed for convention with arma::submat
         
@@ -1733,80 +1775,16 @@ double SUR_Chain::sampleBetaGivenSigmaRho( arma::mat& mutantBeta , const arma::m
                 
                 singleIdx_k(0) = k;
                 
-                switch ( beta_type )
-                {
-                    case Beta_Type::gprior :
-                    {
-                        varianceFactor = ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) );
-                        
-                        if( preComputedXtX )
-                        {
-                            arma::inv_sympd( iXtX , XtX(VS_IN_k,VS_IN_k) );
-                            // W_k = iXtX * ( (w*temperature)/(w + temperature) ) / varianceFactor;
-                        }else{
-                            arma::inv_sympd( iXtX , data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) );
-                            // W_k = iXtX * ( (w*temperature)/(w + temperature) ) / varianceFactor;
-                        }
-                        
-                        mu_k = ( (w*temperature)/(w + temperature) / varianceFactor ) * iXtX *
-                        ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * y_tilde.col(k) / temperature );
-                        
-                        tmpVec = Distributions::randMvNormal( mu_k , ( (w*temperature)/(w + temperature) / varianceFactor ) * iXtX );
-                        logP += Distributions::logPDFNormal( tmpVec , mu_k , ( (w*temperature)/(w + temperature) / varianceFactor ) * iXtX );
-                        
-                        // logPrior += logPBetaMaskgPriorK( tmpVec , w , iXtX , varianceFactor );
-                        
-                        break;
-                    }
-                        
-                    case Beta_Type::independent :
-                    {
-                        
-                        if( preComputedXtX )
-                            arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        else
-                            arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        
-                        mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * y_tilde.col(k) / temperature ) ;
-                        
-                        tmpVec = Distributions::randMvNormal( mu_k , W_k );
-                        logP += Distributions::logPDFNormal( tmpVec , mu_k , W_k );
-                        
-                        break;
-                    }
-                        
-                    case Beta_Type::reGroup :
-                    {
-                        
-                        if( preComputedXtX )
-                            //arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                            arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                        else
-                          //arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                          arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) +  arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-
-                        mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * y_tilde.col(k) / temperature ) ;
-                        /*
-                        if( k==1 )
-                        {
-                            std::cout << "...Debug the update of w0 & w: " << w0 << "; " << w << std::endl;
-                          std::cout << "...Debug the updated length of mu_1: " << arma::size(mu_k) << std::endl;
-                          std::cout << "...Debug the update of b0: " << arma::conv_to<arma::rowvec>::from(beta.submat(0,0,2,0)) << std::endl;
-                          std::cout << "...Debug the update of b: " << arma::conv_to<arma::rowvec>::from(beta.submat(nFixedPredictors-1+0,0,nFixedPredictors-1+2,0)) << std::endl;
-
-                        }
-                        */
-                        tmpVec = Distributions::randMvNormal( mu_k , W_k );
-                        logP += Distributions::logPDFNormal( tmpVec , mu_k , W_k );
-                        
-                        break;
-                    }
-                        
-                    default:
-                        throw Bad_Beta_Type ( beta_type );
-                }
+                // precision-form sampling, same factor as sampleBetaKGivenSigmaRho (R.t()*R = W_k^-1, whatever the Beta_Type)
+                betaKPrecisionParameters( k , externalSigmaRho , xtxMultiplier(k) , xtxScale , fixedPrecision , vsPrecision );
+                BetaKFactor& factor = betaKPrecisionChol( k , VS_IN_k , xtxScale , fixedPrecision , vsPrecision );
+                
+                mu_k = arma::solve( arma::trimatu( factor.R ) , arma::solve( arma::trimatl( factor.R.t() ) ,
+                            predictors->crossprod( (*predictorsIdx)(factor.idx) , y_tilde.col(k) ) / temperature ) );
+                
+                logP += Distributions::randMvNormalPrecisionCholAndLogPDF( tmpVec , mu_k , factor.R );
                 
-                mutantBeta(VS_IN_k,singleIdx_k) = tmpVec;
+                mutantBeta(factor.idx,singleIdx_k) = tmpVec;
                 
             }// end if VS_IN_k is non-empty
         }// end foreach outcome
@@ -1826,6 +1804,118 @@ double SUR_Chain::sampleBetaGivenSigmaRho( arma::mat& mutantBeta , const arma::m
     
 }
 
+// prior/likelihood scaling of the beta_k full-conditional precision, i.e. xtxScale * XtX_k + diag( prior precisions )
+void SUR_Chain::betaKPrecisionParameters( const unsigned int k , const arma::mat&  externalSigmaRho , double xtxMultiplier ,
+                                         double& xtxScale , double& fixedPrecision , double& vsPrecision )
+{
+    switch ( beta_type )
+    {
+        case Beta_Type::gprior :
+        {
+            xtxScale = ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) * (w + temperature)/(w*temperature);
+            fixedPrecision = 0.;
+            vsPrecision = 0.;
+            break;
+        }
+            
+        case Beta_Type::independent :
+        {
+            xtxScale = ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) / temperature;
+            fixedPrecision = 1./w;
+            vsPrecision = 1./w;
+            break;
+        }
+            
+        case Beta_Type::reGroup :
+        {
+            xtxScale = ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) / temperature;
+            fixedPrecision = 1./w0;
+            vsPrecision = 1./w;
+            break;
+        }
+            
+        default:
+            throw Bad_Beta_Type ( beta_type );
+    }
+}
+
+// get the Cholesky factor of the beta_k precision for the predictors in VS_IN_k
+// if the cached factor has the same scaling and differs by a few predictors it is updated in O(p_k^2) per predictor
+SUR_Chain::BetaKFactor& SUR_Chain::betaKPrecisionChol( const unsigned int k , const arma::uvec& VS_IN_k ,
+                                                      double xtxScale , double fixedPrecision , double vsPrecision )
+{
+    BetaKFactor& factor = betaKFactor[k];
+    
+    bool reuse = factor.valid && factor.xtxScale == xtxScale &&
+                factor.fixedPrecision == fixedPrecision && factor.vsPrecision == vsPrecision;
+    
+    if( reuse )
+    {
+        // VS_IN_k is sorted, factor.idx is in insertion order
+        arma::uvec sortedIdx = arma::sort( factor.idx );
+        std::vector<unsigned int> toRemove, toAdd;
+        
+        for( unsigned int i=factor.idx.n_elem; i-- > 0; ) // backwards so that positions stay valid while removing
+            if( !std::binary_search( VS_IN_k.begin() , VS_IN_k.end() , factor.idx(i) ) )
+                toRemove.push_back( i );
+        
+        for( auto j : VS_IN_k )
+            if( !std::binary_search( sortedIdx.begin() , sortedIdx.end() , j ) )
+                toAdd.push_back( j );
+        
+        // each add/remove is O(p_k^2), a full re-factorisation is O(p_k^3/3)
+        if( 3 * ( toRemove.size() + toAdd.size() ) > VS_IN_k.n_elem )
+            reuse = false;
+        else
+        {
+            for( auto i : toRemove )
+            {
+                Utils::cholRemove( factor.R , i );
+                factor.idx.shed_row( i );
+            }
+            
+            arma::uvec singleIdx(1);
+            arma::mat crossProd;
+            
+            for( auto j : toAdd )
+            {
+                singleIdx(0) = j;
+                crossProd = xtxScale * XtXSubmat( arma::join_cols( factor.idx , singleIdx ) , singleIdx );
+                
+                if( !Utils::cholAppend( factor.R , crossProd.col(0).head( factor.idx.n_elem ) ,
+                                       crossProd( factor.idx.n_elem , 0 ) + ( ( j < nFixedPredictors ) ? fixedPrecision : vsPrecision ) ) )
+                {
+                    reuse = false; // numerical trouble, start again from scratch
+                    break;
+                }
+                
+                factor.idx.insert_rows( factor.idx.n_elem , singleIdx );
+            }
+        }
+    }
+    
+    if( !reuse )
+    {
+        arma::vec priorPrecision( VS_IN_k.n_elem );
+        for( unsigned int i=0; i<VS_IN_k.n_elem; ++i )
+            priorPrecision(i) = ( VS_IN_k(i) < nFixedPredictors ) ? fixedPrecision : vsPrecision ;
+        
+        factor.idx = VS_IN_k;
+        if( !arma::chol( factor.R , xtxScale * XtXSubmat( VS_IN_k , VS_IN_k ) + arma::diagmat( priorPrecision ) ) )
+        {
+            factor.valid = false;
+            throw Distributions::negativeDefiniteParameters();
+        }
+        
+        factor.xtxScale = xtxScale;
+        factor.fixedPrecision = fixedPrecision;
+        factor.vsPrecision = vsPrecision;
+        factor.valid = true;
+    }
+    
+    return factor;
+}
+
 double SUR_Chain::sampleBetaKGivenSigmaRho( const unsigned int k , arma::mat& mutantBeta , const arma::mat&  externalSigmaRho , const JunctionTree& externalJT ,
                                            const arma::umat&  externalGammaMask , arma::mat& mutantXB , arma::mat& mutantU , arma::mat& mutantRhoU )
 {
@@ -1843,7 +1933,7 @@ double SUR_Chain::sampleBetaKGivenSigmaRho( const unsigned int k , arma::mat& mu
             arma::uvec singleIdx_k(1); // needed for convention with arma::submat
             singleIdx_k(0) = k;
             
-            arma::vec mu_k; arma::mat W_k; // beta samplers
+            arma::vec mu_k; // beta samplers
             arma::vec tmpVec;
             //bool test;
             
@@ -1864,78 +1954,24 @@ double SUR_Chain::sampleBetaKGivenSigmaRho( const unsigned int k , arma::mat& mu
                 ( mutantU.col(xi(l)) - mutantRhoU.col(xi(l)) +  externalSigmaRho(xi(l),k) * ( mutantU.col(k) - data->col( (*outcomesIdx)(k) ) ) );
             }
             
-            // actual sampling
-            tmpVec.clear();
+            // precision-form sampling, the factor R (R.t()*R = W_k^-1) comes from the cache
+            double xtxScale, fixedPrecision, vsPrecision;
+            betaKPrecisionParameters( k , externalSigmaRho , xtxMultiplier , xtxScale , fixedPrecision , vsPrecision );
+            BetaKFactor& factor = betaKPrecisionChol( k , VS_IN_k , xtxScale , fixedPrecision , vsPrecision );
             
-            if( preComputedXtX )
-            {
-                switch ( beta_type )
-                {
-                    case Beta_Type::gprior :
-                    {
-                        W_k = (w*temperature)/(w + temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) ) / ( 1./ externalSigmaRho(k,k) + xtxMultiplier );
-                        break;
-                    }
-                        
-                    case Beta_Type::independent :
-                    {
-                        arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        break;
-                    }
-                        
-                    case Beta_Type::reGroup :
-                    {
-                      //arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                      arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                      break;
-                    }
-                        
-                    default:
-                        throw Bad_Beta_Type ( beta_type );
-                }
-                
-            }else{
-                
-                switch ( beta_type )
-                {
-                    case Beta_Type::gprior :
-                    {
-                        W_k = (w*temperature)/(w + temperature) * arma::inv_sympd( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) / ( 1./ externalSigmaRho(k,k) + xtxMultiplier );
-                        break;
-                    }
-                        
-                    case Beta_Type::independent :
-                    {
-                        arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        break;
-                    }
-
-                    case Beta_Type::reGroup :
-                    {
-                        //arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                        break;
-                    }
-                        
-                    default:
-                        throw Bad_Beta_Type ( beta_type );
-                }
-            }
+            mu_k = arma::solve( arma::trimatu( factor.R ) , arma::solve( arma::trimatl( factor.R.t() ) ,
+                        predictors->crossprod( (*predictorsIdx)(factor.idx) , y_tilde ) / temperature ) );
             
-            mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * y_tilde / temperature ) ;
+            logP = Distributions::randMvNormalPrecisionCholAndLogPDF( tmpVec , mu_k , factor.R );
             
-            tmpVec = Distributions::randMvNormal( mu_k , W_k );
-            logP = Distributions::logPDFNormal( tmpVec , mu_k , W_k );
-            mutantBeta(VS_IN_k,singleIdx_k) = tmpVec;
+            mutantBeta(factor.idx,singleIdx_k) = tmpVec;
             
         } // end if VS_IN_k is non-empty
     } // end if gammaMask is non-empty
     
-    // Now the beta have changed so X*B is changed as well as U, compute it to update it for the logLikelihood
-    // finally as U changed, rhoU changes as well
-    mutantXB = createXB(  externalGammaMask , mutantBeta );
-    mutantU = createU( mutantXB );
-    mutantRhoU = createRhoU( mutantU ,  externalSigmaRho , externalJT );
+    // Now beta_k has changed so X*B is changed as well as U, but only in their k-th column
+    // finally as U changed, rhoU changes as well, but only in the columns that depend on U_k
+    updateQuantitiesK( k , externalGammaMask , mutantBeta , externalSigmaRho , externalJT , mutantXB , mutantU , mutantRhoU );
     
     return logP;
     
@@ -1951,128 +1987,31 @@ double SUR_Chain::logPSigmaRhoGivenBeta( const arma::mat&  externalBeta , const
     // hyperparameter of the posterior sampler
     arma::mat Sigma = ( externalU.t() * externalU ) / temperature; Sigma.diag() += tau;
     
-    double thisSigmaTT;
-    arma::uvec connectedNodes;
-    arma::uvec conditioninIndexes;
-    unsigned int nConditioninIndexes;
-    
-    double a,b;
-    arma::mat rhoVar; // inverse matrix of the residual elements of Sigma in the component
-    arma::rowvec rhoMean; // this is the partial Schur complement, needed for the sampler
+    arma::uvec singleIdx_l(1); // needed for convention with arma::submat
     
-    switch ( covariance_type )
+    forEachSigmaRhoConditional( Sigma , externalJT ,
+        [&]( unsigned int l , const arma::uvec& conditioninIndexes , double thisSigmaTT , const arma::mat& L , const arma::vec& v )
     {
-        case Covariance_Type::HIW :
-        {
-            arma::uvec singleIdx_l(1); // needed for convention with arma::submat
-            std::vector<unsigned int> Prime_q,Res_q, Sep_q;
-            unsigned int l;
-            
-            for( unsigned q=0; q < externalJT.perfectCliqueSequence.size(); ++q )
-            {
-                Sep_q = externalJT.perfectCliqueSequence[q]->getSeparator();
-                Prime_q = externalJT.perfectCliqueSequence[q]->getNodes();
-                Res_q.clear();
-                std::set_difference(Prime_q.begin(), Prime_q.end(),
-                                    Sep_q.begin(), Sep_q.end(),
-                                    std::inserter(Res_q, Res_q.begin()));;
-                
-                for( unsigned int t=0; t<Res_q.size(); ++t )
-                {
-                    l = Res_q[t];
-                    singleIdx_l(0) = l;
-                    
-                    // start computing interesting things
-                    thisSigmaTT = Sigma(l,l);
-                    
-                    nConditioninIndexes = Sep_q.size() + t;
-                    conditioninIndexes.zeros( nConditioninIndexes );
-                    
-                    if( nConditioninIndexes > 0 )
-                    {
-                        if( Sep_q.size() > 0 )
-                            conditioninIndexes(arma::span(0,Sep_q.size()-1)) = arma::conv_to<arma::uvec>::from( Sep_q );
-                        
-                        for( unsigned int inner_l=0; inner_l<t; ++inner_l )
-                        {
-                            conditioninIndexes( Sep_q.size() + inner_l ) = Res_q[inner_l];
-                        }
-                        /*test = */arma::inv_sympd( rhoVar , Sigma(conditioninIndexes,conditioninIndexes) ) ;
-                        rhoMean = Sigma( singleIdx_l , conditioninIndexes ) * rhoVar ;
-                        thisSigmaTT -= arma::as_scalar( rhoMean * Sigma( conditioninIndexes , singleIdx_l ) );
-                    }
-                    
-                    // *** Diagonal Element
-                    
-                    // Compute parameters
-                    a = 0.5 * ( nObservations/temperature + nu - nOutcomes + nConditioninIndexes + 1. ) ;
-                    b = 0.5 * thisSigmaTT ;
-                    
-                    logP += Distributions::logPDFIGamma( mutantSigmaRho(l,l), a , b );
-                    
-                    
-                    // *** Off-Diagonal Element(s)
-                    if( nConditioninIndexes > 0 )
-                    {
-                        logP += Distributions::logPDFNormal( mutantSigmaRho( conditioninIndexes , singleIdx_l ) ,
-                                                            rhoMean.t() , mutantSigmaRho(l,l) * rhoVar );
-                    }
-                    
-                    // add zeros were set at the beginning with the SigmaRho reset, so no need to act now
-                    
-                } // end loop over elements inside components
-            } // end loop over components
-            break;
-        }
-            
-        case Covariance_Type::IW :
+        unsigned int nConditioninIndexes = conditioninIndexes.n_elem;
+        singleIdx_l(0) = l;
+        
+        // *** Diagonal Element
+        
+        // Compute parameters
+        double a = 0.5 * ( nObservations/temperature + nu - nOutcomes + nConditioninIndexes + 1. ) ;
+        double b = 0.5 * thisSigmaTT ;
+        
+        logP += Distributions::logPDFIGamma( mutantSigmaRho(l,l), a , b );
+        
+        
+        // *** Off-Diagonal Element(s)
+        if( nConditioninIndexes > 0 )
         {
-            arma::uvec singleIdx_k(1); // needed for convention with arma::submat
-            for( unsigned int k=0; k<nOutcomes; ++k )
-            {
-                singleIdx_k(0) = k;
-                
-                // start computing interesting things
-                thisSigmaTT = Sigma(k,k);
-                
-                nConditioninIndexes = k;
-                conditioninIndexes.zeros( nConditioninIndexes );
-                
-                if( nConditioninIndexes > 0 )
-                {
-                    
-                    conditioninIndexes = arma::regspace<arma::uvec>(0,k-1);
-                    
-                    /*test = */arma::inv_sympd( rhoVar , Sigma(conditioninIndexes,conditioninIndexes) ) ;
-                    rhoMean = Sigma( singleIdx_k , conditioninIndexes ) * rhoVar ;
-                    thisSigmaTT -= arma::as_scalar( rhoMean * Sigma( conditioninIndexes , singleIdx_k ) );
-                }
-                
-                // *** Diagonal Element
-                
-                // Compute parameters
-                a = 0.5 * ( nObservations/temperature + nu - nOutcomes + nConditioninIndexes + 1. ) ;
-                b = 0.5 * thisSigmaTT ;
-                
-                logP += Distributions::logPDFIGamma( mutantSigmaRho(k,k), a , b );
-                
-                
-                // *** Off-Diagonal Element(s)
-                if( nConditioninIndexes > 0 )
-                {
-                    logP += Distributions::logPDFNormal( mutantSigmaRho( conditioninIndexes , singleIdx_k ) ,
-                                                        rhoMean.t() , mutantSigmaRho(k,k) * rhoVar );
-                }
-                
-                // add zeros were set at the beginning with the SigmaRho reset, so no need to act now
-                
-            } // end loop over elements inside components
-            break;
+            logP += Distributions::logPDFNormalPrecisionChol( mutantSigmaRho( conditioninIndexes , singleIdx_l ) ,
+                                                             arma::solve( arma::trimatu( L.t() ) , v ) , L.t() / std::sqrt( mutantSigmaRho(l,l) ) );
         }
-            
-        default:
-            throw Bad_Covariance_Type ( covariance_type );
-    }
+    } );
+    
     return logP;
 }
 
@@ -2083,7 +2022,8 @@ double SUR_Chain::logPBetaGivenSigmaRho( const arma::mat& mutantBeta , const arm
     
     if(externalGammaMask.n_rows>0)
     {
-        arma::vec mu_k; arma::mat W_k; // beta samplers
+        arma::vec mu_k; // beta samplers
+        double xtxScale, fixedPrecision, vsPrecision;
         
         arma::uvec singleIdx_k(1); // needed for convention with arma::submat
         
@@ -2122,65 +2062,13 @@ double SUR_Chain::logPBetaGivenSigmaRho( const arma::mat& mutantBeta , const arm
                 
                 singleIdx_k(0) = k;
                 
-                if( preComputedXtX )
-                {
-                    switch ( beta_type )
-                    {
-                        case Beta_Type::gprior :
-                        {
-                            W_k = (w*temperature)/(w + temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) ) / ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) );
-                            break;
-                        }
-                            
-                        case Beta_Type::independent :
-                        {
-                            arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                            break;
-                        }
-                            
-                        case Beta_Type::reGroup :
-                        {
-                          //arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                          arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                              
-                          break;
-                        }
-                            
-                        default:
-                            throw Bad_Beta_Type ( beta_type );
-                    }
-                    
-                }else{
-                    
-                    switch ( beta_type )
-                    {
-                        case Beta_Type::gprior :
-                        {
-                            W_k = (w*temperature)/(w + temperature) * arma::inv_sympd( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) / ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) );
-                            break;
-                        }
-                            
-                        case Beta_Type::independent :
-                        {
-                            arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                            break;
-                        }
-                            
-                        case Beta_Type::reGroup :
-                        {
-                          //arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                          arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier(k) ) + arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                          break;
-                        }
-                            
-                        default:
-                            throw Bad_Beta_Type ( beta_type );
-                    }
-                }
+                betaKPrecisionParameters( k , externalSigmaRho , xtxMultiplier(k) , xtxScale , fixedPrecision , vsPrecision );
+                BetaKFactor& factor = betaKPrecisionChol( k , VS_IN_k , xtxScale , fixedPrecision , vsPrecision );
                 
-                mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * y_tilde.col(k) / temperature ) ;
+                mu_k = arma::solve( arma::trimatu( factor.R ) , arma::solve( arma::trimatl( factor.R.t() ) ,
+                            predictors->crossprod( (*predictorsIdx)(factor.idx) , y_tilde.col(k) ) / temperature ) );
                 
-                logP += Distributions::logPDFNormal( mutantBeta(VS_IN_k,singleIdx_k) , mu_k , W_k );
+                logP += Distributions::logPDFNormalPrecisionChol( mutantBeta(factor.idx,singleIdx_k) , mu_k , factor.R );
             } // end if VS_IN_k is non-empty
         } // end for each outcome
     } // end ifmask is non-empty
@@ -2200,8 +2088,7 @@ double SUR_Chain::logPBetaKGivenSigmaRho( const unsigned int k , const arma::mat
         
         if(VS_IN_k.n_elem>0)
         {
-            arma::vec mu_k; arma::mat W_k; // beta samplers
-            arma::vec tmpVec;
+            arma::vec mu_k; // beta samplers
             
             arma::uvec singleIdx_k(1); // needed for convention with arma::submat
             singleIdx_k(0) = k;
@@ -2224,66 +2111,16 @@ double SUR_Chain::logPBetaKGivenSigmaRho( const unsigned int k , const arma::mat
                 ( mutantU.col(xi(l)) - mutantRhoU.col(xi(l)) +  externalSigmaRho(xi(l),k) * ( mutantU.col(k) - data->col( (*outcomesIdx)(k) ) ) );
             }
             
+            // in stepGamma this is called right after sampleBetaKGivenSigmaRho with the same scaling
+            // so the cached factor only needs the predictors flipped by the proposal to be added/removed
+            double xtxScale, fixedPrecision, vsPrecision;
+            betaKPrecisionParameters( k , externalSigmaRho , xtxMultiplier , xtxScale , fixedPrecision , vsPrecision );
+            BetaKFactor& factor = betaKPrecisionChol( k , VS_IN_k , xtxScale , fixedPrecision , vsPrecision );
             
-            if( preComputedXtX )
-            {
-                switch ( beta_type )
-                {
-                    case Beta_Type::gprior :
-                    {
-                        W_k = (w*temperature)/(w + temperature) * arma::inv_sympd( XtX(VS_IN_k,VS_IN_k) ) / ( 1./ externalSigmaRho(k,k) + xtxMultiplier );
-                        break;
-                    }
-                        
-                    case Beta_Type::independent :
-                    {
-                        arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        break;
-                    }
-                    
-                    case Beta_Type::reGroup :
-                    {
-                      //arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                      arma::inv_sympd( W_k ,  ( XtX(VS_IN_k,VS_IN_k) / temperature ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-
-                      break;
-                    }
-                        
-                    default:
-                        throw Bad_Beta_Type ( beta_type );
-                }
-                
-            }else{
-                
-                switch ( beta_type )
-                {
-                    case Beta_Type::gprior :
-                    {
-                        W_k = (w*temperature)/(w + temperature) * arma::inv_sympd( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) / ( 1./ externalSigmaRho(k,k) + xtxMultiplier );
-                        break;
-                    }
-                        
-                    case Beta_Type::independent :
-                    {
-                        arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                        break;
-                    }
-                        
-                    case Beta_Type::reGroup :
-                    {
-                      //arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) + (1./w)*arma::eye<arma::mat>(VS_IN_k.n_elem,VS_IN_k.n_elem) );
-                      arma::inv_sympd( W_k ,  ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * data->cols( (*predictorsIdx)(VS_IN_k) ) ) * ( 1./ externalSigmaRho(k,k) + xtxMultiplier ) +  arma::diagmat( arma::join_cols((1./w0)*arma::ones(nFixedPredictors),(1./w)*arma::ones(VS_IN_k.n_elem-nFixedPredictors)) ) );
-                      break;
-                    }
-                        
-                    default:
-                        throw Bad_Beta_Type ( beta_type );
-                }
-            }
-            
-            mu_k = W_k * ( data->cols( (*predictorsIdx)(VS_IN_k) ).t() * y_tilde / temperature ) ;
+            mu_k = arma::solve( arma::trimatu( factor.R ) , arma::solve( arma::trimatl( factor.R.t() ) ,
+                        predictors->crossprod( (*predictorsIdx)(factor.idx) , y_tilde ) / temperature ) );
             
-            logP = Distributions::logPDFNormal( mutantBeta(VS_IN_k,singleIdx_k) , mu_k , W_k );
+            logP = Distributions::logPDFNormalPrecisionChol( mutantBeta(factor.idx,singleIdx_k) , mu_k , factor.R );
             
         }// end if VS_IN_k is non-empty
     } //end if mask is non-empty
@@ -2316,76 +2153,58 @@ double SUR_Chain::gammaBanditProposal( arma::umat& mutantGamma , arma::uvec& upd
     // decide on one outcome
     outcomeUpdateIdx = randIntUniform(0,nOutcomes-1);
     
-    // Sample Zs (only for relevant outocome)
-    for(unsigned int i=0; i<nVSPredictors; ++i)
-    {
-        banditZeta(i) = randBeta(banditAlpha(i,outcomeUpdateIdx),banditAlpha(i,outcomeUpdateIdx));
-    }
-    
-    // Create mismatch (only for relevant outcome)
-    for(unsigned int i=0; i<nVSPredictors; ++i)
-    {
-        mismatch(i) = (mutantGamma(i,outcomeUpdateIdx)==0)?(banditZeta(i)):(1.-banditZeta(i));   //mismatch
-    }
-    
-    // Normalise
-    // mismatch = arma::log(mismatch); //logscale ??? TODO
-    // normalised_mismatch = mismatch - Utils::logspace_add(mismatch);
-    
-    normalised_mismatch = mismatch / arma::as_scalar(arma::sum(mismatch));
+    // mismatch weights for the relevant outcome, after refreshing a few of its zetas
+    Utils::SumTree& mismatch = banditMismatchTree( outcomeUpdateIdx );
+    banditRefreshZeta( outcomeUpdateIdx );
     
     if( randU01() < 0.5 )   // one deterministic update
     {
         // Decide which to update
         updateIdx = arma::zeros<arma::uvec>(1);
-        updateIdx(0) = Distributions::randWeightedIndexSampleWithoutReplacement(nVSPredictors,normalised_mismatch); // sample the one
+        updateIdx(0) = mismatch.sample(); // sample the one
         
         // Update
         mutantGamma(updateIdx(0),outcomeUpdateIdx) = 1 - gamma(updateIdx(0),outcomeUpdateIdx); // deterministic, just switch
-
-        // Compute logProposalRatio probabilities
-        normalised_mismatch_backwards = mismatch;
-        normalised_mismatch_backwards(updateIdx(0)) = 1. - normalised_mismatch_backwards(updateIdx(0)) ;
         
-        // normalised_mismatch_backwards = normalised_mismatch_backwards - Utils::logspace_add(normalised_mismatch_backwards);
-        normalised_mismatch_backwards = normalised_mismatch_backwards / arma::as_scalar(arma::sum(normalised_mismatch_backwards));
+        // Compute logProposalRatio probabilities, backwards only the switched weight changes ( to 1-w )
+        double w_j = mismatch.weight(updateIdx(0));
         
-        logProposalRatio = ( std::log( normalised_mismatch_backwards(updateIdx(0)) ) ) -
-        ( std::log( normalised_mismatch(updateIdx(0)) ) );
+        logProposalRatio = ( std::log( 1. - w_j ) - std::log( mismatch.sum() - w_j + (1. - w_j) ) ) -
+        ( std::log( w_j ) - std::log( mismatch.sum() ) );
         
     }else{
         
         /*
          n_updates_bandit random (bern) updates
-         Note that we make use of column indexing here for armadillo matrices
+         The indexes are drawn sequentially without replacement, but the proposal probabilities are those of the
+         (unordered) set of indexes, computed in O(n_updates_bandit) -- the backward one being the same set under the mismatch of mutantGamma
          */
-
-        logProposalRatio = 0.;
-        // Decide which to update
-        updateIdx = arma::zeros<arma::uvec>(n_updates_bandit);
-        updateIdx = Distributions::randWeightedIndexSampleWithoutReplacement(nVSPredictors,normalised_mismatch,n_updates_bandit); // sample n_updates_bandit indexes
         
-        normalised_mismatch_backwards = mismatch; // copy for backward proposal
+        unsigned int nUpdates = std::min( n_updates_bandit , nVSPredictors );
+        mismatch.sampleWithoutReplacement( nUpdates , updateIdx ); // sample n_updates_bandit indexes
+        
+        arma::vec forwardWeights(nUpdates), backwardWeights(nUpdates);
+        
+        logProposalRatio = 0.;
         
         // Update
-        for(unsigned int i=0; i<n_updates_bandit; ++i)
+        for(unsigned int i=0; i<nUpdates; ++i)
         {
-            mutantGamma(updateIdx(i),outcomeUpdateIdx) = randBernoulli(banditZeta(updateIdx(i))); // random update
+            double zeta_i = banditZeta(updateIdx(i),outcomeUpdateIdx);
+            mutantGamma(updateIdx(i),outcomeUpdateIdx) = randBernoulli(zeta_i); // random update
             
-            normalised_mismatch_backwards(updateIdx(i)) = 1.- normalised_mismatch_backwards(updateIdx(i));
+            forwardWeights(i) = mismatch.weight(updateIdx(i));
+            backwardWeights(i) = ( mutantGamma(updateIdx(i),outcomeUpdateIdx) == 0 ) ? zeta_i : 1. - zeta_i ;
             
-            logProposalRatio += Distributions::logPDFBernoulli(gamma(updateIdx(i),outcomeUpdateIdx),banditZeta(updateIdx(i))) -
-            Distributions::logPDFBernoulli(mutantGamma(updateIdx(i),outcomeUpdateIdx),banditZeta(updateIdx(i)));
+            logProposalRatio += Distributions::logPDFBernoulli(gamma(updateIdx(i),outcomeUpdateIdx),zeta_i) -
+            Distributions::logPDFBernoulli(mutantGamma(updateIdx(i),outcomeUpdateIdx),zeta_i);
         }
-
-        // note that above I might be resampling a value equal to the current one, thus not updating da facto ... TODO
         
-        // Compute logProposalRatio probabilities
-        // normalised_mismatch_backwards = normalised_mismatch_backwards - Utils::logspace_add(normalised_mismatch_backwards);
-        normalised_mismatch_backwards = normalised_mismatch_backwards / arma::as_scalar(arma::sum(normalised_mismatch_backwards));
+        // the weights of the non-selected indexes are the same in both directions
+        double otherWeights = std::max( mismatch.sum() - arma::sum(forwardWeights) , 0. );
         
-        logProposalRatio += Distributions::logPDFWeightedIndexSampleWithoutReplacement(normalised_mismatch_backwards,updateIdx) -
-        Distributions::logPDFWeightedIndexSampleWithoutReplacement(normalised_mismatch,updateIdx);
+        logProposalRatio += Distributions::logPDFWeightedSetSampleWithoutReplacement( backwardWeights , otherWeights ) -
+        Distributions::logPDFWeightedSetSampleWithoutReplacement( forwardWeights , otherWeights );
     }
     
     return logProposalRatio; // pass this to the outside
@@ -2583,33 +2402,28 @@ void SUR_Chain::stepJT()
     } // end for n_updates_jt
 }
 
-// MH update (log-normal)
-// it might seems wastefull to recompute every logP_jk, but at the end you'd need to compute column J for the new value,
-// recopute it for the old value to compare and then recompute the whole thing to replace the whole prior if accepted!
-// The only solution would be to keep track of the whole matrix of values, funny idea but is it worth it memory-wise ?
+// MH update (log-normal), the priors only change in column k (see logPODelta and logPGammaODelta)
 void SUR_Chain::stepOneO()
 {
     
     unsigned int k = randIntUniform(0,nOutcomes-1);
-    arma::vec proposedO = o;
+    double proposedOk, proposedOPrior, proposedGammaPrior, logAccProb;
     
-    double proposedOPrior, proposedGammaPrior, logAccProb;
+    proposedOk = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
     
-    proposedO(k) = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
-    
-    if( arma::all( ( pi * proposedO(k) ) <= 1 ) )
+    if( pi.max() * proposedOk <= 1 )
     {
-        proposedOPrior = logPO( proposedO );
-        proposedGammaPrior = logPGamma( gamma, proposedO, pi);
+        proposedOPrior = logP_o + logPODelta( k , proposedOk );
+        proposedGammaPrior = logP_gamma + logPGammaODelta( k , proposedOk );
         
         // A/R
-        logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedO(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedO(k) ) ) -
-        Distributions::logPDFTruncNorm( std::log( proposedO(k) ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
+        logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedOk ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedOk ) ) -
+        Distributions::logPDFTruncNorm( std::log( proposedOk ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
         logAccProb += (proposedOPrior + proposedGammaPrior) - (logP_o + logP_gamma);
         
         if( randLogU01() < logAccProb )
         {
-            o(k) = proposedO(k);
+            o(k) = proposedOk;
             logP_o = proposedOPrior;
             logP_gamma = proposedGammaPrior;
             
@@ -2622,35 +2436,31 @@ void SUR_Chain::stepOneO()
 void SUR_Chain::stepO()
 {
     
-    arma::vec proposedO = o;
-    
-    double proposedOPrior, proposedGammaPrior, logAccProb;
+    double proposedOk, proposedOPrior, proposedGammaPrior, logAccProb;
     
     for( unsigned int k=0; k < nOutcomes ; ++k )
     {
-        proposedO(k) = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
+        proposedOk = std::exp( std::log( o(k) ) + Distributions::randTruncNorm(0.0, var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) ) );
         
-        if( arma::all( ( pi * proposedO(k) ) <= 1 ) )
+        if( pi.max() * proposedOk <= 1 )
         {
-            proposedOPrior = logPO( proposedO );
-            proposedGammaPrior = logPGamma( gamma, proposedO, pi);
+            proposedOPrior = logP_o + logPODelta( k , proposedOk );
+            proposedGammaPrior = logP_gamma + logPGammaODelta( k , proposedOk );
             
             // A/R
-            logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedO(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedO(k) ) ) -
-            Distributions::logPDFTruncNorm( std::log( proposedO(k) ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
+            logAccProb = Distributions::logPDFTruncNorm( std::log( o(k) ) , std::log( proposedOk ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( proposedOk ) ) -
+            Distributions::logPDFTruncNorm( std::log( proposedOk ) , std::log( o(k) ) , var_o_proposal , -std::numeric_limits<double>::infinity() , -std::log( o(k) ) );
             logAccProb += (proposedOPrior + proposedGammaPrior) - (logP_o + logP_gamma);
             
             if( randLogU01() < logAccProb )
             {
-                o(k) = proposedO(k);
+                o(k) = proposedOk;
                 logP_o = proposedOPrior;
                 logP_gamma = proposedGammaPrior;
                 
                 o_acc_count += o_acc_count / (double)nOutcomes;
-            }else
-                proposedO(k) = o(k);
-        }else
-            proposedO(k) = o(k);
+            }
+        }
     }
     
 }
@@ -2664,22 +2474,22 @@ void SUR_Chain::stepOnePi()
     {
         case Gamma_Type::hotspot :
         {
-            arma::vec proposedPi = pi;
+            double proposedPij;
             double proposedPiPrior, proposedGammaPrior, logAccProb;
             
-            proposedPi(j) = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
+            proposedPij = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
             
-            if( arma::all( ( o * proposedPi(j) ) <= 1 ) )
+            if( o.max() * proposedPij <= 1 )
             {
-                proposedPiPrior = logPPi( proposedPi );
-                proposedGammaPrior = logPGamma( gamma, o, proposedPi);
+                proposedPiPrior = logP_pi + logPPiDelta( j , proposedPij );
+                proposedGammaPrior = logP_gamma + logPGammaPiDelta( j , proposedPij );
                 
                 // A/R
                 logAccProb = (proposedPiPrior + proposedGammaPrior) - (logP_pi + logP_gamma);
                 
                 if( randLogU01() < logAccProb )
                 {
-                    pi(j) = proposedPi(j);
+                    pi(j) = proposedPij;
                     logP_pi = proposedPiPrior;
                     logP_gamma = proposedGammaPrior;
                     
@@ -2708,31 +2518,29 @@ void SUR_Chain::stepPi()
     {
         case Gamma_Type::hotspot :
         {
-            arma::vec proposedPi = pi;
+            double proposedPij;
             double proposedPiPrior, proposedGammaPrior, logAccProb;
             for( unsigned int j=0; j < nVSPredictors ; ++j )
             {
-                proposedPi(j) = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
+                proposedPij = std::exp( std::log( pi(j) ) + randNormal(0.0, var_pi_proposal) );
                 
-                if( arma::all( ( o * proposedPi(j) ) <= 1 ) )
+                if( o.max() * proposedPij <= 1 )
                 {
-                    proposedPiPrior = logPPi( proposedPi );
-                    proposedGammaPrior = logPGamma( gamma, o, proposedPi);
+                    proposedPiPrior = logP_pi + logPPiDelta( j , proposedPij );
+                    proposedGammaPrior = logP_gamma + logPGammaPiDelta( j , proposedPij );
                     
                     // A/R
                     logAccProb = (proposedPiPrior + proposedGammaPrior) - (logP_pi + logP_gamma);
                     
                     if( randLogU01() < logAccProb )
                     {
-                        pi(j) = proposedPi(j);
+                        pi(j) = proposedPij;
                         logP_pi = proposedPiPrior;
                         logP_gamma = proposedGammaPrior;
                         
                         pi_acc_count += pi_acc_count / (double)nVSPredictors;
-                    }else
-                        proposedPi(j) = pi(j);
-                }else
-                    proposedPi(j) = pi(j);
+                    }
+                }
             }
             break;
         }
@@ -2860,26 +2668,40 @@ void SUR_Chain::stepGamma()
     }
     // given proposedGamma now, sample a new proposedBeta matrix and corresponging quantities
     arma::umat proposedGammaMask = createGammaMask( proposedGamma );
-     
-    // note only one outcome is updated
-    // note for quantities below. The firt call to sampleXXX has the proposedQuantities set to the current value,
+    
+    // note only one outcome is updated, so rather than copying beta, XB, U and rhoU the proposal is made in place
+    // keeping an undo log of the columns it touches (XB_k, U_k and the rhoU columns downstream of k) for rejections
+    arma::uvec singleIdx_k(1);
+    singleIdx_k(0) = outcomeUpdateIdx;
+    arma::uvec updatedCols = arma::join_cols( singleIdx_k , rhoUDependentCols( outcomeUpdateIdx , sigmaRho , jt ) );
+    
+    arma::vec currentBetaK = beta.col(outcomeUpdateIdx);
+    arma::vec currentXBK = XB.col(outcomeUpdateIdx);
+    arma::vec currentUK = U.col(outcomeUpdateIdx);
+    arma::mat currentRhoUCols = rhoU.cols(updatedCols);
+    double currentLikelihoodCols = logLikelihoodCols( updatedCols , XB , rhoU , sigmaRho );
+    
+    // note for quantities below. The firt call to sampleXXX has the quantities set to the current value,
     // for them to be updated; the second call to logPXXX has them updated, needed for the backward probability
     // the main parameter of interest instead "changes to the current value" in the backward equation
-    arma::mat proposedBeta = beta;
+    logProposalRatio -= sampleBetaKGivenSigmaRho( outcomeUpdateIdx , beta , sigmaRho , jt ,
+                                                 proposedGammaMask , XB , U , rhoU );
     
-    arma::mat proposedXB = XB;
-    arma::mat proposedU = U;
-    arma::mat proposedRhoU = rhoU;
+    // update log probabilities
+    // the MRF prior changes only through the edges incident to the flipped entries, no need to go through the whole graph
+    double proposedGammaPrior;
+    if( gamma_type == Gamma_Type::mrf )
+        proposedGammaPrior = logP_gamma + mrfGraph.logPDelta( gamma , proposedGamma , updateIdx + outcomeUpdateIdx * nVSPredictors , mrf_d , mrf_e );
+    else
+        proposedGammaPrior = logPGamma( proposedGamma );
+    double proposedBetaPrior = logPBetaMask( beta , proposedGammaMask , w , w0 );
+    double proposedLikelihood = log_likelihood + logLikelihoodCols( updatedCols , XB , rhoU , sigmaRho ) - currentLikelihoodCols;
+    
+    arma::vec proposedBetaK = beta.col(outcomeUpdateIdx);
+    beta.col(outcomeUpdateIdx) = currentBetaK;
     
-    logProposalRatio -= sampleBetaKGivenSigmaRho( outcomeUpdateIdx , proposedBeta , sigmaRho , jt ,
-                                                 proposedGammaMask , proposedXB , proposedU , proposedRhoU );
     logProposalRatio += logPBetaKGivenSigmaRho( outcomeUpdateIdx , beta , sigmaRho , jt ,
-                                               gammaMask , proposedXB , proposedU , proposedRhoU );
-     
-    // update log probabilities
-    double proposedGammaPrior = logPGamma( proposedGamma );
-    double proposedBetaPrior = logPBetaMask( proposedBeta , proposedGammaMask , w , w0 );
-    double proposedLikelihood = logLikelihood( proposedGammaMask , proposedXB , proposedU , proposedRhoU , sigmaRho );
+                                               gammaMask , XB , U , rhoU );
     
     double logAccProb = logProposalRatio +
     ( proposedGammaPrior + proposedBetaPrior + proposedLikelihood ) -
@@ -2888,12 +2710,9 @@ void SUR_Chain::stepGamma()
     if( randLogU01() < logAccProb )
     {
         gamma = proposedGamma;
-        beta = proposedBeta;
+        beta.col(outcomeUpdateIdx) = proposedBetaK;
         
         gammaMask = proposedGammaMask;
-        XB = proposedXB;
-        U = proposedU;
-        rhoU = proposedRhoU;
         
         logP_gamma = proposedGammaPrior;
         logP_beta = proposedBetaPrior;
@@ -2901,11 +2720,18 @@ void SUR_Chain::stepGamma()
         
         // ++gamma_acc_count;
         gamma_acc_count += 1. ; // / updatedOutcomesIdx.n_elem
+    }else{
+        // undo the in-place changes to the quantities
+        XB.col(outcomeUpdateIdx) = currentXBK;
+        U.col(outcomeUpdateIdx) = currentUK;
+        rhoU.cols(updatedCols) = currentRhoUCols;
     }
      
     // after A/R, update bandit Related variables
     if( gamma_sampler_type == Gamma_Sampler_Type::bandit )
     {
+        banditUpdateMismatch( outcomeUpdateIdx , updateIdx );
+        
         for(arma::uvec::iterator iter = updateIdx.begin(); iter != updateIdx.end(); ++iter)
         {
             // FINITE UPDATE
@@ -3517,7 +3343,7 @@ int SUR_Chain::block_crossOver_step( std::shared_ptr<SUR_Chain>& that , arma::ma
         // covIdx = arma::find( arma::abs( tmpVec ) > threshold );
         // I'd rather leave parallelisation to armadillo and avoid the temp, but this version would work as well
         
-        covIdx = arma::find( arma::abs( arma::cor( data->col( (*VSPredictorsIdx)(predIdx) ) , data->cols( (*VSPredictorsIdx) ) ) ) > threshold );
+        covIdx = arma::find( arma::abs( predictors->cor( arma::uvec{ (*VSPredictorsIdx)(predIdx) } , (*VSPredictorsIdx) ) ) > threshold );
     }
     
     gammaXO[0] = this->getGamma();
@@ -3611,6 +3437,13 @@ int SUR_Chain::block_crossOver_step( std::shared_ptr<SUR_Chain>& that , arma::ma
     
 }
 
+void SUR_Chain::swapTemperature( std::shared_ptr<SUR_Chain>& thatChain )
+{
+    double swapTemp = this->getTemperature();
+    this->setTemperature( thatChain->getTemperature() );
+    thatChain->setTemperature( swapTemp );
+}
+
 void SUR_Chain::swapAll( std::shared_ptr<SUR_Chain>& thatChain )
 {
     
@@ -3730,8 +3563,9 @@ int SUR_Chain::exchangeAll_step( std::shared_ptr<SUR_Chain>& thatChain )
     
     if( randLogU01() < logPExchange )
     {
-        // Swap all the states
-        this -> swapAll( thatChain );
+        // Swap the temperatures, which is the same as swapping all the states
+        // but leaves each of them where it is (the sampler re-reads its ladder off the temperatures)
+        this -> swapTemperature( thatChain );
         
         return 1;
     }else
@@ -3816,7 +3650,7 @@ arma::mat SUR_Chain::createXB( const arma::umat&  externalGammaMask , const arma
         {
             singleIdx_k(0) = k;
             VS_IN_k =  externalGammaMask( arma::find(  externalGammaMask.col(1) == k ) , arma::zeros<arma::uvec>(1) );
-            externalXB.col(k) = (data->cols( (*predictorsIdx)(VS_IN_k) ) *  externalBeta.submat(VS_IN_k,singleIdx_k) );
+            externalXB.col(k) = predictors->times( (*predictorsIdx)(VS_IN_k) , externalBeta.submat(VS_IN_k,singleIdx_k) );
         }
     }
     return externalXB;
@@ -3834,7 +3668,7 @@ void SUR_Chain::updateXB()
         {
             singleIdx_k(0) = k;
             VS_IN_k = gammaMask( arma::find( gammaMask.col(1) == k ) , arma::zeros<arma::uvec>(1) );
-            XB.col(k) = (data->cols( (*predictorsIdx)(VS_IN_k) ) * beta.submat(VS_IN_k,singleIdx_k) );
+            XB.col(k) = predictors->times( (*predictorsIdx)(VS_IN_k) , beta.submat(VS_IN_k,singleIdx_k) );
         }
     }
 }
@@ -3950,31 +3784,243 @@ void SUR_Chain::updateQuantities()
     updateRhoU();
 }
 
+// outcomes whose rhoU column is a (non-zero) function of U_k
+arma::uvec SUR_Chain::rhoUDependentCols( const unsigned int k , const arma::mat&  externalSigmaRho , const JunctionTree& externalJT )
+{
+    std::vector<unsigned int> dependentCols;
+    
+    switch ( covariance_type )
+    {
+        case Covariance_Type::HIW :
+        {
+            arma::uvec xi = arma::conv_to<arma::uvec>::from(externalJT.perfectEliminationOrder);
+            unsigned int k_idx = arma::as_scalar( arma::find( xi == k , 1 ) );
+            
+            for( unsigned int l=k_idx+1; l < nOutcomes; ++l)
+            {
+                if(  externalSigmaRho(xi(l),k) != 0 )
+                    dependentCols.push_back( xi(l) );
+            }
+            break;
+        }
+            
+        case Covariance_Type::IW :
+        {
+            for( unsigned int l=k+1; l < nOutcomes; ++l)
+            {
+                if(  externalSigmaRho(l,k) != 0 )
+                    dependentCols.push_back( l );
+            }
+            break;
+        }
+            
+        default:
+            throw Bad_Covariance_Type ( covariance_type );
+    }
+    
+    return arma::conv_to<arma::uvec>::from( dependentCols );
+}
+
+// re-compute XB_k and U_k after a change in beta_k, and update the rhoU columns downstream of k by the change in U_k
+void SUR_Chain::updateQuantitiesK( const unsigned int k , const arma::umat&  externalGammaMask , const arma::mat&  externalBeta ,
+                                  const arma::mat&  externalSigmaRho , const JunctionTree& externalJT ,
+                                  arma::mat& mutantXB , arma::mat& mutantU , arma::mat& mutantRhoU )
+{
+    arma::uvec singleIdx_k(1), VS_IN_k;
+    singleIdx_k(0) = k;
+    
+    arma::vec deltaU = mutantU.col(k);
+    
+    if( externalGammaMask.n_rows > 0 )
+        VS_IN_k =  externalGammaMask( arma::find(  externalGammaMask.col(1) == k ) , arma::zeros<arma::uvec>(1) );
+    
+    if( VS_IN_k.n_elem > 0 )
+        mutantXB.col(k) = predictors->times( (*predictorsIdx)(VS_IN_k) , externalBeta.submat(VS_IN_k,singleIdx_k) );
+    else
+        mutantXB.col(k).zeros();
+    
+    mutantU.col(k) = data->col( (*outcomesIdx)(k) ) - mutantXB.col(k);
+    deltaU = mutantU.col(k) - deltaU;
+    
+    for( auto l : rhoUDependentCols( k , externalSigmaRho , externalJT ) )
+        mutantRhoU.col(l) += deltaU * externalSigmaRho(l,k);
+}
+
+// log-likelihood contribution of a subset of outcomes (tempered), used to update log_likelihood by differences
+double SUR_Chain::logLikelihoodCols( const arma::uvec& cols , const arma::mat& externalXB , const arma::mat& externalRhoU , const arma::mat&  externalSigmaRho )
+{
+    double logP = 0.;
+    
+    for( auto k : cols )
+    {
+        logP += Distributions::logPDFNormal( data->col( (*outcomesIdx)(k) ) , (externalXB.col(k) + externalRhoU.col(k)) ,  externalSigmaRho(k,k));
+    }
+    
+    return logP/temperature;
+}
+
 
 
 // Bandit-sampling related methods
 void SUR_Chain::banditInit()// initialise all the private memebers
 {
-    banditZeta = arma::vec(nVSPredictors);
-    
     banditAlpha = arma::mat(nVSPredictors,nOutcomes);
     banditAlpha.fill( 0.5 );
     
     banditBeta = arma::mat(nVSPredictors,nOutcomes);
     banditBeta.fill( 0.5 );
     
-    mismatch = arma::vec(nVSPredictors);
-    normalised_mismatch = arma::vec(nVSPredictors);
-    normalised_mismatch_backwards = arma::vec(nVSPredictors);
+    banditZeta = arma::mat(nVSPredictors,nOutcomes);
+    for( unsigned int k=0; k<nOutcomes; ++k )
+        banditZeta.col(k) = randVecBeta( banditAlpha.col(k) , banditBeta.col(k) );
+    
+    banditResetMismatch();
     
-    n_updates_bandit = 4; // this needs to be low as its O(n_updates!)
+    n_updates_bandit = 4; // proposal cost is O(n_updates log p), this can be raised (to 20-50) for large p
+    n_refresh_bandit = std::min( 32u , nVSPredictors ); // arbitrary, trades freshness of the zetas against cost per step
     
     banditLimit = (double)nObservations;
     banditIncrement = 1.;
 }
 
+Utils::SumTree& SUR_Chain::banditMismatchTree( unsigned int k )
+{
+    if( banditMismatch[k].size() == 0 )
+    {
+        arma::vec weights = banditZeta.col(k);
+        for( unsigned int i=0; i<nVSPredictors; ++i )
+            if( gamma(i,k) != 0 )
+                weights(i) = 1. - weights(i);
+        
+        banditMismatch[k].build( weights );
+    }
+    
+    return banditMismatch[k];
+}
+
+void SUR_Chain::banditResetMismatch()
+{
+    banditMismatch = std::vector<Utils::SumTree>(nOutcomes); // empty trees, rebuilt on demand
+}
+
+// gamma(idx,k) might have changed, zetas haven't
+void SUR_Chain::banditUpdateMismatch( unsigned int k , const arma::uvec& idx )
+{
+    if( banditMismatch[k].size() == 0 )
+        return;
+    
+    for( auto i : idx )
+        banditMismatch[k].update( i , ( gamma(i,k) == 0 ) ? banditZeta(i,k) : 1. - banditZeta(i,k) );
+}
+
+// Gibbs refresh of n_refresh_bandit zetas from their Beta. The zetas are independent of everything else, so this is valid
+// as long as which ones are refreshed does not depend on their values
+void SUR_Chain::banditRefreshZeta( unsigned int k )
+{
+    Utils::SumTree& mismatch = banditMismatchTree( k );
+    
+    for( unsigned int r=0; r<n_refresh_bandit; ++r )
+    {
+        unsigned int i = randIntUniform(0,nVSPredictors-1);
+        banditZeta(i,k) = randBeta( banditAlpha(i,k) , banditBeta(i,k) );
+        mismatch.update( i , ( gamma(i,k) == 0 ) ? banditZeta(i,k) : 1. - banditZeta(i,k) );
+    }
+}
+
 // MC3 init
 void SUR_Chain::MC3Init()
 {
     n_updates_MC3 = std::ceil( nVSPredictors/40 ); //arbitrary number, should I use something different?
 }
+
+// *******************************
+// Checkpointing
+// *******************************
+
+// everything that evolves during the run (or is set after construction), in a fixed order;
+// data and what is derived from it (XtX, corrMatX, the Gram cache) are rebuilt with the chain instead
+template<typename Archive>
+void SUR_Chain::checkpointState( Archive& ar )
+{
+    ar.match( nObservations ); ar.match( nOutcomes ); ar.match( nVSPredictors ); ar.match( nFixedPredictors );
+    ar.match( covariance_type ); ar.match( gamma_type ); ar.match( beta_type ); ar.match( gamma_sampler_type );
+    
+    // quantities, and the cached beta_k factors as these are updated rather than recomputed (so they carry their own round-off)
+    ar.io( gammaMask ); ar.io( XB ); ar.io( U ); ar.io( rhoU );
+    
+    uint64_t nFactors = betaKFactor.size();
+    ar.io( nFactors );
+    betaKFactor.resize( nFactors );
+    for( auto& factor : betaKFactor )
+    {
+        ar.io( factor.idx ); ar.io( factor.R );
+        ar.io( factor.xtxScale ); ar.io( factor.fixedPrecision ); ar.io( factor.vsPrecision );
+        ar.io( factor.valid );
+    }
+    
+    ar.io( temperature ); ar.io( internalIterationCounter ); ar.io( jtStartIteration );
+    
+    // adaptation
+    ar.io( tauEmpiricalMean ); ar.io( wEmpiricalMean ); ar.io( oEmpiricalMean ); ar.io( piEmpiricalMean );
+    ar.io( tauEmpiricalM2 ); ar.io( wEmpiricalM2 ); ar.io( oEmpiricalM2 ); ar.io( piEmpiricalM2 );
+    ar.io( var_tau_proposal_init ); ar.io( var_o_proposal_init ); ar.io( var_pi_proposal_init ); ar.io( var_w_proposal_init );
+    
+    // bandit, the mismatch trees are rebuilt from zeta and gamma (bit-identical, see Utils::SumTree)
+    ar.io( n_updates_bandit ); ar.io( n_refresh_bandit );
+    ar.io( banditZeta ); ar.io( banditAlpha ); ar.io( banditBeta );
+    ar.io( banditLimit ); ar.io( banditIncrement );
+    
+    // parameters
+    ar.io( tau ); ar.io( a_tau ); ar.io( b_tau ); ar.io( var_tau_proposal ); ar.io( tau_acc_count ); ar.io( logP_tau );
+    ar.io( eta ); ar.io( a_eta ); ar.io( b_eta ); ar.io( logP_eta );
+    ar.io( jt ); ar.io( n_updates_jt ); ar.io( jt_acc_count ); ar.io( logP_jt );
+    ar.io( sigmaRho ); ar.io( nu ); ar.io( logP_sigmaRho );
+    ar.io( o ); ar.io( a_o ); ar.io( b_o ); ar.io( var_o_proposal ); ar.io( o_acc_count ); ar.io( logP_o );
+    ar.io( pi ); ar.io( a_pi ); ar.io( b_pi ); ar.io( var_pi_proposal ); ar.io( pi_acc_count ); ar.io( logP_pi );
+    ar.io( mrf_d ); ar.io( mrf_e );
+    ar.io( gamma ); ar.io( n_updates_MC3 ); ar.io( gamma_acc_count ); ar.io( logP_gamma );
+    ar.io( w ); ar.io( a_w ); ar.io( b_w ); ar.io( logP_w ); ar.io( w_acc_count ); ar.io( var_w_proposal );
+    ar.io( w0 ); ar.io( a_w0 ); ar.io( b_w0 ); ar.io( logP_w0 ); ar.io( w0_acc_count ); ar.io( var_w0_proposal );
+    ar.io( beta ); ar.io( logP_beta );
+    
+    ar.io( log_likelihood ); ar.io( predLik );
+}
+
+void SUR_Chain::saveState( CheckpointWriter& ar )
+{
+    checkpointState( ar );
+}
+
+void SUR_Chain::loadState( CheckpointReader& ar )
+{
+    checkpointState( ar );
+    banditResetMismatch();
+}
+
+// what the output and the progress messages read off the cold chain, a small part of the state above
+template<typename Archive>
+void SUR_Chain::outputState( Archive& ar )
+{
+    ar.io( temperature ); ar.io( internalIterationCounter );
+    ar.io( tau ); ar.io( var_tau_proposal ); ar.io( logP_tau );
+    ar.io( eta ); ar.io( logP_eta );
+    ar.io( jt ); ar.io( jt_acc_count ); ar.io( logP_jt );
+    ar.io( sigmaRho ); ar.io( logP_sigmaRho );
+    ar.io( o ); ar.io( logP_o );
+    ar.io( pi ); ar.io( logP_pi );
+    ar.io( gamma ); ar.io( gamma_acc_count ); ar.io( logP_gamma );
+    ar.io( w ); ar.io( logP_w );
+    ar.io( beta ); ar.io( logP_beta );
+    
+    ar.io( log_likelihood ); ar.io( predLik );
+}
+
+void SUR_Chain::saveOutputState( CheckpointWriter& ar )
+{
+    outputState( ar );
+}
+
+void SUR_Chain::loadOutputState( CheckpointReader& ar )
+{
+    outputState( ar );
+}
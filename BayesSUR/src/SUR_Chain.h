@@ -4,10 +4,13 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <map>
+#include <algorithm>
 
 #include "utils.h"
 #include "distr.h"
 #include "junction_tree.h"
+#include "checkpoint.h"
 
 #include "ESS_Atom.h"
 #include "Parameter_types.h"
@@ -43,7 +46,7 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
             std::shared_ptr<arma::uvec> fixedPredictorsIdx_, std::shared_ptr<arma::umat> missingDataArrayIdx_, std::shared_ptr<arma::uvec> completeCases_, 
             Gamma_Sampler_Type gamma_sampler_type_ , Gamma_Type gamma_type_ ,
             Beta_Type beta_type_ , Covariance_Type covariance_type_ , bool output_CPO = false , int maxThreads = 1,
-            double externalTemperature = 1. );
+            double externalTemperature = 1. , std::shared_ptr<GramCache> gramCache_ = nullptr , std::shared_ptr<PredictorMatrix> predictors_ = nullptr );
 
         SUR_Chain( Utils::SUR_Data& surData, 
             Gamma_Sampler_Type gamma_sampler_type_ , Gamma_Type gamma_type_ ,
@@ -119,15 +122,6 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
         arma::mat& getBanditBeta();
         void setBanditBeta( arma::mat );
         
-        arma::vec& getBanditMismatch();
-        void setBanditMismatch( arma::vec );
-
-        arma::vec& getBanditNormalisedMismatch();
-        void setBanditNormalisedMismatch( arma::vec );
-        
-        arma::vec& getBanditNormalisedMismatchBackwards();
-        void setBanditNormalisedMismatchBackwards( arma::vec );
-        
         // Parameter states etc
 
         // TAU
@@ -170,7 +164,7 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
 
         // JT
         JunctionTree& getJT();
-        arma::sp_umat getGAdjMat() const;
+        const arma::sp_umat& getGAdjMat() const;
         void setJT( JunctionTree& );
         void setJT( JunctionTree& , double );
 
@@ -420,6 +414,12 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
 //        double logPGamma( const arma::umat& , double , double , const arma::mat& );
         double logPGamma( const arma::umat& , double , double );
 
+        // change in the o / pi / gamma log-priors when only o_k or pi_j moves
+        double logPODelta( unsigned int , double );
+        double logPPiDelta( unsigned int , double );
+        double logPGammaODelta( unsigned int , double );
+        double logPGammaPiDelta( unsigned int , double );
+
         // W
         double logPW( );
         double logPW( double );
@@ -511,11 +511,19 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
 
         // update all the internal proposal RW variances based on their acceptance rate
         void updateProposalVariances();
+
+        // save/restore the whole state of the chain (but not the data) for checkpoint and resume
+        void saveState( CheckpointWriter& );
+        void loadState( CheckpointReader& );
+        // save/restore only what the output reads, to follow the cold chain from another process
+        void saveOutputState( CheckpointWriter& );
+        void loadOutputState( CheckpointReader& );
         // more complex functions could be defined outide
         // through public methods but this as a baseline is good to have.
 
         int globalStep( std::shared_ptr<SUR_Chain>& );
         void swapAll( std::shared_ptr<SUR_Chain>& );
+        void swapTemperature( std::shared_ptr<SUR_Chain>& );
 
         // *******************************
         // Global operators between two chains
@@ -561,6 +569,12 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
                 const arma::umat& , const arma::mat& , const arma::mat& , const JunctionTree& );
         void updateQuantities();
 
+        // single outcome versions, used by stepGamma when only beta_k changes
+        arma::uvec rhoUDependentCols( const unsigned int , const arma::mat& , const JunctionTree& ); // k, sigmaRho, jt
+        void updateQuantitiesK( const unsigned int , const arma::umat& , const arma::mat& , const arma::mat& , const JunctionTree& ,
+                arma::mat& , arma::mat& , arma::mat& ); // k, gammaMask, beta, sigmaRho, jt -> XB, U, rhoU
+        double logLikelihoodCols( const arma::uvec& , const arma::mat& , const arma::mat& , const arma::mat& ); // outcomes, XB, rhoU, sigmaRho
+
 
         // Bandit-sampling related methods
         void banditInit(); // initialise all the private memebers
@@ -572,7 +586,9 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
 
         // Data (and related quatities)
         std::shared_ptr<arma::mat> data;
+        std::shared_ptr<PredictorMatrix> predictors; // X'y, X'X and X*beta go through this, see predictor_matrix.h
         std::shared_ptr<arma::mat> mrfG;
+        Utils::MRFGraph mrfGraph; // CSR adjacency of mrfG, built in mrfGInit
         std::shared_ptr<arma::uvec> outcomesIdx;
 
         std::shared_ptr<arma::uvec> predictorsIdx;
@@ -582,11 +598,35 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
         std::shared_ptr<arma::umat> missingDataArrayIdx;
         std::shared_ptr<arma::uvec> completeCases;
 
+        template<typename Archive> void checkpointState( Archive& ); // describes the checkpoint, see saveState/loadState
+        template<typename Archive> void outputState( Archive& ); // see saveOutputState/loadOutputState
+
+        // walks the full conditionals of sigmaRho given beta in the order they're sampled, calling visit( l , conditioninIndexes , schurComplement , L , v )
+        // for each outcome l: L is the lower Cholesky factor of Sigma(conditioninIndexes,conditioninIndexes), extended by one row per node
+        // inside a clique (and shared by cliques with the same separator), v = L^-1 * Sigma(conditioninIndexes,l)
+        template<typename F> void forEachSigmaRhoConditional( const arma::mat& , const JunctionTree& , F ) const;
+
         // these are pointers cause they will live on outside the MCMC
         
         bool preComputedXtX;
+        std::shared_ptr<GramCache> gramCache; // used for X'X when this is too big to be precomputed
         arma::mat XtX;
         void setXtX();
+        arma::mat XtXSubmat( const arma::uvec& , const arma::uvec& ); // XtX(rows,cols), from XtX if precomputed or from the Gram cache otherwise
+
+        // Cholesky factor of the beta_k full-conditional precision, one per outcome
+        // cached so that the forward/backward proposals in stepGamma (which differ only by a few predictors)
+        // are obtained by adding/removing variables to the factor rather than re-factorising
+        struct BetaKFactor
+        {
+            arma::uvec idx; // predictor indexes in the order they enter the factor
+            arma::mat R; // upper triangular, R.t()*R = xtxScale * XtX(idx,idx) + diag( prior precisions )
+            double xtxScale, fixedPrecision, vsPrecision;
+            bool valid = false;
+        };
+        std::vector<BetaKFactor> betaKFactor;
+        BetaKFactor& betaKPrecisionChol( const unsigned int , const arma::uvec& , double , double , double ); // outcome, VS_IN_k, xtxScale, fixed and VS predictors prior precision
+        void betaKPrecisionParameters( const unsigned int , const arma::mat& , double , double& , double& , double& ); // outcome, sigmaRho, xtxMultiplier -> xtxScale, fixed and VS prior precision
 
         unsigned int nObservations; // number of samples
         unsigned int nOutcomes; // number of outcomes
@@ -618,9 +658,16 @@ class SUR_Chain : public ESS_Atom<SUR_Chain>
         arma::mat banditZeta;
         arma::mat banditAlpha;
         arma::mat banditBeta;
-        arma::vec mismatch;
-        arma::vec normalised_mismatch;
-        arma::vec normalised_mismatch_backwards;
+
+        // mismatch weights ( zeta if gamma is 0, 1-zeta otherwise ), one sum tree per outcome over the persistent zetas
+        // so that each bandit proposal is O(log p); a tree is (re)built lazily when gamma is changed outside stepGamma
+        std::vector<Utils::SumTree> banditMismatch;
+        unsigned int n_refresh_bandit; // zetas redrawn at each proposal, chosen uniformly at random
+
+        Utils::SumTree& banditMismatchTree( unsigned int k );
+        void banditResetMismatch();
+        void banditUpdateMismatch( unsigned int k , const arma::uvec& idx );
+        void banditRefreshZeta( unsigned int k );
 
         double banditLimit;
         double banditIncrement;
@@ -0,0 +1,169 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+
+namespace
+{
+	const char checkpointMagic[8] = { 'B','S','U','R','C','K','P','1' };
+}
+
+// ****************************
+// Writer
+
+CheckpointWriter::CheckpointWriter( const std::string& fileName_ ):
+fileName(fileName_), out(file)
+{
+	file.open( fileName + ".tmp" , std::ios::out | std::ios::trunc | std::ios::binary );
+	if( !file.is_open() )
+		throw Bad_Checkpoint( fileName + ".tmp" );
+
+	out.write( checkpointMagic , sizeof(checkpointMagic) );
+}
+
+CheckpointWriter::CheckpointWriter( std::ostream& out_ ):
+out(out_)
+{ }
+
+void CheckpointWriter::write( const arma::sp_umat& m )
+{
+	write( arma::umat( m ) ); // adjacency matrices, small enough to go dense
+}
+
+void CheckpointWriter::write( const RNGStream& stream )
+{
+	static_assert( std::is_trivially_copyable<RNGStream>::value , "RNGStream is expected to be a plain state array" );
+	out.write( reinterpret_cast<const char*>( &stream ) , sizeof(RNGStream) );
+}
+
+// components are written in PCS order, with the tree links as positions in the PCS
+void CheckpointWriter::write( const JunctionTree& jt )
+{
+	const auto& pcs = jt.perfectCliqueSequence;
+
+	auto position = [&pcs]( const unsigned int c ) -> unsigned int
+	{
+		for( unsigned int i=0; i<pcs.size(); ++i )
+			if( pcs[i] == c )
+				return i;
+		return UINT_MAX;
+	};
+
+	write( jt.n );
+	write( (uint64_t)pcs.size() );
+
+	for( unsigned int q=0; q<jt.getNCliques(); ++q )
+	{
+		const JTComponent& c = jt.getClique(q);
+
+		write( std::vector<unsigned int>( c.getNodes().begin() , c.getNodes().end() ) );
+		write( std::vector<unsigned int>( c.getSeparator().begin() , c.getSeparator().end() ) );
+		write( c.hasParent() ? position( c.getParent() ) : UINT_MAX );
+
+		std::vector<unsigned int> childrenPositions;
+		for( auto child : c.getChildrens() )
+			childrenPositions.push_back( position( child ) );
+		write( childrenPositions );
+	}
+
+	write( jt.perfectEliminationOrder );
+	write( jt.adjacencyMatrix );
+}
+
+void CheckpointWriter::commit()
+{
+	file.close();
+
+	if( file.fail() )
+		throw Bad_Checkpoint( fileName + ".tmp" );
+
+	if( std::rename( ( fileName + ".tmp" ).c_str() , fileName.c_str() ) != 0 )
+	{
+		std::remove( fileName.c_str() ); // rename does not overwrite on some platforms
+		if( std::rename( ( fileName + ".tmp" ).c_str() , fileName.c_str() ) != 0 )
+			throw Bad_Checkpoint( fileName );
+	}
+}
+
+// ****************************
+// Reader
+
+CheckpointReader::CheckpointReader( const std::string& fileName_ ):
+fileName(fileName_), in(file)
+{
+	file.open( fileName , std::ios::in | std::ios::binary );
+
+	char magic[8];
+	in.read( magic , sizeof(magic) );
+
+	if( !in || std::memcmp( magic , checkpointMagic , sizeof(magic) ) != 0 )
+		throw Bad_Checkpoint( fileName );
+}
+
+CheckpointReader::CheckpointReader( std::istream& in_ , const std::string& name ):
+fileName(name), in(in_)
+{ }
+
+void CheckpointReader::read( arma::sp_umat& m )
+{
+	arma::umat dense;
+	read( dense );
+	m = arma::sp_umat( dense );
+}
+
+void CheckpointReader::read( RNGStream& stream )
+{
+	in.read( reinterpret_cast<char*>( &stream ) , sizeof(RNGStream) );
+	check();
+}
+
+void CheckpointReader::read( JunctionTree& jt )
+{
+	unsigned int n;
+	uint64_t nComponents;
+	read( n );
+	read( nComponents );
+
+	// read back in PCS order, so arena indexes and PCS positions coincide
+	std::vector<JTComponent> components( nComponents );
+	std::vector<unsigned int> pcs( nComponents );
+
+	std::vector<unsigned int> nodes, separator, childrenPositions;
+	unsigned int parentPosition;
+
+	for( uint64_t i=0; i<nComponents; ++i )
+	{
+		read( nodes );
+		read( separator );
+		read( parentPosition );
+		read( childrenPositions );
+
+		components[i].setNodes( nodes );
+		components[i].setSeparator( separator );
+
+		if( parentPosition != UINT_MAX )
+		{
+			if( parentPosition >= nComponents )
+				throw Bad_Checkpoint( fileName );
+			components[i].setParent( parentPosition );
+		}
+
+		JTLinks childrens;
+		for( auto c : childrenPositions )
+		{
+			if( c >= nComponents )
+				throw Bad_Checkpoint( fileName );
+			childrens.push_back( c );
+		}
+		components[i].setChildrens( childrens );
+
+		pcs[i] = i;
+	}
+
+	jt = JunctionTree( n , components , pcs );
+
+	// these are recomputed by the constructor, but restore them verbatim anyway
+	read( jt.perfectEliminationOrder );
+	read( jt.adjacencyMatrix );
+}
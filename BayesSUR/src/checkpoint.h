@@ -0,0 +1,136 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#ifdef CCODE
+	#include <iostream>
+    #include <armadillo>
+#else
+    #include <RcppArmadillo.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <type_traits>
+
+#include "global.h"
+#include "junction_tree.h"
+
+/*
+Binary checkpoint of a whole run (see ESS_Sampler::saveState/loadState and the chains' own saveState/loadState).
+Values are written raw, in the order they are read back: the chains describe their state once, in a function
+templated on the archive, calling io() for the state and match() for what must agree with the rebuilt run;
+the file starts with a magic/version tag so that a stale or foreign file is rejected rather than misread.
+The writer goes through a temporary file that replaces the old checkpoint only once complete,
+so a run killed while checkpointing still leaves the previous checkpoint usable.
+Both also work on a plain stream, with no tag, to move part of a chain state in memory (see ESS_Sampler::poolStep).
+*/
+
+class Bad_Checkpoint : public std::exception
+{
+	public:
+		Bad_Checkpoint( const std::string& fileName_ ): message( "Checkpoint file " + fileName_ + " is missing, truncated or does not match this run." ) {}
+
+		const char * what () const throw ()
+		{
+			return message.c_str();
+		}
+
+	private:
+		std::string message;
+};
+
+class CheckpointWriter {
+
+	public:
+
+		explicit CheckpointWriter( const std::string& fileName_ );
+		explicit CheckpointWriter( std::ostream& out_ );
+
+		template<typename T>
+		typename std::enable_if< std::is_arithmetic<T>::value || std::is_enum<T>::value >::type
+		write( const T& value ){ out.write( reinterpret_cast<const char*>( &value ) , sizeof(T) ); }
+
+		template<typename eT>
+		void write( const arma::Mat<eT>& m )
+		{
+			write( (uint64_t)m.n_rows ); write( (uint64_t)m.n_cols );
+			out.write( reinterpret_cast<const char*>( m.memptr() ) , m.n_elem * sizeof(eT) );
+		}
+
+		template<typename T>
+		void write( const std::vector<T>& v )
+		{
+			write( (uint64_t)v.size() );
+			for( const auto& x : v )
+				write( x );
+		}
+
+		void write( const arma::sp_umat& m );
+		void write( const RNGStream& stream );
+		void write( const JunctionTree& jt );
+
+		// same interface as CheckpointReader, so that a single function can describe what a checkpoint contains
+		template<typename T> void io( const T& value ){ write( value ); }
+		template<typename T> void match( const T& value ){ write( value ); }
+
+		// moves the temporary file in place of the checkpoint file
+		void commit();
+
+	private:
+
+		std::string fileName;
+		std::ofstream file;
+		std::ostream& out; // file, or the stream given
+};
+
+class CheckpointReader {
+
+	public:
+
+		explicit CheckpointReader( const std::string& fileName_ );
+		CheckpointReader( std::istream& in_ , const std::string& name ); // name is only for the error messages
+
+		template<typename T>
+		typename std::enable_if< std::is_arithmetic<T>::value || std::is_enum<T>::value >::type
+		read( T& value ){ in.read( reinterpret_cast<char*>( &value ) , sizeof(T) ); check(); }
+
+		template<typename eT>
+		void read( arma::Mat<eT>& m )
+		{
+			uint64_t nRows, nCols;
+			read( nRows ); read( nCols );
+			m.set_size( nRows , nCols );
+			in.read( reinterpret_cast<char*>( m.memptr() ) , m.n_elem * sizeof(eT) ); check();
+		}
+
+		template<typename T>
+		void read( std::vector<T>& v )
+		{
+			uint64_t n;
+			read( n );
+			v.resize( n );
+			for( auto& x : v )
+				read( x );
+		}
+
+		void read( arma::sp_umat& m );
+		void read( RNGStream& stream );
+		void read( JunctionTree& jt );
+
+		template<typename T> void io( T& value ){ read( value ); }
+
+		// throws Bad_Checkpoint unless the stored value equals expected, used for what the run is rebuilt with (dimensions, types, ...)
+		template<typename T>
+		void match( const T& expected ){ T value; read( value ); if( value != expected ) throw Bad_Checkpoint( fileName ); }
+
+	private:
+
+		void check(){ if( !in ) throw Bad_Checkpoint( fileName ); }
+
+		std::string fileName;
+		std::ifstream file;
+		std::istream& in; // file, or the stream given
+};
+
+#endif
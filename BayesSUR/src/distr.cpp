@@ -17,27 +17,198 @@
 
 using namespace Rcpp;
 
+// Generators used when the calling thread has its own RNGStream (see global.h).
+// Normals come from the Marsaglia & Tsang (2000) 128-layer ziggurat and Gammas from Marsaglia & Tsang (2000)
+// squeeze method on top of it, so the batch versions below are tight loops over cheap integer draws.
+namespace
+{
+	struct ZigguratTables
+	{
+		uint32_t kn[128];
+		double wn[128], fn[128];
+
+		ZigguratTables()
+		{
+			const double m1 = 2147483648.0, vn = 9.91256303526217e-3;
+			double dn = 3.442619855899, tn = dn;
+			double q = vn / std::exp( -.5*dn*dn );
+
+			kn[0] = (uint32_t)( (dn/q)*m1 );	kn[1] = 0;
+			wn[0] = q/m1;	wn[127] = dn/m1;
+			fn[0] = 1.;		fn[127] = std::exp( -.5*dn*dn );
+
+			for( int i=126; i>=1; --i )
+			{
+				dn = std::sqrt( -2.*std::log( vn/dn + std::exp( -.5*dn*dn ) ) );
+				kn[i+1] = (uint32_t)( (dn/tn)*m1 );
+				tn = dn;
+				fn[i] = std::exp( -.5*dn*dn );
+				wn[i] = dn/m1;
+			}
+		}
+	};
+
+	const ZigguratTables& zigguratTables()
+	{
+		static const ZigguratTables tables; // thread-safe initialisation in C++11
+		return tables;
+	}
+
+	inline double zigNormal( RNGStream& stream )
+	{
+		const ZigguratTables& zt = zigguratTables();
+		const double r = 3.442620;
+
+		// the layer comes from the low bits of the word and the value from its high half, so that they are independent
+		// (taking both from the same 32 bits, as in the original ziggurat, ties the layer to the magnitude)
+		uint64_t u = stream();
+		int32_t hz = (int32_t)( u >> 32 );
+		uint32_t iz = u & 127;
+
+		if( (uint32_t)std::abs( (int64_t)hz ) < zt.kn[iz] )
+			return hz * zt.wn[iz];
+
+		for(;;)
+		{
+			double x = hz * zt.wn[iz];
+
+			if( iz == 0 ) // tail
+			{
+				double y;
+				do{
+					x = -std::log( stream.nextU01() ) / r;
+					y = -std::log( stream.nextU01() );
+				}while( y+y < x*x );
+				return ( hz > 0 ) ? r+x : -r-x;
+			}
+
+			if( zt.fn[iz] + stream.nextU01()*( zt.fn[iz-1] - zt.fn[iz] ) < std::exp( -.5*x*x ) )
+				return x;
+
+			u = stream();
+			hz = (int32_t)( u >> 32 );
+			iz = u & 127;
+			if( (uint32_t)std::abs( (int64_t)hz ) < zt.kn[iz] )
+				return hz * zt.wn[iz];
+		}
+	}
+
+	// unit scale; shape < 1 uses Gamma(shape) = Gamma(shape+1) * U^(1/shape)
+	inline double mtGamma( RNGStream& stream , const double shape )
+	{
+		if( shape < 1. )
+			return mtGamma( stream , shape + 1. ) * std::pow( stream.nextU01() , 1./shape );
+
+		const double d = shape - 1./3. , c = 1./std::sqrt( 9.*d );
+		double x, v, u;
+
+		for(;;)
+		{
+			do{
+				x = zigNormal( stream );
+				v = 1. + c*x;
+			}while( v <= 0. );
+
+			v = v*v*v;
+			u = stream.nextU01();
+
+			if( u < 1. - 0.0331*(x*x)*(x*x) )
+				return d*v;
+			if( std::log(u) < 0.5*x*x + d*( 1. - v + std::log(v) ) )
+				return d*v;
+		}
+	}
+
+	inline double mtBeta( RNGStream& stream , const double a , const double b )
+	{
+		double x = mtGamma( stream , a );
+		return x / ( x + mtGamma( stream , b ) );
+	}
+
+	// a normal over the square root of an independent chi-square / nu, the chi-square being 2*Gamma(nu/2)
+	inline double mtStudentT( RNGStream& stream , const double nu )
+	{
+		double z = zigNormal( stream );
+		return z / std::sqrt( mtGamma( stream , 0.5*nu ) * 2. / nu );
+	}
+
+	// inversion (sequential search from 0) for small n, otherwise Knuth's recursion on the order statistics of
+	// n uniforms: the i-th of them is Beta(i,n+1-i) and splits the problem in two binomials of about half the size
+	unsigned int mtBinomial( RNGStream& stream , unsigned int n , double p )
+	{
+		unsigned int offset = 0;
+
+		while( n >= 64 )
+		{
+			if( p <= 0. )
+				return offset;
+			if( p >= 1. )
+				return offset + n;
+
+			unsigned int i = 1 + n/2;
+			double x = mtBeta( stream , i , n + 1 - i );
+
+			if( x >= p ) // the i-th uniform is above p, so are the ones after it
+			{
+				n = i - 1;
+				p = p / x;
+			}
+			else
+			{
+				offset += i;
+				n -= i;
+				p = ( p - x ) / ( 1. - x );
+			}
+		}
+
+		if( p <= 0. )
+			return offset;
+		if( p >= 1. )
+			return offset + n;
+
+		bool flip = ( p > 0.5 ); // keeps q^n away from underflow
+		double q = flip ? p : 1.-p , r = ( flip ? 1.-p : p ) / q;
+		double f = std::pow( q , (double)n ) , u = stream.nextU01();
+
+		unsigned int k = 0;
+		while( k < n && u >= f )
+		{
+			u -= f;
+			f *= r * (double)( n - k ) / (double)( k + 1 );
+			++k;
+		}
+
+		return offset + ( flip ? n - k : k );
+	}
+}
+
     // [[Rcpp::export]]
 	double randU01()
 	{
+		if( RNGStream* stream = getThreadRNGStream() )
+			return stream->nextU01();
+
 		return R::runif( 0., 1. );
 	}
 
     // [[Rcpp::export]]
 	double randLogU01()
 	{
-		return log( R::runif( 0., 1. ) );
+		return log( randU01() );
 	}
 
     // [[Rcpp::export]]
 	int randIntUniform(const int a,const int b)
 	{
-		return ceil( R::runif( a-1, b ) );
+		return ceil( (a-1) + (b-a+1) * randU01() ); // same as R::runif( a-1, b )
 	}
 
     // [[Rcpp::export]]
 	double randExponential(const double lambda)
 	{
+		if( RNGStream* stream = getThreadRNGStream() )
+			return -lambda * std::log( stream->nextU01() ); // lambda is the scale, as in R::rexp
+
 		return R::rexp( lambda );
 	}
 
@@ -45,9 +216,16 @@ using namespace Rcpp;
 	arma::vec randVecExponential(const unsigned int n, const double lambda)
 	{
 		arma::vec res(n);
-		for(unsigned int i=0; i<n; ++i)
+		if( RNGStream* stream = getThreadRNGStream() )
 		{
-			res(i) = R::rexp( lambda );
+			double* buf = res.memptr();
+			for(unsigned int i=0; i<n; ++i)
+				buf[i] = -lambda * std::log( stream->nextU01() ); // lambda is the scale, as in R::rexp
+		}
+		else
+		{
+			for(unsigned int i=0; i<n; ++i)
+				res(i) = R::rexp( lambda );
 		}
 		return res;
 	}
@@ -55,6 +233,9 @@ using namespace Rcpp;
     // [[Rcpp::export]]
 	unsigned int randBinomial(const unsigned int n, const double p) // slow but safe (CARE, n here is the binomial parameters, return value is always ONE integer)
 	{
+		if( RNGStream* stream = getThreadRNGStream() )
+			return mtBinomial( *stream , n , p );
+
 		return R::rbinom( n, p );
         
 	}
@@ -72,7 +253,7 @@ using namespace Rcpp;
 	  {
 	    if(prob(k)>0) {
 	    	pp = prob(k) / p_tot;
-	    	rN(k) = ((pp < 1.) ? R::rbinom(n,  pp) : n);
+	    	rN(k) = ((pp < 1.) ? randBinomial(n,  pp) : n);
 	    	n -= rN(k);
 	    }else{
 	    	rN(k) = 0;
@@ -93,6 +274,9 @@ using namespace Rcpp;
 		if( sigmaSquare< 0 )
 			throw Distributions::negativeParameters();
 
+		if( RNGStream* stream = getThreadRNGStream() )
+			return m + sigmaSquare * zigNormal( *stream ); // same parametrisation as the R::rnorm call below
+
     	return R::rnorm( m, sigmaSquare );
 	}
 
@@ -104,9 +288,16 @@ using namespace Rcpp;
 			throw Distributions::negativeParameters();
         
     	arma::vec res(n);
-    	for(unsigned int i=0; i<n; ++i)
+		if( RNGStream* stream = getThreadRNGStream() )
+		{
+			double* buf = res.memptr();
+			for(unsigned int i=0; i<n; ++i)
+				buf[i] = m + sigmaSquare * zigNormal( *stream );
+		}
+		else
 		{
-			res(i) = R::rnorm( m, sigmaSquare );
+			for(unsigned int i=0; i<n; ++i)
+				res(i) = R::rnorm( m, sigmaSquare );
 		}
 		return res;
 	}
@@ -114,6 +305,9 @@ using namespace Rcpp;
     // [[Rcpp::export]]
 	double randT(const double nu)
 	{
+		if( RNGStream* stream = getThreadRNGStream() )
+			return mtStudentT( *stream , nu );
+
     	return R::rt( nu );
 	}
 
@@ -123,7 +317,7 @@ using namespace Rcpp;
     	arma::vec res(n);
     	for(unsigned int i=0; i<n; ++i)
 		{
-			res(i) = R::rt( nu );
+			res(i) = randT( nu );
 		}
 		return res;
 	}
@@ -146,6 +340,9 @@ using namespace Rcpp;
 			throw Distributions::negativeParameters(); // THROW EXCPTION
 		}
 
+		if( RNGStream* stream = getThreadRNGStream() )
+			return scale * mtGamma( *stream , shape );
+
 		return R::rgamma( shape, scale );
 	}
 
@@ -159,7 +356,7 @@ using namespace Rcpp;
 			throw Distributions::negativeParameters(); // THROW EXCPTION
 		}
 
-		return 1./R::rgamma(shape, 1./scale);
+		return 1./randGamma(shape, 1./scale);
         //return 1./Rcpp::rgamma(1, shape, 1./scale)[0];
 	}
 
@@ -175,8 +372,8 @@ using namespace Rcpp;
         
 		//std::normal_distribution<> normal01(0.,1.);
         
-		// misc above diagonal
-		arma::mat Z(m,m);
+		// zeros above diagonal
+		arma::mat Z(m,m,arma::fill::zeros);
 
 		// Fill the diagonal
 		for(unsigned int i = 0; i < m; i++){
@@ -186,7 +383,7 @@ using namespace Rcpp;
 		// Fill the lower matrix with random normals
 		for(unsigned int j = 0; j < m; j++){
 			for(unsigned int i = j+1; i < m; i++){
-		  		Z(i,j) = R::rnorm(0.,1.);
+		  		Z(i,j) = randNormal(0.,1.);
 			}
 		}
 
@@ -200,24 +397,82 @@ using namespace Rcpp;
     // [[Rcpp::export]]
 	double randBeta(double a, double b)
 	{
+		if( RNGStream* stream = getThreadRNGStream() )
+			return mtBeta( *stream , a , b );
+
 		return R::rbeta( a, b );
 	}
 
+	arma::vec randVecU01(const unsigned int n)
+	{
+		arma::vec res(n);
+		if( RNGStream* stream = getThreadRNGStream() )
+		{
+			double* buf = res.memptr();
+			for(unsigned int i=0; i<n; ++i)
+				buf[i] = stream->nextU01();
+		}
+		else
+		{
+			for(unsigned int i=0; i<n; ++i)
+				res(i) = R::runif( 0., 1. );
+		}
+		return res;
+	}
+
+	arma::vec randVecGamma(const unsigned int n, const double shape, const double scale)
+	{
+		if(shape <= 0 || scale <= 0 )
+			throw Distributions::negativeParameters();
+
+		arma::vec res(n);
+		if( RNGStream* stream = getThreadRNGStream() )
+		{
+			double* buf = res.memptr();
+			for(unsigned int i=0; i<n; ++i)
+				buf[i] = scale * mtGamma( *stream , shape );
+		}
+		else
+		{
+			for(unsigned int i=0; i<n; ++i)
+				res(i) = R::rgamma( shape, scale );
+		}
+		return res;
+	}
+
+	arma::vec randVecBeta(const arma::vec& a, const arma::vec& b)
+	{
+		if( a.n_elem != b.n_elem )
+			throw Distributions::dimensionsNotMatching();
+
+		unsigned int n = a.n_elem;
+		arma::vec res(n);
+		if( RNGStream* stream = getThreadRNGStream() )
+		{
+			double* buf = res.memptr();
+			for(unsigned int i=0; i<n; ++i)
+				buf[i] = mtBeta( *stream , a(i) , b(i) );
+		}
+		else
+		{
+			for(unsigned int i=0; i<n; ++i)
+				res(i) = R::rbeta( a(i), b(i) );
+		}
+		return res;
+	}
+
     // [[Rcpp::export]]
 	unsigned int randBernoulli(double pi)
 	{
+		if( RNGStream* stream = getThreadRNGStream() )
+			return ( stream->nextU01() < pi ) ? 1 : 0;
+
 		return R::rbinom( 1, pi );
 	}
 
 
 namespace Distributions{
 
-    arma::mat randIWishart(double df, const arma::mat& S)
-    {
-
-          return arma::inv_sympd( randWishart(df,S.i()) );   // return the inverse of the correspondent Wishart variate ... is this even fast enough?
-    }
-
     arma::vec randMvNormal(const arma::vec &m, const arma::mat &Sigma) // random normal interface to arma::randn
     {
         unsigned int d = m.n_elem;
@@ -251,12 +506,30 @@ namespace Distributions{
         return res.t() + m;
     }
 
+    double randMvNormalPrecisionCholAndLogPDF(arma::vec& x, const arma::vec& m, const arma::mat& R)
+    {
+        unsigned int d = m.n_elem;
+        if(R.n_rows != d || R.n_cols != d )
+            throw dimensionsNotMatching();
+
+        arma::vec z = randVecNormal(d);
+        x = m + arma::solve( arma::trimatu(R) , z ); // R^-1 z has covariance (R'R)^-1
+
+        return -0.5*(double)d*log(2.*M_PI) + arma::sum( arma::log( R.diag() ) ) - 0.5*arma::dot( z , z );
+    }
+
+    // with A'A = rowCov and B'B = colCov, A'*Z*B has covariance kron(colCov,rowCov) -- that is never formed
     arma::mat randMN(const arma::mat &M, const arma::mat &rowCov, const arma::mat &colCov)
     {
-        arma::mat C = arma::chol( arma::kron(colCov,rowCov) );
-        arma::mat z = randVecNormal( (unsigned int)(M.n_cols * M.n_rows) ).t() * C;
-        z.reshape( arma::size(M) );
-        return (z + M);
+        if( rowCov.n_rows != M.n_rows || colCov.n_rows != M.n_cols )
+            throw dimensionsNotMatching();
+
+        arma::mat A, B;
+        if( !arma::chol(A,rowCov) || !arma::chol(B,colCov) )
+            throw negativeDefiniteParameters();
+
+        arma::mat z = arma::reshape( randVecNormal( (unsigned int)(M.n_cols * M.n_rows) ) , M.n_rows , M.n_cols );
+        return arma::trimatl( A.t() ) * z * arma::trimatu(B) + M;
     }
 
 
@@ -339,9 +612,34 @@ namespace Distributions{
 	    return res;
 	}
 
-	// IMPLEMENTATION FROM Efraimidistr and Spirakis 2006
-	// (probably efficient when n is close to N rather than in our case, but is there a better alternative?)
-	//  even for n=1, we'd still need to compute the cumulative sum of all the weights if we want to use bisection, or what I use below which is O(N) anyway...
+	// IMPLEMENTATION FROM Efraimidis and Spirakis 2006, with exponential keys
+	// each element gets the key E_i/w_i with E_i ~ Exp(1) and the sample is the sampleSize smallest keys, in order;
+	// this is the same as drawing sequentially proportionally to the remaining weights.
+	// Only the first sampleSize keys are selected (nth_element) and sorted, so this is O(N + n log n) rather than O(N log N)
+	namespace
+	{
+		arma::uvec smallestKeysIndexes( const arma::vec& score , unsigned int sampleSize )
+		{
+			std::vector<arma::uword> idx( score.n_elem );
+			std::iota( idx.begin() , idx.end() , 0 );
+
+			auto byScore = [&score]( const arma::uword a , const arma::uword b ){ return score(a) < score(b); };
+
+			arma::uword n = std::min<arma::uword>( sampleSize , score.n_elem );
+			if( n < score.n_elem )
+				std::nth_element( idx.begin() , idx.begin() + n , idx.end() , byScore );
+			std::sort( idx.begin() , idx.begin() + n , byScore );
+
+			return arma::uvec( idx.data() , n );
+		}
+
+		// log( 1 - exp(-x) ) for x > 0, Maechler (2012)
+		inline double log1mExp( const double x )
+		{
+			return ( x < M_LN2 ) ? std::log( -std::expm1( -x ) ) : std::log1p( -std::exp( -x ) );
+		}
+	}
+
 	arma::uvec randWeightedSampleWithoutReplacement
 	(
 	    unsigned int populationSize,    // size of set sampling from
@@ -351,9 +649,8 @@ namespace Distributions{
 	) // sample is a zero-offset indices to selected items, output is the subsampled population.
 	{
 	    arma::vec score = randVecExponential(populationSize,1.)/weights;
-	    arma::uvec result = population( (arma::sort_index(weights,"ascend")) );
 
-	    return result.subvec(0,sampleSize-1);
+	    return population( smallestKeysIndexes( score , sampleSize ) );
 	}
 
 	// overload with sampleSize equal to one
@@ -364,16 +661,7 @@ namespace Distributions{
 	    const arma::uvec& population // population to draw from
 	) // sample is a zero-offset indices to selected items, output is the subsampled population.
 	{
-	    double u = randU01();
-	    double tmp = weights(0);
-	    int t = 0;
-
-	    while(u > tmp)
-	    {
-	    	tmp += weights(++t);
-	    }
-
-	    return population( t );
+	    return population( randWeightedIndexSampleWithoutReplacement( populationSize , weights ) );
 	}
 
 
@@ -381,15 +669,13 @@ namespace Distributions{
 	arma::uvec randWeightedIndexSampleWithoutReplacement
 	(
 	    unsigned int populationSize,    // size of set sampling from
-	    const arma::vec& weights,	   // (log) probability for each element
+	    const arma::vec& weights,	   // probability for each element
 	    unsigned int sampleSize         // size of each sample
 	) // sample is a zero-offset indices to selected items, output is the subsampled population.
 	{
-		// note I can do everything in the log scale as the ordering won't change!
-	    arma::vec score = randVecExponential(populationSize,1.) - weights;
-	    arma::uvec result = arma::sort_index(score,"ascend");
+	    arma::vec score = randVecExponential(populationSize,1.)/weights;
 
-	    return result.subvec(0,sampleSize-1);
+	    return smallestKeysIndexes( score , sampleSize );
 	}
 
 	// Overload with equal weights
@@ -399,11 +685,9 @@ namespace Distributions{
 	    unsigned int sampleSize         // size of each sample
 	) // sample is a zero-offset indices to selected items, output is the subsampled population.
 	{
-		// note I can do everything in the log scale as the ordering won't change!
 	    arma::vec score = randVecExponential(populationSize,1.);
-	    arma::uvec result = arma::sort_index(score,"ascend");
-        
-	    return result.subvec(0,sampleSize-1);
+
+	    return smallestKeysIndexes( score , sampleSize );
 	}
 
 	// overload with sampleSize equal to one
@@ -413,15 +697,13 @@ namespace Distributions{
 	    const arma::vec& weights     // probability for each element
 	) // sample is a zero-offset indices to selected items, output is the subsampled population.
 	{
-		// note I can do everything in the log scale as the ordering won't change!
-
-	    double u = randU01();
+		// weights need not be normalised, the last element catches any rounding left
+	    double u = randU01() * arma::sum(weights);
 	    double tmp = weights(0);
 	    unsigned int t = 0;
 
-	    while(u > tmp)
+	    while( u > tmp && t < populationSize-1 )
 	    {
-	    	// tmp = Utils::logspace_add(tmp,logWeights(++t));
 	    	tmp += weights(++t);
 	    }
 
@@ -433,37 +715,80 @@ namespace Distributions{
 	/// ################### NOW LOG PDFs
 
 
-	// logPDF rand Weighted Indexes (need to implement the one for the original starting vector?)
+	// logPDF of the (unordered) set of indexes drawn by randWeightedIndexSampleWithoutReplacement
 	double logPDFWeightedIndexSampleWithoutReplacement(const arma::vec& weights, const arma::uvec& indexes)
 	{
-		// arma::vec logP_permutation = arma::zeros<arma::vec>((int)std::tgamma(indexes.n_elem+1));  //too big of a vector
-		double logP_permutation = 0.; double tmp;
+		arma::vec otherWeights = weights;
+		otherWeights(indexes).zeros(); // summed directly, sum(weights) - sum(selected) cancels out when the selected weights dominate
+
+		return logPDFWeightedSetSampleWithoutReplacement( weights(indexes) , arma::sum(otherWeights) );
+	}
+
+	// With exponential keys the set S is drawn iff all its keys are smaller than all the others, so with R = W - w(S)
+	//     P(S) = R \int_0^inf \prod_{i in S} ( 1 - exp(-w_i t) ) exp(-R t) dt
+	// instead of the sum over the |S|! orderings. Writing t = exp(s), the log-integrand
+	//     phi(s) = s - R exp(s) + \sum_{i in S} log( 1 - exp(-w_i exp(s)) )
+	// is concave, so we locate its mode by bisection on phi' and integrate with the trapezoidal rule around it
+	// (exponentially accurate for such smooth, fast-decaying integrands); the cost is O(|S|) per evaluation.
+	double logPDFWeightedSetSampleWithoutReplacement(const arma::vec& selectedWeights, double otherWeights)
+	{
+		const unsigned int n = selectedWeights.n_elem;
 
-		std::vector<unsigned int> v = arma::conv_to<std::vector<unsigned int>>::from(arma::sort(indexes));
-		// vector should be sorted at the beginning.
+		if( n == 0 || otherWeights <= 0. ) // nothing drawn, or everything was
+			return 0.;
 
-		arma::uvec current_permutation;
-		arma::vec current_weights;
-	 	unsigned int i = 0;
+		const double* w = selectedWeights.memptr();
 
-	    do {
-	        current_permutation = arma::conv_to<arma::uvec>::from(v);
-	        current_weights = weights;
-			tmp = 0.;
+		auto phi = [&]( const double s )
+		{
+			double t = std::exp(s) , res = s - otherWeights * t;
+			for( unsigned int i=0; i<n; ++i )
+				res += log1mExp( w[i] * t );
+			return res;
+		};
 
-			while( current_permutation.n_elem > 0 )
+		auto dPhi = [&]( const double s )
+		{
+			double t = std::exp(s) , res = 1. - otherWeights * t;
+			for( unsigned int i=0; i<n; ++i )
 			{
-			   tmp += log(current_weights(current_permutation(0)));
-			   current_permutation.shed_row(0);
-			   current_weights = current_weights/arma::sum(current_weights(current_permutation));   // this will gets array weights that do not sum to 1 in total, but will only use relevant elements
-    		}
+				double x = w[i] * t;
+				res += ( x > 1e-300 ) ? x / std::expm1( x ) : 1. ;
+			}
+			return res;
+		};
+
+		// phi' goes from n+1 to -inf, bracket its root
+		double lower = - std::log( otherWeights + arma::sum(selectedWeights) ) - 1.;
+		double upper = std::log( (n+1.) / otherWeights ) + 1.;
+
+		while( dPhi(lower) <= 0. ) lower -= 1.;
+		while( dPhi(upper) >= 0. ) upper += 1.;
+
+		for( unsigned int it=0; it<100 && upper-lower > 1e-10; ++it )
+		{
+			double mid = 0.5*(lower+upper);
+			if( dPhi(mid) > 0. )
+				lower = mid;
+			else
+				upper = mid;
+		}
 
-			++i;
-			logP_permutation = Utils::logspace_add(logP_permutation,tmp);
+		const double sMode = 0.5*(lower+upper) , phiMode = phi(sMode);
 
-	    } while (std::next_permutation(v.begin(), v.end()));
+		// integration range where the integrand is above exp(-40) of its maximum
+		double left = 1., right = 1.;
+		while( phi( sMode - left ) > phiMode - 40. ) left *= 2.;
+		while( phi( sMode + right ) > phiMode - 40. ) right *= 2.;
 
-		return logP_permutation;
+		const unsigned int nNodes = 256;
+		const double h = ( left + right ) / nNodes;
+		double integral = 0.;
+
+		for( unsigned int k=1; k<nNodes; ++k ) // the endpoints are negligible by construction
+			integral += std::exp( phi( sMode - left + k*h ) - phiMode );
+
+		return std::log( otherWeights ) + phiMode + std::log( integral * h );
 	}
 
 
@@ -500,22 +825,30 @@ namespace Distributions{
 	}
 
 
-	double logPDFMN(const arma::mat& X, const arma::mat& rowCov, const arma::mat colCov)
+	// matrix normal log-density of the residual E through the Cholesky factors A'A = rowCov and B'B = colCov:
+	// tr( colCov^-1 E' rowCov^-1 E ) = || A'^-1 E B^-1 ||_F^2 and log|kron(colCov,rowCov)| = n log|colCov| + m log|rowCov|
+	static double logPDFMNResidual(const arma::mat& E, const arma::mat& rowCov, const arma::mat& colCov)
 	{
-		unsigned int n = X.n_rows;
-		unsigned int m = X.n_cols;
+		unsigned int n = E.n_rows;
+		unsigned int m = E.n_cols;
 
-		double ret = -0.5*arma::trace( arma::inv_sympd(colCov) * X.t() * arma::inv_sympd(rowCov) * X ) -
-					(double)n*(double)m*0.5*log(2.*M_PI);
-        double tmp = 0.;
-        double sign;
-		arma::log_det(tmp, sign, colCov );
-		ret += -0.5*(double)n*tmp;
+		if( rowCov.n_rows != n || colCov.n_rows != m )
+			throw dimensionsNotMatching();
 
-		arma::log_det(tmp, sign, rowCov );
-		ret += -0.5*(double)m*tmp;
+		arma::mat A, B;
+		if( !arma::chol(A,rowCov) || !arma::chol(B,colCov) )
+			throw negativeDefiniteParameters();
 
-		return ret;
+		arma::mat Y = arma::solve( arma::trimatl( A.t() ) , E ); // A'^-1 E
+		Y = arma::solve( arma::trimatl( B.t() ) , Y.t() ); // ( A'^-1 E B^-1 )'
+
+		return -(double)n*(double)m*0.5*log(2.*M_PI) - 0.5*arma::accu( arma::square(Y) ) -
+				(double)m*arma::sum( arma::log( A.diag() ) ) - (double)n*arma::sum( arma::log( B.diag() ) );
+	}
+
+	double logPDFMN(const arma::mat& X, const arma::mat& rowCov, const arma::mat colCov)
+	{
+		return logPDFMNResidual( X , rowCov , colCov );
 	}
 
 
@@ -562,19 +895,17 @@ namespace Distributions{
 
 	double logPDFNormal(arma::vec& x, arma::vec& m, const arma::mat& rowCov ,const arma::mat& colCov)   // vectorised version of a matrix normal
 	{
-		unsigned int k = rowCov.n_rows;
-		unsigned int d = colCov.n_rows;
-
-		double logP = -0.5*(double)k*log(2.*M_PI) - 0.5 * arma::as_scalar( ( (x-m).t() * arma::inv_sympd( arma::kron( colCov , rowCov ) ) * (x-m) ) );
+		if( x.n_elem != rowCov.n_rows * colCov.n_rows )
+			throw dimensionsNotMatching();
 
-		double sign, tmp;
-		arma::log_det(tmp, sign, rowCov );
-		logP += -0.5*(double)d*tmp;
+		return logPDFMNResidual( arma::reshape( x-m , rowCov.n_rows , colCov.n_rows ) , rowCov , colCov );
+	}
 
-		arma::log_det(tmp, sign, colCov );
-		logP += -0.5*(double)k*tmp;
+	double logPDFNormalPrecisionChol(const arma::vec& x, const arma::vec& m, const arma::mat& R)
+	{
+		arma::vec z = R * (x-m);
 
-		return logP;
+		return -0.5*(double)x.n_elem*log(2.*M_PI) + arma::sum( arma::log( R.diag() ) ) - 0.5*arma::dot( z , z );
 	}
 
 	double lBeta(double a,double b){    //log beta function
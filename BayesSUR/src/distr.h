@@ -12,6 +12,8 @@
 
 #include <limits>
 #include <vector>
+#include <algorithm>
+#include <numeric>
 #include <random>
 
 
@@ -22,7 +24,7 @@ unsigned int randBinomial(const unsigned int n, const double p);
 arma::uvec randMultinomial(unsigned int n, const arma::vec prob);
 
 double randNormal(const double m, const double sigmaSquare); // random normal interface to arma::randn
-arma::vec randVecNormal(const int n, const double m, const double sigmaSquare);
+arma::vec randVecNormal(const unsigned int n, const double m, const double sigmaSquare);
 
 double randT(const double nu);
 arma::vec randVecT(const unsigned int n, const double nu);
@@ -32,13 +34,16 @@ arma::vec randMvT(const double &nu, const arma::vec &m, const arma::mat &Sigma);
 arma::mat randWishart(double df, const arma::mat& S);
 arma::mat randMN(const arma::mat &M, const arma::mat &rowCov, const arma::mat &colCov);
 double randBeta(double a, double b);
+arma::vec randVecBeta(const arma::vec& a, const arma::vec& b); // element-wise parameters
 unsigned int randBernoulli(double pi);
 double randU01();
+arma::vec randVecU01(const unsigned int n);
 double randLogU01();
 int randIntUniform(const int a,const int b);
 arma::ivec randIntUniform(const unsigned int n, const int a,const int b);
 
 double randIGamma(double a, double b);
+arma::vec randVecGamma(const unsigned int n, const double shape, const double scale);
 
 
 namespace Distributions{
@@ -68,8 +73,10 @@ namespace Distributions{
 	};
 
 
-    arma::mat randIWishart(double df, const arma::mat& S);
     arma::vec randMvNormal(const arma::vec &m, const arma::mat &Sigma);
+
+    // fused draw and score: x ~ N(m,(R'R)^-1) given R upper triangular, and its log-density, from triangular solves -- no log_det nor inverse
+    double randMvNormalPrecisionCholAndLogPDF(arma::vec& x, const arma::vec& m, const arma::mat& R);
     arma::mat randMN(const arma::mat &M, const arma::mat &rowCov, const arma::mat &colCov);
     double randTruncNorm(double m, double sd,double lower, double upper);
 
@@ -82,6 +89,7 @@ namespace Distributions{
 	double logPDFNormal(const arma::vec& x, const arma::vec& m, const arma::mat& Sigma);
 	double logPDFNormal(const arma::vec& x, const arma::vec& m,const  double& Sigma);
 	double logPDFNormal(arma::vec& x, arma::vec& m, const arma::mat& rowCov, const arma::mat& colCov);
+	double logPDFNormalPrecisionChol(const arma::vec& x, const arma::vec& m, const arma::mat& R); // R upper triangular, R'R is the precision
     
     // double logPDFt( double x, double d );
 
@@ -158,9 +166,12 @@ namespace Distributions{
 	); // sample is a zero-offset indices to selected items, output is the subsampled population.
 
 
-	// logPDF rand Weighted Indexes (need to implement the one for the original starting vector?)
+	// logPDF of the unordered set of indexes drawn by randWeightedIndexSampleWithoutReplacement
 	double logPDFWeightedIndexSampleWithoutReplacement(const arma::vec& weights, const arma::uvec& indexes);
 
+	// same, given only the weights of the selected elements and the total weight of those not selected -- O(n_selected)
+	double logPDFWeightedSetSampleWithoutReplacement(const arma::vec& selectedWeights, double otherWeights);
+
 
 }
 
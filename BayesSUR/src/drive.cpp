@@ -11,7 +11,6 @@ using Rcpp::Rcerr;
 #ifdef _OPENMP
 extern omp_lock_t RNGlock; /*defined in global.h*/
 #endif
-/*extern std::vector<std::mt19937_64> rng;*/
 
 #include <Rcpp.h>
 // [[Rcpp::plugins(openmp)]]
@@ -19,6 +18,16 @@ extern omp_lock_t RNGlock; /*defined in global.h*/
 
 using Utils::Chain_Data;
 
+// linear (column-major) indexes of the edges in G, read off the sparse adjacency matrix without densifying it
+static arma::urowvec edgeIndexes( const arma::sp_umat& adjacency )
+{
+    arma::urowvec idx( adjacency.n_nonzero );
+    unsigned int k = 0;
+    for( auto it = adjacency.begin(); it != adjacency.end(); ++it )
+        idx(k++) = it.row() + it.col() * adjacency.n_rows;
+    return idx;
+}
+
 int drive_SUR( Chain_Data& chainData )
 {
     
@@ -27,10 +36,10 @@ int drive_SUR( Chain_Data& chainData )
     // ****************************************
     Rcout << "Initialising the (SUR) MCMC Chain";
     
+    // with nProcesses > 1 everything down to sampler.serve() runs in every process, on the chains each of them holds
     ESS_Sampler<SUR_Chain> sampler( chainData.surData , chainData.nChains , 1.2 ,
-                                   chainData.gamma_sampler_type, chainData.gamma_type, chainData.beta_type, chainData.covariance_type, chainData.output_CPO, chainData.maxThreads, chainData.burnin );
-    
-    Rcout << " ... ";
+                                   chainData.gamma_sampler_type, chainData.gamma_type, chainData.beta_type, chainData.covariance_type, chainData.output_CPO, chainData.maxThreads, chainData.burnin ,
+                                   chainData.nProcesses );
     
     // *****************************
     
@@ -49,8 +58,6 @@ int drive_SUR( Chain_Data& chainData )
     // *****************************
     sampler.setHyperParameters( chainData );
     
-    Rcout << " ... ";
-    
     // *****************************
     
     // set when the JT move should start
@@ -58,10 +65,14 @@ int drive_SUR( Chain_Data& chainData )
     if( chainData.covariance_type == Covariance_Type::HIW )
     {
         jtStartIteration = chainData.nIter/10;
-        for( unsigned int i=0; i< chainData.nChains; ++i )
-            sampler[i]->setJTStartIteration( jtStartIteration );
+        sampler.forLocalChains( [jtStartIteration]( std::shared_ptr<SUR_Chain>& c ){ c->setJTStartIteration( jtStartIteration ); } );
     }
     
+    // from here on the other processes (if any) run their share of the chains and never come back
+    sampler.serve();
+    
+    Rcout << " ... ";
+    
     // Init gamma and beta for the main chain
     // *****************************
     sampler[0] -> gammaInit( chainData.gammaInit );
@@ -73,67 +84,64 @@ int drive_SUR( Chain_Data& chainData )
     if ( chainData.output_CPO )
         sampler[0] -> predLikelihood();
     
-    
     // ****************************************
     Rcout << " DONE!\nDrafting the output files with the start of the chain ... ";
     
     // INIT THE FILE OUTPUT
     std::string outFilePrefix = chainData.outFilePath+chainData.filePrefix;
     
-    // clear the content of previous files
-    std::ofstream logPOutFile; logPOutFile.open(outFilePrefix+"logP_out.txt", std::ios::out | std::ios::trunc); logPOutFile.close();
-    // openlogP file in append mode
-    logPOutFile.open( outFilePrefix+"logP_out.txt" , std::ios_base::app); // note we don't close!
-    // open avg files in trunc mode to cut previous content
+    // all the output goes through a background writer so that the I/O never stalls the MCMC loop:
+    // averages are snapshotted to their text files, traces are kept in binary and exported to text when the writer is closed
+    // (the binary traces stay on disk when checkpointing, a resumed run appends to them)
+    OutputWriter outWriter( 4096 , chainData.checkpointInterval > 0 || chainData.resume );
     
-    std::ofstream gammaOutFile;
-    if ( chainData.output_gamma )
+    // the checkpoint holds the next iteration, the trace sizes, the sampler and then the output accumulators
+    std::string checkpointFile = outFilePrefix+"checkpoint.bin";
+    std::unique_ptr<CheckpointReader> checkpointIn;
+    unsigned int firstIteration = 1;
+    
+    if( chainData.resume )
     {
-        gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-        gammaOutFile.close();
+        std::vector<unsigned long long> traceSizes;
+        checkpointIn.reset( new CheckpointReader( checkpointFile ) );
+        checkpointIn -> io( firstIteration );
+        checkpointIn -> io( traceSizes );
+        sampler.loadState( *checkpointIn );
+        outWriter.resumeTraces( traceSizes );
+        Rcout << " resuming from iteration " << firstIteration << " ... ";
     }
     
-    std::ofstream gOutFile;
-    if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
+    unsigned int logPTrace = outWriter.openTrace( outFilePrefix+"logP_out.txt" );
+    auto logPRow = [&sampler]()
     {
-        gOutFile.open( outFilePrefix+"Gy_out.txt" , std::ios_base::trunc);
-        gOutFile.close();
-    }
+        return arma::rowvec{ sampler[0] -> getLogPTau() , sampler[0] -> getLogPEta() , sampler[0] -> getLogPJT() ,
+            sampler[0] -> getLogPSigmaRho() , sampler[0] -> getLogPO() , sampler[0] -> getLogPPi() , sampler[0] -> getLogPGamma() ,
+            sampler[0] -> getLogPW() , sampler[0] -> getLogPBeta() , sampler[0] -> getLogLikelihood() };
+    };
+    
+    // clear the content of previous avg files
+    if ( chainData.output_gamma )
+        std::ofstream( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc );
+    
+    if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
+        std::ofstream( outFilePrefix+"Gy_out.txt" , std::ios_base::trunc );
     
-    std::ofstream piOutFile;
     if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) && chainData.output_pi )
-    {
-        piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-        piOutFile.close();
-    }
+        std::ofstream( outFilePrefix+"pi_out.txt" , std::ios_base::trunc );
     
-    std::ofstream htpOutFile;
     if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
-    {
-        htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-        htpOutFile.close();
-    }
+        std::ofstream( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc );
     
-    std::ofstream ModelSizeOutFile;
+    unsigned int modelSizeTrace = 0;
     if ( chainData.output_model_size )
-    {
-        ModelSizeOutFile.open( outFilePrefix+"model_size_out.txt", std::ios::out | std::ios::trunc); ModelSizeOutFile.close();
-        ModelSizeOutFile.open( outFilePrefix+"model_size_out.txt" , std::ios_base::app); // note we don't close!
-    }
+        modelSizeTrace = outWriter.openTrace( outFilePrefix+"model_size_out.txt" );
     
-    std::ofstream GVisitOutFile;
-    std::ofstream ModelVisitGammaOutFile;
-    std::ofstream ModelVisitGOutFile;
+    unsigned int gVisitTrace = 0, modelVisitGammaTrace = 0, modelVisitGTrace = 0;
     if( chainData.output_model_visit )
     {
-        GVisitOutFile.open( outFilePrefix+"Gy_visit.txt", std::ios::out | std::ios::trunc); GVisitOutFile.close();
-        GVisitOutFile.open( outFilePrefix+"Gy_visit.txt" , std::ios_base::app); // note we don't close!
-        
-        ModelVisitGammaOutFile.open( outFilePrefix+"model_visit_gamma_out.txt", std::ios::out | std::ios::trunc); ModelVisitGammaOutFile.close();
-        ModelVisitGammaOutFile.open( outFilePrefix+"model_visit_gamma_out.txt" , std::ios_base::app); // note we don't close!
-        
-        ModelVisitGOutFile.open( outFilePrefix+"model_visit_gy_out.txt", std::ios::out | std::ios::trunc); ModelVisitGOutFile.close();
-        ModelVisitGOutFile.open( outFilePrefix+"model_visit_gy_out.txt" , std::ios_base::app); // note we don't close!
+        gVisitTrace = outWriter.openTrace( outFilePrefix+"Gy_visit.txt" );
+        modelVisitGammaTrace = outWriter.openTrace( outFilePrefix+"model_visit_gamma_out.txt" );
+        modelVisitGTrace = outWriter.openTrace( outFilePrefix+"model_visit_gy_out.txt" );
     }
     
     // Output to file the initial state (if burnin=0)
@@ -150,23 +158,35 @@ int drive_SUR( Chain_Data& chainData )
     arma::vec cposumy_out; // CPO with each element summerizing all response variables
     arma::mat lpd, waic_out, waic_frac_sum;
 
-    if( chainData.burnin == 0 )
+    if( chainData.resume )
+    {
+        checkpointIn -> io( gamma_out );
+        checkpointIn -> io( g_out );
+        checkpointIn -> io( beta_out );
+        checkpointIn -> io( betaSD_out );
+        checkpointIn -> io( sigmaRho_out );
+        checkpointIn -> io( pi_out );
+        checkpointIn -> io( hotspot_tail_prob_out );
+        checkpointIn -> io( cpo_out );
+        checkpointIn -> io( cposumy_out );
+        checkpointIn -> io( lpd );
+        checkpointIn -> io( waic_out );
+        checkpointIn -> io( waic_frac_sum );
+        checkpointIn.reset();
+    }
+    else if( chainData.burnin == 0 )
     {
         if ( chainData.output_gamma )
         {
             gamma_out = sampler[0] -> getGamma();
-            gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-            gammaOutFile << (arma::conv_to<arma::mat>::from(gamma_out));
-            gammaOutFile.close();
+            outWriter.writeSnapshot( outFilePrefix+"gamma_out.txt" , arma::conv_to<arma::mat>::from(gamma_out) );
         }
         
         if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
         {
             tmpG = arma::umat( sampler[0] -> getGAdjMat() );
             g_out = tmpG;
-            gOutFile.open( outFilePrefix+"Gy_out.txt" , std::ios_base::trunc);
-            gOutFile << ( arma::conv_to<arma::mat>::from(g_out) );   // this might be quite long...
-            gOutFile.close();
+            outWriter.writeSnapshot( outFilePrefix+"Gy_out.txt" , arma::conv_to<arma::mat>::from(g_out) );   // this might be quite long...
         }
         
         if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) &&
@@ -176,9 +196,7 @@ int drive_SUR( Chain_Data& chainData )
             if ( chainData.output_pi )
             {
                 pi_out = tmpVec;
-                piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-                piOutFile << pi_out;
-                piOutFile.close();
+                outWriter.writeSnapshot( outFilePrefix+"pi_out.txt" , pi_out );
             }
             
             if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
@@ -186,9 +204,7 @@ int drive_SUR( Chain_Data& chainData )
                 tmpVec.for_each( [](arma::vec::elem_type& val) { if(val>1.0) val = 1.0; else val=0.0; } );
                 hotspot_tail_prob_out = tmpVec;
                 
-                htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-                htpOutFile << hotspot_tail_prob_out;
-                htpOutFile.close();
+                outWriter.writeSnapshot( outFilePrefix+"hotspot_tail_p_out.txt" , hotspot_tail_prob_out );
             }
         }
         
@@ -231,25 +247,16 @@ int drive_SUR( Chain_Data& chainData )
         }
     }
     
-    logPOutFile <<     sampler[0] -> getLogPTau() << " ";
-    logPOutFile <<     sampler[0] -> getLogPEta() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPJT() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPSigmaRho() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPBeta() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogLikelihood();
-    logPOutFile <<     '\n';
+    // the initial state, unless it is already in the resumed traces and accumulators
+    if ( !chainData.resume )
+        outWriter.appendTrace( logPTrace , logPRow() );
     
-    if ( chainData.output_model_size )
+    if ( chainData.output_model_size && !chainData.resume )
     {
-        ModelSizeOutFile << sampler[0]->getModelSize() << " ";
-        ModelSizeOutFile << '\n';
+        outWriter.appendTrace( modelSizeTrace , sampler[0]->getModelSize() );
     }
     
-    if ( chainData.output_model_visit )
+    if ( chainData.output_model_visit && !chainData.resume )
     {
         if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
         {
@@ -258,18 +265,15 @@ int drive_SUR( Chain_Data& chainData )
             {
                 g_visit = join_rows( g_visit, tmpG.submat(k,k+1, k,tmpG.n_cols-1) );
             }
-            GVisitOutFile << g_visit << " ";
-            GVisitOutFile << '\n';
+            outWriter.appendTrace( gVisitTrace , g_visit );
         }
         
-        ModelVisitGammaOutFile << arma::find((sampler[0] -> getGamma()) == 1).t() << " ";
-        ModelVisitGammaOutFile << '\n';
+        outWriter.appendTrace( modelVisitGammaTrace , arma::urowvec( arma::find((sampler[0] -> getGamma()) == 1).t() ) );
         
-        ModelVisitGOutFile << arma::find(arma::conv_to<arma::umat>::from(sampler[0] -> getGAdjMat()) == 1).t() << " ";
-        ModelVisitGOutFile << '\n';
+        outWriter.appendTrace( modelVisitGTrace , edgeIndexes( sampler[0] -> getGAdjMat() ) );
     }
 
-    if ( chainData.output_CPO )
+    if ( chainData.output_CPO && !chainData.resume )
     {
         predLik =  sampler[0] -> getPredLikelihood() ;
         cpo_out = 1./predLik;
@@ -291,7 +295,7 @@ int drive_SUR( Chain_Data& chainData )
     
     unsigned int tick = 1000; // how many iter for each print?
     
-    for(unsigned int i=1; i < chainData.nIter ; ++i)
+    for(unsigned int i=firstIteration; i < chainData.nIter ; ++i)
     {
         sampler.step();
        
@@ -307,10 +311,7 @@ int drive_SUR( Chain_Data& chainData )
                 gamma_out += sampler[0] -> getGamma(); // the result of the whole procedure is now my new mcmc point, so add that up
             
             if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
-            {
-                tmpG = arma::umat( sampler[0] -> getGAdjMat() );
-                g_out += tmpG;
-            }
+                g_out += sampler[0] -> getGAdjMat(); // sparse accumulation, touches the edges only
             
             if ( chainData.output_beta ){
                 tmpB = sampler[0] -> getBeta();
@@ -347,18 +348,13 @@ int drive_SUR( Chain_Data& chainData )
             }
             
             // Nothing to update for model size
-        }else{
-            if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
-                tmpG = arma::umat( sampler[0] -> getGAdjMat() );
         }
         
         if ( chainData.output_model_visit )
         {
-            ModelVisitGammaOutFile << arma::find((sampler[0] -> getGamma()) == 1).t() << " ";
-            ModelVisitGammaOutFile << '\n';
+            outWriter.appendTrace( modelVisitGammaTrace , arma::urowvec( arma::find((sampler[0] -> getGamma()) == 1).t() ) );
             
-            ModelVisitGOutFile << arma::find(arma::conv_to<arma::umat>::from(sampler[0] -> getGAdjMat()) == 1).t() << " ";
-            ModelVisitGOutFile << '\n';
+            outWriter.appendTrace( modelVisitGTrace , edgeIndexes( sampler[0] -> getGAdjMat() ) );
         }
         
         // Print something on how the chain is going
@@ -368,7 +364,8 @@ int drive_SUR( Chain_Data& chainData )
             Rcout << " -- JT: " << Utils::round( sampler[0] -> getJTAccRate() , 3 ) ;
             
             if( chainData.nChains > 1){
-                Rcout << " -- Global: " << Utils::round( sampler.getGlobalAccRate() , 3 ) << '\n';
+                Rcout << " -- Global: " << Utils::round( sampler.getGlobalAccRate() , 3 ) <<
+                    " -- Swaps: " << Utils::round( arma::mean( sampler.getPairSwapAccRates() ) , 3 ) << '\n';
             }else{
                 Rcout << '\n';
             }
@@ -384,69 +381,79 @@ int drive_SUR( Chain_Data& chainData )
                 
                 if ( chainData.output_gamma )
                 {
-                    gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-                    gammaOutFile << (arma::conv_to<arma::mat>::from(gamma_out))/(double)(i+1.0-chainData.burnin);
-                    gammaOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"gamma_out.txt" , arma::conv_to<arma::mat>::from(gamma_out) , 1./(double)(i+1.0-chainData.burnin) );
                 }
                 
                 if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
                 {
-                    gOutFile.open( outFilePrefix+"Gy_out.txt" , std::ios_base::trunc);
-                    gOutFile << ( arma::conv_to<arma::mat>::from(g_out) )/((double)(i-std::max(jtStartIteration,chainData.burnin))+1.0);   // this might be quite long...
-                    gOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"Gy_out.txt" , arma::conv_to<arma::mat>::from(g_out) , 1./((double)(i-std::max(jtStartIteration,chainData.burnin))+1.0) );   // this might be quite long...
                 }
                 
                 if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) &&
                     chainData.output_pi )
                 {
-                    piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-                    piOutFile << pi_out/(double)(i+1.0-chainData.burnin);
-                    piOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"pi_out.txt" , pi_out , 1./(double)(i+1.0-chainData.burnin) );
                 }
                 
                 if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
                 {
-                    htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-                    htpOutFile << hotspot_tail_prob_out/(double)(i+1.0-chainData.burnin);
-                    htpOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"hotspot_tail_p_out.txt" , hotspot_tail_prob_out , 1./(double)(i+1.0-chainData.burnin) );
                 }
             }
             
             //if( (i-chainData.burnin+1) % (tick*1) == 0 )
             if( (i+1) % (tick*1) == 0 )
             {
-                logPOutFile <<     sampler[0] -> getLogPTau() << " ";
-                logPOutFile <<     sampler[0] -> getLogPEta() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPJT() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPSigmaRho() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPBeta() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogLikelihood();
-                logPOutFile <<     '\n';
+                outWriter.appendTrace( logPTrace , logPRow() );
                 
                 if ( chainData.output_model_size )
                 {
                     if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
                     {
+                        tmpG = arma::umat( sampler[0] -> getGAdjMat() ); // dense only when it is written out
                         //g_visit = arma::conv_to<arma::urowvec>::from( arma::trimatu(tmpG, 1) );
                         g_visit.clear();
                         for(unsigned int k=0; k < tmpG.n_cols-1; ++k)
                         {
                             g_visit = join_rows( g_visit, tmpG.submat(k,k+1, k,tmpG.n_cols-1) );
                         }
-                        GVisitOutFile << g_visit << " ";
-                        GVisitOutFile << '\n';
+                        if( chainData.output_model_visit )
+                            outWriter.appendTrace( gVisitTrace , g_visit );
                     }
                     
-                    ModelSizeOutFile << sampler[0]->getModelSize() << " ";
-                    ModelSizeOutFile << '\n';
+                    outWriter.appendTrace( modelSizeTrace , sampler[0]->getModelSize() );
                 }
+                
+                outWriter.exportTraces(); // keep the text traces readable during the run
             }
         }
         
+        if( chainData.checkpointInterval > 0 && (i+1) % chainData.checkpointInterval == 0 )
+        {
+            outWriter.exportTraces();
+            outWriter.flush(); // the trace sizes must correspond to this iteration
+            
+            CheckpointWriter checkpointOut( checkpointFile );
+            checkpointOut.io( i+1 );
+            checkpointOut.io( outWriter.getTraceSizes() );
+            sampler.saveState( checkpointOut );
+            
+            checkpointOut.io( gamma_out );
+            checkpointOut.io( g_out );
+            checkpointOut.io( beta_out );
+            checkpointOut.io( betaSD_out );
+            checkpointOut.io( sigmaRho_out );
+            checkpointOut.io( pi_out );
+            checkpointOut.io( hotspot_tail_prob_out );
+            checkpointOut.io( cpo_out );
+            checkpointOut.io( cposumy_out );
+            checkpointOut.io( lpd );
+            checkpointOut.io( waic_out );
+            checkpointOut.io( waic_frac_sum );
+            
+            checkpointOut.commit();
+        }
+        
     } // end MCMC
     
     // Print the end
@@ -455,45 +462,19 @@ int drive_SUR( Chain_Data& chainData )
     // ### Collect results and save them
     if ( chainData.output_gamma )
     {
-        gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-        gammaOutFile << (arma::conv_to<arma::mat>::from(gamma_out))/(double)(chainData.nIter-chainData.burnin+1.);
-        gammaOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"gamma_out.txt" , arma::conv_to<arma::mat>::from(gamma_out) , 1./(double)(chainData.nIter-chainData.burnin+1.) );
     }
     
     if ( chainData.covariance_type == Covariance_Type::HIW && chainData.output_Gy )
     {
-        gOutFile.open( outFilePrefix+"Gy_out.txt" , std::ios_base::trunc);
-        gOutFile << ( arma::conv_to<arma::mat>::from(g_out) )/(double)(chainData.nIter-std::max(jtStartIteration,chainData.burnin)+1.);   // this might be quite long...
-        gOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"Gy_out.txt" , arma::conv_to<arma::mat>::from(g_out) , 1./(double)(chainData.nIter-std::max(jtStartIteration,chainData.burnin)+1.) );   // this might be quite long...
     }
     
-    logPOutFile <<     sampler[0] -> getLogPTau() << " ";
-    logPOutFile <<     sampler[0] -> getLogPEta() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPJT() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPSigmaRho() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPBeta() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogLikelihood();
-    logPOutFile <<     '\n';
-    logPOutFile.close();
+    outWriter.appendTrace( logPTrace , logPRow() );
     
     if ( chainData.output_model_size )
     {
-        ModelSizeOutFile << sampler[0]->getModelSize();
-        ModelSizeOutFile << '\n';
-        ModelSizeOutFile.close();
-    }
-    
-    GVisitOutFile.close();
-    
-    if ( chainData.output_model_visit )
-    {
-        ModelVisitGammaOutFile.close();
-        ModelVisitGOutFile.close();
-        
+        outWriter.appendTrace( modelSizeTrace , sampler[0]->getModelSize() );
     }
     
     // ----
@@ -528,19 +509,17 @@ int drive_SUR( Chain_Data& chainData )
     // -----
     if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) && chainData.output_pi )
     {
-        piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-        piOutFile << pi_out/(double)(chainData.nIter-chainData.burnin+1);
-        piOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"pi_out.txt" , pi_out , 1./(double)(chainData.nIter-chainData.burnin+1) );
     }
     
     if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
     {
-        htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-        htpOutFile << hotspot_tail_prob_out/(double)(chainData.nIter-chainData.burnin+1);
-        htpOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"hotspot_tail_p_out.txt" , hotspot_tail_prob_out , 1./(double)(chainData.nIter-chainData.burnin+1) );
     }
     // -----
     
+    outWriter.close(); // wait for the writer to be done
+    
     Rcout << "Saved to :   "+outFilePrefix+"****_out.txt" << '\n';
     Rcout << "Final w : " << sampler[0] -> getW() <<  '\n';
     Rcout << "Final tau : " << sampler[0] -> getTau() << "    w/ proposal variance: " << sampler[0] -> getVarTauProposal() << '\n';
@@ -548,7 +527,7 @@ int drive_SUR( Chain_Data& chainData )
         Rcout << "Final eta : " << sampler[0] -> getEta() <<  '\n';
     Rcout << "  -- Average Omega : " << arma::accu( sampler[0] -> getO() * sampler[0] -> getPi().t() )/((double)(sampler[0]->getP()*sampler[0]->getS())) <<  '\n';
     if( chainData.nChains > 1 )
-        Rcout << "Final temperature ratio : " << sampler[1]->getTemperature() <<  '\n' << '\n' ;
+        Rcout << "Final temperature ratio : " << sampler.getTemperature(1) <<  '\n' << '\n' ;
     
     
     // Exit
@@ -564,10 +543,11 @@ int drive_HRR( Chain_Data& chainData )
     // ****************************************
     Rcout << "Initialising the (HRR) MCMC Chain ";
     
+    // with nProcesses > 1 everything down to sampler.serve() runs in every process, on the chains each of them holds
     ESS_Sampler<HRR_Chain> sampler( chainData.surData , chainData.nChains , 1.2 ,
-                                   chainData.gamma_sampler_type, chainData.gamma_type, chainData.beta_type, chainData.covariance_type, chainData.output_CPO, chainData.maxThreads, chainData.burnin );
+                                   chainData.gamma_sampler_type, chainData.gamma_type, chainData.beta_type, chainData.covariance_type, chainData.output_CPO, chainData.maxThreads, chainData.burnin ,
+                                   chainData.nProcesses );
     
-    Rcout << " ... ";
     // *****************************
     
     // extra step needed to read in the MRF prior G matrix if needed
@@ -584,6 +564,10 @@ int drive_HRR( Chain_Data& chainData )
     // Init all parameters
     // *****************************
     sampler.setHyperParameters( chainData );
+    
+    // from here on the other processes (if any) run their share of the chains and never come back
+    sampler.serve();
+    
     Rcout << " ... ";
     
     // Init gamma for the main chain
@@ -602,53 +586,54 @@ int drive_HRR( Chain_Data& chainData )
     
     std::string outFilePrefix = chainData.outFilePath+chainData.filePrefix;
     
-    // clear the content of previous files
-    std::ofstream logPOutFile; logPOutFile.open(outFilePrefix+"logP_out.txt", std::ios::out | std::ios::trunc); logPOutFile.close();
-    // openlogP file in append mode
-    logPOutFile.open( outFilePrefix+"logP_out.txt" , std::ios_base::app); // note we don't close!
-    // open avg files in trunc mode to cut previous content
+    // all the output goes through a background writer so that the I/O never stalls the MCMC loop:
+    // averages are snapshotted to their text files, traces are kept in binary and exported to text when the writer is closed
+    // (the binary traces stay on disk when checkpointing, a resumed run appends to them)
+    OutputWriter outWriter( 4096 , chainData.checkpointInterval > 0 || chainData.resume );
     
-    std::ofstream gammaOutFile;
-    if ( chainData.output_gamma )
+    // the checkpoint holds the next iteration, the trace sizes, the sampler and then the output accumulators
+    std::string checkpointFile = outFilePrefix+"checkpoint.bin";
+    std::unique_ptr<CheckpointReader> checkpointIn;
+    unsigned int firstIteration = 1;
+    
+    if( chainData.resume )
     {
-        gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-        gammaOutFile.close();
+        std::vector<unsigned long long> traceSizes;
+        checkpointIn.reset( new CheckpointReader( checkpointFile ) );
+        checkpointIn -> io( firstIteration );
+        checkpointIn -> io( traceSizes );
+        sampler.loadState( *checkpointIn );
+        outWriter.resumeTraces( traceSizes );
+        Rcout << " resuming from iteration " << firstIteration << " ... ";
     }
     
-    std::ofstream piOutFile;
-    if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) && chainData.output_pi )
+    unsigned int logPTrace = outWriter.openTrace( outFilePrefix+"logP_out.txt" );
+    auto logPRow = [&sampler]()
     {
-        piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-        piOutFile.close();
-    }
+        return arma::rowvec{ sampler[0] -> getLogPO() , sampler[0] -> getLogPPi() , sampler[0] -> getLogPGamma() ,
+            sampler[0] -> getLogPW() , sampler[0] -> getLogLikelihood() };
+    };
+    
+    // clear the content of previous avg files
+    if ( chainData.output_gamma )
+        std::ofstream( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc );
+    
+    if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) && chainData.output_pi )
+        std::ofstream( outFilePrefix+"pi_out.txt" , std::ios_base::trunc );
     
-    std::ofstream htpOutFile;
     if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
-    {
-        htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-        htpOutFile.close();
-    }
+        std::ofstream( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc );
     
-    logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogLikelihood();
-    logPOutFile <<     '\n';
+    if ( !chainData.resume )
+        outWriter.appendTrace( logPTrace , logPRow() );
     
-    std::ofstream ModelSizeOutFile;
+    unsigned int modelSizeTrace = 0;
     if ( chainData.output_model_size )
-    {
-        ModelSizeOutFile.open(outFilePrefix+"model_size_out.txt", std::ios::out | std::ios::trunc); ModelSizeOutFile.close(); // clear out previous content
-        ModelSizeOutFile.open( outFilePrefix+"model_size_out.txt" , std::ios_base::app); //note we don't close it
-    }
+        modelSizeTrace = outWriter.openTrace( outFilePrefix+"model_size_out.txt" );
     
-    std::ofstream ModelVisitGammaOutFile;
+    unsigned int modelVisitGammaTrace = 0;
     if ( chainData.output_model_visit )
-    {
-        ModelVisitGammaOutFile.open( outFilePrefix+"model_visit_gamma_out.txt", std::ios::out | std::ios::trunc); ModelVisitGammaOutFile.close();
-        ModelVisitGammaOutFile.open( outFilePrefix+"model_visit_gamma_out.txt" , std::ios_base::app); // note we don't close!
-    }
+        modelVisitGammaTrace = outWriter.openTrace( outFilePrefix+"model_visit_gamma_out.txt" );
     
     // Output to file the initial state (if burnin=0)
     arma::umat gamma_out; // out var for the gammas
@@ -663,14 +648,24 @@ int drive_HRR( Chain_Data& chainData )
     //arma::mat lpd;
     arma::mat waic_out, waic_frac_sum;
     
-    if( chainData.burnin == 0 )
+    if( chainData.resume )
+    {
+        checkpointIn -> io( gamma_out );
+        checkpointIn -> io( beta_out );
+        checkpointIn -> io( pi_out );
+        checkpointIn -> io( hotspot_tail_prob_out );
+        checkpointIn -> io( cpo_out );
+        checkpointIn -> io( cposumy_out );
+        checkpointIn -> io( waic_out );
+        checkpointIn -> io( waic_frac_sum );
+        checkpointIn.reset();
+    }
+    else if( chainData.burnin == 0 )
     {
         if ( chainData.output_gamma )
         {
             gamma_out = sampler[0] -> getGamma();
-            gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-            gammaOutFile << (arma::conv_to<arma::mat>::from(gamma_out));
-            gammaOutFile.close();
+            outWriter.writeSnapshot( outFilePrefix+"gamma_out.txt" , arma::conv_to<arma::mat>::from(gamma_out) );
         }
         
         if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) &&
@@ -680,9 +675,7 @@ int drive_HRR( Chain_Data& chainData )
             if ( chainData.output_pi )
             {
                 pi_out = tmpVec;
-                piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-                piOutFile << pi_out;
-                piOutFile.close();
+                outWriter.writeSnapshot( outFilePrefix+"pi_out.txt" , pi_out );
             }
             
             if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
@@ -690,9 +683,7 @@ int drive_HRR( Chain_Data& chainData )
                 tmpVec.for_each( [](arma::vec::elem_type& val) { if(val>1.0) val = 1.0; else val=0.0; } );
                 hotspot_tail_prob_out = tmpVec;
                 
-                htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-                htpOutFile << hotspot_tail_prob_out;
-                htpOutFile.close();
+                outWriter.writeSnapshot( outFilePrefix+"hotspot_tail_p_out.txt" , hotspot_tail_prob_out );
             }
         }
         
@@ -714,10 +705,10 @@ int drive_HRR( Chain_Data& chainData )
         }
     }
     
-    if ( chainData.output_beta )
+    if ( chainData.output_beta && !chainData.resume )
         beta_out = sampler[0] -> getBeta();
     
-    if ( chainData.output_CPO )
+    if ( chainData.output_CPO && !chainData.resume )
     {
         predLik =  sampler[0] -> getPredLikelihood() ;
         cpo_out = predLik;
@@ -728,23 +719,18 @@ int drive_HRR( Chain_Data& chainData )
         waic_frac_sum = arma::log(predLik);
     }
     
-    logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogLikelihood();
-    logPOutFile <<     '\n';
+    // the initial state, unless it is already in the resumed traces and accumulators
+    if ( !chainData.resume )
+        outWriter.appendTrace( logPTrace , logPRow() );
     
-    if ( chainData.output_model_size )
+    if ( chainData.output_model_size && !chainData.resume )
     {
-        ModelSizeOutFile << sampler[0]->getModelSize() << " ";
-        ModelSizeOutFile << '\n';
+        outWriter.appendTrace( modelSizeTrace , sampler[0]->getModelSize() );
     }
     
-    if ( chainData.output_model_visit )
+    if ( chainData.output_model_visit && !chainData.resume )
     {
-        ModelVisitGammaOutFile << arma::find((sampler[0] -> getGamma()) == 1).t() << " ";
-        ModelVisitGammaOutFile << '\n';
+        outWriter.appendTrace( modelVisitGammaTrace , arma::urowvec( arma::find((sampler[0] -> getGamma()) == 1).t() ) );
     }
     
     // ########
@@ -757,7 +743,7 @@ int drive_HRR( Chain_Data& chainData )
     
     unsigned int tick = 1000; // how many iter for each print?
     
-    for(unsigned int i=1; i < chainData.nIter ; ++i)
+    for(unsigned int i=firstIteration; i < chainData.nIter ; ++i)
     {
         
         sampler.step();
@@ -807,8 +793,7 @@ int drive_HRR( Chain_Data& chainData )
         
         if( chainData.output_model_visit )
         {
-            ModelVisitGammaOutFile << arma::find((sampler[0] -> getGamma()) == 1).t() << " ";
-            ModelVisitGammaOutFile << '\n';
+            outWriter.appendTrace( modelVisitGammaTrace , arma::urowvec( arma::find((sampler[0] -> getGamma()) == 1).t() ) );
         }
         
         // Print something on how the chain is going
@@ -818,7 +803,8 @@ int drive_HRR( Chain_Data& chainData )
             Rcout << " Running iteration " << i+1 << " ... local Acc Rate: ~ gamma: " << Utils::round( sampler[0] -> getGammaAccRate() , 3 );
             
             if( chainData.nChains > 1)
-                Rcout << " -- Global: " << Utils::round( sampler.getGlobalAccRate() , 3 ) << '\n';
+                Rcout << " -- Global: " << Utils::round( sampler.getGlobalAccRate() , 3 ) <<
+                    " -- Swaps: " << Utils::round( arma::mean( sampler.getPairSwapAccRates() ) , 3 ) << '\n';
             else
                 Rcout << '\n';
             
@@ -833,43 +819,55 @@ int drive_HRR( Chain_Data& chainData )
                 
                 if ( chainData.output_gamma )
                 {
-                    gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-                    gammaOutFile << (arma::conv_to<arma::mat>::from(gamma_out))/(double)(i+1.0-chainData.burnin);
-                    gammaOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"gamma_out.txt" , arma::conv_to<arma::mat>::from(gamma_out) , 1./(double)(i+1.0-chainData.burnin) );
                 }
                 
                 if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) &&
                     chainData.output_pi )
                 {
-                    piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-                    piOutFile << pi_out/(double)(i+1.0-chainData.burnin);
-                    piOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"pi_out.txt" , pi_out , 1./(double)(i+1.0-chainData.burnin) );
                 }
                 
                 if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
                 {
-                    htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-                    htpOutFile << hotspot_tail_prob_out/(double)(i+1.0-chainData.burnin);
-                    htpOutFile.close();
+                    outWriter.writeSnapshot( outFilePrefix+"hotspot_tail_p_out.txt" , hotspot_tail_prob_out , 1./(double)(i+1.0-chainData.burnin) );
                 }
                 
             }
             
             if( (i+1) % (tick*1) == 0 )
             {
-                logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-                logPOutFile <<     sampler[0] -> getLogLikelihood();
-                logPOutFile <<     '\n';
+                outWriter.appendTrace( logPTrace , logPRow() );
                 if ( chainData.output_model_size )
                 {
-                    ModelSizeOutFile << sampler[0]->getModelSize() << " ";
-                    ModelSizeOutFile << '\n';
+                    outWriter.appendTrace( modelSizeTrace , sampler[0]->getModelSize() );
                 }
+                
+                outWriter.exportTraces(); // keep the text traces readable during the run
             }
         }
+        
+        if( chainData.checkpointInterval > 0 && (i+1) % chainData.checkpointInterval == 0 )
+        {
+            outWriter.exportTraces();
+            outWriter.flush(); // the trace sizes must correspond to this iteration
+            
+            CheckpointWriter checkpointOut( checkpointFile );
+            checkpointOut.io( i+1 );
+            checkpointOut.io( outWriter.getTraceSizes() );
+            sampler.saveState( checkpointOut );
+            
+            checkpointOut.io( gamma_out );
+            checkpointOut.io( beta_out );
+            checkpointOut.io( pi_out );
+            checkpointOut.io( hotspot_tail_prob_out );
+            checkpointOut.io( cpo_out );
+            checkpointOut.io( cposumy_out );
+            checkpointOut.io( waic_out );
+            checkpointOut.io( waic_frac_sum );
+            
+            checkpointOut.commit();
+        }
     } // end MCMC
     
     
@@ -879,30 +877,18 @@ int drive_HRR( Chain_Data& chainData )
     // ### Collect results and save them
     if ( chainData.output_gamma )
     {
-        gammaOutFile.open( outFilePrefix+"gamma_out.txt" , std::ios_base::trunc);
-        gammaOutFile << (arma::conv_to<arma::mat>::from(gamma_out))/(double)(chainData.nIter-chainData.burnin+1.);
-        gammaOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"gamma_out.txt" , arma::conv_to<arma::mat>::from(gamma_out) , 1./(double)(chainData.nIter-chainData.burnin+1.) );
     }
     
     
-    logPOutFile <<     sampler[0] -> getLogPO() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPPi() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPGamma() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogPW() <<  " ";
-    logPOutFile <<     sampler[0] -> getLogLikelihood();
-    logPOutFile <<     '\n';
-    logPOutFile.close();
+    outWriter.appendTrace( logPTrace , logPRow() );
     
     
     if ( chainData.output_model_size )
     {
-        ModelSizeOutFile << sampler[0]->getModelSize();
-        ModelSizeOutFile.close();
+        outWriter.appendTrace( modelSizeTrace , sampler[0]->getModelSize() );
     }
     
-    if ( chainData.output_model_visit )
-        ModelVisitGammaOutFile.close();
-    
     // ----
     if ( chainData.output_beta )
     {
@@ -925,25 +911,24 @@ int drive_HRR( Chain_Data& chainData )
     // -----
     if ( ( chainData.gamma_type == Gamma_Type::hotspot || chainData.gamma_type == Gamma_Type::hierarchical ) && chainData.output_pi )
     {
-        piOutFile.open( outFilePrefix+"pi_out.txt" , std::ios_base::trunc);
-        piOutFile << pi_out/(double)(chainData.nIter-chainData.burnin+1);
-        piOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"pi_out.txt" , pi_out , 1./(double)(chainData.nIter-chainData.burnin+1) );
     }
     
     if ( chainData.gamma_type == Gamma_Type::hotspot && chainData.output_tail )
     {
-        htpOutFile.open( outFilePrefix+"hotspot_tail_p_out.txt" , std::ios_base::trunc);
-        htpOutFile << hotspot_tail_prob_out/(double)(chainData.nIter-chainData.burnin+1);
-        htpOutFile.close();
+        outWriter.writeSnapshot( outFilePrefix+"hotspot_tail_p_out.txt" , hotspot_tail_prob_out , 1./(double)(chainData.nIter-chainData.burnin+1) );
     }
     // -----
+    
+    outWriter.close(); // wait for the writer to be done
+    
     Rcout << "Saved to :   "+outFilePrefix+"****_out.txt" << '\n';
     Rcout << "Final w : " << sampler[0] -> getW() << "       w/ proposal variance: " << sampler[0] -> getVarWProposal() << '\n';
     // Rcout << "Final o : " << sampler[0] -> getO().t() << "       w/ proposal variance: " << sampler[0] -> getVarOProposal() << '\n';
     // Rcout << "Final pi : " << sampler[0] -> getPi().t() << "       w/ proposal variance: " << sampler[0] -> getVarPiProposal() << '\n';
     Rcout << "  -- Average Omega : " << arma::accu( sampler[0] -> getO() * sampler[0] -> getPi().t() )/((double)(sampler[0]->getP()*sampler[0]->getS())) <<  '\n';
     if( chainData.nChains > 1 )
-        Rcout << "Final temperature ratio : " << sampler[1]->getTemperature() <<  '\n' << '\n' ;
+        Rcout << "Final temperature ratio : " << sampler.getTemperature(1) <<  '\n' << '\n' ;
     
     
     // Exit
@@ -963,7 +948,8 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
           const std::string& covariancePrior,
           const std::string& gammaPrior, const std::string& gammaSampler, const std::string& gammaInit,
           const std::string& betaPrior, const int maxThreads,
-          bool output_gamma, bool output_beta, bool output_Gy, bool output_sigmaRho, bool output_pi, bool output_tail, bool output_model_size, bool output_CPO, bool output_model_visit )
+          bool output_gamma, bool output_beta, bool output_Gy, bool output_sigmaRho, bool output_pi, bool output_tail, bool output_model_size, bool output_CPO, bool output_model_visit,
+          unsigned int checkpointInterval, bool resume, unsigned int nProcesses , double xtxMemoryBudget )
 {
     
     Rcout << "BayesSUR -- Bayesian Seemingly Unrelated Regression Modelling" << '\n';
@@ -1075,6 +1061,23 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
     chainData.maxThreads = maxThreads;
     chainData.output_model_visit = output_model_visit;
     
+    chainData.checkpointInterval = checkpointInterval;
+    chainData.resume = resume;
+    chainData.nProcesses = std::max( nProcesses , 1u );
+    chainData.xtxMemoryBudget = xtxMemoryBudget;
+    
+    // the chains of a multi-process run are spread over the processes, so there is no single sampler state to save
+    if( chainData.nProcesses > 1 && resume )
+    {
+        Rcerr << "A run can't be resumed with nProcesses > 1" << '\n';
+        return 1;
+    }
+    if( chainData.nProcesses > 1 && checkpointInterval > 0 )
+    {
+        Rcout << "Checkpointing is not available with nProcesses > 1, it is disabled for this run" << '\n';
+        chainData.checkpointInterval = 0;
+    }
+    
     // ***********************************
     // ***********************************
     
@@ -1103,9 +1106,14 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
     }
     
     Rcout << "... successfull!" << '\n';
-    
+
+    // X'X (or the cache of its tiles if it doesn't fit in xtxMemoryBudget) is shared by all the chains
+    chainData.surData.gramCache = std::make_shared<GramCache>( chainData.surData.predictors ,
+                                    std::make_shared<arma::uvec>( arma::join_vert( *chainData.surData.fixedPredictorsIdx , *chainData.surData.VSPredictorsIdx ) ) ,
+                                    chainData.xtxMemoryBudget );
+
     // ############
-    
+
     Rcout << "Clearing and initialising output files " << '\n';
     
     // Re-define dataFile so that I can use it in the output
@@ -1172,7 +1180,7 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
         
     }else if ( gammaInit == "MLE" ) {
         // ** MLE
-        arma::mat Q,R; arma::qr(Q,R, chainData.surData.data->cols( arma::join_vert( *chainData.surData.fixedPredictorsIdx , *chainData.surData.VSPredictorsIdx ) ) );
+        arma::mat Q,R; arma::qr(Q,R, chainData.surData.predictors->cols( arma::join_vert( *chainData.surData.fixedPredictorsIdx , *chainData.surData.VSPredictorsIdx ) ) );
         
         chainData.betaInit = arma::solve(R,arma::trans(Q) * chainData.surData.data->cols( *chainData.surData.outcomesIdx ) );
         chainData.gammaInit = chainData.betaInit > 0.5*arma::stddev(arma::vectorise(chainData.betaInit));
@@ -1189,7 +1197,7 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
     // Samplers
     // ###################################
     
-    int status;
+    int status {1};
     
     // TODO, I hate this, but I can't initialise/instanciate templated classes
     // at runtime so this seems fair (given that the different drive functions have their differences in output and stuff...)
@@ -1213,6 +1221,10 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
                 throw Bad_Covariance_Type( chainData.covariance_type );
         }
     }
+    catch(const std::exception& e)
+    {
+        Rcerr << e.what() << '\n'; // e.g. a missing or corrupted checkpoint when resuming
+    }
     catch(...){ }
     
     return status;
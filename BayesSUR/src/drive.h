@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 #ifndef CCODE
 	#include <RcppArmadillo.h>
@@ -20,6 +21,8 @@
 #include "utils.h"
 #include "distr.h"
 
+#include "checkpoint.h"
+#include "output_writer.h"
 #include "ESS_Sampler.h"
 #include "HRR_Chain.h"
 #include "SUR_Chain.h"
@@ -39,6 +42,7 @@ int drive( const std::string& dataFile, const std::string& mrfGFile, const std::
 			const std::string& gammaPrior, const std::string& gammaSampler, const std::string& gammaInit,
 			const std::string& betaPrior, const int maxThreads,
 			bool output_gamma, bool output_beta, bool output_Gy, bool output_sigmaRho, bool output_pi, bool output_tail, bool output_model_size,
-            bool output_CPO, bool output_model_visit );
+            bool output_CPO, bool output_model_visit, unsigned int checkpointInterval, bool resume, unsigned int nProcesses ,
+            double xtxMemoryBudget );
 
 #endif
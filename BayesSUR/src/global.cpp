@@ -6,5 +6,55 @@
   //use with 
   // omp_set_lock(&RNGlock);
   // omp_unset_lock(&RNGlock);
-//std::vector<std::mt19937_64> rng;
 //Rcpp::RNGScope scope;
+
+static RNGStream* threadRNGStream = nullptr;
+#ifdef _OPENMP
+  #pragma omp threadprivate(threadRNGStream)
+#endif
+
+RNGStream* getThreadRNGStream(){ return threadRNGStream; }
+void setThreadRNGStream( RNGStream* stream ){ threadRNGStream = stream; }
+
+void RNGStream::seed( uint64_t seed_ )
+{
+  // splitmix64, as recommended to initialise the xoshiro state from a single 64bit seed
+  for( unsigned int i=0; i<4; ++i )
+  {
+    uint64_t z = ( seed_ += 0x9e3779b97f4a7c15 );
+    z = ( z ^ (z >> 30) ) * 0xbf58476d1ce4e5b9;
+    z = ( z ^ (z >> 27) ) * 0x94d049bb133111eb;
+    s[i] = z ^ (z >> 31);
+  }
+}
+
+void RNGStream::jump()
+{
+  static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+
+  uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for( unsigned int i=0; i<4; ++i )
+    for( unsigned int b=0; b<64; ++b )
+    {
+      if( JUMP[i] & ( UINT64_C(1) << b ) )
+      {
+        s0 ^= s[0]; s1 ^= s[1]; s2 ^= s[2]; s3 ^= s[3];
+      }
+      (*this)();
+    }
+
+  s[0] = s0; s[1] = s1; s[2] = s2; s[3] = s3;
+}
+
+void seedRNGStreams( std::vector<RNGStream>& streams , uint64_t seed )
+{
+  if( streams.empty() )
+    return;
+
+  streams[0].seed( seed );
+  for( unsigned int i=1; i<streams.size(); ++i )
+  {
+    streams[i] = streams[i-1];
+    streams[i].jump();
+  }
+}
@@ -3,6 +3,7 @@
 
   #include <random>
   #include <vector>
+  #include <cstdint>
   
   // to get std::beta
   #define __STDCPP_WANT_MATH_SPEC_FUNCS__ 1
@@ -18,4 +19,68 @@
     #include <armadillo>
   #endif
 
+  // Independent random number streams, one per chain, so that chains stepping in parallel never touch R's global RNG.
+  // xoshiro256++ (Blackman & Vigna) satisfies UniformRandomBitGenerator, so it can feed the <random> distributions,
+  // and jump() advances it by 2^128 draws, which gives non-overlapping streams from a single seed.
+  class RNGStream {
+
+    public:
+
+      typedef uint64_t result_type;
+
+      RNGStream( uint64_t seed_ = 0 ){ seed( seed_ ); }
+
+      void seed( uint64_t seed_ ); // fills the state through splitmix64
+      void jump();
+
+      static constexpr result_type min(){ return 0; }
+      static constexpr result_type max(){ return UINT64_MAX; }
+
+      inline result_type operator()()
+      {
+        const uint64_t result = rotl( s[0] + s[3] , 23 ) + s[0];
+        const uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0]; s[3] ^= s[1];
+        s[1] ^= s[2]; s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl( s[3] , 45 );
+
+        return result;
+      }
+
+      inline double nextU01(){ return ( ( (*this)() >> 11 ) + 0.5 ) * ( 1. / 9007199254740992. ); } // in (0,1) like R::runif, 53 bits of randomness
+
+    private:
+
+      static inline uint64_t rotl( const uint64_t x , int k ){ return (x << k) | (x >> (64 - k)); }
+      uint64_t s[4];
+
+  };
+
+  // seeds the first stream with seed and obtains the others by successive jumps
+  void seedRNGStreams( std::vector<RNGStream>& streams , uint64_t seed );
+
+  // stream used by the random number generators in distr.cpp for the calling thread,
+  // nullptr (the default) means R's global RNG
+  RNGStream* getThreadRNGStream();
+  void setThreadRNGStream( RNGStream* stream );
+
+  // selects a stream for the calling thread for the lifetime of the object, then restores the previous one
+  class RNGStreamScope {
+
+    public:
+
+      RNGStreamScope( RNGStream& stream ): previous( getThreadRNGStream() ) { setThreadRNGStream( &stream ); }
+      ~RNGStreamScope(){ setThreadRNGStream( previous ); }
+
+      RNGStreamScope( const RNGStreamScope& ) = delete;
+      RNGStreamScope& operator=( const RNGStreamScope& ) = delete;
+
+    private:
+
+      RNGStream* previous;
+
+  };
+
 #endif
@@ -0,0 +1,140 @@
+#include "gram_cache.h"
+
+constexpr double GramCache::defaultMemoryBudget;
+
+GramCache::GramCache( std::shared_ptr<PredictorMatrix> predictors_, std::shared_ptr<arma::uvec> columnsIdx_,
+                     double memoryBudget_ , unsigned int tileSize_ ):
+predictors(predictors_), columnsIdx(columnsIdx_), memoryBudget(memoryBudget_), tileSize( std::max( tileSize_ , 1u ) ), usedBytes(0)
+{
+    nTiles = ( columnsIdx->n_elem + tileSize - 1 ) / tileSize;
+    maxBytes = (unsigned long long)( std::max( memoryBudget , 0. ) * 1024. * 1024. );
+
+#ifdef _OPENMP
+    omp_init_lock(&cacheLock);
+#endif
+}
+
+GramCache::~GramCache()
+{
+#ifdef _OPENMP
+    omp_destroy_lock(&cacheLock);
+#endif
+}
+
+bool GramCache::fitsInBudget() const
+{
+    double p = (double)columnsIdx->n_elem;
+    return ( p * p * sizeof(double) ) <= (double)maxBytes ;
+}
+
+double GramCache::getMemoryBudget() const { return memoryBudget; }
+unsigned int GramCache::getTileSize() const { return tileSize; }
+unsigned int GramCache::getNCachedTiles() const { return lruList.size(); }
+
+void GramCache::clear()
+{
+#ifdef _OPENMP
+    omp_set_lock(&cacheLock);
+#endif
+
+    lruList.clear();
+    tileMap.clear();
+    usedBytes = 0;
+
+#ifdef _OPENMP
+    omp_unset_lock(&cacheLock);
+#endif
+}
+
+std::shared_ptr<const arma::mat> GramCache::computeTile( const unsigned int I , const unsigned int J ) const
+{
+    unsigned int p = columnsIdx->n_elem;
+    arma::uvec colsI = (*columnsIdx)( arma::span( I*tileSize , std::min( (I+1)*tileSize , p ) - 1 ) );
+    arma::uvec colsJ = (*columnsIdx)( arma::span( J*tileSize , std::min( (J+1)*tileSize , p ) - 1 ) );
+
+    return std::make_shared<arma::mat>( predictors->gram( colsI , colsJ ) );
+}
+
+// always called with I <= J; the (expensive) computation of a missing tile happens outside the lock
+std::shared_ptr<const arma::mat> GramCache::getTile( const unsigned int I , const unsigned int J )
+{
+    unsigned long long key = (unsigned long long)I * nTiles + J;
+    std::shared_ptr<const arma::mat> tile;
+
+#ifdef _OPENMP
+    omp_set_lock(&cacheLock);
+#endif
+
+    auto it = tileMap.find( key );
+    if( it != tileMap.end() )
+    {
+        lruList.splice( lruList.begin() , lruList , it->second ); // move to front, iterators stay valid
+        tile = it->second->second;
+    }
+
+#ifdef _OPENMP
+    omp_unset_lock(&cacheLock);
+#endif
+
+    if( tile )
+        return tile;
+
+    tile = computeTile( I , J );
+    unsigned long long tileBytes = tile->n_elem * sizeof(double);
+
+#ifdef _OPENMP
+    omp_set_lock(&cacheLock);
+#endif
+
+    // another chain might have inserted the same tile in the meantime
+    if( tileMap.find( key ) == tileMap.end() )
+    {
+        lruList.emplace_front( key , tile );
+        tileMap[key] = lruList.begin();
+        usedBytes += tileBytes;
+
+        // evict least recently used tiles, but always keep the one just computed
+        while( usedBytes > maxBytes && lruList.size() > 1 )
+        {
+            usedBytes -= lruList.back().second->n_elem * sizeof(double);
+            tileMap.erase( lruList.back().first );
+            lruList.pop_back();
+        }
+    }
+
+#ifdef _OPENMP
+    omp_unset_lock(&cacheLock);
+#endif
+
+    return tile;
+}
+
+arma::mat GramCache::submat( const arma::uvec& rowsIdx , const arma::uvec& colsIdx )
+{
+    arma::mat result( rowsIdx.n_elem , colsIdx.n_elem );
+
+    // local map so that each needed tile is fetched (and locked for) only once per call
+    std::unordered_map< unsigned long long , std::shared_ptr<const arma::mat> > localTiles;
+
+    for( unsigned int j=0; j<colsIdx.n_elem; ++j )
+    {
+        unsigned int tc = colsIdx(j) / tileSize , oc = colsIdx(j) % tileSize ;
+
+        for( unsigned int i=0; i<rowsIdx.n_elem; ++i )
+        {
+            unsigned int tr = rowsIdx(i) / tileSize , or_ = rowsIdx(i) % tileSize ;
+
+            // only upper tiles are stored, use the symmetry of X'X for the lower ones
+            unsigned int I = std::min( tr , tc ) , J = std::max( tr , tc );
+            unsigned long long key = (unsigned long long)I * nTiles + J;
+
+            auto it = localTiles.find( key );
+            if( it == localTiles.end() )
+                it = localTiles.emplace( key , getTile( I , J ) ).first;
+
+            result(i,j) = ( tr <= tc ) ? (*it->second)( or_ , oc ) : (*it->second)( oc , or_ ) ;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,79 @@
+#ifndef GRAM_CACHE_H
+#define GRAM_CACHE_H
+
+#ifdef CCODE
+	#include <iostream>
+    #include <armadillo>
+#else
+    #include <RcppArmadillo.h>
+#endif
+
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+#include "predictor_matrix.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+/*
+Bounded-memory, lazily populated Gram matrix X'X for the predictors.
+X'X is split into square tiles of tileSize columns, and only the upper-triangular tiles (I <= J) are
+ever computed -- on demand, the first time an entry inside them is requested -- and kept in a LRU list
+whose total size is bounded by the memory budget.
+Tiles are handed around as shared_ptr so that an eviction by another chain never invalidates a tile in use.
+*/
+
+class GramCache {
+
+    public:
+
+        GramCache( std::shared_ptr<PredictorMatrix> predictors_, std::shared_ptr<arma::uvec> columnsIdx_,
+                  double memoryBudget_ = defaultMemoryBudget , unsigned int tileSize_ = 64 );
+        ~GramCache();
+
+        GramCache( const GramCache& ) = delete;
+        GramCache& operator=( const GramCache& ) = delete;
+
+        // X'X( rowsIdx , colsIdx ), indices are relative to columnsIdx
+        arma::mat submat( const arma::uvec& rowsIdx , const arma::uvec& colsIdx );
+
+        // true if the whole p x p X'X fits in the memory budget (in which case there's no point in caching tiles)
+        bool fitsInBudget() const;
+
+        double getMemoryBudget() const;
+        unsigned int getTileSize() const;
+        unsigned int getNCachedTiles() const;
+
+        void clear();
+
+        static constexpr double defaultMemoryBudget = 200.; // in MB, roughly the size of a full X'X for p = 5000
+
+    private:
+
+        std::shared_ptr<const arma::mat> getTile( const unsigned int I , const unsigned int J );
+        std::shared_ptr<const arma::mat> computeTile( const unsigned int I , const unsigned int J ) const;
+
+        std::shared_ptr<PredictorMatrix> predictors;
+        std::shared_ptr<arma::uvec> columnsIdx;
+
+        double memoryBudget;
+        unsigned int tileSize, nTiles;
+        unsigned long long maxBytes, usedBytes;
+
+        // LRU: most recently used at the front, the map points into the list
+        typedef std::pair< unsigned long long , std::shared_ptr<const arma::mat> > TileEntry;
+        std::list<TileEntry> lruList;
+        std::unordered_map< unsigned long long , std::list<TileEntry>::iterator > tileMap;
+
+#ifdef _OPENMP
+        omp_lock_t cacheLock;
+#endif
+
+};
+
+#endif
@@ -7,7 +7,7 @@
 #endif
 
 /*
-I here decide that the Clique Sequence follows the JT in a Depth First manner, 
+I here decide that the Clique Sequence follows the JT in a Depth First manner,
 so we follow each branch till the end, then come back andd follow another branch and so on...
 */
 
@@ -25,33 +25,32 @@ as we migt be updating them only locally. Still...
 Nodes and Separator sets are SORTED, mainly to help STL algorithms to serach for inclusions and stuff..
 */
 
+/*
+Components are stored by value in the JT arena and linked by their index there (JTComponent::none for no parent),
+perfectCliqueSequence lists the arena indexes in PCS order. A proposal works on a plain copy of the current JT.
+*/
 
-JTComponent::JTComponent( )
-{
-    nodes = std::vector<unsigned int>(0);
-    separator = std::vector<unsigned int>(0);
-    // parent = nullptr;
-    childrens = std::vector<std::shared_ptr<JTComponent>>(0);
-}
+const unsigned int JTComponent::none;
 
-JTComponent::JTComponent( const std::vector<unsigned int>& nodes_)
+JTComponent::JTComponent( ):
+parent(none)
+{ }
+
+JTComponent::JTComponent( const std::vector<unsigned int>& nodes_):
+parent(none)
 {
     this->setNodes(nodes_);
-    separator = std::vector<unsigned int>(0);
-    // parent = nullptr;
-    childrens = std::vector<std::shared_ptr<JTComponent>>(0);
 }
 
-JTComponent::JTComponent( const std::vector<unsigned int>& nodes_ , const std::vector<unsigned int>& separator_)
+JTComponent::JTComponent( const std::vector<unsigned int>& nodes_ , const std::vector<unsigned int>& separator_):
+parent(none)
 {
     this->setNodes(nodes_);
     this->setSeparator(separator_);
-    // parent = nullptr;
-    childrens = std::vector<std::shared_ptr<JTComponent>>(0);
 }
 
 JTComponent::JTComponent( const std::vector<unsigned int>& nodes_ , const std::vector<unsigned int>& separator_ ,
-                          const std::vector<std::shared_ptr<JTComponent>>& childrens_ , const std::shared_ptr<JTComponent>& parent_)
+                          const JTLinks& childrens_ , const unsigned int parent_)
 {
     this->setNodes(nodes_);
     this->setSeparator(separator_);
@@ -59,29 +58,26 @@ JTComponent::JTComponent( const std::vector<unsigned int>& nodes_ , const std::v
     this->setChildrens(childrens_);
 }
 
-JTComponent::JTComponent( const JTComponent& otherJTComponent )
-{
-    nodes = otherJTComponent.getNodes();
-    separator = otherJTComponent.getSeparator();
-    parent = otherJTComponent.getParent();
-    childrens = otherJTComponent.getChildrens();
-}
-
-std::vector<unsigned int> JTComponent::getNodes() const
+const JTSet& JTComponent::getNodes() const
 {
     return nodes;
 }
-std::vector<unsigned int> JTComponent::getSeparator() const
+const JTSet& JTComponent::getSeparator() const
 {
     return separator;
 }
 
-std::shared_ptr<JTComponent> JTComponent::getParent() const
+unsigned int JTComponent::getParent() const
+{
+    return parent;
+}
+
+bool JTComponent::hasParent() const
 {
-    return parent.lock();
+    return parent != none;
 }
 
-std::vector<std::shared_ptr<JTComponent>> JTComponent::getChildrens() const
+const JTLinks& JTComponent::getChildrens() const
 {
     return childrens;
 }
@@ -126,40 +122,46 @@ void JTComponent::addSeparators( const std::vector<unsigned int>& seps_)
 }
 
 
-void JTComponent::add1Children( const std::shared_ptr<JTComponent>& otherJTComponentPTR)
+void JTComponent::add1Children( const unsigned int otherComponent )
 {
-    if(std::find(childrens.begin(), childrens.end(), otherJTComponentPTR) == childrens.end())
-        childrens.push_back( otherJTComponentPTR );
+    if(std::find(childrens.begin(), childrens.end(), otherComponent) == childrens.end())
+        childrens.push_back( otherComponent );
     // else do nothing as it is a duplicate
 }
 
-void JTComponent::addChildrens( const std::vector<std::shared_ptr<JTComponent>>& otherJTComponentPTRs )
+void JTComponent::removeChildren( const unsigned int otherComponent )
 {
-    for( auto i : otherJTComponentPTRs )
-    {
-        if(std::find(childrens.begin(), childrens.end(), i) == childrens.end())
-            childrens.push_back( i );
-        // else do nothing as it is a duplicate
-    }
+    childrens.erase( std::remove( childrens.begin(), childrens.end(), otherComponent ), childrens.end() );
 }
 
 
 void JTComponent::setNodes( const std::vector<unsigned int>& nodes_)
 {
-    nodes = nodes_ ;
+    nodes.assign( nodes_.begin(), nodes_.end() );
     // remove duplicates from nodes
     nodes.erase( std::unique( nodes.begin(), nodes.end() ), nodes.end() );
     std::sort(nodes.begin(), nodes.end());
 }
 
+void JTComponent::setNodes( const JTSet& nodes_)
+{
+    nodes = nodes_; // already a sorted set
+}
+
 void JTComponent::setSeparator( const std::vector<unsigned int>& sep_)
 {
-    separator = sep_;
+    separator.assign( sep_.begin(), sep_.end() );
     // remove duplicates from seo
     separator.erase( std::unique( separator.begin(), separator.end() ), separator.end() );
     std::sort(separator.begin(), separator.end());
 }
-void JTComponent::setChildrens( const  std::vector<std::shared_ptr<JTComponent>>& c)
+
+void JTComponent::setSeparator( const JTSet& sep_)
+{
+    separator = sep_;
+}
+
+void JTComponent::setChildrens( const JTLinks& c)
 {
     // remove duplicates from c
     childrens = c;
@@ -171,9 +173,9 @@ void JTComponent::clearSeparator()
     separator.clear();
 }
 
-void JTComponent::setParent( const std::shared_ptr<JTComponent>& otherJTComponentPTR )
+void JTComponent::setParent( const unsigned int otherComponent )
 {
-    parent = otherJTComponentPTR;
+    parent = otherComponent;
 }
 
 void JTComponent::print() const
@@ -188,7 +190,7 @@ void JTComponent::print() const
         Rcout << " " << i;
     Rcout << '\n';
 
-    Rcout << "  Its Parent is @ " << parent.lock() << " and its Children are @:";
+    Rcout << "  Its Parent is component " << (int)( hasParent() ? parent : -1 ) << " and its Children are components:";
     for( auto i : childrens )
         Rcout << " " << i;
     Rcout << '\n' << '\n';
@@ -207,60 +209,34 @@ JunctionTree::JunctionTree( const unsigned int n_ , const std::string type ) //
     if( type == "" || type == "empty" )
     {
         perfectEliminationOrder = std::vector<unsigned int>(n);
-        perfectCliqueSequence = std::deque<std::shared_ptr<JTComponent>>(); // init empty list
-
-
-        std::vector<unsigned int> node(1); 
-
-
-        std::deque<std::shared_ptr<JTComponent>>::iterator pcs_it = perfectCliqueSequence.end();
+        perfectCliqueSequence = std::vector<unsigned int>(n);
+        components = std::vector<JTComponent>(n);
 
-        node[0] = 0;
-        perfectCliqueSequence.insert( pcs_it, std::make_shared<JTComponent>( node ));
-        // the above returns a shared ptr to a new component,
-        // the component has one node, empty separator and no parent or child
-        // and it adds it to the pcs_it position in the list
-
-        pcs_it = perfectCliqueSequence.end(); //update iterator
-        --pcs_it;
-
-        perfectEliminationOrder[0] = 0;
-
-        std::shared_ptr<JTComponent> tmpPointerToComponent;
-
-        
-        for( unsigned int i=1; i<n; ++i)
+        // a chain 0 -> 1 -> ... -> n-1 of single-node components
+        for( unsigned int i=0; i<n; ++i)
         {
-            node[0] = i;
-            perfectEliminationOrder[i] = i;
+            components[i].setNodes( std::vector<unsigned int>(1,i) );
+            if( i > 0 )
+            {
+                components[i-1].add1Children( i );
+                components[i].setParent( i-1 );
+            }
 
-            // create a new component
-            tmpPointerToComponent = std::make_shared<JTComponent>( node );
-            // insert the new compoent as child in the previous component
-            (*pcs_it) -> add1Children( tmpPointerToComponent );
-            // add the previous component as parent of the new component
-            tmpPointerToComponent -> setParent( *pcs_it );
-            // increment iterator
-            ++pcs_it;
-            // add new component to the list
-            perfectCliqueSequence.insert( pcs_it, tmpPointerToComponent );
-
-            // update iterator since the previous insert deprecated it
-            pcs_it = perfectCliqueSequence.end();
-            --pcs_it;
+            perfectCliqueSequence[i] = i;
+            perfectEliminationOrder[i] = i;
         }
 
         adjacencyMatrix.zeros(n,n); // the matrix is empty, no edges
 
     }else{
         perfectEliminationOrder = std::vector<unsigned int>(n);
-        perfectCliqueSequence = std::deque<std::shared_ptr<JTComponent>>();
 
         for( unsigned int i=0; i<n; ++i)
             perfectEliminationOrder[i] = i;
 
-        perfectCliqueSequence.push_back( std::make_shared<JTComponent>(perfectEliminationOrder) );
-        
+        components = std::vector<JTComponent>( 1 , JTComponent(perfectEliminationOrder) );
+        perfectCliqueSequence = std::vector<unsigned int>( 1 , 0 );
+
         arma::umat tmp = arma::ones<arma::umat>(n,n);
         adjacencyMatrix = tmp - arma::eye<arma::umat>(n,n); // the matrix is full of edges
 
@@ -269,17 +245,23 @@ JunctionTree::JunctionTree( const unsigned int n_ , const std::string type ) //
 }
 
 
-JunctionTree::JunctionTree( const unsigned int n_, const std::deque<std::shared_ptr<JTComponent>>& PCS_)
+JunctionTree::JunctionTree( const unsigned int n_, const std::vector<JTComponent>& components_ , const std::vector<unsigned int>& PCS_ )
 {
     n = n_;
+    components = components_;
     perfectCliqueSequence = PCS_;
     updatePEO();
     updateAdjMat();
 }
 
-std::deque<std::shared_ptr<JTComponent>> JunctionTree::getPCS() const
+const JTComponent& JunctionTree::getClique( const unsigned int q ) const
+{
+    return components[ perfectCliqueSequence[q] ];
+}
+
+unsigned int JunctionTree::getNCliques() const
 {
-    return perfectCliqueSequence;
+    return perfectCliqueSequence.size();
 }
 
 std::vector<unsigned int> JunctionTree::getPEO() const
@@ -287,7 +269,7 @@ std::vector<unsigned int> JunctionTree::getPEO() const
     return perfectEliminationOrder;
 }
 
-arma::sp_umat JunctionTree::getAdjMat() const
+const arma::sp_umat& JunctionTree::getAdjMat() const
 {
     return adjacencyMatrix;
 }
@@ -302,735 +284,163 @@ void JunctionTree::print() const
 {
     Rcout << '\n' << " ---------------------------------- " << '\n';
     for( auto i : perfectCliqueSequence )
-        i->print();
+        components[i].print();
     Rcout << " ---------------------------------- " << '\n' <<
         "The PEO for this JT is :" << '\n';
 
     for(auto i : perfectEliminationOrder )
         Rcout << i << " ";
-    Rcout << '\n' << " ---------------------------------- " << '\n';
-
-    arma::umat tmp(adjacencyMatrix);
-    Rcout << "Graph's Adjacency Matrix: " << tmp << '\n' << '\n';
-}
-
-void JunctionTree::cloneRoot( std::shared_ptr<JTComponent>& newComponent , 
-                                    std::shared_ptr<JTComponent>& oldComponent )
-{
-    newComponent->setNodes( oldComponent->getNodes() );
-    newComponent->setSeparator( oldComponent->getSeparator() );
-    newComponent->setParent( nullptr );
-
-    unsigned int nChildrens = oldComponent->getChildrens().size();
-
-    std::vector<std::shared_ptr<JTComponent>> newChildrens( nChildrens );
-    std::vector<std::shared_ptr<JTComponent>> oldChildrens = oldComponent->getChildrens();
-
-    for( unsigned int i=0; i<nChildrens; ++i )
-    {
-        newChildrens[i] = std::make_shared<JTComponent>();
-        cloneComponent( newChildrens[i], oldChildrens[i], newComponent);
-    }
-
-    newComponent->setChildrens( newChildrens );
-}
-
-
-void JunctionTree::cloneComponent( std::shared_ptr<JTComponent>& newComponent , 
-                                    std::shared_ptr<JTComponent>& oldComponent , 
-                                    std::shared_ptr<JTComponent>& newParent )
-{
-    newComponent->setNodes( oldComponent->getNodes() );
-    newComponent->setSeparator( oldComponent->getSeparator() );
-    newComponent->setParent( newParent );
-
-    unsigned int nChildrens = oldComponent->getChildrens().size();
-
-    std::vector<std::shared_ptr<JTComponent>> newChildrens( nChildrens );
-    std::vector<std::shared_ptr<JTComponent>> oldChildrens = oldComponent->getChildrens();
-
-    for( unsigned int i=0; i<nChildrens; ++i )
-    {
-        newChildrens[i] = std::make_shared<JTComponent>();
-        cloneComponent( newChildrens[i], oldChildrens[i], newComponent);
-    }
-
-    newComponent->setChildrens( newChildrens );
-}
-
-
-/* 
-This assumes that all the elements before pos are correctly initialised
-*/
-void JunctionTree::buildNewPCS( std::deque<std::shared_ptr<JTComponent>>& newPCS, unsigned int& pos)
-{
-
-    unsigned int j=0; // index for the childrens inside each 'root' node
-    std::vector<std::shared_ptr<JTComponent>> rootChildrens = newPCS[pos]->getChildrens();
-    std::vector<std::shared_ptr<JTComponent>> childChildrens;
-
-    while( ( rootChildrens.size() - j ) > 0 )
-    {
-        newPCS.insert( newPCS.begin() + (++pos) , rootChildrens[j] );  // I love how increments in c++ make things less readable..
-        childChildrens = rootChildrens[j++]->getChildrens();
-
-        if( childChildrens.size() > 0 )
-        {
-            buildNewPCS(newPCS, pos);
-        }
-    }
-}
-
-void JunctionTree::copyJT( JunctionTree& newJT ) // returns a copy of this, copying each component into newJT
-{
-  
-    std::deque<std::shared_ptr<JTComponent>> newPCS;
-
-    newPCS.insert( newPCS.end() , std::make_shared<JTComponent>() );
-
-    cloneRoot(newPCS[0],perfectCliqueSequence[0]); //this clones the root component and ALL its childrens
-
-    // build up again the newPCS (the O-th element is already set)
-    unsigned int pcsPosition=0; // index for the PCS
-    buildNewPCS( newPCS, pcsPosition);
-
-    newJT = JunctionTree( this->n, newPCS );
-}
-
-
-void JunctionTree::updatePEO( )
-{
-    std::vector<unsigned int> tmpResidual;
-
-    perfectEliminationOrder.clear();
-    perfectEliminationOrder.reserve(n);
-
-    std::vector<unsigned int> tmpNodes,tmpSeparator;
-
-    for( auto c : perfectCliqueSequence )
-    {
-        tmpResidual.clear();
-        
-        tmpNodes = c->getNodes();
-        tmpSeparator = c->getSeparator();
-
-        std::set_difference(tmpNodes.begin(), tmpNodes.end(), 
-                            tmpSeparator.begin(), tmpSeparator.end(), 
-                        std::inserter(tmpResidual, tmpResidual.begin()));
-
-        perfectEliminationOrder.insert(perfectEliminationOrder.end(),
-                                    tmpResidual.begin(), tmpResidual.end()); 
-    }
-}
-
-
-void JunctionTree::updateAdjMat( )
-{
-    adjacencyMatrix.zeros(n,n); //this maintains dimensions but reset it
-
-    std::vector<unsigned int> componentNodes;
-
-    for(auto i : perfectCliqueSequence)
-    {
-        componentNodes = i->getNodes();
-        if( componentNodes.size() > 1 )
-        {
-
-            for( unsigned int j=0, nNodes=componentNodes.size() ; j<(nNodes-1) ; ++j )  // j < k -- nodes are ordered
-            {
-                for( unsigned int k=j+1 ; k<nNodes ; ++k )                          // so element (k,j) is in the lower tri
-                {
-                    if( !adjacencyMatrix(componentNodes[k],componentNodes[j]) )
-                    {
-                        adjacencyMatrix(componentNodes[k],componentNodes[j]) = 1;
-                        adjacencyMatrix(componentNodes[j],componentNodes[k]) = 1;
-                    }
-                }
-            }
-
-        }
-    }
-
-    // adjacencyMatrix = adjacencyMatrix + adjacencyMatrix.t(); // to fill the upper tri part.
-}
-
-
-/*
-JT Update proposal, from Green and Thomas 2013
-The idea is to call this from a copied JT, as it will modify the JT structure (is this TOO costly?)
-*/
-std::pair<bool,double> JunctionTree::propose_single_edge_update( arma::uvec& update_idx )
-{
-    // We need to select randomly one separator -- in our structure is any component beside the first
-    unsigned int numComponents = perfectCliqueSequence.size();
-    unsigned int randomSep, randomComp;
-
-    arma::uvec randomIndexes;
-
-    std::shared_ptr<JTComponent> Cx, Cy, C, ClX, ClY, cLeft, cRight;
-    std::vector<unsigned int> setCx, setCy, setCxlS, setCylS, setS, 
-        setC, setNeighbour, xUS, yUS, setCLeft, setCRight;
-
-    unsigned int x,y;
-
-    std::vector<std::shared_ptr<JTComponent>> newChildrens;
-    std::vector<unsigned int> newNodes;
-    std::vector<unsigned int> newSeparator;
-    std::shared_ptr<JTComponent> newParent;
-
-    std::vector<std::shared_ptr<JTComponent>> neighbours, N, Nx, Ny, possibleComponents;
-    bool definedCx=false, definedCy=false;
-    std::deque<std::shared_ptr<JTComponent>> newPCS;
-    unsigned int pos = 0;
-    unsigned int countN = 0;
-
-    double logP = 0;
-
-    if( randU01() < 0.5 )
-    {
-        // propose addition
-        // if there's one component only, return false and no update happened
-        if( numComponents > 1 )
-        {
-            // get a Random separator
-            randomSep = randIntUniform(1,numComponents-1);
-
-            // populate Cx and Cy
-            Cx = perfectCliqueSequence[randomSep]->getParent();
-            Cy = perfectCliqueSequence[randomSep];
-
-            setCx = Cx->getNodes();
-            setCy = Cy->getNodes();
-            setS = perfectCliqueSequence[randomSep]->getSeparator();
-            
-            // Populate Cx\S and Cy\S
-            std::set_difference(setCx.begin(), setCx.end(), setS.begin(), setS.end(), 
-                            std::inserter(setCxlS, setCxlS.begin()));
-
-            std::set_difference(setCy.begin(), setCy.end(), setS.begin(), setS.end(), 
-                            std::inserter(setCylS, setCylS.begin()));
-
-            // now choose x and y from Cx\S and Cy\S
-            x = setCxlS[ randIntUniform(0,setCxlS.size()-1) ];
-            y = setCylS[ randIntUniform(0,setCylS.size()-1) ];
-
-            // check whether or not Cx and Cy are superset of x U S and y U S and act accordingly
-            // note there's no way for it to be the other way around by construction
-            if( setCxlS.size() == 1 && setCylS.size() == 1 ) // a) this means that both Cx and Cy are exactly just x and S (and y and S) 
-            {
-                
-                // Type a)
-
-                // compute new children set
-                newChildrens = Cy->getChildrens();
-                for( auto c : Cx->getChildrens() )
-                {
-                    if( c != Cy )
-                        newChildrens.push_back(c);
-                }
-
-
-                newNodes = setS; 
-                newNodes.push_back(x);
-                newNodes.push_back(y);
-
-                // newSeparator = Cx->getSeparator();
-                // newParent = Cx->getParent();
-
-                // Modify Cx to C* (the new component we need)
-                Cx->setChildrens(newChildrens);
-                Cx->setNodes(newNodes);
-                // Cx->setSeparator(newSeparator);
-                // Cx->setParent(newParent);
-
-                // make the new childrens point to C* (rather than Cy)
-                for( auto c : newChildrens )
-                {
-                    if( c->getParent() != Cx )
-                        c->setParent(Cx);
-                }
-
-                // Erase Cy
-                perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomSep);
-
-                // **** logP addition
-                neighbours.clear();
-                if( Cx->getParent() )
-                    neighbours.push_back( Cx->getParent() );  // push parent only if it exists
-
-                for( auto i : Cx->getChildrens() )
-                    neighbours.push_back(i);
-
-                for( auto i : neighbours )
-                {
-                    setNeighbour = i->getNodes();
-                    if(std::find(setNeighbour.begin(), setNeighbour.end(), x) == setNeighbour.end()) // if x is NOT in there
-                    {
-                        if(std::find(setNeighbour.begin(), setNeighbour.end(), y) == setNeighbour.end()) // if y is NOT in there either
-                        {
-                            ++countN;
-                        
-                        }
-
-                    }
-                }
-
-                logP -= countN * log(2.); // backward probability addition
-                logP -= log((double)(numComponents-1.)) - log(2.) + ( log( (double)(Cx->getNodes().size()) ) + log( (double)(Cx->getNodes().size()-1.) ) ); // backward probability (-1 because we reduce the # component by 1)
-
-            }else if( setCxlS.size() > 1 && setCylS.size() == 1 ) // b)
-            {
-
-                // Type b)
-
-                Cy->add1Node(x);
-                Cy->add1Separator(x);
-
-                logP -= log((double)numComponents) - log(2.) + ( log( (double)(Cx->getNodes().size()) ) + log( (double)(Cx->getNodes().size()-1.) ) ); // backward probability
-
-            }else if( setCxlS.size() == 1 && setCylS.size() > 1 ) //c)
-            {
-                // Type c)
-
-                Cx->add1Node(y);
-                Cy->add1Separator(y); // remember the separator is always the one from the Cy obj
-
-                logP -= log((double)numComponents) - log(2.) + ( log( (double)(Cx->getNodes().size()) ) + log( (double)(Cx->getNodes().size()-1.) ) ); // backward probability
-
-            }else if( setCxlS.size() > 1 && setCylS.size() > 1 ) // d) Cx and Cy contain more than just x and S (and y and S) 
-            {
-                // Type d)
-
-                // Create C* (the new Component)
-                newChildrens = std::vector<std::shared_ptr<JTComponent>>(1);
-                newChildrens[0] = Cy;
-
-                newNodes = setS; 
-                newNodes.push_back(x);
-                newNodes.push_back(y);
-
-                newSeparator = setS;
-                newSeparator.push_back(x);
-                
-                newParent = Cx;
-
-                // insert it in the PCS
-                perfectCliqueSequence.insert( perfectCliqueSequence.begin() + randomSep ,
-                                std::make_shared<JTComponent>(newNodes,newSeparator,newChildrens,newParent) );
-
-                // Modify Cx to point to C*
-                newChildrens = Cx->getChildrens();
-                for (auto itC = newChildrens.begin(); itC != newChildrens.end();  ++itC )
-                {
-                    if( *(itC) == Cy )
-                        *(itC) = perfectCliqueSequence[randomSep];
-                }
-                Cx->setChildrens(newChildrens);
-
-                // Modify Cy to have C* as parent and modify its separator
-                Cy->setParent(perfectCliqueSequence[randomSep]);
-
-                Cy->add1Separator(y);         
-
-
-                logP -= log((double)(numComponents+1.)) - log(2.) +
-                    ( log( (double)(perfectCliqueSequence[randomSep]->getNodes().size()) ) +
-                        log( (double)(perfectCliqueSequence[randomSep]->getNodes().size()-1.) ) ); // backward probability (+1 because we inserta new component here)
-                
-            }
-
-            logP += log((double)(numComponents-1.)) + log((double)(setCxlS.size())) + log((double)(setCylS.size())) ; // forward probability
-
-        }else //if only one there's no option for edge addition
-        {
-            return std::make_pair(false,0.0); // and the graph is unchanged
-        }
-    
-    }else         // propose deletion
-    {
-        // get a random component
-        randomComp = randIntUniform(0,numComponents-1);
-        C = perfectCliqueSequence[randomComp];
-
-        setC = C->getNodes();
-
-        if( setC.size() > 1 )
-        {
-            // deletion has its forward logP computed immediately as setC is likely to be modified after
-            logP += log((double)numComponents) - log(2.) + ( log( (double)(setC.size()) ) + log( (double)(setC.size()-1.) ) ); // forward probability
-
-            // partition C into 3 sets, x y and S (S might be empty)"
-            randomIndexes = Distributions::randWeightedIndexSampleWithoutReplacement(setC.size(),2);
-
-            x = setC[randomIndexes(0)];
-            y = setC[randomIndexes(1)];
-
-            std::copy(setC.begin(), setC.end(),
-                std::back_inserter(setS));
-            setS.erase(std::remove(setS.begin(), setS.end(), x), setS.end());
-            setS.erase(std::remove(setS.begin(), setS.end(), y), setS.end());
-
-            // now scan the neighbours of C and construct Nx, Ny and N"
-            neighbours.clear();
-            if( C->getParent() )
-                neighbours.push_back( C->getParent() );  // push parent only if it exists
-
-            for( auto i : C->getChildrens() )
-                neighbours.push_back(i);
-
-            for( auto i : neighbours )
-            {
-                setNeighbour = i->getNodes();
-                if(std::find(setNeighbour.begin(), setNeighbour.end(), x) != setNeighbour.end()) // if x is in there
-                {
-                    if(std::find(setNeighbour.begin(), setNeighbour.end(), y) != setNeighbour.end()) // if y is in there as well
-                    {
-                        return std::make_pair(false,0.0); // exit, deletion is not possible
-                    
-                    }else{ // i contains only x
-
-                        Nx.push_back(i);
-                    }
-
-                }else if(std::find(setNeighbour.begin(), setNeighbour.end(), y) != setNeighbour.end()) // if y is in there (but not x)
-                {
-                    Ny.push_back(i);
-                }else{ // nor x nor y are in there
-                    N.push_back(i);
-                }
-            }
-
-            // search Nx for x U S and select Cx if possible
-            possibleComponents.clear(); 
-
-            std::copy(setS.begin(), setS.end(),
-                std::back_inserter(xUS));
-            xUS.push_back(x);
-            std::sort(xUS.begin(),xUS.end());
-
-            for( auto i : Nx )
-            {
-                setNeighbour = i->getNodes();
-                if( std::includes(setNeighbour.begin(), setNeighbour.end(), xUS.begin(), xUS.end()) ) // note that includes only works on sorted ranges
-                    possibleComponents.push_back(i);
-            }
-            if( possibleComponents.size() > 0 )
-            {
-                Cx = possibleComponents[ randIntUniform(0,possibleComponents.size()-1) ];
-                definedCx = true;
-            }
-
-            // search Ny for y U S and select Cy if possible
-            possibleComponents.clear();
-
-            std::copy(setS.begin(), setS.end(),
-                std::back_inserter(yUS));
-            yUS.push_back(y);
-            std::sort(yUS.begin(),yUS.end());
-
-            for( auto i : Ny )
-            {
-                setNeighbour = i->getNodes();
-                if( std::includes(setNeighbour.begin(), setNeighbour.end(), yUS.begin(), yUS.end()) ) // note that includes only works on sorted ranges
-                    possibleComponents.push_back(i);
-            }
-            
-            if( possibleComponents.size() > 0 )
-            {
-                Cy = possibleComponents[ randIntUniform(0,possibleComponents.size()-1) ];
-                definedCy = true;
-            }
-
-            // Now onto the 4 cases
-
-            if( !definedCx && !definedCy ) // if both are undefined
-            {
-                // Type a)
-
-                // Create two new JTComponents, separated by S and made up by xUS and yUS
-                ClX = std::make_shared<JTComponent>( setS );
-                ClX->add1Node(y);
-
-                ClY = std::make_shared<JTComponent>( setS );
-                ClY->add1Node(x);
-
-                // decide which (Clx or Cly) is the left and which the right clique
-                if( std::find(Nx.begin(), Nx.end(), C->getParent() ) != Nx.end() ) // the parent was in Nx, hence I need ClY on the left
-                {
-                    cLeft = ClY;  // here I'm copying the pointer, so I can use them interchangeably
-                    cRight = ClX;
-
-                }else if( std::find(Ny.begin(), Ny.end(), C->getParent() ) != Ny.end() ) // the parent was in Ny, hence I need ClX on the left
-                {
-                    cLeft = ClX;  
-                    cRight = ClY;
-
-                }else{ // either C was the root or the parent is in N, so I can choose randomly
-
-                    if( randU01() < 0.5 )
-                    {
-                        cLeft = ClY;  
-                        cRight = ClX;
-                    }else{
-                        cLeft = ClX;  
-                        cRight = ClY;                        
-                    }
-                }
-
-                // regardless, add now cLeft to its childrens and remove C
-                if( C->getParent() )
-                {
-                    newChildrens = C->getParent()->getChildrens();
-                    newChildrens.erase(std::remove(newChildrens.begin(), newChildrens.end(), C), newChildrens.end());
-                    newChildrens.push_back( cLeft );
-                    C->getParent()->setChildrens( newChildrens );
-                } // else it was the root so no changes
-
-                // Add the original parent to cLeft                
-                cLeft->setParent( C->getParent() );
-                // and its separator, which might be empty
-                cLeft->setSeparator( C->getSeparator() );
-
-                // the parent of the right clique is then the left clique 
-                // (and the right is a child for the left)
-                // their separator is S
-                cLeft->add1Children( cRight ); // note that this is just ONE children and there were none before
-                cRight->setParent( cLeft );
-                cRight->setSeparator( setS );    
-
-                // Now connect all the neighbours to either cLeft or cRight (except the original parent which is already connected)
-                for( auto i : Nx )
-                {
-                    if( i != C->getParent() )
-                    {
-                        ClY->add1Children( i );
-                        i->setParent( ClY );
-                    }
-                }
-
-                for( auto i : Ny )
-                {
-                    if( i != C->getParent() )
-                    {
-                        ClX->add1Children( i );
-                        i->setParent( ClX );
-                    }
-                }
-
-                for( auto i : N )
-                {
-                    if( i != C->getParent() )
-                    {
-                        if( randU01() < 0.5 )
-                        {
-                            ClX->add1Children( i );
-                            i->setParent( ClX );
-
-                        }else{
-                            ClY->add1Children( i );
-                            i->setParent( ClY );
-                        }
-                    }
-                }
+    Rcout << '\n' << " ---------------------------------- " << '\n';
 
-                // Finally erase C from PCS .. (this actually gets overwritten so no need..)
-                // perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomComp);
+    arma::umat tmp(adjacencyMatrix);
+    Rcout << "Graph's Adjacency Matrix: " << tmp << '\n' << '\n';
+}
 
-                // .. and Re-build the PCS after this
-                newPCS.clear();
-                if( !( C->getParent() ) )
-                {
-                    // cLeft is the new root
-                    newPCS.insert( newPCS.end() , cLeft );
-                }else{
-                    // the old root is still the root, but I've modified its childrens
-                    newPCS.insert( newPCS.end() , perfectCliqueSequence[0] );
-                }
-                pos = 0;
-                buildNewPCS( newPCS, pos );
-                perfectCliqueSequence = newPCS; // substitute to the current one
-                // PEO updated below
+unsigned int JunctionTree::newComponent( const JTComponent& component )
+{
+    if( freeComponents.empty() )
+    {
+        components.push_back( component );
+        return components.size() - 1;
+    }
 
-                logP += N.size() * log(2.); // forward probability addition
-                logP -= log((double)numComponents) + log((double)(ClX->getNodes().size() - setS.size())) + log((double)(ClY->getNodes().size() - setS.size())) ; //backward probability (we added one component here so numComponents rather than numComponents-1)
+    unsigned int c = freeComponents.back();
+    freeComponents.pop_back();
+    components[c] = component;
+    return c;
+}
 
-            }else if( definedCx && !definedCy ) // if only Cx is defined
-            {
-                // Type b)
+void JunctionTree::freeComponent( const unsigned int c )
+{
+    freeComponents.push_back( c );
+}
 
-                // Separation is possible only if Nx contains only Cx
-                if( Nx.size() == 1 )
-                {
-                    if( Nx[0] == Cx )
-                    {
-                        // remove x from C
-                        setC.erase(std::remove(setC.begin(), setC.end(), x), setC.end());
-                        C->setNodes( setC );
-                        // find the separator that connects C to Cx
-                        if( Cx == C->getParent() )
-                        {
-                            setS = C->getSeparator();
-                            setS.erase(std::remove(setS.begin(), setS.end(), x), setS.end());
-                            C->setSeparator( setS );
-                        }else{ // it's a child
-                            setS = Cx->getSeparator();
-                            setS.erase(std::remove(setS.begin(), setS.end(), x), setS.end());
-                            Cx->setSeparator( setS );
-                        }
-                    }else{
-                        return std::make_pair(false,0.0); // and the graph is unchanged
-                    }
-                }else{
-                    return std::make_pair(false,0.0); // and the graph is unchanged
-                }
+/*
+This assumes that all the elements before pos are correctly initialised
+*/
+void JunctionTree::buildNewPCS( std::vector<unsigned int>& newPCS, unsigned int& pos)
+{
 
-                logP -= log((double)(numComponents-1.)) + log((double)(Cx->getNodes().size() - setS.size())) + log((double)(setC.size() - setS.size())) ; //backward probability
+    unsigned int j=0; // index for the childrens inside each 'root' node
+    JTLinks rootChildrens = components[ newPCS[pos] ].getChildrens();
 
-            }else if( !definedCx && definedCy ) // if only Cy is defined
-            {
-                // Type c)
+    while( ( rootChildrens.size() - j ) > 0 )
+    {
+        newPCS.insert( newPCS.begin() + (++pos) , rootChildrens[j] );  // I love how increments in c++ make things less readable..
 
-                // Separation is possible only if Ny contains only Cy
-                if( Ny.size() == 1 )
-                {
-                    if( Ny[0] == Cy )
-                    {
-                        // remove y from C
-                        setC.erase(std::remove(setC.begin(), setC.end(), y), setC.end());
-                        C->setNodes( setC );
-                        // find the separator that connects C to Cy
-                        if( Cy == C->getParent() )
-                        {
-                            setS = C->getSeparator();
-                            setS.erase(std::remove(setS.begin(), setS.end(), y), setS.end());
-                            C->setSeparator( setS );
-                        }else{ // it's a child
-                            setS = Cy->getSeparator();
-                            setS.erase(std::remove(setS.begin(), setS.end(), y), setS.end());
-                            Cy->setSeparator( setS );
-                        }
-                    }else{
-                        return std::make_pair(false,0.0); // and the graph is unchanged
-                    }
-                }else{
-                    return std::make_pair(false,0.0); // and the graph is unchanged
-                }
-                
-                logP -= log((double)(numComponents-1.)) + log((double)(Cy->getNodes().size() - setS.size()) ) + log((double)(setC.size() - setS.size())) ; //backward probability
-                
-            }else{ //if both are defined
-                // Type d)
+        if( components[ rootChildrens[j++] ].getChildrens().size() > 0 )
+        {
+            buildNewPCS(newPCS, pos);
+        }
+    }
+}
 
-                // Separation is possible only if N* contains only C* [*=x,y] and N is empty
-                if( Nx.size() == 1 && Ny.size() == 1 && N.size() == 0 )
-                {
-                    if( Nx[0]==Cx && Ny[0]==Cy)
-                    {
-                        // Find who's first between Cx and Cy
-                        // adjust their links
-                        // and change their separator to be a new S
-                        // the separator for cLeft now is either its old separator (if it was the parent)
-                        // or it needs to be set to the separator of C if cLeft was its child
-                        if( Cx == C->getParent() )
-                        {
-                            cLeft = Cx;
-                            cRight = Cy;
+void JunctionTree::copyJT( JunctionTree& newJT ) const // returns a copy of this, with its PCS re-built depth first from the root
+{
+    newJT = *this; // flat arrays only, this reuses newJT's storage when it's big enough
 
-                        }else if( Cy == C->getParent() ) // if Cy is the parent
-                        {
-                            cLeft = Cy;
-                            cRight = Cx;
+    std::vector<unsigned int> newPCS( 1 , perfectCliqueSequence[0] );
+    unsigned int pcsPosition=0; // index for the PCS
+    newJT.buildNewPCS( newPCS, pcsPosition);
 
-                        }else if( !( C->getParent()) ) // C was their parent, so choose randomly
-                        {                               // note as well that in this case (becase N is empty), C was the root of JT
-                            if( randU01() < 0.5 )
-                            {
-                                cLeft = Cx;
-                                cRight = Cy;
-                            }else{
-                                cLeft = Cy;
-                                cRight = Cx;
-                            }
+    if( newPCS != perfectCliqueSequence )
+    {
+        newJT.perfectCliqueSequence = newPCS;
+        newJT.updatePEO();
+    }
+}
 
-                            // because C was the root of the tree, the clique chosen to replace him at the top get its separator emptied
-                            newSeparator.clear();
-                            cLeft->setSeparator( newSeparator );
 
-                            // and its parent's emptied as well as it becomes the new root
-                            cLeft->setParent( nullptr );
+void JunctionTree::updatePEO( )
+{
+    perfectEliminationOrder.clear();
+    perfectEliminationOrder.reserve(n);
 
-                            // DO WE NEED TO CHANGE THE PCS in this case? (it's safer to do so, but... do we need?)
-                            // I'll do it because our code relies on the fact that perfectCliqueSequence[0] is the root
+    for( auto c : perfectCliqueSequence )
+    {
+        const JTSet& tmpNodes = components[c].getNodes();
+        const JTSet& tmpSeparator = components[c].getSeparator();
 
-                        }
+        std::set_difference(tmpNodes.begin(), tmpNodes.end(),
+                            tmpSeparator.begin(), tmpSeparator.end(),
+                        std::back_inserter(perfectEliminationOrder));
+    }
+}
 
-                        // Now fix links
-                        // find C in cLeft's childs and substitute (or add) cRight
-                        newChildrens = cLeft->getChildrens();
-                        newChildrens.erase(std::remove(newChildrens.begin(), newChildrens.end(), C), newChildrens.end());
-                        newChildrens.push_back( cRight );
-                        cLeft->setChildrens( newChildrens );
 
-                        // set cLeft as cRight's parent (cRight HAS to come from C's childs)
-                        cRight->setParent( cLeft );
+/*
+Move node to its place among the residual of component (nodes minus separator) in the PEO,
+assuming all the other residuals are already up to date
+*/
+void JunctionTree::moveInPEO( const unsigned int node , const unsigned int component )
+{
+    perfectEliminationOrder.erase( std::find( perfectEliminationOrder.begin() , perfectEliminationOrder.end() , node ) );
 
-                        // set the separator between them as the intersection between them
-                        newSeparator.clear();
-                        setCLeft = cLeft->getNodes();
-                        setCRight = cRight->getNodes();
+    unsigned int start = 0;
+    for( auto c : perfectCliqueSequence )
+    {
+        if( c == component )
+            break;
+        start += components[c].getNodes().size() - components[c].getSeparator().size();
+    }
 
-                        std::set_intersection(setCLeft.begin(), setCLeft.end(),
-                                                setCRight.begin(), setCRight.end(),
-                                            std::back_inserter(newSeparator));
+    unsigned int residualSize = components[component].getNodes().size() - components[component].getSeparator().size();
 
-                        cRight->setSeparator( newSeparator );
-                        
-                        // Finally erase C
-                        perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomComp);
+    auto first = perfectEliminationOrder.begin() + start;
+    perfectEliminationOrder.insert( std::lower_bound( first , first + ( residualSize - 1 ) , node ) , node );
+}
 
-                        if( !( C->getParent()) ) // if we erased the root node, we created a new one and we need to create a newPCS
-                        {
-                            newPCS.clear();
-                            // cLeft is the new root
-                            newPCS.insert( newPCS.end() , cLeft );
-                            pos = 0;
-                            buildNewPCS( newPCS, pos );
-                            perfectCliqueSequence = newPCS; // substitute to the current one
-                            // PEO updated below
-                        }
+void JunctionTree::setEdge( const unsigned int x , const unsigned int y , const bool present )
+{
+    adjacencyMatrix(x,y) = present ? 1 : 0;
+    adjacencyMatrix(y,x) = present ? 1 : 0;
+}
 
-                    }else{
-                        return std::make_pair(false,0.0); // and the graph is unchanged
-                    }
+void JunctionTree::updateAdjMat( )
+{
+    // filled densely and converted once, inserting one by one in a sparse matrix costs O(nnz) per element
+    arma::umat tmpAdjacency = arma::zeros<arma::umat>(n,n);
 
-                }else{
-                    return std::make_pair(false,0.0); // and the graph is unchanged
+    for(auto i : perfectCliqueSequence)
+    {
+        const JTSet& componentNodes = components[i].getNodes();
+        if( componentNodes.size() > 1 )
+        {
+
+            for( unsigned int j=0, nNodes=componentNodes.size() ; j<(nNodes-1) ; ++j )  // j < k -- nodes are ordered
+            {
+                for( unsigned int k=j+1 ; k<nNodes ; ++k )                          // so element (k,j) is in the lower tri
+                {
+                    tmpAdjacency(componentNodes[k],componentNodes[j]) = 1;
+                    tmpAdjacency(componentNodes[j],componentNodes[k]) = 1;
                 }
-                
-                logP -= log((double)(numComponents-2.)) + log((double)(setCLeft.size()-newSeparator.size())) + log((double)(setCRight.size()-newSeparator.size())) ; //backward probability (-2 here cause we further deleted one component)
-        
             }
 
-        }else //if only one there's no option for edge deletion
-        {
-            return std::make_pair(false,0.0); // and the graph is unchanged
         }
-
     }
 
-    updatePEO(); // this->updatePEO();
-    updateAdjMat();
+    adjacencyMatrix = arma::sp_umat( tmpAdjacency );
+}
 
-    update_idx.zeros(2); update_idx(0) = x; update_idx(1) = y;
-    return std::make_pair(true,logP);
 
+namespace
+{
+    inline void toVector( const JTSet& set , std::vector<unsigned int>& vec )
+    {
+        vec.assign( set.begin() , set.end() );
+    }
+
+    inline bool contains( const JTSet& set , const unsigned int node )
+    {
+        return std::find( set.begin() , set.end() , node ) != set.end();
+    }
 }
 
 /*
 JT Update proposal, from Green and Thomas 2013
-The idea is to call this from a copied JT, as it will modify the JT structure (is this TOO costly?)
+The idea is to call this from a copied JT, as it will modify the JT structure
 */
-std::pair<bool,double> JunctionTree::propose_single_edge_update( )
+std::pair<bool,double> JunctionTree::propose_single_edge_update( arma::uvec& update_idx )
 {
     // We need to select randomly one separator -- in our structure is any component beside the first
     unsigned int numComponents = perfectCliqueSequence.size();
@@ -1038,27 +448,33 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
     arma::uvec randomIndexes;
 
-    std::shared_ptr<JTComponent> Cx, Cy, C, ClX, ClY, cLeft, cRight;
-    std::vector<unsigned int> setCx, setCy, setCxlS, setCylS, setS, 
-        setC, setNeighbour, xUS, yUS, setCLeft, setCRight;
+    unsigned int Cx = JTComponent::none, Cy = JTComponent::none, C, ClX, ClY, cLeft, cRight, CParent;
+    std::vector<unsigned int> setCx, setCy, setCxlS, setCylS, setS,
+        setC, xUS, yUS, setCLeft, setCRight;
 
     unsigned int x,y;
 
-    std::vector<std::shared_ptr<JTComponent>> newChildrens;
+    JTLinks newChildrens;
     std::vector<unsigned int> newNodes;
     std::vector<unsigned int> newSeparator;
-    std::shared_ptr<JTComponent> newParent;
 
-    std::vector<std::shared_ptr<JTComponent>> neighbours, N, Nx, Ny, possibleComponents;
+    std::vector<unsigned int> neighbours, N, Nx, Ny, possibleComponents;
     bool definedCx=false, definedCy=false;
-    std::deque<std::shared_ptr<JTComponent>> newPCS;
+    std::vector<unsigned int> newPCS;
     unsigned int pos = 0;
     unsigned int countN = 0;
 
     double logP = 0;
 
+    // a single edge move changes one edge in the graph and (at most) the position of one node in the PEO,
+    // so both are updated in place unless the PCS needs to be rebuilt
+    bool addition;
+    bool rebuildPEO = false;
+    unsigned int movedNode = 0, movedTo = JTComponent::none;
+
     if( randU01() < 0.5 )
     {
+        addition = true;
         // propose addition
         // if there's one component only, return false and no update happened
         if( numComponents > 1 )
@@ -1067,18 +483,18 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
             randomSep = randIntUniform(1,numComponents-1);
 
             // populate Cx and Cy
-            Cx = perfectCliqueSequence[randomSep]->getParent();
             Cy = perfectCliqueSequence[randomSep];
+            Cx = components[Cy].getParent();
+
+            toVector( components[Cx].getNodes() , setCx );
+            toVector( components[Cy].getNodes() , setCy );
+            toVector( components[Cy].getSeparator() , setS );
 
-            setCx = Cx->getNodes();
-            setCy = Cy->getNodes();
-            setS = perfectCliqueSequence[randomSep]->getSeparator();
-            
             // Populate Cx\S and Cy\S
-            std::set_difference(setCx.begin(), setCx.end(), setS.begin(), setS.end(), 
+            std::set_difference(setCx.begin(), setCx.end(), setS.begin(), setS.end(),
                             std::inserter(setCxlS, setCxlS.begin()));
 
-            std::set_difference(setCy.begin(), setCy.end(), setS.begin(), setS.end(), 
+            std::set_difference(setCy.begin(), setCy.end(), setS.begin(), setS.end(),
                             std::inserter(setCylS, setCylS.begin()));
 
             // now choose x and y from Cx\S and Cy\S
@@ -1087,125 +503,126 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
             // check whether or not Cx and Cy are superset of x U S and y U S and act accordingly
             // note there's no way for it to be the other way around by construction
-            if( setCxlS.size() == 1 && setCylS.size() == 1 ) // a) this means that both Cx and Cy are exactly just x and S (and y and S) 
+            if( setCxlS.size() == 1 && setCylS.size() == 1 ) // a) this means that both Cx and Cy are exactly just x and S (and y and S)
             {
-                
+
                 // Type a)
 
                 // compute new children set
-                newChildrens = Cy->getChildrens();
-                for( auto c : Cx->getChildrens() )
+                newChildrens = components[Cy].getChildrens();
+                for( auto c : components[Cx].getChildrens() )
                 {
                     if( c != Cy )
                         newChildrens.push_back(c);
                 }
 
 
-                newNodes = setS; 
+                newNodes = setS;
                 newNodes.push_back(x);
                 newNodes.push_back(y);
 
-                // newSeparator = Cx->getSeparator();
-                // newParent = Cx->getParent();
-
                 // Modify Cx to C* (the new component we need)
-                Cx->setChildrens(newChildrens);
-                Cx->setNodes(newNodes);
-                // Cx->setSeparator(newSeparator);
-                // Cx->setParent(newParent);
+                components[Cx].setChildrens(newChildrens);
+                components[Cx].setNodes(newNodes);
 
                 // make the new childrens point to C* (rather than Cy)
                 for( auto c : newChildrens )
                 {
-                    if( c->getParent() != Cx )
-                        c->setParent(Cx);
+                    if( components[c].getParent() != Cx )
+                        components[c].setParent(Cx);
                 }
 
                 // Erase Cy
                 perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomSep);
+                freeComponent(Cy);
+
+                movedNode = y; movedTo = Cx; // Cy's residual was y only
 
                 // **** logP addition
                 neighbours.clear();
-                if( Cx->getParent() )
-                    neighbours.push_back( Cx->getParent() );  // push parent only if it exists
+                if( components[Cx].hasParent() )
+                    neighbours.push_back( components[Cx].getParent() );  // push parent only if it exists
 
-                for( auto i : Cx->getChildrens() )
+                for( auto i : components[Cx].getChildrens() )
                     neighbours.push_back(i);
 
                 for( auto i : neighbours )
                 {
-                    setNeighbour = i->getNodes();
-                    if(std::find(setNeighbour.begin(), setNeighbour.end(), x) == setNeighbour.end()) // if x is NOT in there
+                    if( !contains( components[i].getNodes() , x ) ) // if x is NOT in there
                     {
-                        if(std::find(setNeighbour.begin(), setNeighbour.end(), y) == setNeighbour.end()) // if y is NOT in there either
+                        if( !contains( components[i].getNodes() , y ) ) // if y is NOT in there either
                         {
                             ++countN;
+
                         }
 
                     }
                 }
 
                 logP -= countN * log(2.); // backward probability addition
-                logP -= log((double)(numComponents-1.)) - log(2.) + ( log( (double)(Cx->getNodes().size() )) + log( (double)(Cx->getNodes().size()-1. )) ); // backward probability (-1 because we reduce the # component by 1)
+                logP -= log((double)(numComponents-1.)) - log(2.) + ( log( (double)(components[Cx].getNodes().size()) ) + log( (double)(components[Cx].getNodes().size()-1.) ) ); // backward probability (-1 because we reduce the # component by 1)
 
-           }else if( setCxlS.size() > 1 && setCylS.size() == 1 ) // b)
+            }else if( setCxlS.size() > 1 && setCylS.size() == 1 ) // b)
             {
 
                 // Type b)
 
-                Cy->add1Node(x);
-                Cy->add1Separator(x);
+                components[Cy].add1Node(x);
+                components[Cy].add1Separator(x);
 
-                logP -= log((double)numComponents) - log(2.) + ( log( (double)(Cx->getNodes().size() )) + log( (double)(Cx->getNodes().size()-1.) ) ); // backward probability
+                logP -= log((double)numComponents) - log(2.) + ( log( (double)(components[Cx].getNodes().size()) ) + log( (double)(components[Cx].getNodes().size()-1.) ) ); // backward probability
 
             }else if( setCxlS.size() == 1 && setCylS.size() > 1 ) //c)
             {
                 // Type c)
 
-                Cx->add1Node(y);
-                Cy->add1Separator(y); // remember the separator is always the one from the Cy obj
+                components[Cx].add1Node(y);
+                components[Cy].add1Separator(y); // remember the separator is always the one from the Cy obj
+
+                movedNode = y; movedTo = Cx;
 
-                logP -= log((double)numComponents) - log(2.) + ( log( (double)(Cx->getNodes().size()) ) + log( (double)(Cx->getNodes().size()-1.) ) ); // backward probability
-            }else if( setCxlS.size() > 1 && setCylS.size() > 1 ) // d) Cx and Cy contain more than just x and S (and y and S) 
+                logP -= log((double)numComponents) - log(2.) + ( log( (double)(components[Cx].getNodes().size()) ) + log( (double)(components[Cx].getNodes().size()-1.) ) ); // backward probability
+
+            }else if( setCxlS.size() > 1 && setCylS.size() > 1 ) // d) Cx and Cy contain more than just x and S (and y and S)
             {
                 // Type d)
 
                 // Create C* (the new Component)
-                newChildrens = std::vector<std::shared_ptr<JTComponent>>(1);
-                newChildrens[0] = Cy;
+                newChildrens.clear();
+                newChildrens.push_back( Cy );
 
-                newNodes = setS; 
+                newNodes = setS;
                 newNodes.push_back(x);
                 newNodes.push_back(y);
 
                 newSeparator = setS;
                 newSeparator.push_back(x);
-                
-                newParent = Cx;
 
                 // insert it in the PCS
-                perfectCliqueSequence.insert( perfectCliqueSequence.begin() + randomSep ,
-                                std::make_shared<JTComponent>(newNodes,newSeparator,newChildrens,newParent) );
+                unsigned int newC = newComponent( JTComponent(newNodes,newSeparator,newChildrens,Cx) );
+                perfectCliqueSequence.insert( perfectCliqueSequence.begin() + randomSep , newC );
 
                 // Modify Cx to point to C*
-                newChildrens = Cx->getChildrens();
+                newChildrens = components[Cx].getChildrens();
                 for (auto itC = newChildrens.begin(); itC != newChildrens.end();  ++itC )
                 {
                     if( *(itC) == Cy )
-                        *(itC) = perfectCliqueSequence[randomSep];
+                        *(itC) = newC;
                 }
-                Cx->setChildrens(newChildrens);
+                components[Cx].setChildrens(newChildrens);
 
                 // Modify Cy to have C* as parent and modify its separator
-                Cy->setParent(perfectCliqueSequence[randomSep]);
+                components[Cy].setParent(newC);
+
+                components[Cy].add1Separator(y);
 
-                Cy->add1Separator(y);         
+                movedNode = y; movedTo = newC;
 
 
                 logP -= log((double)(numComponents+1.)) - log(2.) +
-                    ( log( (double)(perfectCliqueSequence[randomSep]->getNodes().size()) ) +
-                        log( (double)(perfectCliqueSequence[randomSep]->getNodes().size()-1.) ) ); // backward probability (+1 because we inserta new component here)
-                
+                    ( log( (double)(components[newC].getNodes().size()) ) +
+                        log( (double)(components[newC].getNodes().size()-1.) ) ); // backward probability (+1 because we inserta new component here)
+
             }
 
             logP += log((double)(numComponents-1.)) + log((double)(setCxlS.size())) + log((double)(setCylS.size())) ; // forward probability
@@ -1214,14 +631,16 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
         {
             return std::make_pair(false,0.0); // and the graph is unchanged
         }
-    
+
     }else         // propose deletion
     {
+        addition = false;
         // get a random component
         randomComp = randIntUniform(0,numComponents-1);
         C = perfectCliqueSequence[randomComp];
+        CParent = components[C].getParent();
 
-        setC = C->getNodes();
+        toVector( components[C].getNodes() , setC );
 
         if( setC.size() > 1 )
         {
@@ -1241,27 +660,27 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
             // now scan the neighbours of C and construct Nx, Ny and N"
             neighbours.clear();
-            if( C->getParent() )
-                neighbours.push_back( C->getParent() );  // push parent only if it exists
+            if( components[C].hasParent() )
+                neighbours.push_back( CParent );  // push parent only if it exists
 
-            for( auto i : C->getChildrens() )
+            for( auto i : components[C].getChildrens() )
                 neighbours.push_back(i);
 
             for( auto i : neighbours )
             {
-                setNeighbour = i->getNodes();
-                if(std::find(setNeighbour.begin(), setNeighbour.end(), x) != setNeighbour.end()) // if x is in there
+                const JTSet& setNeighbour = components[i].getNodes();
+                if( contains( setNeighbour , x ) ) // if x is in there
                 {
-                    if(std::find(setNeighbour.begin(), setNeighbour.end(), y) != setNeighbour.end()) // if y is in there as well
+                    if( contains( setNeighbour , y ) ) // if y is in there as well
                     {
                         return std::make_pair(false,0.0); // exit, deletion is not possible
-                    
+
                     }else{ // i contains only x
 
                         Nx.push_back(i);
                     }
 
-                }else if(std::find(setNeighbour.begin(), setNeighbour.end(), y) != setNeighbour.end()) // if y is in there (but not x)
+                }else if( contains( setNeighbour , y ) ) // if y is in there (but not x)
                 {
                     Ny.push_back(i);
                 }else{ // nor x nor y are in there
@@ -1270,7 +689,7 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
             }
 
             // search Nx for x U S and select Cx if possible
-            possibleComponents.clear(); 
+            possibleComponents.clear();
 
             std::copy(setS.begin(), setS.end(),
                 std::back_inserter(xUS));
@@ -1279,7 +698,7 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
             for( auto i : Nx )
             {
-                setNeighbour = i->getNodes();
+                const JTSet& setNeighbour = components[i].getNodes();
                 if( std::includes(setNeighbour.begin(), setNeighbour.end(), xUS.begin(), xUS.end()) ) // note that includes only works on sorted ranges
                     possibleComponents.push_back(i);
             }
@@ -1299,11 +718,11 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
             for( auto i : Ny )
             {
-                setNeighbour = i->getNodes();
+                const JTSet& setNeighbour = components[i].getNodes();
                 if( std::includes(setNeighbour.begin(), setNeighbour.end(), yUS.begin(), yUS.end()) ) // note that includes only works on sorted ranges
                     possibleComponents.push_back(i);
             }
-            
+
             if( possibleComponents.size() > 0 )
             {
                 Cy = possibleComponents[ randIntUniform(0,possibleComponents.size()-1) ];
@@ -1317,97 +736,94 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                 // Type a)
 
                 // Create two new JTComponents, separated by S and made up by xUS and yUS
-                ClX = std::make_shared<JTComponent>( setS );
-                ClX->add1Node(y);
+                ClX = newComponent( JTComponent( setS ) );
+                components[ClX].add1Node(y);
 
-                ClY = std::make_shared<JTComponent>( setS );
-                ClY->add1Node(x);
+                ClY = newComponent( JTComponent( setS ) );
+                components[ClY].add1Node(x);
 
                 // decide which (Clx or Cly) is the left and which the right clique
-                if( std::find(Nx.begin(), Nx.end(), C->getParent() ) != Nx.end() ) // the parent was in Nx, hence I need ClY on the left
+                if( std::find(Nx.begin(), Nx.end(), CParent ) != Nx.end() ) // the parent was in Nx, hence I need ClY on the left
                 {
-                    cLeft = ClY;  // here I'm copying the pointer, so I can use them interchangeably
+                    cLeft = ClY;  // here I'm copying the index, so I can use them interchangeably
                     cRight = ClX;
 
-                }else if( std::find(Ny.begin(), Ny.end(), C->getParent() ) != Ny.end() ) // the parent was in Ny, hence I need ClX on the left
+                }else if( std::find(Ny.begin(), Ny.end(), CParent ) != Ny.end() ) // the parent was in Ny, hence I need ClX on the left
                 {
-                    cLeft = ClX;  
+                    cLeft = ClX;
                     cRight = ClY;
 
                 }else{ // either C was the root or the parent is in N, so I can choose randomly
 
                     if( randU01() < 0.5 )
                     {
-                        cLeft = ClY;  
+                        cLeft = ClY;
                         cRight = ClX;
                     }else{
-                        cLeft = ClX;  
-                        cRight = ClY;                        
+                        cLeft = ClX;
+                        cRight = ClY;
                     }
                 }
 
                 // regardless, add now cLeft to its childrens and remove C
-                if( C->getParent() )
+                if( components[C].hasParent() )
                 {
-                    newChildrens = C->getParent()->getChildrens();
+                    newChildrens = components[CParent].getChildrens();
                     newChildrens.erase(std::remove(newChildrens.begin(), newChildrens.end(), C), newChildrens.end());
                     newChildrens.push_back( cLeft );
-                    C->getParent()->setChildrens( newChildrens );
+                    components[CParent].setChildrens( newChildrens );
                 } // else it was the root so no changes
 
-                // Add the original parent to cLeft                
-                cLeft->setParent( C->getParent() );
+                // Add the original parent to cLeft
+                components[cLeft].setParent( CParent );
                 // and its separator, which might be empty
-                cLeft->setSeparator( C->getSeparator() );
+                components[cLeft].setSeparator( components[C].getSeparator() );
 
-                // the parent of the right clique is then the left clique 
+                // the parent of the right clique is then the left clique
                 // (and the right is a child for the left)
                 // their separator is S
-                cLeft->add1Children( cRight ); // note that this is just ONE children and there were none before
-                cRight->setParent( cLeft );
-                cRight->setSeparator( setS );    
+                components[cLeft].add1Children( cRight ); // note that this is just ONE children and there were none before
+                components[cRight].setParent( cLeft );
+                components[cRight].setSeparator( setS );
 
                 // Now connect all the neighbours to either cLeft or cRight (except the original parent which is already connected)
                 for( auto i : Nx )
                 {
-                    if( i != C->getParent() )
+                    if( i != CParent )
                     {
-                        ClY->add1Children( i );
-                        i->setParent( ClY );
+                        components[ClY].add1Children( i );
+                        components[i].setParent( ClY );
                     }
                 }
 
                 for( auto i : Ny )
                 {
-                    if( i != C->getParent() )
+                    if( i != CParent )
                     {
-                        ClX->add1Children( i );
-                        i->setParent( ClX );
+                        components[ClX].add1Children( i );
+                        components[i].setParent( ClX );
                     }
                 }
 
                 for( auto i : N )
                 {
-                    if( i != C->getParent() )
+                    if( i != CParent )
                     {
                         if( randU01() < 0.5 )
                         {
-                            ClX->add1Children( i );
-                            i->setParent( ClX );
+                            components[ClX].add1Children( i );
+                            components[i].setParent( ClX );
 
                         }else{
-                            ClY->add1Children( i );
-                            i->setParent( ClY );
+                            components[ClY].add1Children( i );
+                            components[i].setParent( ClY );
                         }
                     }
                 }
 
-                // Finally erase C from PCS .. (this actually gets overwritten so no need..)
-                // perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomComp);
-
-                // .. and Re-build the PCS after this
+                // C is not reachable anymore, re-build the PCS after this
                 newPCS.clear();
-                if( !( C->getParent() ) )
+                if( !( components[C].hasParent() ) )
                 {
                     // cLeft is the new root
                     newPCS.insert( newPCS.end() , cLeft );
@@ -1418,10 +834,11 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                 pos = 0;
                 buildNewPCS( newPCS, pos );
                 perfectCliqueSequence = newPCS; // substitute to the current one
-                // PEO updated below
+                freeComponent(C);
+                rebuildPEO = true;
 
                 logP += N.size() * log(2.); // forward probability addition
-                logP -= log((double)numComponents) + log((double)(ClX->getNodes().size() - setS.size())) + log((double)(ClY->getNodes().size() - setS.size())) ; //backward probability (we added one component here so numComponents rather than numComponents-1)
+                logP -= log((double)numComponents) + log((double)(components[ClX].getNodes().size() - setS.size())) + log((double)(components[ClY].getNodes().size() - setS.size())) ; //backward probability (we added one component here so numComponents rather than numComponents-1)
 
             }else if( definedCx && !definedCy ) // if only Cx is defined
             {
@@ -1434,17 +851,19 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                     {
                         // remove x from C
                         setC.erase(std::remove(setC.begin(), setC.end(), x), setC.end());
-                        C->setNodes( setC );
+                        components[C].setNodes( setC );
                         // find the separator that connects C to Cx
-                        if( Cx == C->getParent() )
+                        if( Cx == CParent )
                         {
-                            setS = C->getSeparator();
+                            toVector( components[C].getSeparator() , setS );
                             setS.erase(std::remove(setS.begin(), setS.end(), x), setS.end());
-                            C->setSeparator( setS );
+                            components[C].setSeparator( setS );
                         }else{ // it's a child
-                            setS = Cx->getSeparator();
+                            toVector( components[Cx].getSeparator() , setS );
                             setS.erase(std::remove(setS.begin(), setS.end(), x), setS.end());
-                            Cx->setSeparator( setS );
+                            components[Cx].setSeparator( setS );
+
+                            movedNode = x; movedTo = Cx;
                         }
                     }else{
                         return std::make_pair(false,0.0); // and the graph is unchanged
@@ -1453,7 +872,7 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                     return std::make_pair(false,0.0); // and the graph is unchanged
                 }
 
-                logP -= log((double)(numComponents-1.)) + log((double)(Cx->getNodes().size() - setS.size())) + log((double)(setC.size() - setS.size())) ; //backward probability
+                logP -= log((double)(numComponents-1.)) + log((double)(components[Cx].getNodes().size() - setS.size())) + log((double)(setC.size() - setS.size())) ; //backward probability
 
             }else if( !definedCx && definedCy ) // if only Cy is defined
             {
@@ -1466,17 +885,19 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                     {
                         // remove y from C
                         setC.erase(std::remove(setC.begin(), setC.end(), y), setC.end());
-                        C->setNodes( setC );
+                        components[C].setNodes( setC );
                         // find the separator that connects C to Cy
-                        if( Cy == C->getParent() )
+                        if( Cy == CParent )
                         {
-                            setS = C->getSeparator();
+                            toVector( components[C].getSeparator() , setS );
                             setS.erase(std::remove(setS.begin(), setS.end(), y), setS.end());
-                            C->setSeparator( setS );
+                            components[C].setSeparator( setS );
                         }else{ // it's a child
-                            setS = Cy->getSeparator();
+                            toVector( components[Cy].getSeparator() , setS );
                             setS.erase(std::remove(setS.begin(), setS.end(), y), setS.end());
-                            Cy->setSeparator( setS );
+                            components[Cy].setSeparator( setS );
+
+                            movedNode = y; movedTo = Cy;
                         }
                     }else{
                         return std::make_pair(false,0.0); // and the graph is unchanged
@@ -1484,34 +905,34 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                 }else{
                     return std::make_pair(false,0.0); // and the graph is unchanged
                 }
-                
-                logP -= log((double)(numComponents-1.)) + log((double)(Cy->getNodes().size() - setS.size()) ) + log((double)(setC.size() - setS.size())) ; //backward probability
-                
+
+                logP -= log((double)(numComponents-1.)) + log((double)(components[Cy].getNodes().size() - setS.size()) ) + log((double)(setC.size() - setS.size())) ; //backward probability
+
             }else{ //if both are defined
                 // Type d)
 
                 // Separation is possible only if N* contains only C* [*=x,y] and N is empty
                 if( Nx.size() == 1 && Ny.size() == 1 && N.size() == 0 )
                 {
-                    if( Nx[0]==Cx && Ny[0]==Cy)
+                    if( Nx[0] == Cx && Ny[0] == Cy )
                     {
                         // Find who's first between Cx and Cy
                         // adjust their links
                         // and change their separator to be a new S
                         // the separator for cLeft now is either its old separator (if it was the parent)
                         // or it needs to be set to the separator of C if cLeft was its child
-                        if( Cx == C->getParent() )
+                        if( Cx == CParent )
                         {
                             cLeft = Cx;
                             cRight = Cy;
 
-                        }else if( Cy == C->getParent() ) // if Cy is the parent
+                        }else if( Cy == CParent ) // if Cy is the parent
                         {
                             cLeft = Cy;
                             cRight = Cx;
 
-                        }else if( !( C->getParent()) ) // C was their parent, so choose randomly
-                        {                               // note as well that in this case (becase N is empty), C was the root of JT
+                        }else if( !( components[C].hasParent() ) ) // C was their parent, so choose randomly
+                        {     // note as well that in this case (becase N is empty), C was the root of JT
                             if( randU01() < 0.5 )
                             {
                                 cLeft = Cx;
@@ -1523,41 +944,40 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
                             // because C was the root of the tree, the clique chosen to replace him at the top get its separator emptied
                             newSeparator.clear();
-                            cLeft->setSeparator( newSeparator );
+                            components[cLeft].setSeparator( newSeparator );
 
                             // and its parent's emptied as well as it becomes the new root
-                            cLeft->setParent( nullptr );
-
-                            // DO WE NEED TO CHANGE THE PCS in this case? (it's safer to do so, but... do we need?)
-                            // I'll do it because our code relies on the fact that perfectCliqueSequence[0] is the root
+                            components[cLeft].setParent( JTComponent::none );
 
+                            // our code relies on the fact that perfectCliqueSequence[0] is the root, so the PCS is rebuilt below
                         }
 
                         // Now fix links
                         // find C in cLeft's childs and substitute (or add) cRight
-                        newChildrens = cLeft->getChildrens();
+                        newChildrens = components[cLeft].getChildrens();
                         newChildrens.erase(std::remove(newChildrens.begin(), newChildrens.end(), C), newChildrens.end());
                         newChildrens.push_back( cRight );
-                        cLeft->setChildrens( newChildrens );
+                        components[cLeft].setChildrens( newChildrens );
 
                         // set cLeft as cRight's parent (cRight HAS to come from C's childs)
-                        cRight->setParent( cLeft );
+                        components[cRight].setParent( cLeft );
 
                         // set the separator between them as the intersection between them
                         newSeparator.clear();
-                        setCLeft = cLeft->getNodes();
-                        setCRight = cRight->getNodes();
+                        toVector( components[cLeft].getNodes() , setCLeft );
+                        toVector( components[cRight].getNodes() , setCRight );
 
                         std::set_intersection(setCLeft.begin(), setCLeft.end(),
                                                 setCRight.begin(), setCRight.end(),
                                             std::back_inserter(newSeparator));
 
-                        cRight->setSeparator( newSeparator );
-                        
+                        components[cRight].setSeparator( newSeparator );
+
                         // Finally erase C
                         perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomComp);
+                        freeComponent(C);
 
-                        if( !( C->getParent()) ) // if we erased the root node, we created a new one and we need to create a newPCS
+                        if( !( components[C].hasParent() ) ) // if we erased the root node, we created a new one and we need to create a newPCS
                         {
                             newPCS.clear();
                             // cLeft is the new root
@@ -1565,7 +985,11 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                             pos = 0;
                             buildNewPCS( newPCS, pos );
                             perfectCliqueSequence = newPCS; // substitute to the current one
-                            // PEO updated below
+                            rebuildPEO = true;
+                        }else{
+                            // C's residual was the node of cRight that cLeft lacks
+                            movedNode = ( cRight == Cx ) ? x : y;
+                            movedTo = cRight;
                         }
 
                     }else{
@@ -1575,9 +999,9 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
                 }else{
                     return std::make_pair(false,0.0); // and the graph is unchanged
                 }
-                
+
                 logP -= log((double)(numComponents-2.)) + log((double)(setCLeft.size()-newSeparator.size())) + log((double)(setCRight.size()-newSeparator.size())) ; //backward probability (-2 here cause we further deleted one component)
-        
+
             }
 
         }else //if only one there's no option for edge deletion
@@ -1587,13 +1011,24 @@ std::pair<bool,double> JunctionTree::propose_single_edge_update( )
 
     }
 
-    updatePEO(); // this->updatePEO();
-    updateAdjMat();
+    if( rebuildPEO )
+        updatePEO();
+    else if( movedTo != JTComponent::none )
+        moveInPEO( movedNode , movedTo );
+
+    setEdge( x , y , addition );
 
+    update_idx.zeros(2); update_idx(0) = x; update_idx(1) = y;
     return std::make_pair(true,logP);
 
 }
 
+std::pair<bool,double> JunctionTree::propose_single_edge_update( )
+{
+    arma::uvec updateIdx;
+    return propose_single_edge_update( updateIdx );
+}
+
 /*
 JT Update proposal, from Green and Thomas 2013
 MULTIPLE EDGES UPDATE
@@ -1607,21 +1042,20 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
     arma::uvec randomIndexes;
 
-    std::shared_ptr<JTComponent> Cx, Cy, C, ClX, ClY, cLeft, cRight;
-    std::vector<unsigned int> setCx, setCy, setCxlS, setCylS, setS, 
-        setC, setNeighbour, xUS, yUS, setCLeft, setCRight, tmpVec;
+    unsigned int Cx = JTComponent::none, Cy = JTComponent::none, C, ClX, ClY, cLeft, cRight, CParent;
+    std::vector<unsigned int> setCx, setCy, setCxlS, setCylS, setS,
+        setC, xUS, yUS, setCLeft, setCRight, tmpVec;
 
     std::vector<unsigned int> X,Y;
     unsigned int dimX, dimY; // dimension of the X and Y sets
 
-    std::vector<std::shared_ptr<JTComponent>> newChildrens;
+    JTLinks newChildrens;
     std::vector<unsigned int> newNodes;
     std::vector<unsigned int> newSeparator;
-    std::shared_ptr<JTComponent> newParent;
 
-    std::vector<std::shared_ptr<JTComponent>> neighbours, N, Nx, Ny, possibleCxComponents, possibleCyComponents;
+    std::vector<unsigned int> neighbours, N, Nx, Ny, possibleCxComponents, possibleCyComponents;
     bool definedCx=false, definedCy=false;
-    std::deque<std::shared_ptr<JTComponent>> newPCS;
+    std::vector<unsigned int> newPCS;
     bool XisRightYisLeft = false;
     unsigned int sizeXIntersect, sizeYIntersect;
 
@@ -1640,26 +1074,26 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
             randomSep = randIntUniform(1,numComponents-1);
 
             // populate Cx and Cy
-            Cx = perfectCliqueSequence[randomSep]->getParent();
             Cy = perfectCliqueSequence[randomSep];
+            Cx = components[Cy].getParent();
+
+            toVector( components[Cx].getNodes() , setCx );
+            toVector( components[Cy].getNodes() , setCy );
+            toVector( components[Cy].getSeparator() , setS );
 
-            setCx = Cx->getNodes();
-            setCy = Cy->getNodes();
-            setS = perfectCliqueSequence[randomSep]->getSeparator();
-            
             // Populate Cx\S and Cy\S
-            std::set_difference(setCx.begin(), setCx.end(), setS.begin(), setS.end(), 
+            std::set_difference(setCx.begin(), setCx.end(), setS.begin(), setS.end(),
                             std::inserter(setCxlS, setCxlS.begin()));
 
-            std::set_difference(setCy.begin(), setCy.end(), setS.begin(), setS.end(), 
+            std::set_difference(setCy.begin(), setCy.end(), setS.begin(), setS.end(),
                             std::inserter(setCylS, setCylS.begin()));
 
             // now choose x and y from Cx\S and Cy\S
             dimX = randIntUniform(1,setCxlS.size());
             dimY = randIntUniform(1,setCylS.size());
 
-            X = Distributions::randSampleWithoutReplacement( setCxlS.size() , setCxlS , dimX ); 
-            Y = Distributions::randSampleWithoutReplacement( setCylS.size() , setCylS , dimY ); 
+            X = Distributions::randSampleWithoutReplacement( setCxlS.size() , setCxlS , dimX );
+            Y = Distributions::randSampleWithoutReplacement( setCylS.size() , setCylS , dimY );
                 // this is uncorrect, we should sample
                 // randomly from all possible subsets of CxlS
 
@@ -1673,78 +1107,51 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                 log((double)(setCylS.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(setCylS.size()-dimY+1.)) + std::lgamma((double)(setCylS.size()+1.)) ;
 
 
-            if( setCxlS.size() == X.size() && setCylS.size() == Y.size() ) // a) this means that both Cx and Cy are exactly just X and S (and Y and S) 
+            if( setCxlS.size() == X.size() && setCylS.size() == Y.size() ) // a) this means that both Cx and Cy are exactly just X and S (and Y and S)
             {
-                
+
                 // Type a)
 
                 // compute new children set
-                newChildrens = Cy->getChildrens();
-                for( auto c : Cx->getChildrens() )
+                newChildrens = components[Cy].getChildrens();
+                for( auto c : components[Cx].getChildrens() )
                 {
                     if( c != Cy )
                         newChildrens.push_back(c);
                 }
 
-                newNodes = setS; 
+                newNodes = setS;
                 for( auto i : X )
                     newNodes.push_back(i);
                 for( auto i : Y )
                     newNodes.push_back(i);
 
-                // newSeparator = Cx->getSeparator();
-                // newParent = Cx->getParent();
-
                 // Modify Cx to C* (the new component we need)
-                Cx->setChildrens(newChildrens);
-                Cx->setNodes(newNodes);
-                // Cx->setSeparator(newSeparator);
-                // Cx->setParent(newParent);
+                components[Cx].setChildrens(newChildrens);
+                components[Cx].setNodes(newNodes);
 
                 // make the new childrens point to C* (rather than Cy)
                 for( auto c : newChildrens )
                 {
-                    if( c->getParent() != Cx )
-                        c->setParent(Cx);
+                    if( components[c].getParent() != Cx )
+                        components[c].setParent(Cx);
                 }
 
                 // Erase Cy
                 perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomSep);
+                freeComponent(Cy);
 
                 // **** logP addition
                 neighbours.clear();
-                if( Cx->getParent() )
-                    neighbours.push_back( Cx->getParent() );  // push parent only if it exists
+                if( components[Cx].hasParent() )
+                    neighbours.push_back( components[Cx].getParent() );  // push parent only if it exists
 
-                for( auto i : Cx->getChildrens() )
+                for( auto i : components[Cx].getChildrens() )
                     neighbours.push_back(i);
 
                 for( auto i : neighbours )
                 {
-                    setNeighbour = i->getNodes();
-
-                    // // compute intersection between this neighbour and X
-                    // tmpVec.clear();
-                    // std::set_intersection(setNeighbour.begin(), setNeighbour.end(),
-                    //         X.begin(), X.end(),
-                    //         std::back_inserter(tmpVec));
-
-                    // // if size is more than 0, then it intersects
-                    // // if size is equal to dimX then the complete X is in "i" (neighbour)
-                    // sizeXIntersect = tmpVec.size();
-
-                    // // same for Y
-                    // tmpVec.clear();
-                    // std::set_intersection(setNeighbour.begin(), setNeighbour.end(),
-                    //         Y.begin(), Y.end(),
-                    //         std::back_inserter(tmpVec));
-
-                    // // if size is more than 0, then it intersects
-                    // // if size is equal to dimY then the complete Y is in "i" (neighbour)
-                    // sizeYIntersect = tmpVec.size();
-                    //
-                    // if( sizeXIntersect == 0 && sizeYIntersect == 0 ) // if neither intersect i
-                    //     ++countN;
+                    const JTSet& setNeighbour = components[i].getNodes();
 
                     // go to the next "i" as soon as you find one match in X
                     for( auto j : X )
@@ -1763,89 +1170,87 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
                 logP -= countN * log(2.); // backward probability addition
                 logP -= // backward probability (-1 because we reduce the # component by 1)
-                        log((double)(numComponents-1.)) - log(2.) + log( (double)(Cx->getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) -
-                            std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(Cx->getSeparator().size()+1.)) + std::lgamma((double)(Cx->getNodes().size()+1.));
+                        log((double)(numComponents-1.)) - log(2.) + log( (double)(components[Cx].getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) -
+                            std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(components[Cx].getSeparator().size()+1.)) + std::lgamma((double)(components[Cx].getNodes().size()+1.));
 
             }else if( setCxlS.size() > X.size() && setCylS.size() == Y.size() ) // b)
             {
 
                 // Type b)
-                Cy->addNodes(X);
-                Cy->addSeparators(X);
+                components[Cy].addNodes(X);
+                components[Cy].addSeparators(X);
 
                 logP -= // backward probability
-                        log((double)numComponents) - log(2.) + ( log( (double)(Cy->getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) ) -
-                            std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(Cy->getSeparator().size()+1.)) + std::lgamma((double)(Cy->getNodes().size()+1.));
+                        log((double)numComponents) - log(2.) + ( log( (double)(components[Cy].getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) ) -
+                            std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(components[Cy].getSeparator().size()+1.)) + std::lgamma((double)(components[Cy].getNodes().size()+1.));
 
             }else if( setCxlS.size() == X.size() && setCylS.size() > Y.size() ) //c)
             {
                 // Type c)
 
-
-                Cx->addNodes(Y);
-                Cy->addSeparators(Y); // remember the separator is always the one from the Cy obj
+                components[Cx].addNodes(Y);
+                components[Cy].addSeparators(Y); // remember the separator is always the one from the Cy obj
 
                 logP -= // backward probability
-                        log((double)numComponents) - log(2.) + ( log( (double)(Cx->getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) ) -
-                            std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(Cy->getSeparator().size()+1.)) + std::lgamma((double)(Cx->getNodes().size()+1.));
+                        log((double)numComponents) - log(2.) + ( log( (double)(components[Cx].getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) ) -
+                            std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(components[Cy].getSeparator().size()+1.)) + std::lgamma((double)(components[Cx].getNodes().size()+1.));
 
-            }else if( setCxlS.size() > X.size() && setCylS.size() > Y.size() ) // d) Cx and Cy contain more than just x and S (and y and S) 
+            }else if( setCxlS.size() > X.size() && setCylS.size() > Y.size() ) // d) Cx and Cy contain more than just x and S (and y and S)
             {
                 // Type d)
 
                 // Create C* (the new Component)
-                newChildrens = std::vector<std::shared_ptr<JTComponent>>(1);
-                newChildrens[0] = Cy;
+                newChildrens.clear();
+                newChildrens.push_back( Cy );
 
-                newNodes = setS; 
+                newNodes = setS;
                 for( auto i : X )
                     newNodes.push_back(i);
                 for( auto i : Y )
                     newNodes.push_back(i);
 
                 newSeparator = setS;
-                for( auto i : X ) 
+                for( auto i : X )
                     newSeparator.push_back(i);
-                
-                newParent = Cx;
 
                 // insert it in the PCS
-                perfectCliqueSequence.insert( perfectCliqueSequence.begin() + randomSep ,
-                                std::make_shared<JTComponent>(newNodes,newSeparator,newChildrens,newParent) );
+                unsigned int newC = newComponent( JTComponent(newNodes,newSeparator,newChildrens,Cx) );
+                perfectCliqueSequence.insert( perfectCliqueSequence.begin() + randomSep , newC );
 
                 // Modify Cx to point to C*
-                newChildrens = Cx->getChildrens();
+                newChildrens = components[Cx].getChildrens();
                 for (auto itC = newChildrens.begin(); itC != newChildrens.end();  ++itC )
                 {
                     if( *(itC) == Cy )
-                        *(itC) = perfectCliqueSequence[randomSep];
+                        *(itC) = newC;
                 }
-                Cx->setChildrens(newChildrens);
+                components[Cx].setChildrens(newChildrens);
 
                 // Modify Cy to have C* as parent and modify its separator
-                Cy->setParent(perfectCliqueSequence[randomSep]);
+                components[Cy].setParent(newC);
 
-                Cy->addSeparators(Y);         
+                components[Cy].addSeparators(Y);
 
 
                 logP -= // backward probability (+1 because we insert a new component here)
-                    log((double)(numComponents+1.)) - log(2.) + log( (double)(perfectCliqueSequence[randomSep]->getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) -
-                        std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(perfectCliqueSequence[randomSep]->getSeparator().size()+1.)) + std::lgamma((double)(perfectCliqueSequence[randomSep]->getNodes().size()+1.));
-                
+                    log((double)(numComponents+1.)) - log(2.) + log( (double)(components[newC].getNodes().size()-1.) ) + log( (double)(dimX+dimY-1.) ) -
+                        std::lgamma((double)(dimX+1.)) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(components[newC].getSeparator().size()+1.)) + std::lgamma((double)(components[newC].getNodes().size()+1.));
+
             }
 
         }else //if only one there's no option for edge addition
         {
             return std::make_pair(false,0.0); // and the graph is unchanged
         }
-    
+
     }else         // propose deletion
     {
         // get a random component
         randomComp = randIntUniform(0,numComponents-1);
         C = perfectCliqueSequence[randomComp];
+        CParent = components[C].getParent();
 
-        setC = C->getNodes();
+        toVector( components[C].getNodes() , setC );
 
         if( setC.size() > 1 )
         {
@@ -1858,24 +1263,24 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
             std::copy(setC.begin(), setC.end(),
                 std::back_inserter(setS));
             // Select X
-            X = Distributions::randSampleWithoutReplacement( setS.size() , setS , dimX ); 
+            X = Distributions::randSampleWithoutReplacement( setS.size() , setS , dimX );
 
             //remove X from setS
             tmpVec.clear();
-            std::set_difference(std::make_move_iterator(setS.begin()), 
-                                std::make_move_iterator(setS.end()), 
-                                X.begin(), X.end(), 
+            std::set_difference(std::make_move_iterator(setS.begin()),
+                                std::make_move_iterator(setS.end()),
+                                X.begin(), X.end(),
                         std::inserter(tmpVec, tmpVec.begin()));
             setS.swap(tmpVec);
 
             // Select Y
-            Y = Distributions::randSampleWithoutReplacement( setS.size() , setS , dimY ); 
+            Y = Distributions::randSampleWithoutReplacement( setS.size() , setS , dimY );
 
             //remove Y from setS
             tmpVec.clear();
-            std::set_difference(std::make_move_iterator(setS.begin()), 
-                                std::make_move_iterator(setS.end()), 
-                                Y.begin(), Y.end(), 
+            std::set_difference(std::make_move_iterator(setS.begin()),
+                                std::make_move_iterator(setS.end()),
+                                Y.begin(), Y.end(),
                         std::inserter(tmpVec, tmpVec.begin()));
             setS.swap(tmpVec);
 
@@ -1887,10 +1292,10 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
             // now scan the neighbours of C and construct Nx, Ny and N"
             neighbours.clear();
-            if( C->getParent() )
-                neighbours.push_back( C->getParent() );  // push parent only if it exists
+            if( components[C].hasParent() )
+                neighbours.push_back( CParent );  // push parent only if it exists
 
-            for( auto i : C->getChildrens() )
+            for( auto i : components[C].getChildrens() )
                 neighbours.push_back(i);
 
 
@@ -1899,7 +1304,7 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
             for( auto i : neighbours )
             {
-                setNeighbour = i->getNodes();
+                const JTSet& setNeighbour = components[i].getNodes();
 
                 // compute intersection between this neighbour and X
                 tmpVec.clear();
@@ -1924,7 +1329,7 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                 if( sizeXIntersect > 0 && sizeYIntersect > 0 ) // if both intersect i
                 {
                     return std::make_pair(false,0.0); // exit, deletion is not possible
-                    
+
                 }else if( sizeXIntersect > 0 && sizeYIntersect == 0 ) // i contains only x
                 {
                     Nx.push_back(i);
@@ -1971,97 +1376,94 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                 // Type a)
 
                 // Create two new JTComponents, separated by S and made up by xUS and yUS
-                ClX = std::make_shared<JTComponent>( setS );
-                ClX->addNodes(Y);
+                ClX = newComponent( JTComponent( setS ) );
+                components[ClX].addNodes(Y);
 
-                ClY = std::make_shared<JTComponent>( setS );
-                ClY->addNodes(X);
+                ClY = newComponent( JTComponent( setS ) );
+                components[ClY].addNodes(X);
 
                 // decide which (Clx or Cly) is the left and which the right clique
-                if( std::find(Nx.begin(), Nx.end(), C->getParent() ) != Nx.end() ) // the parent was in Nx, hence I need ClY on the left
+                if( std::find(Nx.begin(), Nx.end(), CParent ) != Nx.end() ) // the parent was in Nx, hence I need ClY on the left
                 {
-                    cLeft = ClY;  // here I'm copying the pointer, so I can use them interchangeably
+                    cLeft = ClY;  // here I'm copying the index, so I can use them interchangeably
                     cRight = ClX;
 
-                }else if( std::find(Ny.begin(), Ny.end(), C->getParent() ) != Ny.end() ) // the parent was in Ny, hence I need ClX on the left
+                }else if( std::find(Ny.begin(), Ny.end(), CParent ) != Ny.end() ) // the parent was in Ny, hence I need ClX on the left
                 {
-                    cLeft = ClX;  
+                    cLeft = ClX;
                     cRight = ClY;
 
                 }else{ // either C was the root or the parent is in N, so I can choose randomly
 
                     if( randU01() < 0.5 )
                     {
-                        cLeft = ClY;  
+                        cLeft = ClY;
                         cRight = ClX;
                     }else{
-                        cLeft = ClX;  
-                        cRight = ClY;                        
+                        cLeft = ClX;
+                        cRight = ClY;
                     }
                 }
 
                 // regardless, add now cLeft to its childrens and remove C
-                if( C->getParent() )
+                if( components[C].hasParent() )
                 {
-                    newChildrens = C->getParent()->getChildrens();
+                    newChildrens = components[CParent].getChildrens();
                     newChildrens.erase(std::remove(newChildrens.begin(), newChildrens.end(), C), newChildrens.end());
                     newChildrens.push_back( cLeft );
-                    C->getParent()->setChildrens( newChildrens );
+                    components[CParent].setChildrens( newChildrens );
                 } // else it was the root so no changes
 
-                // Add the original parent to cLeft                
-                cLeft->setParent( C->getParent() );
+                // Add the original parent to cLeft
+                components[cLeft].setParent( CParent );
                 // and its separator, which might be empty
-                cLeft->setSeparator( C->getSeparator() );
+                components[cLeft].setSeparator( components[C].getSeparator() );
 
-                // the parent of the right clique is then the left clique 
+                // the parent of the right clique is then the left clique
                 // (and the right is a child for the left)
                 // their separator is S
-                cLeft->add1Children( cRight ); // note that this is just ONE children and there were none before
-                cRight->setParent( cLeft );
-                cRight->setSeparator( setS );    
+                components[cLeft].add1Children( cRight ); // note that this is just ONE children and there were none before
+                components[cRight].setParent( cLeft );
+                components[cRight].setSeparator( setS );
 
                 // Now connect all the neighbours to either cLeft or cRight (except the original parent which is already connected)
                 for( auto i : Nx )
                 {
-                    if( i != C->getParent() )
+                    if( i != CParent )
                     {
-                        ClY->add1Children( i );
-                        i->setParent( ClY );
+                        components[ClY].add1Children( i );
+                        components[i].setParent( ClY );
                     }
                 }
 
                 for( auto i : Ny )
                 {
-                    if( i != C->getParent() )
+                    if( i != CParent )
                     {
-                        ClX->add1Children( i );
-                        i->setParent( ClX );
+                        components[ClX].add1Children( i );
+                        components[i].setParent( ClX );
                     }
                 }
 
                 for( auto i : N )
                 {
-                    if( i != C->getParent() )
+                    if( i != CParent )
                     {
                         if( randU01() < 0.5 )
                         {
-                            ClX->add1Children( i );
-                            i->setParent( ClX );
+                            components[ClX].add1Children( i );
+                            components[i].setParent( ClX );
 
                         }else{
-                            ClY->add1Children( i );
-                            i->setParent( ClY );
+                            components[ClY].add1Children( i );
+                            components[i].setParent( ClY );
                         }
                     }
                 }
 
-                // Finally erase C from PCS .. (this actually gets overwritten so no need..)
-                // perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomComp);
-
-                // .. and Re-build the PCS after this
+                // C is not reachable anymore, re-build the PCS after this
                 newPCS.clear();
-                if( !( C->getParent() ) )
+                if( !( components[C].hasParent() ) )
                 {
                     // cLeft is the new root
                     newPCS.insert( newPCS.end() , cLeft );
@@ -2072,13 +1474,14 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                 pos = 0;
                 buildNewPCS( newPCS, pos );
                 perfectCliqueSequence = newPCS; // substitute to the current one
+                freeComponent(C);
                 // PEO updated below
 
                 logP += N.size() * log(2.); // forward probability addition
                 logP -= //backward probability (we added one component here so numComponents rather than numComponents-1)
                         log((double)numComponents) +
-                        log((double)(ClY->getNodes().size() - setS.size())) - std::lgamma((double)(dimX+1.)) - std::lgamma((double)(ClY->getNodes().size()-setS.size()-dimX+1.)) + std::lgamma((double)(ClY->getNodes().size()-setS.size()+1.)) +
-                        log((double)(ClX->getNodes().size() - setS.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(ClX->getNodes().size()-setS.size()-dimY+1.)) + std::lgamma((double)(ClX->getNodes().size()-setS.size()+1.)) ;
+                        log((double)(components[ClY].getNodes().size() - setS.size())) - std::lgamma((double)(dimX+1.)) - std::lgamma((double)(components[ClY].getNodes().size()-setS.size()-dimX+1.)) + std::lgamma((double)(components[ClY].getNodes().size()-setS.size()+1.)) +
+                        log((double)(components[ClX].getNodes().size() - setS.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(components[ClX].getNodes().size()-setS.size()-dimY+1.)) + std::lgamma((double)(components[ClX].getNodes().size()-setS.size()+1.)) ;
 
             }else if( definedCx && !definedCy ) // if only Cx is defined
             {
@@ -2091,40 +1494,40 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                     {
                         // remove x from C
                         tmpVec.clear();
-                        std::set_difference(std::make_move_iterator(setC.begin()), 
-                                            std::make_move_iterator(setC.end()), 
-                                            X.begin(), X.end(), 
+                        std::set_difference(std::make_move_iterator(setC.begin()),
+                                            std::make_move_iterator(setC.end()),
+                                            X.begin(), X.end(),
                                     std::inserter(tmpVec, tmpVec.begin()));
                         setC.swap(tmpVec); // move operator, move semantic and swap...ah
-                    
-                        C->setNodes( setC );
+
+                        components[C].setNodes( setC );
 
                         // find the separator that connects C to Cx
-                        if( Cx == C->getParent() )
+                        if( Cx == CParent )
                         {
-                            setS = C->getSeparator();
+                            toVector( components[C].getSeparator() , setS );
 
                             tmpVec.clear();
-                            std::set_difference(std::make_move_iterator(setS.begin()), 
-                                            std::make_move_iterator(setS.end()), 
-                                            X.begin(), X.end(), 
+                            std::set_difference(std::make_move_iterator(setS.begin()),
+                                            std::make_move_iterator(setS.end()),
+                                            X.begin(), X.end(),
                                     std::inserter(tmpVec, tmpVec.begin()));
                             setS.swap(tmpVec);
 
-                            C->setSeparator( setS );
+                            components[C].setSeparator( setS );
 
                         }else{ // it's a child
 
-                            setS = Cx->getSeparator();
-                            
+                            toVector( components[Cx].getSeparator() , setS );
+
                             tmpVec.clear();
-                            std::set_difference(std::make_move_iterator(setS.begin()), 
-                                            std::make_move_iterator(setS.end()), 
-                                            X.begin(), X.end(), 
+                            std::set_difference(std::make_move_iterator(setS.begin()),
+                                            std::make_move_iterator(setS.end()),
+                                            X.begin(), X.end(),
                                     std::inserter(tmpVec, tmpVec.begin()));
                             setS.swap(tmpVec);
-                            
-                            Cx->setSeparator( setS );
+
+                            components[Cx].setSeparator( setS );
                         }
                     }else{
                         return std::make_pair(false,0.0); // and the graph is unchanged
@@ -2135,7 +1538,7 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
                 logP -= //backward probability
                         log((double)(numComponents-1.)) +
-                        log((double)(Cx->getNodes().size() - setS.size())) - std::lgamma((double)(dimX+1.)) - std::lgamma((double)(Cx->getNodes().size()-setS.size()-dimX+1.)) + std::lgamma((double)(Cx->getNodes().size()-setS.size()+1.)) +
+                        log((double)(components[Cx].getNodes().size() - setS.size())) - std::lgamma((double)(dimX+1.)) - std::lgamma((double)(components[Cx].getNodes().size()-setS.size()-dimX+1.)) + std::lgamma((double)(components[Cx].getNodes().size()-setS.size()+1.)) +
                         log((double)(setC.size() - setS.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(setC.size()-setS.size()-dimY+1.)) + std::lgamma((double)(setC.size()-setS.size()+1.)) ;
 
             }else if( !definedCx && definedCy ) // if only Cy is defined
@@ -2149,37 +1552,37 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                     {
                         // remove y from C
                         tmpVec.clear();
-                        std::set_difference(std::make_move_iterator(setC.begin()), 
-                                            std::make_move_iterator(setC.end()), 
-                                            Y.begin(), Y.end(), 
+                        std::set_difference(std::make_move_iterator(setC.begin()),
+                                            std::make_move_iterator(setC.end()),
+                                            Y.begin(), Y.end(),
                                     std::inserter(tmpVec, tmpVec.begin()));
                         setC.swap(tmpVec); // move operator, move semantic and swap...ah
 
-                        C->setNodes( setC );
+                        components[C].setNodes( setC );
                         // find the separator that connects C to Cy
-                        if( Cy == C->getParent() )
+                        if( Cy == CParent )
                         {
-                            setS = C->getSeparator();
-                            
+                            toVector( components[C].getSeparator() , setS );
+
                             tmpVec.clear();
-                            std::set_difference(std::make_move_iterator(setS.begin()), 
-                                            std::make_move_iterator(setS.end()), 
-                                            Y.begin(), Y.end(), 
+                            std::set_difference(std::make_move_iterator(setS.begin()),
+                                            std::make_move_iterator(setS.end()),
+                                            Y.begin(), Y.end(),
                                     std::inserter(tmpVec, tmpVec.begin()));
                             setS.swap(tmpVec);
 
-                            C->setSeparator( setS );
+                            components[C].setSeparator( setS );
                         }else{ // it's a child
-                            setS = Cy->getSeparator();
+                            toVector( components[Cy].getSeparator() , setS );
 
                             tmpVec.clear();
-                            std::set_difference(std::make_move_iterator(setS.begin()), 
-                                            std::make_move_iterator(setS.end()), 
-                                            Y.begin(), Y.end(), 
+                            std::set_difference(std::make_move_iterator(setS.begin()),
+                                            std::make_move_iterator(setS.end()),
+                                            Y.begin(), Y.end(),
                                     std::inserter(tmpVec, tmpVec.begin()));
                             setS.swap(tmpVec);
 
-                            Cy->setSeparator( setS );
+                            components[Cy].setSeparator( setS );
                         }
                     }else{
                         return std::make_pair(false,0.0); // and the graph is unchanged
@@ -2187,11 +1590,11 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                 }else{
                     return std::make_pair(false,0.0); // and the graph is unchanged
                 }
-                
+
                 logP -= //backward probability
                     log((double)(numComponents-1.)) +
                     log((double)(setC.size() - setS.size())) - std::lgamma((double)(dimX+1.)) - std::lgamma((double)(setC.size()-setS.size()-dimX+1.)) + std::lgamma((double)(setC.size()-setS.size()+1.)) +
-                    log((double)(Cy->getNodes().size() - setS.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(Cy->getNodes().size()-setS.size()-dimY+1.)) + std::lgamma((double)(Cy->getNodes().size()-setS.size()+1.));
+                    log((double)(components[Cy].getNodes().size() - setS.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(components[Cy].getNodes().size()-setS.size()-dimY+1.)) + std::lgamma((double)(components[Cy].getNodes().size()-setS.size()+1.));
 
 
             }else{ //if both are defined
@@ -2207,21 +1610,21 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                         // and change their separator to be a new S
                         // the separator for cLeft now is either its old separator (if it was the parent)
                         // or it needs to be set to the separator of C if cLeft was its child
-                        if( Cx == C->getParent() )
+                        if( Cx == CParent )
                         {
                             cLeft = Cx;
                             cRight = Cy;
 
                             XisRightYisLeft = false;
 
-                        }else if( Cy == C->getParent() ) // if Cy is the parent
+                        }else if( Cy == CParent ) // if Cy is the parent
                         {
                             cLeft = Cy;
                             cRight = Cx;
 
                             XisRightYisLeft = true;
 
-                        }else if( !( C->getParent()) ) // C was their parent, so choose randomly
+                        }else if( !( components[C].hasParent() ) ) // C was their parent, so choose randomly
                         {                               // note as well that in this case (becase N is empty), C was the root of JT
                             if( randU01() < 0.5 )
                             {
@@ -2237,41 +1640,41 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
                             // because C was the root of the tree, the clique chosen to replace him at the top get its separator emptied
                             newSeparator.clear();
-                            cLeft->setSeparator( newSeparator );
+                            components[cLeft].setSeparator( newSeparator );
 
                             // and its parent's emptied as well as it becomes the new root
-                            cLeft->setParent( nullptr );
+                            components[cLeft].setParent( JTComponent::none );
 
-                            // DO WE NEED TO CHANGE THE PCS in this case? (it's safer to do so, but... do we need?)
-                            // I'll do it because our code relies on the fact that perfectCliqueSequence[0] is the root
+                            // our code relies on the fact that perfectCliqueSequence[0] is the root, so the PCS is rebuilt below
 
                         }
 
                         // Now fix links
                         // find C in cLeft's childs and substitute (or add) cRight
-                        newChildrens = cLeft->getChildrens();
+                        newChildrens = components[cLeft].getChildrens();
                         newChildrens.erase(std::remove(newChildrens.begin(), newChildrens.end(), C), newChildrens.end());
                         newChildrens.push_back( cRight );
-                        cLeft->setChildrens( newChildrens );
+                        components[cLeft].setChildrens( newChildrens );
 
                         // set cLeft as cRight's parent (cRight HAS to come from C's childs)
-                        cRight->setParent( cLeft );
+                        components[cRight].setParent( cLeft );
 
                         // set the separator between them as the intersection between them
                         newSeparator.clear();
-                        setCLeft = cLeft->getNodes();
-                        setCRight = cRight->getNodes();
+                        toVector( components[cLeft].getNodes() , setCLeft );
+                        toVector( components[cRight].getNodes() , setCRight );
 
                         std::set_intersection(setCLeft.begin(), setCLeft.end(),
                                                 setCRight.begin(), setCRight.end(),
                                             std::back_inserter(newSeparator));
 
-                        cRight->setSeparator( newSeparator );
-                        
+                        components[cRight].setSeparator( newSeparator );
+
                         // Finally erase C
                         perfectCliqueSequence.erase(perfectCliqueSequence.begin() + randomComp);
+                        freeComponent(C);
 
-                        if( !( C->getParent()) ) // if we erased the root node, we created a new one and we need to create a newPCS
+                        if( !( components[C].hasParent() ) ) // if we erased the root node, we created a new one and we need to create a newPCS
                         {
                             newPCS.clear();
                             // cLeft is the new root
@@ -2294,7 +1697,7 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                                 log((double)(setCLeft.size() - newSeparator.size())) - std::lgamma((double)(dimX+1.)) - std::lgamma((double)(setCLeft.size()-newSeparator.size()-dimX+1.)) + std::lgamma((double)(setCLeft.size()-newSeparator.size()+1.)) +
                                 log((double)(setCRight.size() - newSeparator.size())) - std::lgamma((double)(dimY+1.)) - std::lgamma((double)(setCRight.size()-newSeparator.size()-dimY+1.)) + std::lgamma((double)(setCRight.size()-newSeparator.size()+1.));
                         }
-                        
+
 
                     }else{
                         return std::make_pair(false,0.0); // and the graph is unchanged
@@ -2303,7 +1706,7 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
                 }else{
                     return std::make_pair(false,0.0); // and the graph is unchanged
                 }
-                
+
 
             }
 
@@ -2323,92 +1726,63 @@ std::pair<bool,double> JunctionTree::propose_multiple_edge_update( )
 
 
 
-void JunctionTree::swapParentChild( std::shared_ptr<JTComponent>& parent , std::shared_ptr<JTComponent>& child )
+void JunctionTree::swapParentChild( unsigned int parent , unsigned int child )
 {
 
-    std::vector<std::shared_ptr<JTComponent>> childrenVec;
-    std::shared_ptr<JTComponent> hyperParent;
-
-    if( parent->getParent() )
+    if( components[parent].hasParent() )
     {
-        hyperParent = parent->getParent();
-        swapParentChild( hyperParent , parent );
-
+        swapParentChild( components[parent].getParent() , parent );
     }
-    
+
     // parent is now the root of the tree, so now swap
-    
-    child -> add1Children(parent);
-    child -> setParent(nullptr);
 
-    parent->setParent(child);
-    
-    childrenVec = parent->getChildrens();
-    childrenVec.erase(std::remove(childrenVec.begin(), childrenVec.end(), child), childrenVec.end());
-    parent -> setChildrens( childrenVec );
+    components[child].add1Children(parent);
+    components[child].setParent(JTComponent::none);
+
+    components[parent].setParent(child);
+    components[parent].removeChildren(child);
 
-    parent -> setSeparator( child->getSeparator() );
-    child -> clearSeparator();
+    components[parent].setSeparator( components[child].getSeparator() );
+    components[child].clearSeparator();
 
 }
 
 void JunctionTree::reRoot()
 {
     unsigned int pos = 0;
-    std::deque<std::shared_ptr<JTComponent>> newPCS;
-    std::shared_ptr<JTComponent> parent;
+    std::vector<unsigned int> newPCS;
 
     // select at random one component as the NEW root ( sampling from 1 excludes current root )
     newPCS.insert( newPCS.end() , perfectCliqueSequence[ randIntUniform( 1 , perfectCliqueSequence.size() -1 ) ] );
 
-    // get its parent
-    parent = newPCS[pos]->getParent();
-
     // make the selected component recursively the root by swapping parents and childs
-    swapParentChild( parent , newPCS[pos] );
+    swapParentChild( components[ newPCS[pos] ].getParent() , newPCS[pos] );
 
     // now build the new PCS, starting from the root and its (new and old) childrens ..
     buildNewPCS( newPCS, pos );
     // ... and substitute to the current one
-    perfectCliqueSequence = newPCS; 
+    perfectCliqueSequence = newPCS;
 
     // updateAdjMat(); // this shouldn't be necessary !
     updatePEO();
-    
+
 }
 
-bool JunctionTree::isChild( std::shared_ptr<JTComponent>& parent , std::shared_ptr<JTComponent>& node )
+bool JunctionTree::isChild( unsigned int parent , unsigned int node ) const
 {
-    std::vector<std::shared_ptr<JTComponent>> parentsChildrens = parent -> getChildrens();
-    const unsigned int nChildrens = parentsChildrens.size();
-
-    if( nChildrens == 0 )
-        return false;
-
-    std::vector<bool> res;
-    res.resize(nChildrens,false); // init and set all to false
-
-    for( unsigned int i=0; i<nChildrens; ++i )
+    for( auto c : components[parent].getChildrens() )
     {
-        if( parentsChildrens[i] == node )
+        if( c == node || isChild( c , node ) )
             return true;
-        else{
-            res[i] = isChild( parentsChildrens[i] , node );
-        }
     }
 
-    for( auto const& b : res)
-        if(b) return true;
     return false;
-
 }
 
 void JunctionTree::randomJTPermutation()
 {
     unsigned int numComponents = perfectCliqueSequence.size();
 
-    // this->print();
-
     // reroot the tree, this happens anyway
     if( numComponents > 1 ) // otherwise is at best the reverse of the above reRoot move
         this->reRoot();
@@ -2417,15 +1791,11 @@ void JunctionTree::randomJTPermutation()
     if( numComponents > 2 ) // otherwise is at best the reverse of thea bove reRoot move
     {
         // Select at random one component (not the root)
-        std::shared_ptr<JTComponent> thisComponent = perfectCliqueSequence[ randIntUniform( 1 , numComponents -1 ) ];
-        std::shared_ptr<JTComponent> itsParent = thisComponent -> getParent();
-        std::vector<std::shared_ptr<JTComponent>> itsChildrens = thisComponent -> getChildrens();
-        std::vector<unsigned int> setI;
-        std::vector<unsigned int> itsSeparator = thisComponent->getSeparator();
-        std::vector<std::shared_ptr<JTComponent>> parentsChildrens;
+        unsigned int thisComponent = perfectCliqueSequence[ randIntUniform( 1 , numComponents -1 ) ];
+        unsigned int itsParent = components[thisComponent].getParent();
+        const JTSet& itsSeparator = components[thisComponent].getSeparator();
 
-
-        std::vector<std::shared_ptr<JTComponent>> possibleNewParent;
+        std::vector<unsigned int> possibleNewParent;
         unsigned int idx;
 
         // search in the PCS if there are other possible fathers (not in its childrens)
@@ -2444,8 +1814,8 @@ void JunctionTree::randomJTPermutation()
 
                     if( !isItsChild )
                     {
-                        setI = perfectCliqueSequence[i]->getNodes();
-                        hasRightSep = std::includes(setI.begin(), setI.end(), itsSeparator.begin(), itsSeparator.end()); 
+                        const JTSet& setI = components[ perfectCliqueSequence[i] ].getNodes();
+                        hasRightSep = std::includes(setI.begin(), setI.end(), itsSeparator.begin(), itsSeparator.end());
                         // should I check if the intersection between setI and setThis is just setS? no right?
                         // because if that was the case, the RIProperty would be violated from the start
 
@@ -2465,24 +1835,23 @@ void JunctionTree::randomJTPermutation()
             idx = randIntUniform(0,possibleNewParent.size()-1);
 
             //swap its parent with this new one, break and rebuild PCS
-            thisComponent->setParent( possibleNewParent[idx] );
-            possibleNewParent[idx] -> add1Children( thisComponent );
-            
-            parentsChildrens = itsParent -> getChildrens();
-            parentsChildrens.erase(std::remove(parentsChildrens.begin(), parentsChildrens.end(), thisComponent), parentsChildrens.end());
-            itsParent -> setChildrens( parentsChildrens );
+            components[thisComponent].setParent( possibleNewParent[idx] );
+            components[ possibleNewParent[idx] ].add1Children( thisComponent );
+
+            components[itsParent].removeChildren( thisComponent );
 
             // Rebuild the PCS
             unsigned int pos = 0;
-            std::deque<std::shared_ptr<JTComponent>> newPCS;
+            std::vector<unsigned int> newPCS;
 
             newPCS.insert( newPCS.end() , perfectCliqueSequence[ 0 ] );
 
             buildNewPCS( newPCS , pos );
+            perfectCliqueSequence = newPCS;
 
             // updateAdjMat(); // this shouldn't be necessary !
             updatePEO();
 
-        } //else nothing to do  
+        } //else nothing to do
     }
 }
@@ -11,31 +11,152 @@
 
 #include <string>
 #include <vector>
-#include <deque>
-#include <set>
-#include <memory>
+#include <climits>
+#include <cstring>
+#include <iterator>
 #include <algorithm> // std::set_difference, std::sort, ...
 
 #include "distr.h"
 #include "utils.h"
 
-class JTComponent { 
+/*
+Vector of a trivially copyable T whose first N elements live inline in the object:
+node and separator sets are usually small, so copying a whole JT (see below) does not touch the heap
+*/
+template< typename T , unsigned int N >
+class SmallVector {
 
     public:
 
+        typedef T value_type;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+
+        SmallVector(): count(0), capacity(N), data(local) { }
+        SmallVector( const SmallVector& other ): SmallVector() { assign( other.begin() , other.end() ); }
+        SmallVector( SmallVector&& other ): SmallVector() { *this = std::move( other ); }
+        template< typename It > SmallVector( It first , It last ): SmallVector() { assign( first , last ); }
+        ~SmallVector(){ if( data != local ) delete[] data; }
+
+        SmallVector& operator=( const SmallVector& other )
+        {
+            if( this != &other )
+                assign( other.begin() , other.end() );
+            return *this;
+        }
+
+        SmallVector& operator=( SmallVector&& other )
+        {
+            if( this == &other )
+                return *this;
+
+            if( other.data != other.local ) // steal the heap buffer
+            {
+                if( data != local )
+                    delete[] data;
+                data = other.data; capacity = other.capacity; count = other.count;
+                other.data = other.local; other.capacity = N; other.count = 0;
+            }else{
+                assign( other.begin() , other.end() );
+            }
+            return *this;
+        }
+
+        template< typename It > void assign( It first , It last )
+        {
+            count = 0;
+            reserve( (unsigned int)std::distance( first , last ) );
+            for( ; first != last ; ++first )
+                data[count++] = *first;
+        }
+
+        void reserve( unsigned int n )
+        {
+            if( n <= capacity )
+                return;
+
+            unsigned int newCapacity = std::max( n , 2*capacity );
+            T* newData = new T[newCapacity];
+            std::memcpy( newData , data , count * sizeof(T) );
+            if( data != local )
+                delete[] data;
+            data = newData;
+            capacity = newCapacity;
+        }
+
+        void push_back( const T& value )
+        {
+            T v = value; // value might live in data
+            reserve( count + 1 );
+            data[count++] = v;
+        }
+
+        iterator insert( const_iterator position , const T& value )
+        {
+            unsigned int offset = position - data;
+            T v = value;
+            reserve( count + 1 );
+            std::memmove( data + offset + 1 , data + offset , ( count - offset ) * sizeof(T) );
+            data[offset] = v;
+            ++count;
+            return data + offset;
+        }
+
+        iterator erase( const_iterator first , const_iterator last )
+        {
+            unsigned int offset = first - data , n = last - first;
+            std::memmove( data + offset , data + offset + n , ( count - offset - n ) * sizeof(T) );
+            count -= n;
+            return data + offset;
+        }
+
+        iterator erase( const_iterator position ){ return erase( position , position + 1 ); }
+
+        void clear(){ count = 0; }
+
+        unsigned int size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        iterator begin(){ return data; }
+        iterator end(){ return data + count; }
+        const_iterator begin() const { return data; }
+        const_iterator end() const { return data + count; }
+
+        T& operator[]( unsigned int i ){ return data[i]; }
+        const T& operator[]( unsigned int i ) const { return data[i]; }
+
+    private:
+
+        unsigned int count, capacity;
+        T* data;
+        T local[N];
+
+};
+
+typedef SmallVector<unsigned int,8> JTSet; // sorted set of outcome indexes
+typedef SmallVector<unsigned int,4> JTLinks; // component indexes in the JT arena
+
+/*
+A clique of the JT. Components live in the arena of their JunctionTree and refer to each other by their index there,
+so a JT is a handful of contiguous arrays that copy in one go (no pointer chasing and no reference counting)
+*/
+class JTComponent {
+
+    public:
+
+        static const unsigned int none = UINT_MAX; // parent of the root
+
         JTComponent( );
         JTComponent( const std::vector<unsigned int>& );
         JTComponent( const std::vector<unsigned int>& , const std::vector<unsigned int>& );
         JTComponent( const std::vector<unsigned int>& , const std::vector<unsigned int>& ,
-                          const std::vector<std::shared_ptr<JTComponent>>& , const std::shared_ptr<JTComponent>& );
-        JTComponent( const JTComponent& );
-
-        JTComponent copyNode( ); // returns a COPY of this node
+                          const JTLinks& , const unsigned int );
 
-        std::vector<unsigned int> getNodes() const;
-        std::vector<unsigned int> getSeparator() const;
-        std::shared_ptr<JTComponent> getParent() const;
-        std::vector<std::shared_ptr<JTComponent>> getChildrens() const;
+        const JTSet& getNodes() const;
+        const JTSet& getSeparator() const;
+        unsigned int getParent() const;
+        bool hasParent() const;
+        const JTLinks& getChildrens() const;
 
         void add1Node( const unsigned int );
         void addNodes( const std::vector<unsigned int>& );
@@ -43,23 +164,25 @@ class JTComponent {
         void clearSeparator();
         void add1Separator( const unsigned int );
         void addSeparators( const std::vector<unsigned int>& );
-        
-        void add1Children( const std::shared_ptr<JTComponent>& );
-        void addChildrens( const std::vector<std::shared_ptr<JTComponent>>& );
-        
+
+        void add1Children( const unsigned int );
+        void removeChildren( const unsigned int );
+
         void setNodes( const std::vector<unsigned int>& );
+        void setNodes( const JTSet& );
         void setSeparator( const std::vector<unsigned int>& );
-        void setChildrens( const std::vector<std::shared_ptr<JTComponent>>& );
-        void setParent( const std::shared_ptr<JTComponent>& );
+        void setSeparator( const JTSet& );
+        void setChildrens( const JTLinks& );
+        void setParent( const unsigned int );
 
         void print() const;
 
     private:
 
-        std::vector<unsigned int> nodes;
-        std::vector<unsigned int> separator;
-        std::weak_ptr<JTComponent> parent;
-        std::vector<std::shared_ptr<JTComponent>> childrens;
+        JTSet nodes;
+        JTSet separator;
+        unsigned int parent;
+        JTLinks childrens;
 
 };
 
@@ -69,47 +192,59 @@ class JunctionTree {
 
         JunctionTree() = default;
         JunctionTree( const unsigned int , const std::string type="" );
-        JunctionTree( const unsigned int , const std::deque<std::shared_ptr<JTComponent>>& );
 
-        std::deque<std::shared_ptr<JTComponent>> getPCS() const;
+        // components and perfect clique sequence as built by the caller, links are positions in components
+        JunctionTree( const unsigned int , const std::vector<JTComponent>& , const std::vector<unsigned int>& );
+
+        // the q-th clique in the perfect clique sequence
+        const JTComponent& getClique( const unsigned int q ) const;
+        unsigned int getNCliques() const;
+
         std::vector<unsigned int> getPEO() const;
-        arma::sp_umat getAdjMat() const;
+        const arma::sp_umat& getAdjMat() const; // a view, copy it if it needs to outlive the next move
         unsigned int getDimension() const;
 
-        void cloneRoot( std::shared_ptr<JTComponent>& , 
-                std::shared_ptr<JTComponent>& );
-        void cloneComponent( std::shared_ptr<JTComponent>& , 
-                std::shared_ptr<JTComponent>& , 
-                std::shared_ptr<JTComponent>& );
-
-        void buildNewPCS( std::deque<std::shared_ptr<JTComponent>>& , unsigned int& );
+        void buildNewPCS( std::vector<unsigned int>& , unsigned int& );
         void updatePEO();
         void updateAdjMat();
 
-        void copyJT( JunctionTree& ); 
-        
+        void copyJT( JunctionTree& ) const; // flat copy, plus the PCS re-built depth first
+
         std::pair<bool,double> propose_single_edge_update( );
         std::pair<bool,double> propose_single_edge_update( arma::uvec& );
 
         std::pair<bool,double> propose_multiple_edge_update( );
 
-        void swapParentChild( std::shared_ptr<JTComponent>& parent , std::shared_ptr<JTComponent>& child );
+        void swapParentChild( unsigned int parent , unsigned int child );
         void reRoot();
-        bool isChild( std::shared_ptr<JTComponent>& , std::shared_ptr<JTComponent>& );
+        bool isChild( unsigned int , unsigned int ) const;
         void randomJTPermutation();
 
         void print() const;
         // for usability reasons I will have these as public
         // (i.e. I want to use directly the list::insert and other methods)
-        std::deque<std::shared_ptr<JTComponent>> perfectCliqueSequence;
+        std::vector<unsigned int> perfectCliqueSequence; // indexes in components
         std::vector<unsigned int> perfectEliminationOrder;
         arma::sp_umat adjacencyMatrix;
         unsigned int n;
 
+    private:
+
+        // arena, components dropped from the tree leave a free slot for the next new one
+        std::vector<JTComponent> components;
+        std::vector<unsigned int> freeComponents;
+
+        unsigned int newComponent( const JTComponent& );
+        void freeComponent( const unsigned int );
+
+        // in-place updates after a single edge move
+        void moveInPEO( const unsigned int , const unsigned int );
+        void setEdge( const unsigned int , const unsigned int , const bool );
+
 };
 
 #endif
 
 
-// note that I treat an empty parent (nullptr, for the root)
-// differently than an empty list of childern (which is a vector of length 0, without ANY children ptr initialised)
+// note that I treat an empty parent (JTComponent::none, for the root)
+// differently than an empty list of childern (which has length 0)
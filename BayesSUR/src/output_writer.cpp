@@ -0,0 +1,423 @@
+#include "output_writer.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+
+#ifndef CCODE
+	using Rcpp::Rcerr;
+#else
+	#define Rcerr std::cerr
+#endif
+
+namespace
+{
+	const char traceMagic[8] = { 'B','S','U','R','T','R','C','1' };
+	const size_t traceBufferSize = 1 << 20; // 1MB per trace, far fewer (and larger) writes on network filesystems
+
+	// writes as text the complete rows found from the current position of in, end is moved past the last of them;
+	// returns false if the trace is corrupted
+	bool appendTraceRows( std::istream& in , std::ostream& out , unsigned long long& end )
+	{
+		char type;
+		uint32_t n;
+		std::vector<double> doubles;
+		std::vector<uint32_t> indexes;
+
+		while( in.read( &type , 1 ) && in.read( reinterpret_cast<char*>( &n ) , sizeof(n) ) )
+		{
+			if( type == 'd' )
+			{
+				doubles.resize( n );
+				if( !in.read( reinterpret_cast<char*>( doubles.data() ) , n * sizeof(double) ) )
+					break; // truncated last row (being written, or the run died while writing it)
+
+				for( uint32_t j=0; j<n; ++j )
+					out << ( j>0 ? " " : "" ) << doubles[j];
+
+				end += 1 + sizeof(n) + n * sizeof(double);
+			}
+			else if( type == 'u' )
+			{
+				indexes.resize( n );
+				if( !in.read( reinterpret_cast<char*>( indexes.data() ) , n * sizeof(uint32_t) ) )
+					break;
+
+				for( uint32_t j=0; j<n; ++j )
+					out << ( j>0 ? " " : "" ) << indexes[j];
+
+				end += 1 + sizeof(n) + n * sizeof(uint32_t);
+			}
+			else
+			{
+				return false; // corrupted
+			}
+
+			out << '\n';
+		}
+
+		return out.good();
+	}
+}
+
+OutputWriter::OutputWriter( unsigned int queueCapacity , bool keepBinaryTraces_ ):
+ring( std::max( queueCapacity , 2u ) ), head(0), tail(0), nPushed(0), nProcessed(0), nTraces(0),
+keepBinaryTraces(keepBinaryTraces_), closed(false)
+{
+	worker = std::thread( &OutputWriter::run , this );
+}
+
+OutputWriter::~OutputWriter()
+{
+	close();
+}
+
+// ****************************
+// sampling (producer) side
+
+void OutputWriter::push( std::unique_ptr<Record> record )
+{
+	size_t t = tail.load( std::memory_order_relaxed );
+	size_t next = ( t + 1 ) % ring.size();
+
+	while( next == head.load( std::memory_order_acquire ) ) // full, wait for the writer
+		std::this_thread::yield();
+
+	ring[t] = std::move( record );
+	tail.store( next , std::memory_order_release );
+	++nPushed;
+}
+
+void OutputWriter::resumeTraces( const std::vector<unsigned long long>& traceSizes )
+{
+	resumeSizes.assign( nTraces , 0 ); // traces already open start afresh
+	resumeSizes.insert( resumeSizes.end() , traceSizes.begin() , traceSizes.end() );
+}
+
+unsigned int OutputWriter::openTrace( const std::string& fileName )
+{
+	std::unique_ptr<Record> record( new Record );
+	record->type = Record::Type::OpenTrace;
+	record->traceId = nTraces;
+	record->fileName = fileName;
+	record->resumeSize = nTraces < resumeSizes.size() ? resumeSizes[nTraces] : 0;
+
+	push( std::move( record ) );
+
+	return nTraces++;
+}
+
+void OutputWriter::appendTrace( const unsigned int traceId , const arma::rowvec& row )
+{
+	std::unique_ptr<Record> record( new Record );
+	record->type = Record::Type::TraceDoubles;
+	record->traceId = traceId;
+	record->doubles = row;
+
+	push( std::move( record ) );
+}
+
+void OutputWriter::appendTrace( const unsigned int traceId , const arma::urowvec& row )
+{
+	std::unique_ptr<Record> record( new Record );
+	record->type = Record::Type::TraceIndexes;
+	record->traceId = traceId;
+	record->indexes = row;
+
+	push( std::move( record ) );
+}
+
+void OutputWriter::writeSnapshot( const std::string& fileName , const arma::mat& value , const double scale )
+{
+	std::unique_ptr<Record> record( new Record );
+	record->type = Record::Type::Snapshot;
+	record->fileName = fileName;
+	record->value = value;
+	record->scale = scale;
+
+	push( std::move( record ) );
+}
+
+void OutputWriter::flush()
+{
+	while( nProcessed.load() < nPushed.load() )
+		std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+}
+
+void OutputWriter::exportTraces()
+{
+	std::unique_ptr<Record> record( new Record );
+	record->type = Record::Type::ExportTraces;
+
+	push( std::move( record ) );
+}
+
+std::vector<unsigned long long> OutputWriter::getTraceSizes() const
+{
+	std::vector<unsigned long long> sizes;
+	for( const auto& trace : traces )
+		sizes.push_back( trace.size );
+
+	return sizes;
+}
+
+void OutputWriter::close()
+{
+	if( closed )
+		return;
+
+	std::unique_ptr<Record> record( new Record );
+	record->type = Record::Type::Close;
+	push( std::move( record ) );
+
+	worker.join();
+	closed = true;
+
+	if( !errorMessage.empty() )
+		Rcerr << "Warning: " << errorMessage << '\n';
+}
+
+// ****************************
+// writer thread
+
+std::unique_ptr<OutputWriter::Record> OutputWriter::pop()
+{
+	size_t h = head.load( std::memory_order_relaxed );
+
+	if( h == tail.load( std::memory_order_acquire ) )
+		return nullptr;
+
+	std::unique_ptr<Record> record = std::move( ring[h] );
+	head.store( ( h + 1 ) % ring.size() , std::memory_order_release );
+
+	return record;
+}
+
+void OutputWriter::run()
+{
+	for(;;)
+	{
+		std::unique_ptr<Record> record = pop();
+
+		if( !record )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+			continue;
+		}
+
+		bool isClose = ( record->type == Record::Type::Close );
+
+		process( *record );
+		++nProcessed;
+
+		if( isClose )
+			return;
+	}
+}
+
+void OutputWriter::process( Record& record )
+{
+	switch( record.type )
+	{
+		case Record::Type::OpenTrace :
+		{
+			std::ofstream( record.fileName , std::ios::out | std::ios::trunc ); // clear previous content
+
+			if( traces.size() <= record.traceId )
+				traces.resize( record.traceId + 1 );
+
+			Trace& trace = traces[record.traceId];
+			trace.fileName = record.fileName;
+			trace.exportedSize = sizeof(traceMagic); // the text was cleared, a resumed binary is exported again from its start
+
+			bool resumed = ( record.resumeSize > 0 );
+			if( resumed && !truncateTrace( record.fileName + ".bin" , record.resumeSize ) )
+			{
+				if( errorMessage.empty() )
+					errorMessage = "could not resume " + record.fileName + ".bin, the trace restarts from the resumed iteration";
+				resumed = false;
+			}
+
+			trace.buffer.resize( traceBufferSize );
+			trace.binFile.reset( new std::ofstream );
+			trace.binFile->rdbuf()->pubsetbuf( trace.buffer.data() , trace.buffer.size() ); // before open
+			trace.binFile->open( record.fileName + ".bin" , std::ios::out | std::ios::binary | ( resumed ? std::ios::app : std::ios::trunc ) );
+
+			if( !trace.binFile->is_open() )
+			{
+				if( errorMessage.empty() )
+					errorMessage = "could not open " + record.fileName + ".bin for writing";
+				trace.binFile.reset();
+				break;
+			}
+
+			if( resumed )
+			{
+				trace.size = record.resumeSize;
+			}
+			else
+			{
+				trace.binFile->write( traceMagic , sizeof(traceMagic) );
+				trace.size = sizeof(traceMagic);
+			}
+			break;
+		}
+
+		case Record::Type::TraceDoubles :
+		case Record::Type::TraceIndexes :
+		{
+			if( record.traceId >= traces.size() || !traces[record.traceId].binFile )
+				break;
+
+			Trace& trace = traces[record.traceId];
+			std::ofstream& out = *trace.binFile;
+
+			if( record.type == Record::Type::TraceDoubles )
+			{
+				char type = 'd';
+				uint32_t n = record.doubles.n_elem;
+				out.write( &type , 1 );
+				out.write( reinterpret_cast<const char*>( &n ) , sizeof(n) );
+				out.write( reinterpret_cast<const char*>( record.doubles.memptr() ) , n * sizeof(double) );
+				trace.size += 1 + sizeof(n) + n * sizeof(double);
+			}
+			else
+			{
+				char type = 'u';
+				uint32_t n = record.indexes.n_elem;
+				std::vector<uint32_t> values( record.indexes.begin() , record.indexes.end() );
+				out.write( &type , 1 );
+				out.write( reinterpret_cast<const char*>( &n ) , sizeof(n) );
+				out.write( reinterpret_cast<const char*>( values.data() ) , n * sizeof(uint32_t) );
+				trace.size += 1 + sizeof(n) + n * sizeof(uint32_t);
+			}
+			break;
+		}
+
+		case Record::Type::Snapshot :
+		{
+			if( record.scale != 1. )
+				record.value *= record.scale;
+
+			// write to a temporary and swap it in, so that readers never see a half-written file
+			std::string tmpFileName = record.fileName + ".tmp";
+			bool ok = record.value.save( tmpFileName , arma::raw_ascii );
+
+			if( ok && std::rename( tmpFileName.c_str() , record.fileName.c_str() ) != 0 )
+			{
+				std::remove( record.fileName.c_str() ); // rename does not overwrite on some platforms
+				ok = ( std::rename( tmpFileName.c_str() , record.fileName.c_str() ) == 0 );
+			}
+
+			if( !ok && errorMessage.empty() )
+				errorMessage = "could not write " + record.fileName;
+			break;
+		}
+
+		case Record::Type::ExportTraces :
+		{
+			for( auto& trace : traces )
+			{
+				if( trace.binFile && !exportTrace( trace ) && errorMessage.empty() )
+					errorMessage = "could not export " + trace.fileName + ".bin to text";
+			}
+			break;
+		}
+
+		case Record::Type::Close :
+			closeTraces();
+			break;
+	}
+}
+
+// appends to the text file the rows of the binary trace that were not exported yet
+bool OutputWriter::exportTrace( Trace& trace )
+{
+	if( trace.binFile )
+		trace.binFile->flush(); // the buffered rows must be on disk to be read back
+
+	std::ifstream in( trace.fileName + ".bin" , std::ios::in | std::ios::binary );
+	if( !in.is_open() )
+		return false;
+	in.seekg( trace.exportedSize );
+
+	std::ofstream out( trace.fileName , std::ios::out | std::ios::app );
+	if( !out.is_open() )
+		return false;
+
+	return appendTraceRows( in , out , trace.exportedSize );
+}
+
+void OutputWriter::closeTraces()
+{
+	for( auto& trace : traces )
+	{
+		if( !trace.binFile )
+			continue;
+
+		trace.binFile->close();
+		trace.binFile.reset();
+
+		std::string binFileName = trace.fileName + ".bin";
+
+		if( exportTrace( trace ) )
+		{
+			if( !keepBinaryTraces )
+				std::remove( binFileName.c_str() );
+		}
+		else if( errorMessage.empty() )
+			errorMessage = "could not export " + binFileName + " to text, the binary trace was kept";
+	}
+}
+
+// keeps the first size bytes of a binary trace, i.e. drops what was written after the checkpoint we resume from
+bool OutputWriter::truncateTrace( const std::string& binFileName , const unsigned long long size )
+{
+	std::string oldFileName = binFileName + ".old";
+	std::remove( oldFileName.c_str() );
+	if( std::rename( binFileName.c_str() , oldFileName.c_str() ) != 0 )
+		return false;
+
+	std::ifstream in( oldFileName , std::ios::in | std::ios::binary );
+	std::ofstream out( binFileName , std::ios::out | std::ios::trunc | std::ios::binary );
+
+	std::vector<char> buffer( traceBufferSize );
+	unsigned long long left = size;
+
+	while( left > 0 && in )
+	{
+		std::streamsize chunk = (std::streamsize)std::min<unsigned long long>( left , buffer.size() );
+		in.read( buffer.data() , chunk );
+		out.write( buffer.data() , in.gcount() );
+		left -= in.gcount();
+	}
+
+	in.close();
+	out.close();
+	std::remove( oldFileName.c_str() );
+
+	return ( left == 0 ) && out.good();
+}
+
+// ****************************
+// text export
+
+bool OutputWriter::exportTraceToText( const std::string& binFileName , const std::string& txtFileName )
+{
+	std::ifstream in( binFileName , std::ios::in | std::ios::binary );
+	if( !in.is_open() )
+		return false;
+
+	char magic[8];
+	in.read( magic , sizeof(magic) );
+	if( !in || std::memcmp( magic , traceMagic , sizeof(magic) ) != 0 )
+		return false;
+
+	std::ofstream out( txtFileName , std::ios::out | std::ios::trunc );
+	if( !out.is_open() )
+		return false;
+
+	unsigned long long end = sizeof(magic);
+	return appendTraceRows( in , out , end );
+}
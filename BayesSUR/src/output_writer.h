@@ -0,0 +1,120 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#ifdef CCODE
+	#include <iostream>
+    #include <armadillo>
+#else
+    #include <RcppArmadillo.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+
+/*
+Asynchronous writer for the MCMC output.
+The sampling thread only copies the values into a record and pushes it onto a lock-free single-producer
+single-consumer ring; a dedicated thread does all the formatting and the (possibly slow, e.g. NFS) file I/O.
+
+Two kinds of output:
+ - snapshots (posterior means so far) overwrite a text file, through a temporary file so that the file on disk is always complete;
+ - traces (one row per recorded iteration, e.g. logP, model size, visited models) are appended to a buffered compact binary file
+   (fileName + ".bin") during the run; exportTraces() appends the rows written since its last call to the usual text file
+   (drive calls it at every progress print and checkpoint), close() exports the rest -- exportTraceToText rebuilds the text if the run died.
+
+Binary trace format: the 8 bytes "BSURTRC1", then for each row a one-byte type ('d' doubles, 'u' unsigned integers),
+a uint32_t length and the values (as double or uint32_t).
+*/
+
+class OutputWriter {
+
+    public:
+
+        // keepBinaryTraces leaves the binary traces next to the exported text, so that a resumed run can append to them
+        explicit OutputWriter( unsigned int queueCapacity = 4096 , bool keepBinaryTraces = false );
+        ~OutputWriter(); // calls close()
+
+        OutputWriter( const OutputWriter& ) = delete;
+        OutputWriter& operator=( const OutputWriter& ) = delete;
+
+        // returns the id to use with appendTrace; any previous content of the text file is cleared
+        unsigned int openTrace( const std::string& fileName );
+
+        // the traces opened next continue their existing binary file, kept up to the given sizes (as returned by getTraceSizes)
+        void resumeTraces( const std::vector<unsigned long long>& traceSizes );
+
+        void appendTrace( const unsigned int traceId , const arma::rowvec& row );
+        void appendTrace( const unsigned int traceId , const arma::urowvec& row );
+
+        // write scale * value to fileName (raw ascii)
+        void writeSnapshot( const std::string& fileName , const arma::mat& value , const double scale = 1. );
+
+        // blocks until everything pushed so far has been written
+        void flush();
+
+        // appends the trace rows written so far and not yet exported to the text files
+        void exportTraces();
+
+        // drains the queue, exports the traces to text and stops the writer thread
+        void close();
+
+        // current size in bytes of each binary trace, call flush() first
+        std::vector<unsigned long long> getTraceSizes() const;
+
+        static bool exportTraceToText( const std::string& binFileName , const std::string& txtFileName );
+
+    private:
+
+        struct Record
+        {
+            enum class Type { OpenTrace , TraceDoubles , TraceIndexes , Snapshot , ExportTraces , Close };
+
+            Type type;
+            unsigned int traceId;
+            std::string fileName;
+            arma::rowvec doubles;
+            arma::urowvec indexes;
+            arma::mat value;
+            double scale;
+            unsigned long long resumeSize;
+        };
+
+        struct Trace
+        {
+            std::string fileName;
+            std::unique_ptr<std::ofstream> binFile;
+            std::vector<char> buffer;
+            unsigned long long size = 0;
+            unsigned long long exportedSize = 0; // bytes of the binary already in the text file
+        };
+
+        void push( std::unique_ptr<Record> record );
+        std::unique_ptr<Record> pop();
+
+        void run();
+        void process( Record& record );
+        bool exportTrace( Trace& trace );
+        void closeTraces();
+        bool truncateTrace( const std::string& binFileName , const unsigned long long size );
+
+        // ring buffer, head is only written by the writer thread and tail by the sampling thread
+        std::vector< std::unique_ptr<Record> > ring;
+        std::atomic<size_t> head, tail;
+        std::atomic<unsigned long long> nPushed, nProcessed;
+
+        unsigned int nTraces;
+        std::vector<unsigned long long> resumeSizes;
+        std::vector<Trace> traces; // only touched by the writer thread (and read by getTraceSizes once flushed)
+
+        std::string errorMessage; // first error met by the writer thread, reported by close()
+        bool keepBinaryTraces, closed;
+
+        std::thread worker;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include "predictor_matrix.h"
+
+namespace
+{
+	// value of the 4 observations packed in a byte
+	struct DecodeTable
+	{
+		double value[256][4];
+
+		DecodeTable()
+		{
+			for( unsigned int b=0; b<256; ++b )
+				for( unsigned int k=0; k<4; ++k )
+					value[b][k] = (double)( ( b >> (2*k) ) & 3u );
+		}
+	};
+
+	// sum of the products of the 4 observations packed in two bytes, so that a dot product of two genotypes is exact integer arithmetic
+	struct ProductTable
+	{
+		uint8_t value[256][256];
+
+		ProductTable()
+		{
+			for( unsigned int a=0; a<256; ++a )
+				for( unsigned int b=0; b<256; ++b )
+				{
+					unsigned int s = 0;
+					for( unsigned int k=0; k<4; ++k )
+						s += ( ( a >> (2*k) ) & 3u ) * ( ( b >> (2*k) ) & 3u );
+					value[a][b] = (uint8_t)s;
+				}
+		}
+	};
+
+	const DecodeTable& decodeTable(){ static const DecodeTable t; return t; }
+	const ProductTable& productTable(){ static const ProductTable t; return t; }
+}
+
+PredictorMatrix::PredictorMatrix( std::shared_ptr<arma::mat> dense_ ):
+dense(dense_), nObservations(dense_->n_rows), nDense(dense_->n_cols), nPacked(0), bytesPerColumn( (dense_->n_rows+3)/4 )
+{ }
+
+PredictorMatrix::PredictorMatrix( std::shared_ptr<arma::mat> dense_ , const arma::mat& data , const arma::uvec& genotypeIdx ):
+PredictorMatrix( dense_ )
+{
+	nPacked = genotypeIdx.n_elem;
+	packed.assign( (size_t)nPacked * bytesPerColumn , 0 );
+	packedSum.zeros( nPacked );
+	packedSumSq.zeros( nPacked );
+
+	for( unsigned int j=0; j<nPacked; ++j )
+	{
+		uint8_t* column = &packed[ (size_t)j * bytesPerColumn ];
+		for( unsigned int i=0; i<nObservations; ++i )
+		{
+			unsigned int code = (unsigned int)data( i , genotypeIdx(j) );
+			column[i/4] |= (uint8_t)( code << ( 2*(i%4) ) );
+			packedSum(j) += code;
+			packedSumSq(j) += code*code;
+		}
+	}
+}
+
+bool PredictorMatrix::isGenotype( const arma::mat& data , const arma::uvec& columnsIdx )
+{
+	for( auto j : columnsIdx )
+	{
+		const double* x = data.colptr(j);
+		for( unsigned int i=0; i<data.n_rows; ++i )
+			if( x[i] != 0. && x[i] != 1. && x[i] != 2. )
+				return false;
+	}
+
+	return columnsIdx.n_elem > 0;
+}
+
+unsigned int PredictorMatrix::getNPacked() const { return nPacked; }
+
+bool PredictorMatrix::allDense( const arma::uvec& idx ) const
+{
+	return nPacked == 0 || idx.is_empty() || idx.max() < nDense;
+}
+
+const uint8_t* PredictorMatrix::packedCol( const unsigned int j ) const
+{
+	return &packed[ (size_t)j * bytesPerColumn ];
+}
+
+// ****************************
+// packed kernels, j is the position among the packed columns
+
+double PredictorMatrix::dotPacked( const unsigned int j , const double* y ) const
+{
+	const uint8_t* column = packedCol( j );
+	const DecodeTable& t = decodeTable();
+	unsigned int nFull = nObservations / 4;
+	double sum = 0.;
+
+	for( unsigned int b=0; b<nFull; ++b , y+=4 )
+	{
+		const double* v = t.value[ column[b] ];
+		sum += v[0]*y[0] + v[1]*y[1] + v[2]*y[2] + v[3]*y[3];
+	}
+	for( unsigned int k=0; k < nObservations % 4; ++k )
+		sum += t.value[ column[nFull] ][k] * y[k];
+
+	return sum;
+}
+
+double PredictorMatrix::dotPacked( const unsigned int i , const unsigned int j ) const
+{
+	const uint8_t* columnI = packedCol( i );
+	const uint8_t* columnJ = packedCol( j );
+	const ProductTable& t = productTable();
+	uint64_t sum = 0;
+
+	// the padding bits of the last byte are zero, so they don't contribute
+	for( unsigned int b=0; b<bytesPerColumn; ++b )
+		sum += t.value[ columnI[b] ][ columnJ[b] ];
+
+	return (double)sum;
+}
+
+void PredictorMatrix::axpyPacked( const unsigned int j , const double a , double* y ) const
+{
+	const uint8_t* column = packedCol( j );
+	const DecodeTable& t = decodeTable();
+	unsigned int nFull = nObservations / 4;
+
+	for( unsigned int b=0; b<nFull; ++b , y+=4 )
+	{
+		const double* v = t.value[ column[b] ];
+		y[0] += a*v[0]; y[1] += a*v[1]; y[2] += a*v[2]; y[3] += a*v[3];
+	}
+	for( unsigned int k=0; k < nObservations % 4; ++k )
+		y[k] += a * t.value[ column[nFull] ][k];
+}
+
+// ****************************
+// operations on the whole matrix
+
+arma::mat PredictorMatrix::cols( const arma::uvec& idx ) const
+{
+	if( allDense( idx ) )
+		return dense->cols( idx );
+
+	arma::mat result( nObservations , idx.n_elem , arma::fill::zeros );
+	for( unsigned int c=0; c<idx.n_elem; ++c )
+	{
+		if( idx(c) < nDense )
+			result.col(c) = dense->col( idx(c) );
+		else
+			axpyPacked( idx(c)-nDense , 1. , result.colptr(c) );
+	}
+
+	return result;
+}
+
+arma::mat PredictorMatrix::crossprod( const arma::uvec& idx , const arma::mat& Y ) const
+{
+	if( allDense( idx ) )
+		return dense->cols( idx ).t() * Y;
+
+	arma::mat result( idx.n_elem , Y.n_cols );
+	for( unsigned int c=0; c<idx.n_elem; ++c )
+	{
+		for( unsigned int l=0; l<Y.n_cols; ++l )
+		{
+			if( idx(c) < nDense )
+				result(c,l) = arma::dot( dense->col( idx(c) ) , Y.col(l) );
+			else
+				result(c,l) = dotPacked( idx(c)-nDense , Y.colptr(l) );
+		}
+	}
+
+	return result;
+}
+
+arma::mat PredictorMatrix::times( const arma::uvec& idx , const arma::mat& B ) const
+{
+	if( allDense( idx ) )
+		return dense->cols( idx ) * B;
+
+	arma::uvec densePositions = arma::find( idx < nDense );
+	arma::mat result;
+
+	if( densePositions.n_elem > 0 )
+		result = dense->cols( idx( densePositions ) ) * B.rows( densePositions );
+	else
+		result.zeros( nObservations , B.n_cols );
+
+	for( unsigned int c=0; c<idx.n_elem; ++c )
+	{
+		if( idx(c) < nDense )
+			continue;
+
+		for( unsigned int l=0; l<B.n_cols; ++l )
+			if( B(c,l) != 0. )
+				axpyPacked( idx(c)-nDense , B(c,l) , result.colptr(l) );
+	}
+
+	return result;
+}
+
+arma::mat PredictorMatrix::gram( const arma::uvec& idxI , const arma::uvec& idxJ ) const
+{
+	if( allDense( idxI ) && allDense( idxJ ) )
+		return dense->cols( idxI ).t() * dense->cols( idxJ );
+
+	arma::mat result( idxI.n_elem , idxJ.n_elem );
+	for( unsigned int c=0; c<idxJ.n_elem; ++c )
+	{
+		unsigned int j = idxJ(c);
+		for( unsigned int r=0; r<idxI.n_elem; ++r )
+		{
+			unsigned int i = idxI(r);
+
+			if( i < nDense && j < nDense )
+				result(r,c) = arma::dot( dense->col(i) , dense->col(j) );
+			else if( i < nDense )
+				result(r,c) = dotPacked( j-nDense , dense->colptr(i) );
+			else if( j < nDense )
+				result(r,c) = dotPacked( i-nDense , dense->colptr(j) );
+			else
+				result(r,c) = dotPacked( i-nDense , j-nDense );
+		}
+	}
+
+	return result;
+}
+
+arma::mat PredictorMatrix::cor( const arma::uvec& idxI , const arma::uvec& idxJ ) const
+{
+	if( allDense( idxI ) && allDense( idxJ ) )
+	{
+		if( idxI.n_elem == idxJ.n_elem && arma::all( idxI == idxJ ) )
+			return arma::cor( dense->cols( idxI ) );
+		else
+			return arma::cor( dense->cols( idxI ) , dense->cols( idxJ ) );
+	}
+
+	// from the Gram matrix and the column sums, with the same n-1 normalisation as arma::cor
+	auto sums = [this]( const arma::uvec& idx , arma::vec& sum , arma::vec& sumSq )
+	{
+		sum.set_size( idx.n_elem );
+		sumSq.set_size( idx.n_elem );
+		for( unsigned int c=0; c<idx.n_elem; ++c )
+		{
+			if( idx(c) < nDense )
+			{
+				sum(c) = arma::accu( dense->col( idx(c) ) );
+				sumSq(c) = arma::dot( dense->col( idx(c) ) , dense->col( idx(c) ) );
+			}else{
+				sum(c) = packedSum( idx(c)-nDense );
+				sumSq(c) = packedSumSq( idx(c)-nDense );
+			}
+		}
+	};
+
+	arma::vec sumI, sumSqI, sumJ, sumSqJ;
+	sums( idxI , sumI , sumSqI );
+	sums( idxJ , sumJ , sumSqJ );
+
+	double n = (double)nObservations;
+	arma::vec sdI = arma::sqrt( ( sumSqI - arma::square(sumI)/n ) / (n-1.) );
+	arma::vec sdJ = arma::sqrt( ( sumSqJ - arma::square(sumJ)/n ) / (n-1.) );
+
+	arma::mat covIJ = ( gram( idxI , idxJ ) - sumI * sumJ.t() / n ) / (n-1.);
+
+	return covIJ / ( sdI * sdJ.t() );
+}
@@ -0,0 +1,72 @@
+#ifndef PREDICTOR_MATRIX_H
+#define PREDICTOR_MATRIX_H
+
+#ifdef CCODE
+	#include <iostream>
+    #include <armadillo>
+#else
+    #include <RcppArmadillo.h>
+#endif
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+/*
+The data matrix as seen by the samplers when computing X'y, X'X and X*beta.
+Columns [0, nDense) are the dense data matrix (outcomes, fixed predictors and any non-genotype predictor);
+columns [nDense, nDense+nPacked) are genotypes (values 0/1/2) packed on 2 bits, four observations per byte,
+i.e. 32 times smaller than doubles. The column index vectors in SUR_Data address both transparently.
+With no packed columns every operation falls back to exactly the dense armadillo expression used before.
+*/
+
+class PredictorMatrix {
+
+    public:
+
+        explicit PredictorMatrix( std::shared_ptr<arma::mat> dense_ );
+
+        // dense_ keeps the dense columns, the columns genotypeIdx of data are packed and get the indexes dense_->n_cols, dense_->n_cols+1, ...
+        PredictorMatrix( std::shared_ptr<arma::mat> dense_ , const arma::mat& data , const arma::uvec& genotypeIdx );
+
+        PredictorMatrix( const PredictorMatrix& ) = delete;
+        PredictorMatrix& operator=( const PredictorMatrix& ) = delete;
+
+        // true if all the values are 0, 1 or 2 (no missing values), i.e. the columns can be packed
+        static bool isGenotype( const arma::mat& data , const arma::uvec& columnsIdx );
+
+        // X( : , idx ) as a dense matrix, meant for small selections
+        arma::mat cols( const arma::uvec& idx ) const;
+
+        // X( : , idx )' * Y
+        arma::mat crossprod( const arma::uvec& idx , const arma::mat& Y ) const;
+
+        // X( : , idx ) * B
+        arma::mat times( const arma::uvec& idx , const arma::mat& B ) const;
+
+        // X( : , idxI )' * X( : , idxJ )
+        arma::mat gram( const arma::uvec& idxI , const arma::uvec& idxJ ) const;
+
+        // correlation between the columns idxI and the columns idxJ (as arma::cor)
+        arma::mat cor( const arma::uvec& idxI , const arma::uvec& idxJ ) const;
+
+        unsigned int getNPacked() const;
+
+    private:
+
+        bool allDense( const arma::uvec& idx ) const;
+
+        const uint8_t* packedCol( const unsigned int j ) const;
+        double dotPacked( const unsigned int j , const double* y ) const;
+        double dotPacked( const unsigned int i , const unsigned int j ) const;
+        void axpyPacked( const unsigned int j , const double a , double* y ) const;
+
+        std::shared_ptr<arma::mat> dense;
+        unsigned int nObservations, nDense, nPacked, bytesPerColumn;
+
+        std::vector<uint8_t> packed; // column-major, observation i of a column in bits 2*(i%4) of byte i/4
+        arma::vec packedSum, packedSumSq; // per column, for the correlations
+
+};
+
+#endif
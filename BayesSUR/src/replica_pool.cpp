@@ -0,0 +1,423 @@
+#include "replica_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+    #include <atomic>
+    #include <cerrno>
+    #include <csignal>
+    #include <ctime>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/prctl.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+    #define REPLICA_POOL_AVAILABLE
+#endif
+
+#ifdef REPLICA_POOL_AVAILABLE
+
+namespace
+{
+    const long workerCheckInterval = 100000000; // ns, how often rank 0 looks for dead workers while it waits at the barrier
+    const std::size_t transferCapacity = 1 << 24; // bytes per chunk of sendToRoot, only the pages it touches are ever allocated
+}
+
+// a counting barrier on a robust mutex and a condition variable rather than a pthread barrier,
+// as the latter can neither be woken up when a process fails nor waited on with a timeout
+struct ReplicaPool::Shared
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    unsigned int nWaiting;
+    unsigned long long generation; // completed barriers
+    bool closed;
+
+    std::atomic<int> failed; // only the first failure writes its message
+    char failure[256];
+
+    int moveAccepted;
+    double moveTemperatures[2];
+
+    std::size_t transferSize; // of the whole data being sent to rank 0
+};
+
+#else
+
+struct ReplicaPool::Shared { };
+
+#endif
+
+ReplicaPool::ReplicaPool():
+shared(nullptr), logLikelihoods(nullptr), transferBuffer(nullptr), mapSize(0), rank(0), size(1), nChains(0)
+{ }
+
+ReplicaPool::~ReplicaPool()
+{
+    if( rank == 0 )
+        stop();
+}
+
+bool ReplicaPool::isAvailable()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ReplicaPool::start( const unsigned int nProcesses , const unsigned int nChains_ )
+{
+    if( isActive() )
+        throw Replica_Pool_Error( "the pool is already started" );
+
+    nChains = nChains_;
+
+    if( nProcesses <= 1 )
+        return;
+
+#ifdef REPLICA_POOL_AVAILABLE
+
+    std::size_t headSize = ( ( sizeof(Shared) + sizeof(double) - 1 ) / sizeof(double) ) * sizeof(double);
+    mapSize = headSize + nChains * sizeof(double) + transferCapacity;
+
+    void* map = mmap( nullptr , mapSize , PROT_READ | PROT_WRITE , MAP_SHARED | MAP_ANONYMOUS , -1 , 0 );
+    if( map == MAP_FAILED )
+        throw Replica_Pool_Error( "cannot map the shared memory" );
+
+    shared = new(map) Shared;
+    logLikelihoods = reinterpret_cast<double*>( static_cast<char*>(map) + headSize );
+    transferBuffer = static_cast<char*>(map) + headSize + nChains * sizeof(double);
+
+    shared->nWaiting = 0;
+    shared->generation = 0;
+    shared->closed = false;
+    shared->failed = 0;
+    shared->failure[0] = '\0';
+    shared->moveAccepted = 0;
+    shared->transferSize = 0;
+
+    pthread_mutexattr_t mutexAttributes;
+    pthread_mutexattr_init( &mutexAttributes );
+    pthread_mutexattr_setpshared( &mutexAttributes , PTHREAD_PROCESS_SHARED );
+    pthread_mutexattr_setrobust( &mutexAttributes , PTHREAD_MUTEX_ROBUST ); // a process killed while holding it does not block the others
+    int status = pthread_mutex_init( &shared->mutex , &mutexAttributes );
+    pthread_mutexattr_destroy( &mutexAttributes );
+
+    pthread_condattr_t conditionAttributes;
+    pthread_condattr_init( &conditionAttributes );
+    pthread_condattr_setpshared( &conditionAttributes , PTHREAD_PROCESS_SHARED );
+    pthread_condattr_setclock( &conditionAttributes , CLOCK_MONOTONIC );
+    if( status == 0 )
+        status = pthread_cond_init( &shared->condition , &conditionAttributes );
+    pthread_condattr_destroy( &conditionAttributes );
+
+    if( status != 0 )
+    {
+        munmap( map , mapSize );
+        shared = nullptr;
+        throw Replica_Pool_Error( "cannot initialise the process-shared barrier" );
+    }
+
+    pid_t parent = getpid();
+
+    for( unsigned int r=1; r<nProcesses; ++r )
+    {
+        pid_t pid = fork();
+
+        if( pid == 0 ) // worker
+        {
+            prctl( PR_SET_PDEATHSIG , SIGKILL ); // don't outlive rank 0 ...
+            if( getppid() != parent ) // ... even if it died before the line above
+                _exit(1);
+
+            rank = r;
+            size = nProcesses;
+            workers.clear();
+            return;
+        }
+
+        if( pid < 0 ) // the ones already forked are waiting at the barrier, stop() lets them go
+        {
+            abandon( "cannot start the worker processes" );
+            stop();
+            throw Replica_Pool_Error( "cannot start the worker processes" );
+        }
+
+        workers.push_back( pid );
+    }
+
+    size = nProcesses;
+
+#else
+
+    throw Replica_Pool_Error( "multi-process runs are only available on Linux" );
+
+#endif
+}
+
+void ReplicaPool::stop()
+{
+    if( !shared || rank != 0 )
+        return;
+
+#ifdef REPLICA_POOL_AVAILABLE
+
+    lock();
+    close();
+    unlock();
+
+    for( auto w : workers )
+        if( w > 0 )
+            waitpid( w , nullptr , 0 );
+    workers.clear();
+
+    pthread_cond_destroy( &shared->condition );
+    pthread_mutex_destroy( &shared->mutex );
+    munmap( shared , mapSize );
+    shared = nullptr;
+    logLikelihoods = nullptr;
+    transferBuffer = nullptr;
+
+#endif
+
+    size = 1;
+}
+
+void ReplicaPool::barrier()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+
+    lock();
+
+    if( !shared->closed && ++shared->nWaiting == size )
+    {
+        shared->nWaiting = 0;
+        ++shared->generation;
+        pthread_cond_broadcast( &shared->condition );
+        unlock();
+        return;
+    }
+
+    unsigned long long generation = shared->generation;
+
+    while( !shared->closed && shared->generation == generation )
+    {
+        if( rank == 0 )
+        {
+            timespec deadline;
+            clock_gettime( CLOCK_MONOTONIC , &deadline );
+            deadline.tv_nsec += workerCheckInterval;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+
+            int status = pthread_cond_timedwait( &shared->condition , &shared->mutex , &deadline );
+            if( status == EOWNERDEAD )
+                pthread_mutex_consistent( &shared->mutex );
+            else if( status == ETIMEDOUT )
+                checkWorkers();
+        }
+        else
+        {
+            if( pthread_cond_wait( &shared->condition , &shared->mutex ) == EOWNERDEAD )
+                pthread_mutex_consistent( &shared->mutex );
+        }
+    }
+
+    bool passed = ( shared->generation != generation );
+    unlock();
+
+    if( !passed )
+        throw Replica_Pool_Error( hasFailed() ? getFailure() : "the pool is stopped" );
+
+#endif
+}
+
+void ReplicaPool::abandon( const std::string& message )
+{
+    setFailed( message );
+
+#ifdef REPLICA_POOL_AVAILABLE
+    if( shared )
+    {
+        lock();
+        close();
+        unlock();
+    }
+#endif
+}
+
+void ReplicaPool::exitWorker()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    _exit( hasFailed() ? 1 : 0 );
+#else
+    std::abort();
+#endif
+}
+
+void ReplicaPool::lock()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    if( pthread_mutex_lock( &shared->mutex ) == EOWNERDEAD )
+        pthread_mutex_consistent( &shared->mutex );
+#endif
+}
+
+void ReplicaPool::unlock()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    pthread_mutex_unlock( &shared->mutex );
+#endif
+}
+
+void ReplicaPool::close()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    shared->closed = true;
+    pthread_cond_broadcast( &shared->condition );
+#endif
+}
+
+void ReplicaPool::checkWorkers()
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    for( unsigned int w=0; w<workers.size(); ++w )
+    {
+        int status;
+        if( workers[w] <= 0 || waitpid( workers[w] , &status , WNOHANG ) != workers[w] )
+            continue;
+
+        workers[w] = 0; // reaped already
+
+        // no-op if the worker recorded its own failure before exiting
+        std::string process = "process " + std::to_string( w+1 );
+        if( WIFSIGNALED( status ) )
+            setFailure( process + " was killed by signal " + std::to_string( WTERMSIG( status ) ) );
+        else
+            setFailure( process + " exited with status " + std::to_string( WEXITSTATUS( status ) ) );
+
+        close();
+        return;
+    }
+#endif
+}
+
+bool ReplicaPool::isClosed() const
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    return shared && shared->closed;
+#else
+    return false;
+#endif
+}
+
+void ReplicaPool::setLogLikelihood( const unsigned int chainIdx , const double logLikelihood )
+{
+    logLikelihoods[chainIdx] = logLikelihood;
+}
+
+double ReplicaPool::getLogLikelihood( const unsigned int chainIdx ) const
+{
+    return logLikelihoods[chainIdx];
+}
+
+void ReplicaPool::setMoveResult( const int accepted , const double thisTemperature , const double thatTemperature )
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    shared->moveAccepted = accepted;
+    shared->moveTemperatures[0] = thisTemperature;
+    shared->moveTemperatures[1] = thatTemperature;
+#else
+    (void)accepted; (void)thisTemperature; (void)thatTemperature;
+#endif
+}
+
+int ReplicaPool::getMoveResult( double& thisTemperature , double& thatTemperature ) const
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    thisTemperature = shared->moveTemperatures[0];
+    thatTemperature = shared->moveTemperatures[1];
+    return shared->moveAccepted;
+#else
+    (void)thisTemperature; (void)thatTemperature;
+    return 0;
+#endif
+}
+
+void ReplicaPool::sendToRoot( const unsigned int from , std::string& data )
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    if( from == 0 )
+        return;
+
+    std::size_t offset = 0;
+    do
+    {
+        // the sender fills the buffer ...
+        collective( [&](){
+            if( rank != from )
+                return;
+
+            shared->transferSize = data.size();
+            std::memcpy( transferBuffer , data.data() + offset , std::min( transferCapacity , data.size() - offset ) );
+        } );
+
+        // ... and it is not written again before rank 0 is done with it
+        collective( [&](){
+            if( rank != 0 )
+                return;
+
+            data.resize( shared->transferSize );
+            std::memcpy( &data[offset] , transferBuffer , std::min( transferCapacity , data.size() - offset ) );
+        } );
+
+        offset += transferCapacity;
+    }
+    while( offset < shared->transferSize );
+#else
+    (void)from; (void)data;
+#endif
+}
+
+void ReplicaPool::setFailed( const std::string& message )
+{
+    setFailure( "process " + std::to_string( rank ) + ": " + message );
+}
+
+void ReplicaPool::setFailure( const std::string& failure )
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    int expected = 0;
+    if( shared && shared->failed.compare_exchange_strong( expected , 1 ) )
+    {
+        std::strncpy( shared->failure , failure.c_str() , sizeof(shared->failure) - 1 );
+        shared->failure[sizeof(shared->failure) - 1] = '\0';
+    }
+#else
+    (void)failure;
+#endif
+}
+
+bool ReplicaPool::hasFailed() const
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    return shared && shared->failed != 0;
+#else
+    return false;
+#endif
+}
+
+std::string ReplicaPool::getFailure() const
+{
+#ifdef REPLICA_POOL_AVAILABLE
+    return std::string( shared->failure );
+#else
+    return std::string();
+#endif
+}
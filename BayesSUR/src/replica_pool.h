@@ -0,0 +1,160 @@
+#ifndef REPLICA_POOL_H
+#define REPLICA_POOL_H
+
+#include <string>
+#include <vector>
+#include <exception>
+
+/*
+Local message layer to run the chains of an ESS_Sampler in several processes of the same machine.
+start() forks the workers, after which every process (rank 0 being the caller) owns the chains c with c % size == rank.
+The processes share one anonymous memory map holding a barrier, the result of the last chain-level global move and
+one slot per chain for its untempered log-likelihood, which is all that a replica exchange needs to be decided: every
+process reads the whole table after the barrier and takes the same decisions, as they all hold a copy of the same global
+stream, so the temperatures are never sent around either. Chain states never move: the chains' own global moves only
+pair chains of the same process, and rank 0 receives the outputs of the cold chain through the map (see sendToRoot).
+
+The workers run serve(), one step per barrier, until rank 0 calls stop(). A failure anywhere (an exception in any
+process, or a worker that died) closes the pool: the barrier then throws Replica_Pool_Error in every process still
+waiting on it, rank 0 reports the first failure and the workers exit.
+Process-shared barriers are Linux only, elsewhere isAvailable() is false and the sampler stays in a single process.
+*/
+
+class Replica_Pool_Error : public std::exception
+{
+    public:
+        Replica_Pool_Error( const std::string& message_ ): message( "Replica pool: " + message_ ) {}
+
+        const char * what () const throw ()
+        {
+            return message.c_str();
+        }
+
+    private:
+        std::string message;
+};
+
+
+class ReplicaPool {
+
+    public:
+
+        ReplicaPool();
+        ~ReplicaPool(); // stops the workers, from rank 0
+
+        ReplicaPool( const ReplicaPool& ) = delete;
+        ReplicaPool& operator=( const ReplicaPool& ) = delete;
+
+        static bool isAvailable();
+
+        // forks nProcesses-1 workers, returns in all of them (see getRank())
+        void start( const unsigned int nProcesses , const unsigned int nChains );
+
+        // rank 0: closes the pool and waits for the workers to exit
+        void stop();
+
+        bool isActive() const { return size > 1; }
+        unsigned int getRank() const { return rank; }
+        unsigned int getSize() const { return size; }
+        unsigned int owner( const unsigned int chainIdx ) const { return chainIdx % size; }
+        bool owns( const unsigned int chainIdx ) const { return owner( chainIdx ) == rank; }
+
+        // waits for all the processes, throws once the pool is closed
+        void barrier();
+
+        // records the failure (unless one is already recorded) and closes the pool
+        void abandon( const std::string& message );
+
+        // exit code 1 if the pool failed, without destructors nor atexit handlers, they belong to the parent process
+        [[noreturn]] void exitWorker();
+
+        // runs task in every process, then fails in all of them if it failed in any (the failure is only seen after the barrier);
+        // with no workers it is just task()
+        template<typename F> void collective( F task )
+        {
+            if( !isActive() )
+            {
+                task();
+                return;
+            }
+
+            try
+            {
+                task();
+            }
+            catch( const std::exception& e )
+            {
+                setFailed( e.what() );
+            }
+            catch( ... )
+            {
+                setFailed( "unknown exception" );
+            }
+            barrier();
+
+            if( hasFailed() )
+                throw Replica_Pool_Error( getFailure() );
+        }
+
+        // workers: runs step after each barrier of rank 0 until the pool is closed, then exits the process whatever happens
+        template<typename F> [[noreturn]] void serve( F step )
+        {
+            try
+            {
+                for(;;)
+                {
+                    barrier();
+                    step();
+                }
+            }
+            catch( const std::exception& e )
+            {
+                if( !isClosed() || hasFailed() ) // else rank 0 stopped the pool
+                    abandon( e.what() );
+            }
+            catch( ... )
+            {
+                abandon( "unknown exception" );
+            }
+
+            exitWorker();
+        }
+
+        void setLogLikelihood( const unsigned int chainIdx , const double logLikelihood );
+        double getLogLikelihood( const unsigned int chainIdx ) const;
+
+        // outcome of a chain-level global move, published by the process that ran it:
+        // whether it was accepted and the temperatures of the two chains after it
+        void setMoveResult( const int accepted , const double thisTemperature , const double thatTemperature );
+        int getMoveResult( double& thisTemperature , double& thatTemperature ) const;
+
+        // collective: data, as held by process from, ends up in rank 0 (in chunks through the map, two barriers each);
+        // no-op if from is 0
+        void sendToRoot( const unsigned int from , std::string& data );
+
+    private:
+
+        struct Shared; // head of the shared map, defined with the system headers
+
+        void setFailed( const std::string& message ); // prefixed with the rank
+        void setFailure( const std::string& failure );
+        bool hasFailed() const;
+        std::string getFailure() const;
+        bool isClosed() const;
+
+        void lock();
+        void unlock();
+        void close(); // with the lock held
+        void checkWorkers(); // rank 0, with the lock held: closes the pool if a worker is gone
+
+        Shared* shared;
+        double* logLikelihoods; // one slot per chain, right after the head
+        char* transferBuffer; // then the chunks of sendToRoot
+        std::size_t mapSize;
+
+        unsigned int rank, size, nChains;
+        std::vector<int> workers; // process ids by rank-1, on rank 0 (0 once reaped)
+
+};
+
+#endif
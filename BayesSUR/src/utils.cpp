@@ -1,4 +1,18 @@
 #include "utils.h"
+#include "distr.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
 
 #ifndef CCODE
 	using Rcpp::Rcout;
@@ -10,33 +24,288 @@
 
 namespace Utils{
 
-	bool readData(const std::string& dataFileName, std::shared_ptr<arma::mat> data)
+	namespace
 	{
+		const char binaryDataMagic[8] = { 'B','S','U','R','D','A','T','1' };
+		const size_t binaryDataHeaderSize = sizeof(binaryDataMagic) + 2*sizeof(uint64_t);
 
-		bool status = data->load(dataFileName,arma::raw_ascii);
-		if( !status )
+		const size_t textChunkSize = 1 << 24; // 16MB of text per chunk
+
+		inline bool isFieldSeparator( const char c )
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		// number of whitespace-separated fields in [begin,end)
+		unsigned int countFields( const char* begin , const char* end )
+		{
+			unsigned int nFields = 0;
+			bool inField = false;
+
+			for( const char* p = begin; p < end; ++p )
+			{
+				if( isFieldSeparator( *p ) )
+					inField = false;
+				else if( !inField )
+				{
+					inField = true;
+					++nFields;
+				}
+			}
+
+			return nFields;
+		}
+
+		// parses the whitespace-separated fields of [begin,end) into out[0], out[stride], ... and returns their number;
+		// stops at maxFields+1 and returns maxFields+1 on a non-numeric field, so any return other than maxFields is an error.
+		// the text after end must be a separator, a newline or a '\0' so that strtod cannot run past the field
+		unsigned int parseLine( const char* begin , const char* end , double* out , const unsigned int stride , const unsigned int maxFields )
+		{
+			unsigned int nFields = 0;
+			const char* p = begin;
+
+			while( true )
+			{
+				while( p < end && isFieldSeparator( *p ) )
+					++p;
+				if( p >= end )
+					break;
+
+				if( nFields == maxFields )
+					return maxFields + 1;
+
+				const char* fieldEnd = p;
+				while( fieldEnd < end && !isFieldSeparator( *fieldEnd ) )
+					++fieldEnd;
+
+				if( fieldEnd - p == 2 && p[0] == 'N' && p[1] == 'A' )
+				{
+					out[ (size_t)nFields * stride ] = std::numeric_limits<double>::quiet_NaN();
+				}else{
+					char* parsedEnd;
+					out[ (size_t)nFields * stride ] = std::strtod( p , &parsedEnd );
+					if( parsedEnd != fieldEnd )
+						return maxFields + 1;
+				}
+
+				++nFields;
+				p = fieldEnd;
+			}
+
+			return nFields;
+		}
+	}
+
+	bool readTextMatrix(const std::string& fileName, arma::mat& matrix, const unsigned int expectedCols)
+	{
+		std::ifstream in( fileName , std::ios::in | std::ios::binary );
+		if( !in )
 			throw badFile();
 
-		return status;
+		std::vector<char> buffer( textChunkSize + 1 );
+
+		// whole lines by chunks, each chunk's lines parsed in parallel into that chunk's own row-major values,
+		// as the number of rows (hence the layout of matrix) is only known at the end of the file
+		std::vector< std::vector<double> > chunkValues;
+		unsigned long long nRows = 0, lineNumber = 0;
+		unsigned int nCols = 0;
+		size_t carry = 0; // bytes of an incomplete line moved to the front of the buffer
+		std::vector<const char*> lineBegin, lineEnd;
+		std::vector<unsigned long long> lineNumbers;
+
+		while( carry > 0 || in )
+		{
+			if( carry == buffer.size() - 1 )
+				buffer.resize( 2 * buffer.size() ); // a single line longer than the buffer
+
+			in.read( buffer.data() + carry , buffer.size() - 1 - carry );
+			size_t nBytes = carry + in.gcount();
+			bool lastChunk = !in;
+
+			if( nBytes == 0 )
+				break;
+
+			// the chunk ends at its last newline, unless the file ends here
+			size_t chunkEnd = nBytes;
+			if( !lastChunk )
+			{
+				while( chunkEnd > 0 && buffer[chunkEnd-1] != '\n' )
+					--chunkEnd;
+				if( chunkEnd == 0 )
+				{
+					carry = nBytes;
+					continue;
+				}
+			}
+			buffer[nBytes] = '\0';
+
+			lineBegin.clear(); lineEnd.clear(); lineNumbers.clear();
+			const char* p = buffer.data();
+			const char* end = buffer.data() + chunkEnd;
+			while( p < end )
+			{
+				const char* eol = static_cast<const char*>( std::memchr( p , '\n' , end - p ) );
+				if( eol == nullptr )
+					eol = end;
+
+				++lineNumber;
+				const char* q = p;
+				while( q < eol && isFieldSeparator( *q ) )
+					++q;
+				if( q < eol )
+				{
+					lineBegin.push_back( p );
+					lineEnd.push_back( eol );
+					lineNumbers.push_back( lineNumber );
+				}
+
+				p = eol + 1;
+			}
+
+			long long nLines = lineBegin.size();
+			if( nLines > 0 )
+			{
+				// the first line sets the number of columns, so a wrong one fails before anything else is parsed
+				if( nCols == 0 )
+				{
+					nCols = countFields( lineBegin[0] , lineEnd[0] );
+					if( expectedCols > 0 && nCols != expectedCols )
+						throw badDataLine( fileName , lineNumbers[0] , expectedCols );
+				}
+
+				chunkValues.emplace_back( (size_t)nLines * nCols );
+				double* values = chunkValues.back().data();
+				long long firstBadLine = nLines;
+
+				#ifdef _OPENMP
+				#pragma omp parallel for schedule(static) reduction(min:firstBadLine)
+				#endif
+				for( long long l=0; l<nLines; ++l )
+				{
+					if( parseLine( lineBegin[l] , lineEnd[l] , values + (size_t)l * nCols , 1 , nCols ) != nCols )
+						firstBadLine = std::min( firstBadLine , l );
+				}
+
+				// fail at the first malformed line, without going through the rest of the file
+				if( firstBadLine < nLines )
+					throw badDataLine( fileName , lineNumbers[firstBadLine] , nCols );
+
+				nRows += nLines;
+			}
+
+			carry = nBytes - chunkEnd;
+			std::memmove( buffer.data() , buffer.data() + chunkEnd , carry );
+
+			if( lastChunk )
+				break;
+		}
+
+		if( nRows == 0 )
+			throw badFile();
+
+		// assemble, releasing each chunk once copied
+		matrix.set_size( nRows , nCols );
+
+		unsigned long long row = 0;
+		for( auto& values : chunkValues )
+		{
+			const unsigned long long nChunkRows = values.size() / nCols;
+
+			#ifdef _OPENMP
+			#pragma omp parallel for schedule(static)
+			#endif
+			for( long long j=0; j<(long long)nCols; ++j )
+			{
+				double* column = matrix.colptr(j) + row;
+				for( unsigned long long l=0; l<nChunkRows; ++l )
+					column[l] = values[ l * nCols + j ];
+			}
+
+			row += nChunkRows;
+			std::vector<double>().swap( values );
+		}
+
+		return true;
+	}
+
+	bool readData(const std::string& dataFileName, std::shared_ptr<arma::mat>& data, const unsigned int expectedCols)
+	{
+		char magic[sizeof(binaryDataMagic)] = {};
+		std::ifstream( dataFileName , std::ios::in | std::ios::binary ).read( magic , sizeof(magic) );
+
+		if( std::memcmp( magic , binaryDataMagic , sizeof(magic) ) == 0 )
+			return readBinaryData( dataFileName , data , expectedCols );
+
+		return readTextMatrix( dataFileName , *data , expectedCols );
+	}
+
+	bool readBinaryData(const std::string& dataFileName, std::shared_ptr<arma::mat>& data, const unsigned int expectedCols)
+	{
+		std::ifstream in( dataFileName , std::ios::in | std::ios::binary );
+
+		char magic[sizeof(binaryDataMagic)];
+		uint64_t nRows, nCols;
+		in.read( magic , sizeof(magic) );
+		in.read( reinterpret_cast<char*>( &nRows ) , sizeof(nRows) );
+		in.read( reinterpret_cast<char*>( &nCols ) , sizeof(nCols) );
+
+		if( !in || std::memcmp( magic , binaryDataMagic , sizeof(magic) ) != 0 )
+			throw badFile();
+
+		if( expectedCols > 0 && nCols != expectedCols )
+			throw badBlocks();
+
+		const size_t fileSize = binaryDataHeaderSize + nRows * nCols * sizeof(double);
+
+		in.seekg( 0 , std::ios::end );
+		if( (size_t)in.tellg() < fileSize )
+			throw badFile(); // truncated
+
+#ifndef _WIN32
+		in.close();
+
+		int fd = open( dataFileName.c_str() , O_RDONLY );
+		if( fd < 0 )
+			throw badFile();
+
+		// private (copy-on-write) mapping: the missing values are overwritten in memory, never in the file
+		void* map = mmap( nullptr , fileSize , PROT_READ | PROT_WRITE , MAP_PRIVATE , fd , 0 );
+		close( fd ); // the mapping holds its own reference to the file
+		if( map == MAP_FAILED )
+			throw badFile();
+
+		double* values = reinterpret_cast<double*>( static_cast<char*>( map ) + binaryDataHeaderSize );
+
+		// the matrix works directly on the mapped pages (strict, so it can never reallocate away from them)
+		// and the mapping goes away with the last user of the data
+		data = std::shared_ptr<arma::mat>( new arma::mat( values , nRows , nCols , false , true ) ,
+			[map,fileSize]( arma::mat* m ){ delete m; munmap( map , fileSize ); } );
+#else
+		// no mmap, read the values in one go (still no parsing)
+		data = std::make_shared<arma::mat>( nRows , nCols );
+		in.seekg( binaryDataHeaderSize , std::ios::beg );
+		in.read( reinterpret_cast<char*>( data->memptr() ) , nRows * nCols * sizeof(double) );
+		if( !in )
+			throw badFile();
+#endif
+
+		return true;
 	}
     
     bool readGmrf(const std::string& mrfGFileName, std::shared_ptr<arma::mat> mrfG)
     {
         
-        bool status = mrfG->load(mrfGFileName,arma::raw_ascii);
-        if( !status )
-            throw badFile();
-
-        return status;
+        return readTextMatrix( mrfGFileName , *mrfG );
         
     }
 
 	bool readGraph(const std::string& graphFileName, arma::umat& graph)
 	{
 
-		bool status = graph.load(graphFileName,arma::raw_ascii);
-		if( !status )
-			throw badFile();
+		arma::mat values;
+		bool status = readTextMatrix( graphFileName , values );
+
+		graph = arma::conv_to<arma::umat>::from( values );
 
 		return status;
 	}
@@ -44,9 +313,10 @@ namespace Utils{
 	bool readBlocks(const std::string& blocksFileName, arma::ivec& blockLabels)
 	{
 
-		bool status = blockLabels.load(blocksFileName,arma::raw_ascii);
-		if( !status )
-			throw badFile();
+		arma::mat values;
+		bool status = readTextMatrix( blocksFileName , values );
+
+		blockLabels = arma::conv_to<arma::ivec>::from( arma::vectorise( values ) );
 
 		// checks on the blockLabels
 		// index 0 stands for the Xs, predictors
@@ -62,21 +332,6 @@ namespace Utils{
 		return status;
 	}
 
-	void removeDisposable(std::shared_ptr<arma::mat> data, arma::ivec& blockLabels)
-	{
-		arma::uword shedIdx;
-		while( arma::any( arma::find(blockLabels < 0)) )
-		{
-			shedIdx = arma::as_scalar(arma::find(blockLabels < 0 , 1 , "first"));
-			
-			// then shed the rest		
-			data->shed_col( shedIdx );
-			blockLabels.shed_row( shedIdx ); //shed the blockIdx as well!
-		}
-		return;
-	}
-
-
 	void getBlockDimensions(const arma::ivec& blockLabels, const arma::umat& structureGraph,
 							const std::shared_ptr<arma::mat>& data, const std::shared_ptr<arma::mat>& mrfG, unsigned int& nObservations,
 							unsigned int& nOutcomes, std::shared_ptr<arma::uvec> outcomeIndexes, 
@@ -143,29 +398,30 @@ namespace Utils{
 		return ux;
 	}	
 
-	void initMissingData(std::shared_ptr<arma::mat> data, std::shared_ptr<arma::umat> missingDataArrayIndexes, std::shared_ptr<arma::uvec> completeCases, bool print )
+	// only the columns in columnsIndexes are used in the analysis, the others are left untouched
+	void initMissingData(std::shared_ptr<arma::mat> data, const arma::uvec& columnsIndexes, std::shared_ptr<arma::umat> missingDataArrayIndexes, std::shared_ptr<arma::uvec> completeCases, bool print )
 	{
 
 		const unsigned int nObservations = data->n_rows;
-		arma::uvec missingDataVecIdx;
+		std::vector<arma::uword> missingRows, missingColumns;
 
 		// Now deal with NANs
-		if( data->has_nan() )
+		for( auto j : columnsIndexes )
 		{
-			missingDataVecIdx = arma::find_nonfinite(*data);
-			(*data)(missingDataVecIdx).fill( arma::datum::nan );  // This makes all the ind values into valid armadillo NANs (should be ok even without, but..)
+			arma::uvec missingInColumn = arma::find_nonfinite( data->col(j) );
+			for( auto i : missingInColumn )
+			{
+				(*data)(i,j) = arma::datum::nan;  // This makes all the ind values into valid armadillo NANs (should be ok even without, but..)
+				missingRows.push_back( i );
+				missingColumns.push_back( j );
+			}
 		}
 
 		// Init the missing data array in a more readable way, i.e. in a row,column format
-		if( missingDataVecIdx.n_elem > 0 )
+		if( missingRows.size() > 0 )
 		{
-			// create an array of indexes with rows and columns
-			(*missingDataArrayIndexes) = arma::umat(missingDataVecIdx.n_elem,2);
-			for( unsigned int j=0, n=missingDataVecIdx.n_elem; j<n; ++j)
-			{
-				(*missingDataArrayIndexes)(j,1) = std::floor( missingDataVecIdx(j) / nObservations ); // this is the corresponding column
-				(*missingDataArrayIndexes)(j,0) = missingDataVecIdx(j) - (*missingDataArrayIndexes)(j,1) * nObservations; // this is the row
-			}
+			// create an array of indexes with rows and (data) columns
+			(*missingDataArrayIndexes) = arma::join_horiz( arma::uvec( missingRows ) , arma::uvec( missingColumns ) );
 			(*completeCases) = Utils::arma_setdiff_idx( arma::regspace<arma::uvec>(0, nObservations-1)   , missingDataArrayIndexes->col(0) );
 		
 		}else{
@@ -176,7 +432,7 @@ namespace Utils{
 
 		if( print )
 		{
-			Rcout << 100. * missingDataVecIdx.n_elem/(double)(nObservations*data->n_cols) <<"% of missing data.." << '\n';
+			Rcout << 100. * missingRows.size()/(double)(nObservations*columnsIndexes.n_elem) <<"% of missing data.." << '\n';
 			Rcout << 100. * completeCases->n_elem/(double)(nObservations) <<"% of Complete cases" << '\n';
 		}
 
@@ -193,25 +449,68 @@ namespace Utils{
 	}
 */
 
+	// if all the predictors to select are genotypes (0/1/2, e.g. SNPs) they move to 2-bit storage:
+	// the dense data keeps only the outcomes and the fixed predictors, and the indexes are remapped accordingly
+	void packGenotypes( SUR_Data& surData )
+	{
+		if( !PredictorMatrix::isGenotype( *surData.data , *surData.VSPredictorsIdx ) )
+		{
+			surData.predictors = std::make_shared<PredictorMatrix>( surData.data );
+			return;
+		}
+
+		arma::uvec denseIdx = arma::join_vert( *surData.outcomesIdx , *surData.fixedPredictorsIdx );
+		std::shared_ptr<arma::mat> dense = std::make_shared<arma::mat>( surData.data->cols( denseIdx ) );
+
+		surData.predictors = std::make_shared<PredictorMatrix>( dense , *surData.data , *surData.VSPredictorsIdx );
+
+		Rcout << "The " << surData.VSPredictorsIdx->n_elem << " predictors to select are genotypes (0/1/2), they are stored packed on 2 bits" << '\n';
+
+		// old column -> new column, for the missing values (which can only be in the dense columns)
+		for( unsigned int j=0; j<surData.missingDataArrayIdx->n_rows; ++j )
+			(*surData.missingDataArrayIdx)(j,1) = arma::as_scalar( arma::find( denseIdx == (*surData.missingDataArrayIdx)(j,1) , 1 ) );
+
+		auto consecutive = []( arma::uword start , arma::uword n )
+		{
+			arma::uvec idx(n);
+			for( arma::uword i=0; i<n; ++i )
+				idx(i) = start + i;
+			return idx;
+		};
+
+		(*surData.outcomesIdx) = consecutive( 0 , surData.nOutcomes );
+		(*surData.fixedPredictorsIdx) = consecutive( surData.nOutcomes , surData.nFixedPredictors );
+		(*surData.VSPredictorsIdx) = consecutive( dense->n_cols , surData.nVSPredictors );
+
+		surData.data = dense; // the full matrix (or its mapping) goes away here
+	}
+
 	void formatData( const std::string& dataFileName, const std::string& mrfGFileName, const std::string& blockFileName, const std::string& structureGraphFileName,  SUR_Data& surData )
 	{
-		
-		bool status = readData(dataFileName,surData.data);
-		status = status && readGmrf(mrfGFileName,surData.mrfG);
-		status = status && readBlocks(blockFileName,surData.blockLabels);
+		// the small files first, so that the (possibly huge) data file is checked against the block labels
+		// while it's read and a mismatch is reported before parsing the rest of it
+		bool status = readBlocks(blockFileName,surData.blockLabels);
 		status = status && readGraph(structureGraphFileName,surData.structureGraph);
+		status = status && readData(dataFileName,surData.data,surData.blockLabels.n_elem);
+		status = status && readGmrf(mrfGFileName,surData.mrfG);
 
 		if( !status )
 			throw badRead();
-		
-		removeDisposable(surData.data,surData.blockLabels); // variables indexed by negative indexes are deemed unnecessary by the user, remove them
 
+		if( surData.blockLabels.n_elem != surData.data->n_cols )
+			throw badBlocks();
+		
+		// variables indexed by negative labels are deemed unnecessary by the user: they stay in the data
+		// (no copy of a possibly huge matrix) but none of the indexes below points to them
 
 		getBlockDimensions( surData.blockLabels, surData.structureGraph, surData.data, surData.mrfG, surData.nObservations,
 							surData.nOutcomes, surData.outcomesIdx, surData.nPredictors, surData.nVSPredictors, surData.nFixedPredictors,
 							surData.VSPredictorsIdx, surData.fixedPredictorsIdx);
 
-		initMissingData( surData.data, surData.missingDataArrayIdx, surData.completeCases, false );
+		initMissingData( surData.data, arma::join_vert( *surData.outcomesIdx , arma::join_vert( *surData.VSPredictorsIdx , *surData.fixedPredictorsIdx ) ),
+							surData.missingDataArrayIdx, surData.completeCases, false );
+
+		packGenotypes( surData );
 
 		//standardiseData( surData.data, surData.outcomesIdx, surData.VSPredictorsIdx, surData.fixedPredictorsIdx );
 
@@ -337,6 +636,211 @@ namespace Utils{
     	return std::max(a, b) + std::log( (double)(1. + std::exp( (double)-std::abs((double)(a - b)) )));
 	}
 
+	bool cholAppend( arma::mat& R, const arma::vec& crossProd, double diag )
+	{
+		unsigned int m = R.n_rows;
+		arma::vec r;
+		double newDiag = diag;
+
+		if( m > 0 )
+		{
+			r = arma::solve( arma::trimatl( R.t() ) , crossProd );
+			newDiag -= arma::dot( r , r );
+		}
+
+		if( !( newDiag > 0. ) )
+			return false;
+
+		R.resize( m+1 , m+1 ); // preserves the old factor, new elements are zero
+		if( m > 0 )
+			R( arma::span(0,m-1) , m ) = r;
+		R(m,m) = std::sqrt( newDiag );
+
+		return true;
+	}
+
+	void cholRemove( arma::mat& R, unsigned int i )
+	{
+		unsigned int m = R.n_rows;
+		double c, s, t, x, y;
+
+		R.shed_col( i ); // R is now upper Hessenberg from column i onwards
+
+		for( unsigned int j=i; j<m-1; ++j )
+		{
+			t = std::hypot( R(j,j) , R(j+1,j) );
+			c = R(j,j) / t;
+			s = R(j+1,j) / t;
+
+			for( unsigned int l=j; l<m-1; ++l )
+			{
+				x = R(j,l); y = R(j+1,l);
+				R(j,l) = c*x + s*y;
+				R(j+1,l) = -s*x + c*y;
+			}
+		}
+
+		R.shed_row( m-1 );
+	}
+
+	void SumTree::build( const arma::vec& weights )
+	{
+		n = weights.n_elem;
+		cap = 1;
+		while( cap < n )
+			cap <<= 1;
+
+		tree = arma::zeros<arma::vec>( 2*cap );
+		if( n > 0 )
+			tree.subvec( cap , cap+n-1 ) = weights;
+
+		for( unsigned int i=cap-1; i>0; --i )
+			tree(i) = tree(2*i) + tree(2*i+1);
+	}
+
+	void SumTree::update( unsigned int i, double weight )
+	{
+		i += cap;
+		tree(i) = weight;
+
+		for( i>>=1 ; i>0; i>>=1 )
+			tree(i) = tree(2*i) + tree(2*i+1);
+	}
+
+	unsigned int SumTree::find( double u ) const
+	{
+		unsigned int i = 1;
+		while( i < cap )
+		{
+			// go right only if there's mass there, guards against round-off on u close to sum()
+			if( u < tree(2*i) || tree(2*i+1) <= 0. )
+				i = 2*i;
+			else
+			{
+				u -= tree(2*i);
+				i = 2*i+1;
+			}
+		}
+		return i - cap;
+	}
+
+	unsigned int SumTree::sample() const
+	{
+		return find( randU01() * sum() );
+	}
+
+	double SumTree::sampleWithoutReplacement( unsigned int m, arma::uvec& indexes )
+	{
+		indexes = arma::uvec(m);
+		arma::vec sampledWeights(m);
+		double logP = 0.;
+
+		for( unsigned int j=0; j<m; ++j )
+		{
+			double remaining = sum();
+			indexes(j) = sample();
+			sampledWeights(j) = weight( indexes(j) );
+
+			logP += std::log( sampledWeights(j) ) - std::log( remaining );
+			update( indexes(j) , 0. );
+		}
+
+		for( unsigned int j=0; j<m; ++j )
+			update( indexes(j) , sampledWeights(j) );
+
+		return logP;
+	}
+
+	void MRFGraph::build( const arma::mat& mrfG , unsigned int nNodes_ )
+	{
+		nNodes = nNodes_;
+		nodeWeight.ones( nNodes );
+		rowStart.zeros( nNodes + 1 );
+
+		if( mrfG.n_rows > 0 && mrfG.n_cols < 3 )
+			throw badGraph();
+
+		// first pass, degrees
+		for( unsigned int i=0; i<mrfG.n_rows; ++i )
+		{
+			if( mrfG(i,0) < 0 || mrfG(i,1) < 0 || mrfG(i,0) >= nNodes || mrfG(i,1) >= nNodes )
+				throw badGraph();
+
+			unsigned int a = (unsigned int)mrfG(i,0) , b = (unsigned int)mrfG(i,1);
+			if( a == b )
+			{
+				nodeWeight(a) += mrfG(i,2) - 1.;
+			}else{
+				++rowStart(a+1);
+				++rowStart(b+1);
+			}
+		}
+
+		for( unsigned int a=0; a<nNodes; ++a )
+			rowStart(a+1) += rowStart(a);
+
+		// second pass, fill the rows
+		neighbour.set_size( rowStart(nNodes) );
+		edgeWeight.set_size( rowStart(nNodes) );
+		arma::uvec next = rowStart.head( nNodes );
+
+		for( unsigned int i=0; i<mrfG.n_rows; ++i )
+		{
+			unsigned int a = (unsigned int)mrfG(i,0) , b = (unsigned int)mrfG(i,1);
+			if( a != b )
+			{
+				neighbour( next(a) ) = b; edgeWeight( next(a)++ ) = mrfG(i,2);
+				neighbour( next(b) ) = a; edgeWeight( next(b)++ ) = mrfG(i,2);
+			}
+		}
+	}
+
+	double MRFGraph::logP( const arma::umat& gamma , double d , double e ) const
+	{
+		const arma::uword* g = gamma.memptr();
+		double linear = 0. , quad = 0.;
+
+		for( unsigned int a=0; a<nNodes; ++a )
+		{
+			if( g[a] == 0 )
+				continue;
+
+			linear += nodeWeight(a);
+			for( unsigned int r=rowStart(a); r<rowStart(a+1); ++r )
+				quad += edgeWeight(r) * g[ neighbour(r) ];
+		}
+
+		// each edge was seen from both its ends
+		return d * linear + 4. * e * e * 0.5 * quad;
+	}
+
+	double MRFGraph::logPDelta( const arma::umat& gamma , const arma::umat& proposedGamma , const arma::uvec& candidates , double d , double e ) const
+	{
+		const arma::uword* g = gamma.memptr();
+		const arma::uword* p = proposedGamma.memptr();
+		double linear = 0. , quad = 0.;
+
+		for( auto a : arma::unique( candidates ) )
+		{
+			if( g[a] == p[a] )
+				continue;
+
+			double change = (double)p[a] - (double)g[a];
+			linear += change * nodeWeight(a);
+
+			for( unsigned int r=rowStart(a); r<rowStart(a+1); ++r )
+			{
+				unsigned int b = neighbour(r);
+				if( g[b] == p[b] )
+					quad += edgeWeight(r) * change * g[b];
+				else // both ends flipped, this edge is seen again from b
+					quad += 0.5 * edgeWeight(r) * ( (double)( p[a] * p[b] ) - (double)( g[a] * g[b] ) );
+			}
+		}
+
+		return d * linear + 4. * e * e * quad;
+	}
+
 	arma::uvec nonZeroLocations_col( arma::sp_umat X)
 	{
 		std::vector<arma::uword> locations;
@@ -16,6 +16,8 @@
 #include "global.h"
 #include "Parameter_types.h"
 #include "pugixml.hpp"
+#include "gram_cache.h"
+#include "predictor_matrix.h"
 
 namespace Utils{
 
@@ -32,6 +34,9 @@ namespace Utils{
 		std::shared_ptr<arma::umat> missingDataArrayIdx;
 		std::shared_ptr<arma::uvec> completeCases;
 
+		std::shared_ptr<PredictorMatrix> predictors; // the data for the predictor kernels, genotypes packed, set by formatData (chains wrap data if still empty)
+		std::shared_ptr<GramCache> gramCache; // shared between chains, left empty here as it needs the data (chains build their own if still empty)
+
 		SUR_Data() // use this constructor to instanciate all the object at creation (to be sure pointers point to *something*)
 		{
 			data = std::make_shared<arma::mat>();
@@ -84,6 +89,16 @@ namespace Utils{
 		// outputs
 		bool output_gamma, output_beta, output_sigmaRho,
 			output_Gy, output_pi, output_tail, output_model_size, output_CPO, output_model_visit;
+
+        // checkpoint the run every checkpointInterval iterations (0 = never) to outFilePath + "checkpoint.bin",
+        // resume continues the run saved there
+        unsigned int checkpointInterval = 0;
+        bool resume = false;
+
+        // run the chains in this many processes (Linux only, see replica_pool.h)
+        unsigned int nProcesses = 1;
+
+        double xtxMemoryBudget = GramCache::defaultMemoryBudget ; // in MB, X'X is fully precomputed if it fits, otherwise cached by tiles
         
 	};
 
@@ -126,9 +141,36 @@ namespace Utils{
 			return "Unknown error: Something went wrong while reading the files. Check your input.";
 		}
 	};
+
+	class badDataLine : public std::exception
+	{
+		public:
+			badDataLine( const std::string& fileName , unsigned long long lineNumber , unsigned int expectedFields ):
+				message( "Line " + std::to_string( lineNumber ) + " of " + fileName + " does not hold " + std::to_string( expectedFields ) +
+					" numeric values (one per block label), check the data file against the blocks file." ) {}
+
+			const char * what () const throw ()
+			{
+				return message.c_str();
+			}
+
+		private:
+			std::string message;
+	};
 	
 
-	bool readData(const std::string& dataFileName, std::shared_ptr<arma::mat> data);
+	// data files are either plain text (raw ascii) or binary: the 8 bytes "BSURDAT1", the number of rows and of columns (uint64_t)
+	// and then the values column-major (double); binary files are memory-mapped and used in place as the data matrix
+	// if expectedCols > 0 the file must have exactly that many columns, checked before (binary) or while (text) reading the values
+	bool readData(const std::string& dataFileName, std::shared_ptr<arma::mat>& data, const unsigned int expectedCols = 0);
+
+	bool readBinaryData(const std::string& dataFileName, std::shared_ptr<arma::mat>& data, const unsigned int expectedCols = 0);
+
+	// whitespace-separated plain text matrix ("NA" is read as NaN), read once by chunks whose lines are parsed in parallel;
+	// every line must have the same number of fields (expectedCols if > 0, otherwise that of the first line) or badDataLine is thrown
+	// as soon as its chunk is parsed. The values are kept per chunk until the number of rows is known, then copied into matrix
+	// chunk by chunk, so the peak memory is about twice the matrix while assembling
+	bool readTextMatrix(const std::string& fileName, arma::mat& matrix, const unsigned int expectedCols = 0);
     
 	bool readGmrf(const std::string& mrfGFileName, std::shared_ptr<arma::mat> mrfG);
 
@@ -136,8 +178,6 @@ namespace Utils{
 
 	bool readBlocks(const std::string& blocksFileName, arma::ivec& blockLabels);
 
-	void removeDisposable(std::shared_ptr<arma::mat> data, arma::ivec& blockLabels);
-
 	void getBlockDimensions(const arma::ivec& blockLabels, const arma::umat& structureGraph,
 							const std::shared_ptr<arma::mat>& data, const std::shared_ptr<arma::mat>& mrfG, 
 							unsigned int& nObservations,
@@ -148,7 +188,9 @@ namespace Utils{
 	/* Computes the set-difference from two vectors of indexes */
 	arma::uvec arma_setdiff_idx(const arma::uvec& x, const arma::uvec& y);
 
-	void initMissingData(std::shared_ptr<arma::mat> data, std::shared_ptr<arma::umat> missingDataArrayIndexes, std::shared_ptr<arma::uvec> completeCases, bool print=false );
+	void initMissingData(std::shared_ptr<arma::mat> data, const arma::uvec& columnsIndexes, std::shared_ptr<arma::umat> missingDataArrayIndexes, std::shared_ptr<arma::uvec> completeCases, bool print=false );
+
+	void packGenotypes( SUR_Data& surData );
 
 	void formatData(const std::string& dataFileName, const std::string& mrfGFileName, const std::string& blockFileName, const std::string& structureGraphFileName, 
 					SUR_Data& surData );
@@ -174,6 +216,70 @@ namespace Utils{
 	double logspace_add(const arma::vec& logv);
 	double logspace_add(double a,double b);
 
+	// rank-one modifications of an upper triangular Cholesky factor R (R.t()*R = A)
+	// append adds one variable with cross-products crossProd = A_new(old,new) and diagonal value diag, false if A_new is not PD
+	// remove deletes the i-th variable and re-triangularises R through Givens rotations, both are O(m^2)
+	bool cholAppend( arma::mat& R, const arma::vec& crossProd, double diag );
+	void cholRemove( arma::mat& R, unsigned int i );
+
+	// Binary sum tree over non-negative weights: O(log n) single-weight updates and O(log n) draws of an index
+	// with probability proportional to its weight. Internal nodes are recomputed from their children, so no round-off drift.
+	class SumTree
+	{
+		public:
+
+			SumTree(){ n = 0; cap = 0; }
+			SumTree( const arma::vec& weights ){ build( weights ); }
+
+			void build( const arma::vec& weights );
+			void update( unsigned int i, double weight );
+
+			inline double weight( unsigned int i ) const { return tree(cap+i); }
+			inline double sum() const { return ( n > 0 ) ? tree(1) : 0.; }
+			inline unsigned int size() const { return n; }
+
+			unsigned int find( double u ) const; // the i with sum(w[0..i-1]) <= u < sum(w[0..i]), u in [0,sum())
+			unsigned int sample() const;
+
+			// draws m distinct indexes sequentially (each with probability w_i / remaining sum), returns the log-probability of
+			// that ordered sequence; the weights are restored before returning
+			double sampleWithoutReplacement( unsigned int m, arma::uvec& indexes );
+
+		private:
+
+			unsigned int n, cap; // number of leaves, power of two >= n
+			arma::vec tree; // 1-based heap layout, leaves in [cap,cap+n)
+	};
+
+	// The MRF prior graph as a CSR adjacency over the vectorised gamma (node j + k*nVSPredictors), built once from the
+	// (node, node, weight) rows of mrfG. Self-loops fold into a per-node weight, every other row is stored at both its ends,
+	// so the log-prior is a sum over the active nodes and a flip only touches the edges incident to the flipped entries
+	class MRFGraph
+	{
+		public:
+
+			MRFGraph(){ nNodes = 0; }
+			MRFGraph( const arma::mat& mrfG , unsigned int nNodes_ ){ build( mrfG , nNodes_ ); }
+
+			void build( const arma::mat& mrfG , unsigned int nNodes_ );
+
+			// d * sum_a gamma_a * nodeWeight_a + (2e)^2 * sum_edges w_ab * gamma_a * gamma_b
+			double logP( const arma::umat& gamma , double d , double e ) const;
+
+			// logP( proposedGamma ) - logP( gamma ), where the two differ at most at the nodes listed in candidates
+			double logPDelta( const arma::umat& gamma , const arma::umat& proposedGamma , const arma::uvec& candidates , double d , double e ) const;
+
+			inline unsigned int size() const { return nNodes; }
+
+		private:
+
+			unsigned int nNodes;
+			arma::uvec rowStart; // neighbours of node a are in [rowStart(a),rowStart(a+1))
+			arma::uvec neighbour;
+			arma::vec edgeWeight;
+			arma::vec nodeWeight; // 1 + self-loop weights - number of self-loops, as in the original edge-list formulation
+	};
+
 	arma::uvec nonZeroLocations_row( arma::sp_umat X);  // if you pass a row subview
 	arma::uvec nonZeroLocations_col( arma::sp_umat X); // if you pass a col subview
 
@@ -0,0 +1,197 @@
+/*
+Random walk of JT moves (as in the SUR sampler, where a proposal is accepted or not at random) checking every proposed
+junction tree against a straightforward re-derivation of its structure from the clique nodes alone:
+ - each separator is the clique's nodes that appear in the earlier cliques of the PCS (running intersection property)
+   and is a subset of the clique's parent, which comes earlier in the PCS;
+ - the perfect elimination order is the concatenation of the cliques' residuals (nodes minus separator) in PCS order;
+ - the adjacency matrix is the union of the complete graphs on the cliques.
+The JT only draws from the four generators defined below, so the test links junction_tree.o alone (no R, no distr.cpp).
+*/
+
+#include "junction_tree.h"
+
+#include <random>
+#include <numeric>
+#include <iostream>
+
+namespace
+{
+	std::mt19937 testRNG;
+}
+
+double randU01()
+{
+	return std::uniform_real_distribution<double>( 0. , 1. )( testRNG );
+}
+
+int randIntUniform( const int a , const int b )
+{
+	return std::uniform_int_distribution<int>( a , b )( testRNG );
+}
+
+namespace Distributions
+{
+	std::vector<unsigned int> randSampleWithoutReplacement( unsigned int populationSize , const std::vector<unsigned int>& population , unsigned int sampleSize )
+	{
+		std::vector<unsigned int> sample( population.begin() , population.begin() + populationSize );
+		std::shuffle( sample.begin() , sample.end() , testRNG );
+		sample.resize( sampleSize );
+		std::sort( sample.begin() , sample.end() );
+
+		return sample;
+	}
+
+	arma::uvec randWeightedIndexSampleWithoutReplacement( unsigned int populationSize , unsigned int sampleSize )
+	{
+		std::vector<unsigned int> indexes( populationSize );
+		std::iota( indexes.begin() , indexes.end() , 0 );
+		std::shuffle( indexes.begin() , indexes.end() , testRNG );
+
+		arma::uvec sample( sampleSize );
+		for( unsigned int i=0; i<sampleSize; ++i )
+			sample(i) = indexes[i];
+
+		return sample;
+	}
+}
+
+namespace
+{
+	// first inconsistency between jt and the structure implied by its cliques, empty if none
+	std::string checkJT( const JunctionTree& jt )
+	{
+		unsigned int n = jt.n, nCliques = jt.getNCliques();
+
+		std::vector<bool> seen( n , false );
+		std::vector<unsigned int> peo;
+		std::vector< std::vector<unsigned int> > adjacency( n , std::vector<unsigned int>( n , 0 ) );
+
+		for( unsigned int q=0; q<nCliques; ++q )
+		{
+			const JTComponent& clique = jt.getClique( q );
+			std::vector<unsigned int> nodes( clique.getNodes().begin() , clique.getNodes().end() );
+			std::vector<unsigned int> separator( clique.getSeparator().begin() , clique.getSeparator().end() );
+
+			if( nodes.empty() || !std::is_sorted( nodes.begin() , nodes.end() ) || !std::is_sorted( separator.begin() , separator.end() ) )
+				return "clique " + std::to_string(q) + " has empty or unsorted sets";
+
+			std::vector<unsigned int> expectedSeparator, residual;
+			for( auto node : nodes )
+			{
+				if( node >= n )
+					return "clique " + std::to_string(q) + " has a node out of range";
+				( seen[node] ? expectedSeparator : residual ).push_back( node );
+			}
+
+			if( separator != expectedSeparator )
+				return "clique " + std::to_string(q) + " has a wrong separator";
+
+			if( q == 0 )
+			{
+				if( clique.hasParent() )
+					return "the first clique of the PCS has a parent";
+			}
+			else
+			{
+				if( !clique.hasParent() )
+					return "clique " + std::to_string(q) + " has no parent";
+
+				auto parentPos = std::find( jt.perfectCliqueSequence.begin() , jt.perfectCliqueSequence.end() , clique.getParent() );
+				if( parentPos - jt.perfectCliqueSequence.begin() >= q )
+					return "the parent of clique " + std::to_string(q) + " is not earlier in the PCS";
+
+				const JTSet& parentNodes = jt.getClique( parentPos - jt.perfectCliqueSequence.begin() ).getNodes();
+				if( !std::includes( parentNodes.begin() , parentNodes.end() , separator.begin() , separator.end() ) )
+					return "the separator of clique " + std::to_string(q) + " is not in its parent";
+			}
+
+			for( auto child : clique.getChildrens() )
+			{
+				auto childPos = std::find( jt.perfectCliqueSequence.begin() , jt.perfectCliqueSequence.end() , child );
+				if( childPos == jt.perfectCliqueSequence.end() || jt.getClique( childPos - jt.perfectCliqueSequence.begin() ).getParent() != jt.perfectCliqueSequence[q] )
+					return "a child of clique " + std::to_string(q) + " does not point back to it";
+			}
+
+			for( auto node : nodes )
+				seen[node] = true;
+			peo.insert( peo.end() , residual.begin() , residual.end() );
+
+			for( auto i : nodes )
+				for( auto j : nodes )
+					if( i != j )
+						adjacency[i][j] = 1;
+		}
+
+		if( peo.size() != n )
+			return "the cliques do not cover all the nodes";
+
+		if( jt.perfectEliminationOrder != peo )
+			return "wrong perfect elimination order";
+
+		arma::umat adjMat( jt.adjacencyMatrix );
+		for( unsigned int i=0; i<n; ++i )
+			for( unsigned int j=0; j<n; ++j )
+				if( adjMat(i,j) != adjacency[i][j] )
+					return "wrong adjacency matrix";
+
+		return "";
+	}
+}
+
+int main()
+{
+	unsigned int nFailures = 0;
+
+	for( unsigned int n : { 2u , 5u , 9u , 16u } )
+	{
+		for( unsigned int seed=1; seed<=5; ++seed )
+		{
+			testRNG.seed( seed );
+
+			JunctionTree jt( n , "empty" ) , proposedJT;
+			unsigned int nMoves = 0;
+
+			for( unsigned int iteration=0; iteration<5000; ++iteration )
+			{
+				jt.copyJT( proposedJT );
+
+				std::pair<bool,double> updated;
+				double move = randU01();
+				if( move < 0.1 )
+				{
+					proposedJT.randomJTPermutation();
+					updated = std::make_pair( true , 0. );
+				}
+				else if( move < 0.4 )
+					updated = proposedJT.propose_multiple_edge_update();
+				else
+					updated = proposedJT.propose_single_edge_update();
+
+				if( !updated.first )
+					continue;
+				++nMoves;
+
+				std::string error = checkJT( proposedJT );
+				if( !error.empty() )
+				{
+					std::cerr << "n=" << n << " seed=" << seed << " iteration " << iteration << ": " << error << '\n';
+					++nFailures;
+					break;
+				}
+
+				if( randU01() < 0.7 )
+					jt = proposedJT;
+			}
+
+			if( nMoves == 0 )
+			{
+				std::cerr << "n=" << n << " seed=" << seed << ": no move was ever proposed" << '\n';
+				++nFailures;
+			}
+		}
+	}
+
+	std::cout << "junction_tree_test: " << ( nFailures == 0 ? "OK" : std::to_string(nFailures) + " FAILED" ) << '\n';
+
+	return nFailures == 0 ? 0 : 1;
+}
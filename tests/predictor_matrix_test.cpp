@@ -0,0 +1,110 @@
+/*
+Every PredictorMatrix operation against the dense armadillo expression on the same data unpacked: random genotype
+columns (values 0/1/2) mixed with Gaussian ones, addressed by index vectors that are all dense, all packed or shuffled
+mixtures of both, for numbers of observations that leave 1 to 3 observations in the last byte of a packed column.
+The kernels only use armadillo, so the test links predictor_matrix.o alone.
+*/
+
+#include "predictor_matrix.h"
+
+#include <iostream>
+#include <string>
+
+namespace
+{
+	const unsigned int nDense = 5, nGenotypes = 7;
+
+	// nDense dense columns, then nGenotypes non-constant genotype columns
+	arma::mat randData( unsigned int n )
+	{
+		arma::mat data = arma::join_rows( arma::randn<arma::mat>( n , nDense ) , arma::mat( n , nGenotypes ) );
+
+		for( unsigned int j=nDense; j<nDense+nGenotypes; ++j )
+		{
+			do
+			{
+				data.col(j) = arma::conv_to<arma::vec>::from( arma::randi<arma::uvec>( n , arma::distr_param( 0 , 2 ) ) );
+			}
+			while( data.col(j).min() == data.col(j).max() );
+		}
+
+		return data;
+	}
+
+	// a dense indexes and b packed ones, shuffled (packed column j has index nDense+j)
+	arma::uvec randIndexes( unsigned int a , unsigned int b )
+	{
+		arma::uvec idx = arma::join_cols( arma::randperm<arma::uvec>( nDense , a ) , nDense + arma::randperm<arma::uvec>( nGenotypes , b ) );
+
+		return arma::shuffle( idx );
+	}
+
+	// empty if A and B agree to a relative tolerance, otherwise a description of the difference
+	std::string compare( const arma::mat& A , const arma::mat& B , double tolerance = 1e-10 )
+	{
+		if( A.n_rows != B.n_rows || A.n_cols != B.n_cols )
+			return "wrong size";
+
+		if( !A.is_finite() || arma::abs( A - B ).max() > tolerance * ( 1. + arma::abs( B ).max() ) )
+			return "max difference " + std::to_string( arma::abs( A - B ).max() );
+
+		return "";
+	}
+}
+
+int main()
+{
+	unsigned int nFailures = 0;
+	arma::arma_rng::set_seed( 1 );
+
+	for( unsigned int n : { 3u , 6u , 37u , 250u , 1001u } )
+	{
+		arma::mat data = randData( n );
+
+		// the packed matrix, whose columns are numbered as those of data
+		PredictorMatrix X( std::make_shared<arma::mat>( data.cols( 0 , nDense-1 ) ) , data , arma::regspace<arma::uvec>( nDense , nDense+nGenotypes-1 ) );
+
+		if( X.getNPacked() != nGenotypes )
+		{
+			std::cerr << "n=" << n << ": " << X.getNPacked() << " packed columns instead of " << nGenotypes << '\n';
+			++nFailures;
+			continue;
+		}
+
+		// (dense, packed) counts of the index vectors, from all dense to all packed
+		for( auto counts : { std::make_pair( 3u , 0u ) , std::make_pair( 0u , 4u ) , std::make_pair( 1u , 1u ) , std::make_pair( 2u , 5u ) , std::make_pair( 5u , 7u ) } )
+		{
+			for( unsigned int repeat=0; repeat<10; ++repeat )
+			{
+				arma::uvec idx = randIndexes( counts.first , counts.second );
+				arma::uvec idxJ = randIndexes( 2 , 3 );
+
+				arma::mat Y = arma::randn<arma::mat>( n , 3 );
+				arma::mat B = arma::randn<arma::mat>( idx.n_elem , 3 );
+				B.col(1).zeros(); // times() skips the zero coefficients
+				B( 0 , 2 ) = 0.;
+
+				std::vector< std::pair<std::string,std::string> > results = {
+					{ "cols" , compare( X.cols( idx ) , data.cols( idx ) ) },
+					{ "crossprod" , compare( X.crossprod( idx , Y ) , data.cols( idx ).t() * Y ) },
+					{ "times" , compare( X.times( idx , B ) , data.cols( idx ) * B ) },
+					{ "gram" , compare( X.gram( idx , idx ) , data.cols( idx ).t() * data.cols( idx ) ) },
+					{ "gram with another selection" , compare( X.gram( idx , idxJ ) , data.cols( idx ).t() * data.cols( idxJ ) ) },
+					{ "cor" , compare( X.cor( idx , idx ) , arma::cor( data.cols( idx ) ) , 1e-9 ) },
+					{ "cor with another selection" , compare( X.cor( idx , idxJ ) , arma::cor( data.cols( idx ) , data.cols( idxJ ) ) , 1e-9 ) }
+				};
+
+				for( const auto& result : results )
+					if( !result.second.empty() )
+					{
+						std::cerr << "n=" << n << ", " << counts.first << " dense and " << counts.second << " packed columns, " << result.first << ": " << result.second << '\n';
+						++nFailures;
+					}
+			}
+		}
+	}
+
+	std::cout << "predictor_matrix_test: " << ( nFailures == 0 ? "OK" : std::to_string(nFailures) + " FAILED" ) << '\n';
+
+	return nFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/*
+The replica pool on its own: every process must see the same log-likelihood table after each step, rank 0 must receive
+intact what any process sends it (over one or several chunks of the map), and a failure in
+any process (an exception in a collective, an exception thrown outside of one, a worker killed) must reach rank 0 as
+a Replica_Pool_Error instead of leaving it waiting at the barrier.
+Each case forks its own workers, which serve the steps until rank 0 stops the pool or the pool fails.
+*/
+
+#include "replica_pool.h"
+
+#include <csignal>
+#include <iostream>
+#include <functional>
+#include <unistd.h>
+
+namespace
+{
+    const unsigned int nProcesses = 3, nChains = 5, nSteps = 20;
+
+    // runs nSteps of step in a pool, returns the error seen by rank 0 (empty if none)
+    std::string runPool( std::function<void( ReplicaPool& , unsigned int )> step )
+    {
+        ReplicaPool pool;
+        pool.start( nProcesses , nChains );
+
+        unsigned int iteration = 0;
+        if( pool.getRank() != 0 )
+            pool.serve( [&](){ step( pool , iteration++ ); } );
+
+        try
+        {
+            for( ; iteration < nSteps; ++iteration )
+            {
+                pool.barrier();
+                step( pool , iteration );
+            }
+        }
+        catch( const Replica_Pool_Error& e )
+        {
+            pool.stop();
+            return e.what();
+        }
+
+        pool.stop();
+        return "";
+    }
+
+    // every process publishes its chains and checks the whole table
+    void exchange( ReplicaPool& pool , unsigned int iteration )
+    {
+        pool.collective( [&](){
+            for( unsigned int c=0; c<nChains; ++c )
+                if( pool.owns(c) )
+                    pool.setLogLikelihood( c , 100. * iteration + c );
+        } );
+
+        pool.collective( [&](){
+            for( unsigned int c=0; c<nChains; ++c )
+                if( pool.getLogLikelihood(c) != 100. * iteration + c )
+                    throw std::runtime_error( "wrong log-likelihood for chain " + std::to_string(c) );
+        } );
+    }
+
+    // a different process sends each time, every fourth time more than a chunk of the map
+    void send( ReplicaPool& pool , unsigned int iteration )
+    {
+        unsigned int from = iteration % nProcesses;
+        std::size_t length = ( iteration % 4 == 3 ) ? ( 40u << 20 ) + 7 : 1000 * iteration;
+        auto byte = [iteration]( std::size_t i ){ return (char)( ( i * 31 + iteration ) % 251 ); };
+
+        std::string data;
+        if( pool.getRank() == from )
+            for( std::size_t i=0; i<length; ++i )
+                data.push_back( byte(i) );
+
+        pool.sendToRoot( from , data );
+
+        pool.collective( [&](){
+            if( pool.getRank() != 0 )
+                return;
+
+            if( data.size() != length )
+                throw std::runtime_error( "received " + std::to_string( data.size() ) + " bytes instead of " + std::to_string( length ) );
+            for( std::size_t i=0; i<length; ++i )
+                if( data[i] != byte(i) )
+                    throw std::runtime_error( "wrong byte " + std::to_string( i ) + " from process " + std::to_string( from ) );
+        } );
+    }
+
+    unsigned int nFailures = 0;
+
+    void expect( const std::string& what , const std::string& error , const std::string& expected )
+    {
+        bool ok = expected.empty() ? error.empty() : ( error.find( expected ) != std::string::npos );
+        if( !ok )
+        {
+            std::cerr << what << ": got '" << error << "', expected '" << ( expected.empty() ? "no error" : expected ) << "'" << '\n';
+            ++nFailures;
+        }
+    }
+}
+
+int main()
+{
+    alarm( 120 ); // a pool left waiting at its barrier is a failure too
+
+    expect( "table exchange" , runPool( exchange ) , "" );
+
+    expect( "sending to rank 0" , runPool( send ) , "" );
+
+    expect( "exception in a collective" , runPool( []( ReplicaPool& pool , unsigned int iteration ){
+        exchange( pool , iteration );
+        pool.collective( [&](){
+            if( pool.getRank() == 2 && iteration == 5 )
+                throw std::runtime_error( "broken chain" );
+        } );
+    } ) , "process 2: broken chain" );
+
+    expect( "exception in rank 0" , runPool( []( ReplicaPool& pool , unsigned int iteration ){
+        pool.collective( [&](){
+            if( pool.getRank() == 0 && iteration == 3 )
+                throw std::runtime_error( "broken cold chain" );
+        } );
+        exchange( pool , iteration );
+    } ) , "process 0: broken cold chain" );
+
+    expect( "unknown exception outside of a collective" , runPool( []( ReplicaPool& pool , unsigned int iteration ){
+        exchange( pool , iteration );
+        if( pool.getRank() == 1 && iteration == 7 )
+            throw 42;
+    } ) , "process 1: unknown exception" );
+
+    expect( "killed worker" , runPool( []( ReplicaPool& pool , unsigned int iteration ){
+        if( pool.getRank() == 2 && iteration == 4 )
+            raise( SIGKILL );
+        exchange( pool , iteration );
+    } ) , "process 2 was killed by signal " + std::to_string( SIGKILL ) );
+
+    expect( "worker exiting" , runPool( []( ReplicaPool& pool , unsigned int iteration ){
+        exchange( pool , iteration );
+        if( pool.getRank() == 1 && iteration == 9 )
+            _exit( 3 );
+    } ) , "process 1 exited with status 3" );
+
+    // and the pool still works after all that
+    expect( "table exchange after failures" , runPool( exchange ) , "" );
+
+    std::cout << "replica_pool_test: " << ( nFailures == 0 ? "OK" : std::to_string(nFailures) + " FAILED" ) << '\n';
+
+    return nFailures == 0 ? 0 : 1;
+}
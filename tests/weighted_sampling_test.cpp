@@ -0,0 +1,235 @@
+/*
+Weighted sampling without replacement, as used by the bandit proposals:
+ - logPDFWeightedIndexSampleWithoutReplacement (mode search plus trapezoidal quadrature) against the exact probability
+   of the set, the sum over its |S|! orderings of the sequential draw probabilities, for small sets with weights
+   spanning up to sixteen orders of magnitude;
+ - the sets drawn by SumTree::sampleWithoutReplacement against those probabilities (chi-square over all the sets), the
+   log-probability it returns against the ordered sequence it drew, and its weights restored afterwards.
+distr.cpp is compiled into this test with stand-ins for the R generators: every draw goes through a thread RNGStream,
+so they are never called and the test runs without R.
+*/
+
+#include <stdexcept>
+
+namespace Rcpp {}
+
+namespace R
+{
+	inline double noR(){ throw std::logic_error( "R generator called without a thread RNGStream" ); }
+
+	double runif( double , double ){ return noR(); }
+	double rexp( double ){ return noR(); }
+	double rbinom( double , double ){ return noR(); }
+	double rnorm( double , double ){ return noR(); }
+	double rt( double ){ return noR(); }
+	double rgamma( double , double ){ return noR(); }
+	double rbeta( double , double ){ return noR(); }
+}
+
+#include "distr.cpp"
+
+#include <random>
+#include <numeric>
+#include <map>
+#include <iostream>
+
+namespace
+{
+	std::mt19937 testRNG;
+
+	// P(S) = \sum over the orderings of S of \prod_j w_{s_j} / ( sum of the weights not drawn before s_j ), with the
+	// remaining weight summed afresh at each step so that dominant weights do not swamp the others
+	double exactLogPDF( const arma::vec& weights , const arma::uvec& indexes )
+	{
+		std::vector<arma::uword> order( indexes.begin() , indexes.end() );
+		std::sort( order.begin() , order.end() );
+
+		double probability = 0.;
+		do
+		{
+			std::vector<bool> drawn( weights.n_elem , false );
+			double p = 1.;
+			for( auto i : order )
+			{
+				double remaining = 0.;
+				for( unsigned int k=0; k<weights.n_elem; ++k )
+					if( !drawn[k] )
+						remaining += weights(k);
+
+				p *= weights(i) / remaining;
+				drawn[i] = true;
+			}
+			probability += p;
+		}
+		while( std::next_permutation( order.begin() , order.end() ) );
+
+		return std::log( probability );
+	}
+
+	// weights log-uniform over [10^-range, 10^range]
+	arma::vec randWeights( unsigned int n , double range )
+	{
+		arma::vec weights( n );
+		for( unsigned int i=0; i<n; ++i )
+			weights(i) = std::pow( 10. , std::uniform_real_distribution<double>( -range , range )( testRNG ) );
+
+		return weights;
+	}
+
+	arma::uvec randSubset( unsigned int n , unsigned int m )
+	{
+		std::vector<arma::uword> indexes( n );
+		std::iota( indexes.begin() , indexes.end() , 0 );
+		std::shuffle( indexes.begin() , indexes.end() , testRNG );
+
+		return arma::uvec( indexes.data() , m );
+	}
+
+	// all the m-subsets of {0..n-1}, as sorted index vectors
+	std::vector< std::vector<arma::uword> > subsets( unsigned int n , unsigned int m )
+	{
+		std::vector< std::vector<arma::uword> > res;
+		std::vector<bool> mask( n , false );
+		std::fill( mask.begin() , mask.begin() + m , true );
+		do
+		{
+			std::vector<arma::uword> s;
+			for( unsigned int i=0; i<n; ++i )
+				if( mask[i] )
+					s.push_back( i );
+			res.push_back( s );
+		}
+		while( std::prev_permutation( mask.begin() , mask.end() ) );
+
+		return res;
+	}
+}
+
+int main()
+{
+	unsigned int nFailures = 0;
+
+	RNGStream stream( 42 );
+	RNGStreamScope scope( stream ); // randU01 (hence SumTree::sample) draws from it
+
+	// the set log-probability against the sum over orderings
+	for( double range : { 0.5 , 3. , 8. } )
+	{
+		testRNG.seed( 1 );
+		double worst = 0.;
+
+		for( unsigned int trial=0; trial<500; ++trial )
+		{
+			unsigned int n = 2 + testRNG() % 7;
+			unsigned int m = 1 + testRNG() % std::min( n-1 , 5u );
+
+			arma::vec weights = randWeights( n , range );
+			arma::uvec indexes = randSubset( n , m );
+
+			double expected = exactLogPDF( weights , indexes );
+			double logP = Distributions::logPDFWeightedIndexSampleWithoutReplacement( weights , indexes );
+
+			worst = std::max( worst , std::fabs( logP - expected ) / std::max( 1. , std::fabs( expected ) ) );
+		}
+
+		if( !( worst < 1e-9 ) )
+		{
+			std::cerr << "weights within 1e+-" << range << ": set log-probability off by " << worst << '\n';
+			++nFailures;
+		}
+	}
+
+	// nothing drawn, or everything
+	{
+		arma::vec weights = randWeights( 5 , 3. );
+		if( Distributions::logPDFWeightedIndexSampleWithoutReplacement( weights , arma::uvec() ) != 0. ||
+			Distributions::logPDFWeightedIndexSampleWithoutReplacement( weights , arma::regspace<arma::uvec>( 0 , 4 ) ) != 0. )
+		{
+			std::cerr << "the empty and the full set must have probability 1" << '\n';
+			++nFailures;
+		}
+	}
+
+	// SumTree draws against the set probabilities
+	for( const arma::vec& weights : { arma::vec{ 5. , 1. , 0.1 , 2. , 0.01 , 3. } , arma::vec{ 1e3 , 1. , 1e-2 , 30. , 0.5 , 1e2 , 3. } } )
+	{
+		const unsigned int n = weights.n_elem , nDraws = 200000;
+
+		for( unsigned int m : { 1u , 2u , 3u } )
+		{
+			Utils::SumTree tree( weights );
+			std::map< std::vector<arma::uword> , unsigned int > counts;
+			arma::uvec indexes;
+			std::string error;
+
+			for( unsigned int draw=0; draw<nDraws && error.empty(); ++draw )
+			{
+				double logP = tree.sampleWithoutReplacement( m , indexes );
+
+				double expected = 0. , remaining = arma::sum( weights );
+				for( unsigned int j=0; j<m; ++j )
+				{
+					expected += std::log( weights(indexes(j)) ) - std::log( remaining );
+					remaining -= weights(indexes(j));
+				}
+
+				if( std::fabs( logP - expected ) > 1e-9 * std::max( 1. , std::fabs( expected ) ) )
+					error = "wrong log-probability of the ordered draw";
+
+				for( unsigned int i=0; i<n; ++i )
+					if( tree.weight(i) != weights(i) )
+						error = "weights not restored";
+
+				std::vector<arma::uword> set( indexes.begin() , indexes.end() );
+				std::sort( set.begin() , set.end() );
+				if( std::adjacent_find( set.begin() , set.end() ) != set.end() )
+					error = "an index was drawn twice";
+
+				++counts[set];
+			}
+
+			// chi-square over the sets expected at least 5 times, pooling the others
+			double chiSquare = 0. , totalProbability = 0. , pooledProbability = 0.;
+			unsigned int nCells = 0 , pooledCount = nDraws;
+
+			for( const auto& set : subsets( n , m ) )
+			{
+				double p = std::exp( Distributions::logPDFWeightedIndexSampleWithoutReplacement( weights , arma::uvec( set ) ) );
+				totalProbability += p;
+
+				if( nDraws * p < 5. )
+				{
+					pooledProbability += p;
+					continue;
+				}
+
+				double observed = counts[set];
+				chiSquare += ( observed - nDraws * p ) * ( observed - nDraws * p ) / ( nDraws * p );
+				pooledCount -= observed;
+				++nCells;
+			}
+
+			if( nDraws * pooledProbability >= 5. )
+			{
+				chiSquare += ( pooledCount - nDraws * pooledProbability ) * ( pooledCount - nDraws * pooledProbability ) / ( nDraws * pooledProbability );
+				++nCells;
+			}
+
+			// chi-square with nCells-1 degrees of freedom, more than 5 standard deviations above its mean
+			if( std::fabs( totalProbability - 1. ) > 1e-9 )
+				error = "the set probabilities sum to " + std::to_string( totalProbability );
+			else if( chiSquare > ( nCells - 1. ) + 5. * std::sqrt( 2. * ( nCells - 1. ) ) )
+				error = "draws do not follow the set probabilities, chi-square " + std::to_string( chiSquare ) + " on " + std::to_string( nCells - 1 ) + " df";
+
+			if( !error.empty() )
+			{
+				std::cerr << "SumTree, " << n << " weights, m=" << m << ": " << error << '\n';
+				++nFailures;
+			}
+		}
+	}
+
+	std::cout << "weighted_sampling_test: " << ( nFailures == 0 ? "OK" : std::to_string(nFailures) + " FAILED" ) << '\n';
+
+	return nFailures == 0 ? 0 : 1;
+}